@@ -5,7 +5,7 @@
 #include <EASTL/vector.h>
 #include <EASTL/string.h>
 
-enum class AnimationPath
+enum class AnimationPath : uint8_t
 {
     invalid,
     translation,
@@ -14,28 +14,117 @@ enum class AnimationPath
     weights // morph targets
 };
 
-struct AnimationSampler;
+enum class AnimationInterpolation : uint8_t
+{
+    linear,
+    step
+};
 
-struct AnimationChannel
+// Keys that interpolating their neighbours reproduces within these are dropped when a track is added.
+struct AnimationTolerance
 {
-    int samplerIndex = -1;
-    int nodeIndex = -1;
-    AnimationPath path;
+    float translation = 0.0001f; // units
+    float rotation = 0.001f;     // radians
+    float scale = 0.0001f;
 };
 
-struct AnimationSampler
+// 48 bit key value. Rotations are smallest three quaternions, translations and scales are quantized to the range of their track.
+struct AnimationKey
 {
-    eastl::vector<float> inputs;
-    eastl::vector<vec4> outputs;
+    uint16_t values[3];
 };
 
-// NOTE: only linear interpolation supported
-struct Animation
+// Keyframes of every track of a clip. Tracks are ranges of the shared key arrays, stored as structure of arrays
+// so sampling a track touches only its own times and values.
+// Tracks are compressed as they are added: redundant keys are dropped, times and values are quantized, 8 bytes a key.
+// Tracks whose neighbouring keys would share a 16 bit time (long clips) keep 32 bit times, 10 bytes a key.
+struct AnimationClip
 {
     eastl::string name;
-    eastl::vector<AnimationChannel> channels;
-    eastl::vector<AnimationSampler> samplers;
-    float start = std::numeric_limits<float>::max();
-    float end = std::numeric_limits<float>::min();
-    float currentTime = 0.0f;
-};
\ No newline at end of file
+    float duration = 0.0f; // keys start at zero
+
+    // per track
+    eastl::vector<uint32_t> trackNodes; // scene node
+    eastl::vector<AnimationPath> trackPaths;
+    eastl::vector<AnimationInterpolation> trackInterpolations;
+    eastl::vector<uint32_t> trackKeyOffsets;
+    eastl::vector<uint32_t> trackKeyCounts;
+    eastl::vector<vec2> trackTimeRanges; // first key time, last key time - first
+    eastl::vector<vec3> trackValueMins;   // translation and scale
+    eastl::vector<vec3> trackValueExtents;
+    eastl::vector<uint32_t> trackTimeOffsets; // into keyTimes, or exactKeyTimes for tracks with exact times
+    eastl::vector<bool> trackExactTimes;
+
+    // per key
+    eastl::vector<AnimationKey> keyValues;
+    eastl::vector<uint16_t> keyTimes;   // in the time range of the track
+    eastl::vector<float> exactKeyTimes; // seconds
+
+    uint32_t sourceKeyCount = 0; // keys before compression
+
+    uint32_t getTrackCount() const { return trackNodes.size(); }
+    size_t getMemoryUsage() const;
+    size_t getSourceMemoryUsage() const { return sourceKeyCount * (sizeof(float) + sizeof(vec4)); } // float time and vec4 value a key
+
+    // times have to be increasing, values are xyz for translation and scale and quaternion xyzw for rotation
+    void addTrack(uint32_t node, AnimationPath path, AnimationInterpolation interpolation, const float *times, const vec4 *values, uint32_t keyCount, const AnimationTolerance &tolerance = {});
+
+    float getKeyTime(uint32_t track, uint32_t key) const; // key is relative to the track
+    vec4 getKeyValue(uint32_t track, uint32_t key) const;
+};
+
+// Local transform of every node of a scene.
+struct AnimationPose
+{
+    eastl::vector<vec3> translations;
+    eastl::vector<quat> rotations;
+    eastl::vector<vec3> scales;
+
+    uint32_t getNodeCount() const { return translations.size(); }
+    void resize(uint32_t nodeCount);
+};
+
+// Playback of one clip. Cursors keep the last key of every track, playing forward finds the next key in O(1).
+struct AnimationState
+{
+    const AnimationClip *clip = nullptr;
+    float time = 0.0f;
+    float speed = 1.0f;
+    bool loop = true;
+
+    eastl::vector<uint32_t> cursors; // per track
+};
+
+// Animates one instance of a scene. Plays a clip and cross-fades into the next one, the result is in pose.
+struct Animator
+{
+    const AnimationPose *restPose = nullptr; // of the scene, nodes without a track keep it
+
+    AnimationState current;
+    AnimationState next; // faded in over fadeDuration, replaces current when done
+    float fadeTime = 0.0f;
+    float fadeDuration = 0.0f;
+
+    AnimationPose pose;
+    AnimationPose fadePose; // scratch for the next clip
+};
+
+namespace animation
+{
+    // fadeDuration - cross-fade from the current clip, 0 switches immediately
+    void play(Animator &animator, const AnimationClip *clip, float fadeDuration = 0.0f, bool loop = true);
+
+    void advance(AnimationState &state, float deltaTime);
+
+    // Writes the nodes with tracks, the others are left as they are.
+    void sampleClip(const AnimationClip &clip, float time, eastl::vector<uint32_t> &cursors, AnimationPose &pose);
+
+    // weight - 0 is from, 1 is to, result can be one of them
+    void blendPoses(const AnimationPose &from, const AnimationPose &to, float weight, AnimationPose &result);
+
+    // advances the clips and samples the pose
+    void updateAnimator(Animator &animator, float deltaTime);
+
+    // animators are independent, they are spread over the job system workers
+    void updateAnimators(Animator *animators, uint32_t count, float deltaTime);
+} // namespace animation
@@ -33,4 +33,5 @@ private:
     Camera camera;
 
     Scene scene;
+    ecs::World world;
 };
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <rebirth/core/animation.h>
+#include <rebirth/core/ecs.h>
+#include <rebirth/core/light.h>
+#include <rebirth/core/mesh.h>
+
+class Scene;
+
+namespace ecs
+{
+    // World space placement. Whoever changes position, rotation or scale sets dirty, updateTransforms rebuilds the matrix.
+    struct Transform
+    {
+        vec3 position = vec3(0.0f);
+        quat rotation = quat(1.0f, 0.0f, 0.0f, 0.0f);
+        vec3 scale = vec3(1.0f);
+        bool dirty = true;
+
+        mat4 matrix = mat4(1.0f);
+        uint32_t version = 0; // incremented whenever the matrix changes, consumers compare it with the one they saw last
+    };
+
+    // Drawn by the renderer as a mesh instance, see Renderer::syncWorld.
+    // Remove the instance with Renderer::removeInstance before destroying the entity.
+    struct MeshRenderer
+    {
+        const Mesh *mesh = nullptr;
+        bool dynamic = false; // static instances are placed once
+
+        uint32_t instance = UINT32_MAX; // renderer instance id, created on the first sync
+        uint32_t transformVersion = 0;  // transform version the instance was placed with
+    };
+
+    // Placed by the transform, directional and spot lights shine along its -z axis.
+    struct Light
+    {
+        LightType type = LightType::Directional;
+        vec3 color = vec3(1.0f);
+        float cutOff = cos(glm::radians(12.5f)); // for spot light
+        float range = 10.0f;                     // for point and spot light
+    };
+
+    // Simulated by integrateRigidBodies while the Jolt physics system is disabled, no collisions yet.
+    struct RigidBody
+    {
+        vec3 linearVelocity = vec3(0.0f);
+        vec3 angularVelocity = vec3(0.0f); // radians per second around each axis
+        float gravityFactor = 1.0f;
+        bool isStatic = false;
+    };
+
+    // Joints are entities with a transform, updateSkins computes their matrices relative to the skinned entity.
+    struct Skin
+    {
+        eastl::vector<Entity> joints;
+        eastl::vector<mat4> inverseBindMatrices;
+        eastl::vector<mat4> jointMatrices;
+    };
+
+    // Plays the clips of the scene it was spawned from, updateAnimations places the node entities from the pose.
+    struct Animation
+    {
+        const Scene *scene = nullptr;
+        Animator animator;
+
+        Transform root; // the scene was spawned with
+        eastl::vector<Entity> nodeEntities; // per scene node, invalid for nodes the clips don't move
+        AnimationPose worldPose; // scratch
+    };
+
+    Transform makeTransform(const mat4 &matrix);
+
+    // Systems, linear passes over the chunks of the matching archetypes.
+    void updateTransforms(World &world);
+    void integrateRigidBodies(World &world, float deltaTime);
+    void updateAnimations(World &world, float deltaTime); // before updateTransforms
+    void updateSkins(World &world); // after updateTransforms
+
+    // Creates an entity per node with a mesh and per skin joint. The scene has to outlive them, meshes are referenced.
+    // Scenes with animations get an entity playing the first one, nodes it moves are made dynamic.
+    void spawnScene(World &world, const Scene &scene, const mat4 &transform = mat4(1.0f), bool dynamic = false);
+} // namespace ecs
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+// Draw order from 64 bit sort keys, sorted with a radix sort instead of a comparison sort.
+namespace draw_sort
+{
+    // pipeline - 8 bits, smaller ones are drawn first
+    // depth - view depth of the nearest point of the draw, front to back, quantized to 24 bits
+    // material - 16 bits, draws at the same depth keep their materials together
+    uint64_t makeKey(uint32_t pipeline, float depth, int material);
+
+    // Sorts keys and their values, least significant byte first. Bytes that are the same in every key are skipped.
+    // Scratch arrays hold count entries, the result ends up in keys and values.
+    void radixSort(uint64_t *keys, uint32_t *values, uint32_t count, uint64_t *scratchKeys, uint32_t *scratchValues);
+} // namespace draw_sort
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <rebirth/core/job_system.h>
+
+#include <EASTL/array.h>
+#include <EASTL/bitset.h>
+#include <EASTL/hash_map.h>
+#include <EASTL/unique_ptr.h>
+#include <EASTL/utility.h>
+#include <EASTL/vector.h>
+
+#include <assert.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ecs
+{
+    static constexpr uint32_t MAX_COMPONENTS = 64;
+    static constexpr uint32_t CHUNK_SIZE = 16 * 1024; // bytes, an archetype stores its entities in chunks of this size
+
+    // bit per component id
+    using ComponentMask = eastl::bitset<MAX_COMPONENTS>;
+
+    // Index into the entity table. The generation tells apart an entity from a destroyed one whose index it reuses.
+    struct Entity
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+
+        bool operator==(const Entity &other) const = default;
+    };
+
+    static const Entity INVALID_ENTITY = {};
+
+    // Type erased operations on a component, registered once per type by getComponentId.
+    struct ComponentInfo
+    {
+        uint32_t size = 0;
+        uint32_t alignment = 0;
+        void (*move)(void *dst, void *src) = nullptr; // constructs dst from src and destroys src
+        void (*destroy)(void *component) = nullptr;
+    };
+
+    uint32_t registerComponent(const ComponentInfo &info);
+    const ComponentInfo &getComponentInfo(uint32_t id);
+
+    // Ids are handed out on first use, they can differ between runs and must not be saved.
+    template <typename T>
+    uint32_t getComponentId()
+    {
+        static const uint32_t id = registerComponent({
+            .size = sizeof(T),
+            .alignment = alignof(T),
+            .move = [](void *dst, void *src) {
+                new (dst) T(std::move(*static_cast<T *>(src)));
+                static_cast<T *>(src)->~T();
+            },
+            .destroy = [](void *component) { static_cast<T *>(component)->~T(); },
+        });
+
+        return id;
+    }
+
+    template <typename... Ts>
+    ComponentMask makeMask()
+    {
+        ComponentMask mask;
+        (mask.set(getComponentId<Ts>()), ...);
+        return mask;
+    }
+
+    struct alignas(64) ChunkData
+    {
+        uint8_t bytes[CHUNK_SIZE];
+    };
+
+    // Entities of a chunk are the rows [0, count). The chunk starts with their handles, followed by an array per component.
+    struct Chunk
+    {
+        eastl::unique_ptr<ChunkData> data;
+        uint32_t count = 0;
+    };
+
+    // All entities with the same set of components. Rows are kept packed, every chunk but the last one is full.
+    class Archetype
+    {
+    public:
+        explicit Archetype(const ComponentMask &mask);
+
+        const ComponentMask mask;
+        eastl::vector<uint32_t> componentIds; // ascending
+
+        uint32_t capacity = 0; // rows per chunk
+        uint32_t entityCount = 0;
+        eastl::vector<Chunk> chunks;
+
+        // archetype with one component more or less, filled in as entities move between archetypes
+        eastl::array<Archetype *, MAX_COMPONENTS> addEdges = {};
+        eastl::array<Archetype *, MAX_COMPONENTS> removeEdges = {};
+
+        bool matches(const ComponentMask &include, const ComponentMask &exclude) const
+        {
+            return (mask & include) == include && (mask & exclude).none();
+        }
+
+        Entity *getEntities(Chunk &chunk) { return reinterpret_cast<Entity *>(chunk.data->bytes); }
+
+        template <typename T>
+        T *getColumn(Chunk &chunk) { return reinterpret_cast<T *>(chunk.data->bytes + columnOffsets[getComponentId<T>()]); }
+
+        // rows are numbered across chunks
+        Entity &getEntity(uint32_t row) { return getEntities(chunks[row / capacity])[row % capacity]; }
+        void *getComponent(uint32_t row, uint32_t componentId)
+        {
+            return chunks[row / capacity].data->bytes + columnOffsets[componentId] + (row % capacity) * componentSizes[componentId];
+        }
+
+        uint32_t addRow(Entity entity); // components of the new row are left uninitialized
+        void removeLastRow();           // components of the row have to be moved out or destroyed already
+
+    private:
+        eastl::array<uint32_t, MAX_COMPONENTS> columnOffsets = {}; // by component id
+        eastl::array<uint32_t, MAX_COMPONENTS> componentSizes = {};
+    };
+
+    // Owns entities and their components, stored by archetype. Entities are created, destroyed and change their
+    // components (moving them to another archetype) only outside of iteration.
+    class World
+    {
+    public:
+        World() = default;
+        ~World();
+        World(World const &) = delete;
+        void operator=(World const &) = delete;
+
+        template <typename... Ts>
+        Entity createEntity(Ts &&...components)
+        {
+            const ComponentMask mask = makeMask<std::decay_t<Ts>...>();
+            assert(mask.count() == sizeof...(Ts) && "duplicate component");
+
+            Archetype *archetype = getArchetype(mask);
+            const Entity entity = allocateEntity(archetype);
+            const uint32_t row = records[entity.index].row;
+
+            (new (archetype->getComponent(row, getComponentId<std::decay_t<Ts>>())) std::decay_t<Ts>(std::forward<Ts>(components)), ...);
+
+            return entity;
+        }
+
+        void destroyEntity(Entity entity);
+        bool isAlive(Entity entity) const;
+
+        uint32_t getEntityCount() const { return entityCount; }
+        uint32_t getArchetypeCount() const { return archetypes.size(); }
+
+        // null if the entity is dead or doesn't have the component. The pointer is valid until the entity's components change
+        template <typename T>
+        T *getComponent(Entity entity)
+        {
+            if (!isAlive(entity))
+                return nullptr;
+
+            const EntityRecord &record = records[entity.index];
+            const uint32_t id = getComponentId<T>();
+            if (!record.archetype->mask.test(id))
+                return nullptr;
+
+            return static_cast<T *>(record.archetype->getComponent(record.row, id));
+        }
+
+        template <typename T>
+        bool hasComponent(Entity entity) const
+        {
+            return isAlive(entity) && records[entity.index].archetype->mask.test(getComponentId<T>());
+        }
+
+        // replaces the component if the entity already has one
+        template <typename T>
+        void addComponent(Entity entity, T component)
+        {
+            if (!isAlive(entity))
+                return;
+
+            if (T *existing = getComponent<T>(entity)) {
+                *existing = std::move(component);
+                return;
+            }
+
+            const uint32_t id = getComponentId<T>();
+            Archetype *archetype = getAddArchetype(records[entity.index].archetype, id);
+            moveEntity(entity, archetype);
+
+            new (archetype->getComponent(records[entity.index].row, id)) T(std::move(component));
+        }
+
+        template <typename T>
+        void removeComponent(Entity entity)
+        {
+            if (!hasComponent<T>(entity))
+                return;
+
+            moveEntity(entity, getRemoveArchetype(records[entity.index].archetype, getComponentId<T>()));
+        }
+
+        // Calls function(uint32_t count, const Entity *entities, Ts *...components) per chunk of every archetype
+        // that has all of Ts and none of exclude. The arrays hold count entries.
+        template <typename... Ts, typename F>
+        void eachChunk(F &&function, const ComponentMask &exclude = {})
+        {
+            const ComponentMask include = makeMask<Ts...>();
+
+            for (auto &archetype : archetypes) {
+                if (archetype->entityCount == 0 || !archetype->matches(include, exclude))
+                    continue;
+
+                for (Chunk &chunk : archetype->chunks)
+                    function(chunk.count, (const Entity *)archetype->getEntities(chunk), archetype->template getColumn<Ts>(chunk)...);
+            }
+        }
+
+        // calls function(Entity entity, Ts &...components) for every entity with all of Ts and none of exclude
+        template <typename... Ts, typename F>
+        void each(F &&function, const ComponentMask &exclude = {})
+        {
+            eachChunk<Ts...>(
+                [&](uint32_t count, const Entity *entities, Ts *...components) {
+                    for (uint32_t i = 0; i < count; i++)
+                        function(entities[i], components[i]...);
+                },
+                exclude);
+        }
+
+        // Like each, with the chunks split between the job system threads. Returns once every entity was visited.
+        // function runs concurrently, it may only write the components it is given.
+        template <typename... Ts, typename F>
+        void parallelEach(F &&function, const ComponentMask &exclude = {})
+        {
+            const ComponentMask include = makeMask<Ts...>();
+
+            eastl::vector<eastl::pair<Archetype *, Chunk *>> chunks;
+            for (auto &archetype : archetypes) {
+                if (archetype->entityCount == 0 || !archetype->matches(include, exclude))
+                    continue;
+
+                for (Chunk &chunk : archetype->chunks)
+                    chunks.push_back({archetype.get(), &chunk});
+            }
+
+            if (chunks.empty())
+                return;
+
+            // a few groups per thread balances the load without queueing a job per chunk
+            JobSystem *jobSystem = JobSystem::instance();
+            const uint32_t groupCount = eastl::max(jobSystem->getThreadCount() * 4, 1u);
+            const uint32_t groupSize = eastl::max(uint32_t(chunks.size()) / groupCount, 1u);
+
+            JobCounter counter;
+            jobSystem->parallelFor(&counter, chunks.size(), groupSize, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    auto [archetype, chunk] = chunks[i];
+                    const Entity *entities = archetype->getEntities(*chunk);
+                    const uint32_t count = chunk->count;
+
+                    auto visit = [&](Ts *...components) {
+                        for (uint32_t row = 0; row < count; row++)
+                            function(entities[row], components[row]...);
+                    };
+                    visit(archetype->template getColumn<Ts>(*chunk)...);
+                }
+            });
+            jobSystem->wait(counter);
+        }
+
+    private:
+        struct EntityRecord
+        {
+            Archetype *archetype = nullptr; // null while the index is free
+            uint32_t row = 0;
+            uint32_t generation = 0;
+        };
+
+        Archetype *getArchetype(const ComponentMask &mask);
+        Archetype *getAddArchetype(Archetype *archetype, uint32_t componentId);
+        Archetype *getRemoveArchetype(Archetype *archetype, uint32_t componentId);
+
+        Entity allocateEntity(Archetype *archetype);
+
+        // components the target doesn't have are destroyed, the ones it adds are left uninitialized
+        void moveEntity(Entity entity, Archetype *target);
+
+        // fills the row with the archetype's last one, the row's components have to be moved out or destroyed already
+        void removeRow(Archetype *archetype, uint32_t row);
+
+        eastl::vector<eastl::unique_ptr<Archetype>> archetypes;
+        eastl::hash_map<uint64_t, Archetype *> archetypesByMask;
+
+        eastl::vector<EntityRecord> records; // by entity index
+        eastl::vector<uint32_t> freeIndices;
+        uint32_t entityCount = 0;
+    };
+} // namespace ecs
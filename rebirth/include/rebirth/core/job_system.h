@@ -0,0 +1,106 @@
+#pragma once
+
+#include <EASTL/array.h>
+#include <EASTL/unique_ptr.h>
+#include <EASTL/vector.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Number of unfinished jobs. Jobs decrement it when they finish, wait() on it to join them.
+struct JobCounter
+{
+    std::atomic<uint32_t> value = 0;
+
+    bool isDone() const { return value.load(std::memory_order_acquire) == 0; }
+};
+
+struct Job
+{
+    std::function<void()> function;
+    JobCounter *counter = nullptr;
+    JobCounter *dependency = nullptr; // job is not started until this counter reaches zero
+
+    std::atomic<bool> active = false;
+};
+
+// Chase-Lev work-stealing deque. The owner thread pushes and pops from the bottom, other threads steal from the top.
+class WorkStealingQueue
+{
+public:
+    static constexpr int64_t CAPACITY = 4096; // must be power of two
+
+    bool push(Job *job);
+    Job *pop();
+    Job *steal();
+
+private:
+    alignas(64) std::atomic<int64_t> top = 0;
+    alignas(64) std::atomic<int64_t> bottom = 0;
+    eastl::array<std::atomic<Job *>, CAPACITY> jobs;
+};
+
+// One worker per core (the calling thread counts as one). Jobs can only be submitted from the main thread and from workers.
+class JobSystem
+{
+public:
+    static JobSystem *instance();
+
+    // threadCount - total number of threads including the calling one, 0 uses all cores
+    void initialize(uint32_t threadCount = 0);
+    void shutdown();
+
+    void execute(JobCounter *counter, std::function<void()> function, JobCounter *dependency = nullptr);
+
+    // splits [0, count) into groups of groupSize, function receives [begin, end) of a group
+    void parallelFor(JobCounter *counter, uint32_t count, uint32_t groupSize, std::function<void(uint32_t begin, uint32_t end)> function);
+
+    // executes pending jobs until counter reaches zero
+    void wait(JobCounter &counter);
+
+    uint32_t getThreadCount() const { return threadCount; }
+    uint32_t getThreadIndex() const;
+
+private:
+    JobSystem() {};
+    JobSystem(JobSystem const &) = delete;
+    void operator=(JobSystem const &) = delete;
+
+    static constexpr uint32_t JOB_POOL_SIZE = WorkStealingQueue::CAPACITY;
+
+    struct ThreadData
+    {
+        WorkStealingQueue queue;
+        eastl::array<Job, JOB_POOL_SIZE> jobPool;
+        uint32_t jobPoolIndex = 0;
+
+        eastl::vector<Job *> readyJobs; // scratch list for released jobs
+    };
+
+    void workerLoop(uint32_t index);
+
+    Job *allocateJob();
+    void pushJob(Job *job);
+    Job *getJob();
+    bool runPendingJob();
+    void runJob(Job *job);
+    bool releaseWaitingJobs();
+
+    uint32_t threadCount = 0;
+    eastl::vector<eastl::unique_ptr<ThreadData>> threadData;
+    eastl::vector<std::thread> workers;
+
+    std::atomic<bool> running = false;
+    std::atomic<uint32_t> pendingJobs = 0;
+
+    // jobs with unfinished dependencies
+    std::mutex waitingMutex;
+    eastl::vector<Job *> waitingJobs;
+    std::atomic<uint32_t> waitingJobCount = 0;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+};
\ No newline at end of file
@@ -11,12 +11,10 @@ enum class LightType
 
 struct Light
 {
-    mat4 mvp = mat4(1.0f);
     vec3 position; // for point and spot lights
     LightType type = LightType::Directional;
     vec3 color = vec3(1.0, 1.0, 1.0);
     float cutOff = cos(glm::radians(12.5f)); // for spot light
-    vec3 direction; // for directional light
-
-    float _pad0;
+    vec3 direction; // for directional and spot light
+    float range = 10.0f; // for point and spot light, nothing is lit past it
 };
\ No newline at end of file
@@ -15,4 +15,30 @@ struct Material
 
     float _pad0;
     float _pad1;
-};
\ No newline at end of file
+};
+// Texture maps a material samples. Draws are bucketed by them, each bucket is shaded by a pipeline specialized to its maps
+// (MATERIAL_FEATURE_* in shading.glsl), simple materials don't carry the branches and registers of the others.
+enum MaterialFeature : uint32_t
+{
+    MATERIAL_FEATURE_BASE_COLOR = 1 << 0,
+    MATERIAL_FEATURE_METALLIC_ROUGHNESS = 1 << 1,
+    MATERIAL_FEATURE_NORMAL = 1 << 2,
+    MATERIAL_FEATURE_EMISSIVE = 1 << 3,
+};
+
+constexpr uint32_t MATERIAL_PERMUTATION_COUNT = 16; // every combination of the features
+
+inline uint32_t getMaterialFeatures(const Material &material)
+{
+    uint32_t features = 0;
+    if (material.baseColorId > -1)
+        features |= MATERIAL_FEATURE_BASE_COLOR;
+    if (material.metallicRoughnessId > -1)
+        features |= MATERIAL_FEATURE_METALLIC_ROUGHNESS;
+    if (material.normalId > -1)
+        features |= MATERIAL_FEATURE_NORMAL;
+    if (material.emissiveId > -1)
+        features |= MATERIAL_FEATURE_EMISSIVE;
+
+    return features;
+}
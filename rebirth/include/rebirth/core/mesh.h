@@ -11,6 +11,36 @@ struct Primitive
     uint32_t indexCount = 0;
     uint32_t vertexOffset = 0;
     uint32_t vertexCount = 0;
+
+    // primitives without meshlets are culled and drawn as a whole
+    uint32_t meshletOffset = 0;
+    uint32_t meshletCount = 0;
+
+    // level 0 is the primitive itself, primitives without lods are always drawn at full detail
+    uint32_t lodOffset = 0;
+    uint32_t lodCount = 0;
+
+    Bounds bounds{}; // local space bounding sphere, used for gpu culling
+};
+
+// Cluster of a primitive's triangles, culled on its own on the gpu. Its triangles are a contiguous range of the primitive's indices.
+struct Meshlet
+{
+    vec4 boundingSphere = vec4(0.0f); // primitive local space
+    vec4 cone = vec4(0.0f);           // xyz - axis, w - cutoff. The cluster is backfacing when viewed from inside the cone
+
+    uint32_t firstIndex = 0; // relative to the first index of the primitive
+    uint32_t indexCount = 0;
+    uint32_t _pad0[2];
+};
+
+// Simplified level of a primitive. Its indices are stored after the primitive's own and use the same vertices.
+struct MeshLod
+{
+    uint32_t firstIndex = 0; // relative to the first index of the primitive
+    uint32_t indexCount = 0;
+    float error = 0.0f;      // primitive local space distance the simplification moved the surface by
+    uint32_t _pad0;
 };
 
 struct Mesh
@@ -18,12 +48,22 @@ struct Mesh
     eastl::vector<Primitive> primitives;
 };
 
-struct MeshDraw
+// Placement of a mesh kept by the renderer across frames. Its primitives take a contiguous range of draw data entries.
+struct MeshInstance
 {
-    Mesh &mesh;
+    const Mesh *mesh = nullptr; // null once removed
     mat4 transform = mat4(1.0f);
-    Bounds boundingSphere{};
 
-    // TODO:
-    // uint32_t jointMatrixIndex = 0;
+    uint32_t firstDraw = 0;
+    uint32_t drawCount = 0;
+
+    uint32_t dirtyFrames = 0; // frames in flight whose draw data is out of date
+    bool dynamic = false;     // static instances are uploaded once and can't be moved
+    bool movedWarned = false; // a static instance was moved, warned about once
+
+    // skinned instances have a range of the joint palette and of the skinned vertices, its primitives follow each other
+    uint32_t jointOffset = 0;
+    uint32_t jointCount = 0;
+    uint32_t skinnedVertexOffset = 0;
+    uint32_t skinnedVertexCount = 0;
 };
\ No newline at end of file
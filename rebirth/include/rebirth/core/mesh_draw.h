@@ -1 +1,82 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+#include <rebirth/core/material.h>
+#include <rebirth/math/math.h>
+
+// Per-draw data consumed by shaders. Every indirect command points at its entry through firstInstance (gl_InstanceIndex).
+struct DrawData
+{
+    mat4 transform = mat4(1.0f);
+    vec4 boundingSphere = vec4(0.0f); // xyz - local space center, w - radius
+
+    // used by the culling shader to emit the indirect command
+    uint32_t indexCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+
+    int materialIndex = -1;
+
+    // with meshlets the culling shader emits a command per visible meshlet instead
+    uint32_t meshletOffset = 0;
+    uint32_t meshletCount = 0;
+
+    // levels of detail, the culling shader picks one by its projected error. Meshlets are only used at full detail
+    uint32_t lodOffset = 0;
+    uint32_t lodCount = 0;
+
+    uint32_t permutation = 0; // material features, its visible commands go into the range of this permutation
+    uint32_t _pad0[3];
+};
+
+// Culling parameters for a single frame, read by the culling compute shader.
+struct CullData
+{
+    mat4 occlusionView = mat4(1.0f); // view matrix the depth pyramid was rendered with
+    vec4 frustumPlanes[6];           // world space, xyz - normal, w - distance
+    vec4 cameraPosition;             // w is unused, for meshlet cone culling
+
+    float P00;
+    float P11;
+    float znear;
+    int depthPyramidIndex = -1;
+    vec2 depthPyramidSize;
+    int depthPyramidLevels = 0;
+
+    uint32_t drawOffset = 0;
+    uint32_t drawCount = 0;
+    uint32_t frustumCulling = 0;
+    uint32_t occlusionCulling = 0;
+    uint32_t coneCulling = 0;
+
+    // visible commands and cluster tasks of this frame
+    uint32_t commandOffset = 0;
+    uint32_t maxCommandCount = 0;
+    uint32_t taskOffset = 0;
+    uint32_t maxTaskCount = 0;
+
+    // a level of detail is used while error * lodErrorScale / distance stays under a pixel
+    float lodErrorScale = 0.0f;
+    uint32_t lodSelection = 0;
+    uint32_t _pad0[2];
+
+    // the visible commands are split into a range per material permutation, relative to commandOffset
+    uint32_t permutationOffsets[MATERIAL_PERMUTATION_COUNT] = {};
+    uint32_t permutationCapacities[MATERIAL_PERMUTATION_COUNT] = {};
+};
+
+// Written by the culling shaders, one per frame in flight.
+struct DrawCounts
+{
+    uint32_t commandCount = 0; // of all permutations
+    uint32_t triangleCount = 0;
+    uint32_t permutationCounts[MATERIAL_PERMUTATION_COUNT] = {}; // counts of the indirect draws, can go past the capacities
+};
+
+// Skins vertexCount vertices of a primitive into its instance's skinned vertices, read by the skinning shader.
+struct SkinJob
+{
+    uint32_t srcVertexOffset = 0;
+    uint32_t dstVertexOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t jointOffset = 0; // first joint matrix of the instance in the palette
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <rebirth/core/mesh.h>
+#include <rebirth/core/vertex.h>
+
+// Import time mesh optimization on top of meshoptimizer.
+namespace mesh_processing
+{
+    static constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+    static constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+    static constexpr uint32_t MAX_LODS = 5; // including the full detail level
+
+    // accumulated over every optimized primitive
+    struct Stats
+    {
+        size_t primitiveCount = 0;
+        size_t triangleCount = 0;
+
+        size_t inputVertexCount = 0;
+        size_t outputVertexCount = 0;
+
+        // vertex shader invocations with a 16 entry fifo post transform cache
+        size_t inputTransformedCount = 0;
+        size_t outputTransformedCount = 0;
+
+        size_t meshletCount = 0;
+
+        size_t lodCount = 0; // simplified levels only
+        size_t lodTriangleCount = 0;
+    };
+
+    // Merges duplicate vertices, reorders triangles for the post transform cache and overdraw and then vertices for fetch locality.
+    // Works in place on a triangle list with indices relative to the first vertex. Returns the new vertex count, vertices past it are unused.
+    uint32_t optimizeMesh(Vertex *vertices, uint32_t vertexCount, uint32_t *indices, uint32_t indexCount, Stats *stats = nullptr);
+
+    // Splits a triangle list into meshlets and rewrites the indices in meshlet order, so every meshlet is a range of them.
+    // Meshlets are appended, returns how many were added.
+    uint32_t buildMeshlets(eastl::vector<Meshlet> &meshlets, const Vertex *vertices, uint32_t vertexCount, uint32_t *indices, uint32_t indexCount, Stats *stats = nullptr);
+
+    // Simplifies a triangle list into up to MAX_LODS - 1 coarser levels, each about half of the previous one.
+    // The lod indices are appended to indices, levels (the full detail one first) are appended to lods. Returns how many levels were added.
+    uint32_t buildLods(eastl::vector<MeshLod> &lods, eastl::vector<uint32_t> &indices, uint32_t indexOffset, uint32_t indexCount, const Vertex *vertices, uint32_t vertexCount, Stats *stats = nullptr);
+
+    // ACMR (transformed vertices per triangle) and vertex memory before and after
+    void logStats(const Stats &stats);
+} // namespace mesh_processing
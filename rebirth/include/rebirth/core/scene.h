@@ -7,50 +7,65 @@
 
 #include <rebirth/graphics/vulkan/resources.h>
 
-struct SceneNode;
-
 struct Skin
 {
     eastl::string name;
-    int skeletonIndex = -1;
-    eastl::vector<int> joints;
+    int skeletonIndex = -1; // node
+    eastl::vector<int> joints; // nodes
     eastl::vector<mat4> inverseBindMatrices;
 
-    uint32_t jointMatrixIndex;
-};
-
-struct SceneNode
-{
-    int parentIndex = -1;
-    eastl::vector<SceneNode> children;
-    Mesh mesh;
-
-    eastl::string name = "Node";
-    mat4 transform = mat4(1.0f);
-    int skinIndex = -1;
-    int index = -1;
+    eastl::vector<mat4> jointMatrices; // relative to the node using the skin, written by updateAnimation
 };
 
+// Flat hierarchy, every node is an index into the per node arrays.
+// Nodes are stored depth first, so a parent comes before its children and a subtree is a contiguous range starting at its root.
 class Scene
 {
 public:
     eastl::string name;
     mat4 transform = mat4(1.0f);
-    eastl::vector<SceneNode> nodes;
 
+    // per node
+    eastl::vector<int> parents;           // -1 for root nodes
+    eastl::vector<uint32_t> subtreeSizes; // the node and all of its descendants
+    eastl::vector<mat4> localTransforms;
+    eastl::vector<mat4> worldTransforms; // up to date after updateTransforms
+    eastl::vector<int> meshIndices;      // -1 for nodes without a mesh
+    eastl::vector<int> skinIndices;      // -1 for nodes without a skin
+    eastl::vector<eastl::string> names;
+    AnimationPose restPose; // local transforms the nodes were added with, animators sample on top of it
+
+    eastl::vector<Mesh> meshes;
     eastl::vector<Skin> skins;
-    eastl::vector<Animation> animations;
+    eastl::vector<AnimationClip> animations;
+
+    uint32_t getNodeCount() const { return parents.size(); }
+
+    // Nodes have to be added depth first, the parent is -1 or the last added node or one of its ancestors.
+    uint32_t addNode(int parent, const mat4 &localTransform, eastl::string name = "Node");
+
+    void setLocalTransform(uint32_t node, const mat4 &localTransform);
+
+    // Recomputes world transforms of changed subtrees in one pass over the nodes, clean subtrees are skipped.
+    // Nodes whose world transform changed are appended to changedNodes.
+    void updateTransforms(eastl::vector<uint32_t> *changedNodes = nullptr);
 
     // void merge(Scene &scene);
 
-    void updateAnimation(float deltaTime, eastl::string name);
+    // Updates the animator and places the nodes its clips animate, then updates transforms and joints.
+    void updateAnimation(Animator &animator, float deltaTime);
 
-    mat4 getNodeWorldMatrix(SceneNode *node);
-    Animation *getAnimationByName(eastl::string name);
+    const mat4 &getNodeWorldMatrix(uint32_t node) const { return worldTransforms[node]; }
+    const AnimationClip *getAnimationByName(const eastl::string &name) const;
 
 private:
-    void updateJoints(SceneNode &node);
+    void updateJoints();
+
+    enum DirtyFlags : uint8_t
+    {
+        DIRTY_LOCAL = 1 << 0,      // the subtree has to be recomputed
+        DIRTY_DESCENDANT = 1 << 1, // some node of the subtree has DIRTY_LOCAL
+    };
 
-    SceneNode *getNodeByIndex(int index);
-    SceneNode *searchNode(SceneNode *node, int index);
-};
\ No newline at end of file
+    eastl::vector<uint8_t> dirtyFlags;
+};
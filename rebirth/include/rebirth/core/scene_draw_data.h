@@ -2,10 +2,16 @@
 
 #include <rebirth/math/math.h>
 
+static const uint32_t SHADOW_CASCADE_COUNT = 4;
+
 struct SceneDrawData
 {
     mat4 projection;
     mat4 view;
     vec4 cameraPosAndLightNum;
+    mat4 cascadeViewProjections[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits; // view depth where each cascade ends
     int shadowMapIndex;
+    int shadowLightIndex;
+    int directionalLightCount; // come first in the lights buffer
 };
\ No newline at end of file
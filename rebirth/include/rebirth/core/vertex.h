@@ -11,4 +11,26 @@ struct Vertex
     vec4 tangent = vec4(0, 0, 0, 0);
     vec4 jointIndices = vec4(-1, -1, -1, -1);
     vec4 jointWeights = vec4(0, 0, 0, 0);
-};
\ No newline at end of file
+};
+
+// Vertex buffer layout with REBIRTH_QUANTIZE_VERTICES, unpacked by loadVertex() in vertices.glsl
+struct PackedVertex
+{
+    vec3 position;
+    uint32_t uv;         // half2
+    uint32_t normal;     // octahedral snorm16x2
+    uint32_t tangent;    // snorm 10:10:10:2, xyz and handedness. 0 without a tangent
+    uint32_t joints;     // uint8x4, 0xff - unused
+    uint32_t weights[2]; // unorm16x4
+};
+
+static_assert(sizeof(PackedVertex) == 36);
+
+// what the vertex buffer holds on the gpu, the cpu side always keeps full Vertex
+#ifdef REBIRTH_QUANTIZE_VERTICES
+using GpuVertex = PackedVertex;
+#else
+using GpuVertex = Vertex;
+#endif
+
+PackedVertex packVertex(const Vertex &vertex);
@@ -1,32 +1,52 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
 
 #include <rebirth/core/animation.h>
 #include <rebirth/core/light.h>
 #include <rebirth/core/scene.h>
+#include <rebirth/graphics/image_data.h>
 
 #include <cgltf.h>
 
 class Renderer;
 
+namespace mesh_processing
+{
+    struct Stats;
+}
+
 namespace gltf
 {
-    bool loadScene(Renderer &renderer, Scene &scene, std::filesystem::path file);
+    // progress - [0, 1], called on the calling thread
+    using LoadProgressCallback = std::function<void(float progress)>;
+
+    bool loadScene(Renderer &renderer, Scene &scene, std::filesystem::path file, LoadProgressCallback progressCallback = nullptr);
+
+    // parses the file and loads its buffers, free with cgltf_free
+    cgltf_data *parseFile(std::filesystem::path file);
+
+    // primitives are optimized for the vertex cache, overdraw and vertex fetch as they are loaded
+    void loadGltfMeshes(Renderer &renderer, Scene &scene, cgltf_data *data, mesh_processing::Stats *meshStats = nullptr);
+    bool loadGltfMesh(Renderer &renderer, Scene &scene, Mesh &mesh, cgltf_data *data, cgltf_mesh *gltfMesh, mesh_processing::Stats *meshStats = nullptr);
 
-    bool loadGltfNode(Renderer &renderer, Scene &scene, SceneNode &node, cgltf_data *data, cgltf_node *gltfNode);
-    bool loadGltfMesh(Renderer &renderer, Scene &scene, Mesh &mesh, cgltf_data *data, cgltf_mesh *gltfMesh);
+    // adds the nodes of the root depth first, returns the scene node of every gltf node (-1 if not in the scene)
+    eastl::vector<int> loadGltfNodes(Scene &scene, cgltf_data *data, cgltf_scene *root);
+    bool loadGltfNode(Scene &scene, cgltf_data *data, cgltf_node *gltfNode, int parent, eastl::vector<int> &nodeRemap);
 
     size_t loadVertices(eastl::vector<Vertex> &vertices, cgltf_primitive prim);
     size_t loadIndices(eastl::vector<uint32_t> &indices, cgltf_primitive prim);
 
     void loadGltfMaterials(Renderer &renderer, cgltf_data *data);
-    void loadGltfTextures(Renderer &renderer, std::filesystem::path dir, cgltf_data *data);
+    void loadGltfTextures(Renderer &renderer, std::filesystem::path dir, cgltf_data *data, LoadProgressCallback progressCallback);
+    eastl::vector<TextureUsage> getTextureUsages(cgltf_data *data); // per texture, from the materials using it
+    void loadGltfImageData(ImageData &imageData, std::filesystem::path dir, const cgltf_texture &gltfTexture, TextureUsage usage); // decoded with mips, thread safe
 
-    void loadGltfAnimations(Scene &scene, cgltf_data *data);
-    void loadGltfSkins(Scene &scene, cgltf_data *data);
+    void loadGltfAnimations(Scene &scene, cgltf_data *data, const eastl::vector<int> &nodeRemap);
+    void loadGltfSkins(Scene &scene, cgltf_data *data, const eastl::vector<int> &nodeRemap);
 
     bool loadGltfLight(Light &light, mat4 worldMatrix, cgltf_light *gltfLight);
 
-    bool loadGltfTransform(mat4 transform, cgltf_node *node, bool world);
+    bool loadGltfTransform(mat4 &transform, cgltf_node *node, bool world);
 } // namespace gltf
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <EASTL/vector.h>
+#include <volk.h>
+
+#include <algorithm>
+#include <filesystem>
+
+// What a texture is sampled as, decides its format.
+enum class TextureUsage
+{
+    Color,  // base color, emissive - srgb
+    Linear, // metallic roughness, occlusion
+    Normal, // tangent space normal, only xy are used
+};
+
+// Pixels of a 2d image on the cpu. Mip levels are tightly packed one after another, starting from the base level.
+// Decoded images are rgba8, ktx2 files and baked textures can be block compressed.
+struct ImageData
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipLevels = 0;
+    VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+
+    eastl::vector<unsigned char> pixels;
+
+    uint32_t getMipWidth(uint32_t level) const { return std::max(width >> level, 1u); }
+    uint32_t getMipHeight(uint32_t level) const { return std::max(height >> level, 1u); }
+    size_t getMipOffset(uint32_t level) const;
+};
+
+// bytes per 4x4 block of block compressed formats, 0 for other formats
+uint32_t getBlockSize(VkFormat format);
+
+// bytes of a single mip level of rgba8 or block compressed formats
+size_t getMipSize(VkFormat format, uint32_t width, uint32_t height);
+
+// These don't touch the gpu and can be called from job workers.
+bool loadImageData(ImageData &imageData, std::filesystem::path path);
+bool loadImageData(ImageData &imageData, const unsigned char *data, size_t size);
+void createFallbackImageData(ImageData &imageData);
+
+// Only non supercompressed 2d ktx2 files in rgba8 or bc formats are supported, Basis Universal payloads are rejected.
+bool isKtx2(const unsigned char *data, size_t size);
+bool loadKtx2ImageData(ImageData &imageData, std::filesystem::path path);
+bool loadKtx2ImageData(ImageData &imageData, const unsigned char *data, size_t size);
+
+// Box filters the base level of an rgba8 image down to 1x1. With srgb color channels are averaged in linear space, like blits on srgb formats do.
+void generateMipChain(ImageData &imageData, bool srgb);
@@ -1,20 +1,41 @@
 #pragma once
 
 #include <rebirth/graphics/vulkan/graphics.h>
+#include <rebirth/graphics/vulkan/render_graph.h>
 
 #include <rebirth/core/animation.h>
 #include <rebirth/core/camera.h>
+#include <rebirth/core/components.h>
+#include <rebirth/core/job_system.h>
 #include <rebirth/core/light.h>
 #include <rebirth/core/mesh_draw.h>
 #include <rebirth/core/scene.h>
 #include <rebirth/core/scene_draw_data.h>
 
+#include <atomic>
+#include <thread>
+
 using namespace vulkan;
 
 static const int MAX_MATERIALS = 100;
-static const int MAX_LIGHTS = 100;
-static const uint32_t SHADOW_MAP_SIZE = 2048;
-static const uint32_t MAX_INDIRECT_COMMANDS = 100000;
+static const int MAX_LIGHTS = 8192; // per frame in flight, as in scene_data.glsl
+static const uint32_t SHADOW_MAP_SIZE = 2048; // per cascade
+static const VkFormat SHADOW_MAP_FORMAT = VK_FORMAT_D32_SFLOAT;
+static const uint32_t SHADOW_RECORD_RANGE_SIZE = 1024; // draw commands per secondary command buffer at least
+static const float SHADOW_CASTER_DISTANCE = 200.0f;   // casters this far towards the light from a cascade still shadow it
+static const uint32_t MAX_INDIRECT_COMMANDS = 100000; // draw data entries, one per primitive of every instance
+static const uint32_t INVALID_INSTANCE = UINT32_MAX;
+static const uint32_t MAX_VISIBLE_COMMANDS = 262144; // a draw with meshlets emits a command per visible meshlet
+static const uint32_t MAX_CLUSTER_TASKS = 32768;
+static const uint32_t CLUSTER_TASK_SIZE = 64; // meshlets per task, matches cluster_cull.comp
+static const uint32_t MAX_SKINNED_VERTICES = 524288; // per frame in flight, skinned copies of the vertices of all skinned instances (regions are sized to what is used)
+static const uint32_t MAX_JOINT_MATRICES = 65536;    // per frame in flight, joint palettes of all skinned instances
+static const uint32_t MAX_SKIN_JOBS = 4096;          // per frame in flight, one per primitive of every skinned instance
+static const uint32_t LIGHT_GRID_X = 16;             // light clusters, matches light_grid.glsl
+static const uint32_t LIGHT_GRID_Y = 9;
+static const uint32_t LIGHT_GRID_Z = 24;             // exponential view depth slices
+static const uint32_t LIGHT_CLUSTER_COUNT = LIGHT_GRID_X * LIGHT_GRID_Y * LIGHT_GRID_Z;
+static const uint32_t MAX_CLUSTER_LIGHTS = 256;      // lights past it are dropped from the cluster
 
 class Renderer
 {
@@ -25,8 +46,19 @@ public:
     void initialize(SDL_Window *window);
     void shutdown();
 
-    void drawScene(Scene &scene, mat4 transform = mat4(1.0f));
-    void drawMesh(Mesh &mesh, mat4 transform = mat4(1.0f));
+    // Instances persist until removed, their draw data is only written when they are added, moved or removed.
+    // The mesh has to outlive its instance. Instances with joints are skinned on the gpu every frame.
+    uint32_t addInstance(const Mesh &mesh, const mat4 &transform, bool dynamic = false, uint32_t jointCount = 0);
+    void updateInstance(uint32_t id, const mat4 &transform); // dynamic instances only
+    void updateInstanceJoints(uint32_t id, const eastl::vector<mat4> &jointMatrices); // relative to the instance transform
+    void removeInstance(uint32_t id);
+
+    // adds an instance per node with a mesh, ids are appended to instanceIds in node order
+    void addScene(const Scene &scene, mat4 transform = mat4(1.0f), bool dynamic = false, eastl::vector<uint32_t> *instanceIds = nullptr);
+
+    // Creates instances for new mesh renderers and moves the ones whose transform changed. Lights are gathered
+    // from the light entities every call (up to MAX_LIGHTS).
+    void syncWorld(ecs::World &world);
 
     void present(Camera &camera);
 
@@ -45,6 +77,8 @@ public:
 
     eastl::vector<Vertex> vertices;
     eastl::vector<uint32_t> indices;
+    eastl::vector<Meshlet> meshlets;
+    eastl::vector<MeshLod> lods;
 
 protected:
     void updateDynamicData(Camera &camera);
@@ -54,34 +88,91 @@ protected:
     void drawBox(vec3 pos, vec3 halfExtent);
     void drawSphere(vec3 pos, float radius);
 
+    // declares the passes of the frame and the resources they use
+    void buildRenderGraph();
+
     // Passes
     void shadowPass(const VkCommandBuffer cmd);
-    void meshPass(const VkCommandBuffer cmd);
-    void imGuiPass(const VkCommandBuffer cmd);
-    void skyboxPass(const VkCommandBuffer cmd);
-    void clearPass(const VkCommandBuffer cmd);
-
-    void cullMeshDraws(mat4 viewProj);
-    void sortMeshDraws(vec3 cameraPos);
+    void meshPass(const VkCommandBuffer cmd, VkImageView colorView);
+    void imGuiPass(const VkCommandBuffer cmd, VkImageView colorView);
+    void skyboxPass(const VkCommandBuffer cmd, VkImageView colorView);
+    void cullResetPass(const VkCommandBuffer cmd);
+    void cullPass(const VkCommandBuffer cmd);
+    void clusterCullPass(const VkCommandBuffer cmd);
+    void depthPyramidPass(const VkCommandBuffer cmd);
+    void drawPermutation(const VkCommandBuffer cmd, uint32_t permutation); // visible commands of a material permutation
+    void depthPrepass(const VkCommandBuffer cmd);
+    void visibilityPass(const VkCommandBuffer cmd, VkImageView depthView);
+    void visibilityResolvePass(const VkCommandBuffer cmd, VkImageView colorView);
+    void lightCullPass(const VkCommandBuffer cmd);
+    void skinningPass(const VkCommandBuffer cmd);
+
+    void markInstanceDirty(uint32_t id);
+    void updateLightData();
+    void updateDrawData();
+    void updateSkinningData();
+    void updateCullData(Camera &camera);
+    void updateDrawOrder(Camera &camera); // sorts the draws of the live instances front to back
+
+    // Fits the cascades to the camera and finds the ones to render, the others keep the shadows of an earlier frame.
+    void updateShadowCascades(Camera &camera);
+    void addShadowCasterChanges(const MeshInstance &instance); // its casters moved, cascades containing them are rendered
+    void cullShadowCasters();                                  // writes the commands of the cascades to render
 
     eastl::unordered_map<eastl::string, VkShaderModule> loadShaderModules(std::filesystem::path directory);
 
+    // Pipelines are built in parallel on the job system workers through the pipeline cache. The layouts don't depend on
+    // the shaders, reloads only build the pipelines again (serially, on a thread outside the job system).
     void createPipelines();
+    void createPipelineLayouts();
+    eastl::unordered_map<eastl::string, VkPipeline> buildPipelines(bool parallel = true); // with the shaders on disk
     void destroyPipelines();
+    void updateReloadedPipelines(); // swaps in the pipelines of a finished reload
+
+    // Mesh pass pipelines specialized to a material permutation, built the first time the permutation is drawn and kept.
+    static constexpr uint32_t MATERIAL_PIPELINE_EQUAL_DEPTH = MATERIAL_PERMUTATION_COUNT; // after the depth prepass
+    static constexpr uint32_t MATERIAL_PIPELINE_SHADOWS = MATERIAL_PERMUTATION_COUNT << 1;
+    static uint32_t getMaterialPipelineKey(uint32_t permutation, bool equalDepth, bool shadows)
+    {
+        return permutation | (equalDepth ? MATERIAL_PIPELINE_EQUAL_DEPTH : 0) | (shadows ? MATERIAL_PIPELINE_SHADOWS : 0);
+    }
+
+    void createMaterialPipelines(bool shadows); // of the permutations drawn this frame that don't have one yet
+    eastl::hash_map<uint32_t, VkPipeline> buildMaterialPipelines(const eastl::vector<uint32_t> &keys, bool parallel = true);
 
     void createResources();
     void createBuffers();
+    void createVertexBuffer();
     void updateDescriptorSet();
 
+    void createDepthPyramid();
+    void destroyDepthPyramid();
+
+    void createVisibilityImage();
+    void destroyVisibilityImage();
+
+    struct ShadowPassPC
+    {
+        mat4 lightMvp;
+    };
+
     struct MeshPassPC
     {
-        mat4 transform;
-        int materialIndex;
+        vec2 screenSize;
+        float znear; // of the light grid
+        float zfar;
+        uint32_t frameIndex;
+        uint32_t commandBase; // first visible command of the indirect draw, relative to the frame (visibility.vert)
     };
 
-    struct ShadowPassPC
+    struct VisibilityResolvePC
     {
-        mat4 transform;
+        vec2 screenSize;
+        float znear; // of the light grid
+        float zfar;
+        uint32_t frameIndex;
+        int visibilityIndex;
+        uint32_t commandOffset; // visible commands of this frame
     };
 
     struct SkyboxPassPC
@@ -89,14 +180,75 @@ protected:
         int skyboxIndex;
     };
 
+    struct CullPassPC
+    {
+        uint32_t frameIndex;
+    };
+
+    struct SkinningPC
+    {
+        uint32_t jobOffset;
+    };
+
+    struct LightCullPC
+    {
+        mat4 view;
+        float P00;
+        float P11;
+        float znear;
+        float zfar;
+        uint32_t lightOffset; // point and spot lights follow the directional ones
+        uint32_t lightCount;
+        uint32_t frameIndex;
+    };
+
+    struct DepthReducePC
+    {
+        ivec2 srcSize;
+        ivec2 dstSize;
+        int srcIndex;
+        int dstIndex;
+        int srcType; // 0 - pyramid level, 1 - depth image, 2 - multisampled depth image
+    };
+
+    // range of draw data entries, joint matrices or skinned vertices
+    struct Range
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // first fit in the free ranges, then at the end of the used ones. UINT32_MAX if it doesn't fit into capacity
+    static uint32_t allocateRange(eastl::vector<Range> &freeRanges, uint32_t &usedCount, uint32_t count, uint32_t capacity);
+
     eastl::unordered_map<eastl::string, VkPipeline> pipelines;
     eastl::unordered_map<eastl::string, VkPipelineLayout> pipelineLayouts;
 
+    // shader reload built on its own thread while frames keep rendering with the current pipelines
+    std::thread reloadThread;
+    std::atomic<bool> reloadDone = false;
+    bool reloadPending = false;
+    float reloadTimeMs = 0.0f;
+    eastl::unordered_map<eastl::string, VkPipeline> reloadedPipelines;
+    eastl::hash_map<uint32_t, VkPipeline> reloadedMaterialPipelines;
+    eastl::array<eastl::vector<VkPipeline>, FRAMES_IN_FLIGHT> retiredPipelines; // replaced, destroyed when their frame in flight comes around
+
+    eastl::hash_map<uint32_t, VkPipeline> materialPipelines; // by getMaterialPipelineKey
+
     // Common
     Primitive cubePrimitive;
 
-    int shadowMapIndex;
+    int shadowMapIndex; // layer per cascade
     int skyboxIndex;
+    int depthPyramidIndex;
+
+    // the depth image is owned by graphics, it takes the last texture slot
+    static constexpr int depthImageIndex = MAX_TEXTURES - 1;
+
+    // Visibility buffer, visible command and triangle of every pixel, single sampled. It's only allocated while the mode is on.
+    static constexpr int visibilityImageIndex = MAX_TEXTURES - 2;
+    static constexpr VkFormat VISIBILITY_FORMAT = VK_FORMAT_R32G32_UINT;
+    vulkan::Image visibilityImage;
 
     // Resources
     SceneDrawData sceneData;
@@ -106,19 +258,111 @@ protected:
     vulkan::Buffer lightsBuffer;
     vulkan::Buffer vertexBuffer;
     vulkan::Buffer indexBuffer;
-    vulkan::Buffer jointMatricesBuffer;
+    vulkan::Buffer jointMatricesBuffer; // MAX_JOINT_MATRICES per frame in flight
+    vulkan::Buffer skinJobsBuffer;      // MAX_SKIN_JOBS per frame in flight
+
+    // indirect drawing (MAX_INDIRECT_COMMANDS entries per frame in flight)
+    vulkan::Buffer drawDataBuffer;
+    vulkan::Buffer drawOrderBuffer; // draw indices in sort key order, culled in that order
+
+    // commands of the casters of every cascade (MAX_INDIRECT_COMMANDS per cascade and frame in flight)
+    vulkan::Buffer shadowCommandsBuffer;
+
+    // gpu culling (commands that passed culling, their count and culling parameters per frame in flight)
+    vulkan::Buffer visibleDrawCommandsBuffer;
+    vulkan::Buffer drawCountsBuffer;
+    vulkan::Buffer cullDataBuffer;
+
+    // meshlet culling (meshlets of all meshes, cluster tasks of the draws that passed culling and their dispatch per frame in flight)
+    vulkan::Buffer meshletBuffer;
+    vulkan::Buffer clusterTasksBuffer;
+    vulkan::Buffer clusterDispatchBuffer;
+
+    // levels of detail of all meshes
+    vulkan::Buffer lodsBuffer;
+
+    // light count and light indices of every light cluster per frame in flight (written by the light cull pass)
+    vulkan::Buffer lightGridBuffer;
+
+    CullData cullData;
+
+    // directional shadows, cascades of the first directional light fitted to slices of the camera frustum
+    struct ShadowCascade
+    {
+        mat4 viewProjection = mat4(1.0f);
+        vec4 planes[6];          // of the light space volume, casters are culled against them
+        float splitDepth = 0.0f; // far end of the slice, view depth
+
+        bool valid = false;  // the layer has the shadows of viewProjection
+        bool render = false; // this frame
+        uint32_t commandOffset = 0;
+        uint32_t commandCount = 0;
+    };
+
+    eastl::array<ShadowCascade, SHADOW_CASCADE_COUNT> shadowCascades;
+    eastl::array<VkImageView, SHADOW_CASCADE_COUNT> shadowCascadeViews = {}; // a layer each, rendered into
+    eastl::vector<vec4> shadowCasterChanges; // world bounding spheres of casters added, moved or removed since the last frame
+    vec3 shadowLightDirection = vec3(0.0f);
+    int shadowLightIndex = -1; // -1 without shadows
+
+    // lights are kept directional first, the others are binned into the light clusters every frame
+    uint32_t directionalLightCount = 0;
+    float lightGridNear = 0.1f; // view depth where the first slice starts
+    float lightGridFar = 100.0f; // and where the last one ends
+
+    // hierarchical depth of the previous frame, one storage view per mip level
+    eastl::vector<VkImageView> depthPyramidMips;
+    VkExtent2D depthPyramidExtent = {0, 0}; // extent of the depth image it was created for
+    uint32_t swapchainGeneration = UINT32_MAX; // of the depth image it was created for
+    bool depthPyramidValid = false;
 
     eastl::vector<Vertex> debugDrawVertices;
-    eastl::vector<MeshDraw> meshDraws;
-    eastl::vector<uint32_t> opaqueDraws;
+
+    // persistent instances
+    eastl::vector<MeshInstance> instances;
+    eastl::vector<uint32_t> dirtyInstances;  // written every frame until all frames in flight have them
+    eastl::vector<uint32_t> freeInstances;   // ids of removed instances
+    eastl::vector<Range> freeDrawRanges; // draw data of removed instances
+    uint32_t instanceCount = 0;
+
+    // draw order of this frame, keys are built per draw data entry and sorted with their draw indices
+    eastl::vector<uint64_t> drawSortKeys;
+    eastl::vector<uint32_t> drawSortIndices;
+    eastl::vector<uint64_t> drawSortScratchKeys;
+    eastl::vector<uint32_t> drawSortScratchIndices;
+
+    // visible commands of this frame, a range per material permutation sized by the commands its draws can emit
+    eastl::array<uint32_t, MATERIAL_PERMUTATION_COUNT> permutationOffsets = {};
+    eastl::array<uint32_t, MATERIAL_PERMUTATION_COUNT> permutationCapacities = {};
+
+    // skinning, every frame the joint palette is uploaded and the skinned instances are skinned into the vertex buffer
+    // after the static vertices, in a region per frame in flight
+    eastl::vector<uint32_t> skinnedInstances;
+    eastl::vector<mat4> jointMatrices; // palette of all skinned instances
+    eastl::vector<Range> freeJointRanges;
+    eastl::vector<Range> freeSkinnedVertexRanges;
+    uint32_t jointMatrixCount = 0;
+    uint32_t skinnedVertexCount = 0;
+    uint32_t skinnedVertexBase = 0; // first vertex of the skinned regions
+    uint32_t skinnedVertexCapacity = 0; // of a region, grows up to MAX_SKINNED_VERTICES
+    uint32_t skinJobCount = 0;
+    uint32_t maxSkinJobVertexCount = 0;
 
     VkQueryPool queryPool;
     eastl::array<uint64_t, 2> timestamps;
 
     SDL_Window *window;
     Graphics graphics;
+    RenderGraph renderGraph;
 
     bool prepared = false;
     uint32_t drawCount = 0;
+    uint32_t drawCommandCount = 0; // draw data entries in use, including ones of removed instances that weren't reused yet
+    uint32_t sortedDrawCount = 0;  // draws of live instances, the ones in the draw order
+    bool depthPrepassEnabled = false; // this frame, the mesh pass shades with an equal depth test after it
+    bool visibilityBufferEnabled = false; // this frame, the resolve pass shades instead of the mesh pass
+    uint32_t visibleDrawCount = 0;
+    uint32_t clusterTaskCount = 0;
+    uint32_t visibleTriangleCount = 0;
     float timestampDeltaMs = 0.0f;
 };
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+
+#include <rebirth/core/scene.h>
+#include <rebirth/graphics/gltf.h>
+
+class Renderer;
+struct ImageData;
+
+// Baked scene in the layout the renderer consumes, written by rebirth-bake and memory mapped at runtime.
+// Sections are 16 byte aligned. Indices, meshlets, lods, material texture ids and primitive material indices are relative to the pack.
+namespace scene_pack
+{
+    static constexpr uint32_t MAGIC = 0x4b505252; // "RRPK"
+    static constexpr uint32_t VERSION = 6;
+
+    struct Header
+    {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        uint32_t materialCount = 0;
+        uint32_t primitiveCount = 0;
+        uint32_t nodeCount = 0;
+        uint32_t meshCount = 0;
+        uint32_t imageCount = 0;
+        uint32_t meshletCount = 0;
+        uint32_t lodCount = 0;
+        uint32_t _pad0 = 0;
+
+        uint64_t verticesOffset = 0;   // Vertex[vertexCount]
+        uint64_t indicesOffset = 0;    // uint32_t[indexCount]
+        uint64_t materialsOffset = 0;  // Material[materialCount]
+        uint64_t primitivesOffset = 0; // Primitive[primitiveCount]
+        uint64_t nodesOffset = 0;      // Node[nodeCount], depth first like Scene
+        uint64_t meshesOffset = 0;     // MeshRange[meshCount]
+        uint64_t imagesOffset = 0;     // Image[imageCount]
+        uint64_t meshletsOffset = 0;   // Meshlet[meshletCount]
+        uint64_t lodsOffset = 0;       // MeshLod[lodCount]
+    };
+
+    struct Node
+    {
+        mat4 transform; // local
+        char name[64];
+
+        int32_t parentIndex = -1; // an ancestor that comes before the node
+        int32_t skinIndex = -1;   // of the scene the pack is loaded into
+        int32_t meshIndex = -1;
+        uint32_t _pad0;
+    };
+
+    struct MeshRange
+    {
+        uint32_t firstPrimitive = 0;
+        uint32_t primitiveCount = 0;
+    };
+
+    struct Image
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 0;
+        uint32_t format = 0; // VkFormat
+
+        uint64_t dataOffset = 0; // rgba8 or bc mip chain, levels tightly packed
+        uint64_t dataSize = 0;
+    };
+
+    // Images are streamed in after the scene, so the baker doesn't have to keep every decoded texture in memory.
+    class Writer
+    {
+    public:
+        bool open(std::filesystem::path file);
+        void writeScene(const Scene &scene, const Renderer &renderer);
+        void writeImage(const ImageData &imageData);
+        bool close(); // writes the image table and the header
+
+    private:
+        uint64_t writeSection(const void *data, size_t size);
+
+        std::ofstream stream;
+        Header header;
+        eastl::vector<Image> images;
+    };
+
+    bool loadScene(Renderer &renderer, Scene &scene, std::filesystem::path file, gltf::LoadProgressCallback progressCallback = nullptr);
+} // namespace scene_pack
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <rebirth/graphics/image_data.h>
+
+// Simple bc1/bc3/bc4/bc5 block encoders used when baking. Endpoints are the inset bounding box of the block,
+// which is fast and good enough for textures, but lower quality than dedicated encoders.
+namespace texture_compression
+{
+
+// pixels are 16 rgba8 texels of a 4x4 block in row order
+void encodeBC1Block(const unsigned char *pixels, unsigned char *dst);
+void encodeBC3Block(const unsigned char *pixels, unsigned char *dst);
+void encodeBC5Block(const unsigned char *pixels, unsigned char *dst);
+
+// single channel block, values are read with the given stride
+void encodeBC4Block(const unsigned char *values, uint32_t stride, unsigned char *dst);
+
+// format the usage is compressed to, opaque color textures go to bc1 and the rest of color textures to bc3
+VkFormat getCompressedFormat(const ImageData &imageData, TextureUsage usage);
+
+// compresses every mip level of an rgba8 image in place
+void compressImageData(ImageData &imageData, TextureUsage usage);
+
+} // namespace texture_compression
@@ -9,6 +9,7 @@ namespace vulkan
 class Graphics;
 
 static constexpr uint32_t MAX_TEXTURES = 16384;
+static constexpr uint32_t MAX_STORAGE_IMAGES = 1024;
 
 static constexpr uint32_t SCENE_DATA_BINDING = 0;
 static constexpr uint32_t TEXTURES_BINDING = 1;
@@ -16,6 +17,19 @@ static constexpr uint32_t MATERIALS_BINDING = 2;
 static constexpr uint32_t LIGHTS_BINDING = 3;
 static constexpr uint32_t JOINT_MATRICES_BINDING = 4;
 static constexpr uint32_t VERTEX_BINDING = 5;
+static constexpr uint32_t DRAW_DATA_BINDING = 6;
+static constexpr uint32_t DRAW_COMMANDS_BINDING = 7;
+static constexpr uint32_t DRAW_COUNTS_BINDING = 8;
+static constexpr uint32_t CULL_DATA_BINDING = 9;
+static constexpr uint32_t STORAGE_IMAGES_BINDING = 10;
+static constexpr uint32_t MESHLETS_BINDING = 11;
+static constexpr uint32_t CLUSTER_TASKS_BINDING = 12;
+static constexpr uint32_t CLUSTER_DISPATCH_BINDING = 13;
+static constexpr uint32_t LODS_BINDING = 14;
+static constexpr uint32_t SKIN_JOBS_BINDING = 15;
+static constexpr uint32_t LIGHT_GRID_BINDING = 16;
+static constexpr uint32_t DRAW_ORDER_BINDING = 17;
+static constexpr uint32_t INDICES_BINDING = 18;
 
 class DescriptorManager
 {
@@ -2,6 +2,7 @@
 
 #include <EASTL/vector.h>
 #include <EASTL/array.h>
+#include <EASTL/functional.h>
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
@@ -17,13 +18,34 @@
 #include <rebirth/graphics/vulkan/descriptor_manager.h>
 #include <rebirth/graphics/vulkan/resources.h>
 #include <rebirth/graphics/vulkan/swapchain.h>
+#include <rebirth/graphics/vulkan/upload_manager.h>
 
 #include <tracy/TracyVulkan.hpp>
 
+struct ImageData;
+
 constexpr int FRAMES_IN_FLIGHT = 2;
 
 namespace vulkan
 {
+    // Queues a frame is submitted to. AsyncCompute is the compute family without graphics, on devices that don't have one
+    // it's the graphics queue and its work runs in order with the rest of the frame.
+    enum class QueueType : uint8_t
+    {
+        Graphics,
+        AsyncCompute,
+    };
+
+    constexpr uint32_t QUEUE_TYPE_COUNT = 2;
+
+    // a submission waits for a value of the timeline semaphore of another queue, at the stages that use its results
+    struct QueueWait
+    {
+        QueueType queue;
+        uint64_t value;
+        VkPipelineStageFlags2 stages;
+    };
+
     class Graphics
     {
     public:
@@ -38,8 +60,26 @@ namespace vulkan
 
         void uploadBuffer(Buffer &buffer, void *data, VkDeviceSize size);
 
+        // Waits for the frame in flight to finish and begins its first graphics command buffer. submitCommandBuffer submits
+        // the last one and presents. Every submission signals the timeline semaphore of its queue with the next value.
         VkCommandBuffer beginCommandBuffer();
-        void submitCommandBuffer(VkCommandBuffer cmd);
+        void submitCommandBuffer(VkCommandBuffer cmd, const eastl::vector<QueueWait> &waits = {});
+
+        // More command buffers of the current frame, submitted before the last one.
+        // waitSwapchain - cmd uses the swapchain image, it waits for the image to be acquired (once per frame)
+        VkCommandBuffer beginQueueCommandBuffer(QueueType queue);
+        uint64_t submitQueueCommandBuffer(VkCommandBuffer cmd, QueueType queue, const eastl::vector<QueueWait> &waits, bool waitSwapchain);
+        uint64_t getSubmittedValue(QueueType queue) const { return submittedValues[uint32_t(queue)]; }
+
+        // Splits [0, count) into ranges recorded on the job system threads into secondary command buffers that cmd executes
+        // in order. Rendering on cmd has to be begun with VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT, secondaries
+        // only inherit it, function binds the pipeline, descriptor sets, index buffer and dynamic state itself.
+        void recordParallel(
+            VkCommandBuffer cmd,
+            const VkCommandBufferInheritanceRenderingInfo &renderingInfo,
+            uint32_t count,
+            uint32_t minRangeSize,
+            eastl::function<void(VkCommandBuffer cmd, uint32_t begin, uint32_t end)> function);
 
         // Getters
         VmaAllocator &getAllocator() { return allocator; }
@@ -53,21 +93,32 @@ namespace vulkan
         VkQueue &getComputeQueue() { return computeQueue; }
         VkSampleCountFlagBits getSampleCount() const { return sampleCount; }
         DescriptorManager &getDescriptorManager() { return descriptorManager; }
-        Image &getColorImage() { return colorImage; }
+        UploadManager &getUploadManager() { return uploadManager; }
         Image &getDepthImage() { return depthImage; }
+        uint32_t getSwapchainGeneration() const { return swapchainGeneration; } // changes when the swapchain and the depth image are recreated
         VkPhysicalDeviceFeatures &getDeviceFeatures() { return deviceFeatures; }
         VkPhysicalDeviceProperties &getDevicePropertices() { return deviceProperties; }
-        TracyVkCtx &getTracyContext() { return tracyVkCtx[currentFrame]; } // tracy profiler
+        uint32_t getQueueFamilyIndex(QueueType queue) const { return queue == QueueType::Graphics ? graphicsQueueIndex : computeQueueIndex; }
+        TracyVkCtx &getTracyContext(QueueType queue = QueueType::Graphics); // tracy profiler, a gpu timeline per queue
         uint32_t getCurrentFrame() { return currentFrame; }
+
+        // Pipelines are created through it from any thread. Loaded from a file of this device and driver when there is one
+        // (warm), saved back on destroy.
+        VkPipelineCache getPipelineCache() const { return pipelineCache; }
+        bool isPipelineCacheWarm() const { return pipelineCacheWarm; }
+        void savePipelineCache();
         
         // Features support
         bool supportTimestamps();
+        bool supportAsyncCompute() const { return computeQueueIndex != graphicsQueueIndex; }
 
         // Resources
         void createImage(Image &image, ImageCreateInfo &createInfo, bool generateMipmaps);
         void createImageFromFile(Image &image, ImageCreateInfo &createInfo, std::filesystem::path path);
         void createImageFromMemory(Image &image, ImageCreateInfo &createInfo, unsigned char *data, int size);
         void createLoadImage(Image &image, ImageCreateInfo &createInfo, unsigned char *data, uint32_t size);
+        void createImagesFromData(Image *images, const ImageData *imageData, uint32_t count, ImageCreateInfo createInfo);
+        void createImageFromMipChain(Image &image, ImageCreateInfo &createInfo, uint32_t mipLevels, const unsigned char *pixels, size_t size); // rgba8 or bc, levels tightly packed
         void createCubemapImage(Image &image, ImageCreateInfo &createInfo, std::filesystem::path dir);
         void generateMipmaps(Image &image);
         void copyImage(VkCommandBuffer cmd, VkImage src, VkImage dst, uint32_t width, uint32_t height);
@@ -114,10 +165,17 @@ namespace vulkan
 
         void createAllocator(VmaAllocatorCreateFlags flags = 0);
 
-        void createCommandPool();
-        void createCommandBuffers();
+        void createPipelineCache();
+        std::filesystem::path getPipelineCachePath() const;
+
+        void createCommandPools();
+
+        struct FrameCommandPool;
+        VkCommandBuffer allocateCommandBuffer(FrameCommandPool &pool, VkCommandBufferLevel level);
 
         void createSyncPrimitives();
+        void createQueueSemaphores();
+        uint64_t submit(VkCommandBuffer cmd, QueueType queue, const eastl::vector<QueueWait> &waits, bool waitSwapchain, VkSemaphore signalSemaphore);
 
         void recreateSwapchain();
 
@@ -148,26 +206,45 @@ namespace vulkan
 
         VmaAllocator allocator{VK_NULL_HANDLE};
 
+        VkPipelineCache pipelineCache{VK_NULL_HANDLE};
+        bool pipelineCacheWarm = false;
+
         Swapchain swapchain;
 
         DescriptorManager descriptorManager;
+        UploadManager uploadManager;
 
         VkCommandPool commandPool{VK_NULL_HANDLE};
-        eastl::array<VkCommandBuffer, FRAMES_IN_FLIGHT> commandBuffers;
+
+        // Command buffers allocated in a frame, the pool is reset when the frame starts again.
+        struct FrameCommandPool
+        {
+            VkCommandPool pool{VK_NULL_HANDLE};
+            eastl::vector<VkCommandBuffer> commandBuffers;
+            uint32_t usedCount = 0;
+        };
+
+        eastl::array<eastl::array<FrameCommandPool, QUEUE_TYPE_COUNT>, FRAMES_IN_FLIGHT> queueCommandPools; // primary
+        eastl::array<eastl::vector<FrameCommandPool>, FRAMES_IN_FLIGHT> threadCommandPools;                 // secondary, per job system thread
 
         // Sync primitives (per swapchain image)
         eastl::array<VkSemaphore, FRAMES_IN_FLIGHT> acquireSemaphores;
-        eastl::array<VkFence, FRAMES_IN_FLIGHT> finishRenderFences;
         eastl::vector<VkSemaphore> submitSemaphores;
+        bool swapchainWaited = false; // acquire semaphore of the frame
+
+        // timeline per queue, a frame in flight is finished when both reach the values of its last submissions
+        eastl::array<VkSemaphore, QUEUE_TYPE_COUNT> queueSemaphores;
+        eastl::array<uint64_t, QUEUE_TYPE_COUNT> submittedValues = {};
+        eastl::array<eastl::array<uint64_t, QUEUE_TYPE_COUNT>, FRAMES_IN_FLIGHT> frameValues = {};
 
-        vulkan::Image colorImage;
         vulkan::Image depthImage;
 
         VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
 
-        eastl::array<TracyVkCtx, FRAMES_IN_FLIGHT> tracyVkCtx;
+        eastl::array<eastl::array<TracyVkCtx, QUEUE_TYPE_COUNT>, FRAMES_IN_FLIGHT> tracyVkCtx = {};
 
         uint32_t currentFrame = 0;
+        uint32_t swapchainGeneration = 0;
         bool resizeRequested = false;
     };
 
@@ -32,7 +32,11 @@ public:
 
     void setMultisampleCount(VkSampleCountFlagBits samples);
 
+    // builds can run on any thread, the cache is shared by all of them
+    void setPipelineCache(VkPipelineCache cache);
+
     VkPipeline build(VkDevice device, eastl::vector<VkFormat> colorFormats, VkFormat depthFormat = VK_FORMAT_D32_SFLOAT);
+    VkPipeline buildCompute(VkDevice device);
 
 private:
     eastl::vector<VkPipelineShaderStageCreateInfo> shaderStages;
@@ -50,6 +54,7 @@ private:
     VkPipelineColorBlendStateCreateInfo colorBlendState;
     VkPipelineDynamicStateCreateInfo dynamicState;
     VkPipelineLayout pipelineLayout;
+    VkPipelineCache pipelineCache;
 };
 
 } // namespace vulkan
\ No newline at end of file
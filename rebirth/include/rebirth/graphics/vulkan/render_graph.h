@@ -0,0 +1,253 @@
+#pragma once
+
+#include <EASTL/functional.h>
+#include <EASTL/hash_map.h>
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include <rebirth/graphics/vulkan/graphics.h>
+
+namespace vulkan
+{
+
+// How a pass uses a resource, barriers are built from the stages, accesses and image layout of every use.
+enum class RenderGraphAccess : uint8_t
+{
+    None,
+    ColorAttachment,          // read and write
+    DepthAttachment,          // test and write
+    VertexShaderRead,         // storage buffers, sampled images
+    FragmentShaderRead,       // storage buffers, sampled images
+    ComputeShaderRead,        // storage buffers, sampled images
+    ComputeShaderReadGeneral, // images in general layout
+    ComputeShaderWrite,       // read and write, images in general layout
+    TransferWrite,            // fills, updates, clears and copies
+    IndirectRead,             // indirect commands and counts
+    HostRead,                 // read back after the frame wait
+    Present,
+};
+
+// Frame graph. Passes are declared every frame with the resources they use, compile() culls the passes whose results
+// nothing needs, places the transient images in memory and works out the barriers, execute() records the passes in
+// declaration order with a single barrier batch in front of each one that needs it.
+//
+// Imported images keep their state between frames, barriers against the previous frame are part of the batches too.
+// Imported buffers are used in regions per frame in flight that the frame wait already orders, they start every frame
+// without a state. Transient images live for one frame, ones that are never alive at the same time share memory.
+//
+// Passes run on the graphics or the async compute queue. Consecutive passes of a queue are one submission, a new one
+// starts when a pass needs results of the other queue that the current one doesn't wait for yet. Submissions wait for
+// each other with the timeline semaphores of the queues, a resource used on both waits for the last use on the other one
+// (reads included). Without an async compute queue every pass runs on the graphics queue in one submission.
+class RenderGraph
+{
+public:
+    using PassFunction = eastl::function<void(VkCommandBuffer cmd)>;
+
+    struct ImageDesc
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    };
+
+    void initialize(Graphics &graphics);
+    void destroy();
+
+    // starts declaring the passes of a frame
+    void reset();
+
+    // Imported resources are owned by the caller. finalAccess is applied after the last pass, resources with one are
+    // outputs of the graph. Images are used as a whole, every mip level and layer.
+    uint32_t importImage(const char *name, VkImage image, VkImageAspectFlags aspect, RenderGraphAccess finalAccess = RenderGraphAccess::None);
+    uint32_t importBuffer(const char *name, VkBuffer buffer, RenderGraphAccess finalAccess = RenderGraphAccess::None);
+
+    // acquired this frame, the contents are discarded and it's presented after the last pass
+    uint32_t importSwapchainImage(VkImage image, VkImageView view);
+
+    // Usage flags come from the passes using it. Transient images aren't in the bindless set, passes get their views.
+    uint32_t createImage(const char *name, const ImageDesc &desc);
+
+    // contents are used after the frame (by the next one), the passes writing it are kept
+    void markOutput(uint32_t resource) { resources[resource].output = true; }
+
+    uint32_t addPass(const char *name, PassFunction function, QueueType queue = QueueType::Graphics);
+
+    // Uses of the same resource in a pass are merged, they have to agree on the layout.
+    // discard - the pass overwrites the whole image (cleared attachments), its contents and layout don't matter
+    void use(uint32_t pass, uint32_t resource, RenderGraphAccess access, bool discard = false);
+
+    void compile();
+
+    // After compile, every frame that was compiled has to be executed. cmd is the graphics command buffer of the frame, it
+    // gets the first graphics submission. Submissions before the last graphics one are submitted here, its command buffer
+    // is returned and the caller submits it with the waits of getFinalWaits() (Graphics::submitCommandBuffer).
+    VkCommandBuffer execute(VkCommandBuffer cmd);
+    const eastl::vector<QueueWait> &getFinalWaits() const { return finalWaits; }
+
+    // transient and swapchain images, valid after compile
+    VkImage getImage(uint32_t resource) const { return resources[resource].image; }
+    VkImageView getImageView(uint32_t resource) const { return resources[resource].view; }
+
+    bool isCulled(uint32_t pass) const { return passes[pass].culled; }
+
+    // imported images were destroyed, their handles can be reused by new ones
+    void forgetImportedStates() { importedStates.clear(); }
+
+private:
+    struct AccessInfo
+    {
+        VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageUsageFlags usage = 0;
+        bool write = false;
+    };
+
+    static AccessInfo getAccessInfo(RenderGraphAccess access);
+
+    struct ResourceState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE; // last write or layout transition
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE; // since the last write
+        VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE; // the last write was made visible to
+        VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+
+        // last use, in a submission of this frame or at a timeline value of an earlier one (0 - not used yet)
+        QueueType queue = QueueType::Graphics;
+        uint32_t submission = UINT32_MAX;
+        uint64_t value = 0;
+    };
+
+    enum class ResourceType : uint8_t
+    {
+        Image,
+        Buffer,
+        TransientImage,
+    };
+
+    struct Resource
+    {
+        eastl::string name;
+        ResourceType type = ResourceType::Image;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkImageAspectFlags aspect = 0;
+
+        RenderGraphAccess finalAccess = RenderGraphAccess::None;
+        bool output = false;
+        bool persistent = false; // state is kept between frames
+        bool swapchain = false;  // the first submission using it waits for the image to be acquired
+
+        uint32_t transient = UINT32_MAX;
+        ResourceState state;
+    };
+
+    struct PassUse
+    {
+        uint32_t resource;
+        AccessInfo info;
+        bool discard;
+    };
+
+    // barriers in front of a pass
+    struct BarrierBatch
+    {
+        eastl::vector<VkImageMemoryBarrier2> imageBarriers;
+        VkMemoryBarrier2 memoryBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+
+        void record(VkCommandBuffer cmd) const;
+    };
+
+    struct Pass
+    {
+        eastl::string name;
+        PassFunction function;
+        eastl::vector<PassUse> uses;
+        QueueType queue = QueueType::Graphics;
+
+        bool culled = false;
+        uint32_t submission = UINT32_MAX;
+        BarrierBatch barriers;
+    };
+
+    // passes of one queue submitted together
+    struct Submission
+    {
+        QueueType queue = QueueType::Graphics;
+        bool waitSwapchain = false;
+
+        // of the other queues, the last submission of this frame and the timeline value of earlier frames to wait for
+        eastl::array<uint32_t, QUEUE_TYPE_COUNT> waitSubmissions;
+        eastl::array<uint64_t, QUEUE_TYPE_COUNT> waitValues = {};
+        eastl::array<VkPipelineStageFlags2, QUEUE_TYPE_COUNT> waitStages = {};
+
+        uint64_t value = 0; // timeline value of its queue, set when executed
+
+        Submission() { waitSubmissions.fill(UINT32_MAX); }
+    };
+
+    struct TransientImage
+    {
+        eastl::string name;
+        ImageDesc desc;
+        VkImageUsageFlags usage = 0;
+        VkImageAspectFlags aspect = 0;
+        uint32_t queues = 0; // bit per queue type using it, both share it concurrently
+
+        // first and last pass using it that isn't culled
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t block = UINT32_MAX;
+    };
+
+    // memory of transient images that are never alive at the same time
+    struct MemoryBlock
+    {
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VkMemoryRequirements requirements = {};
+
+        // uses of the image that was in it last, the next one waits for them
+        VkPipelineStageFlags2 lastStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 lastWriteAccess = VK_ACCESS_2_NONE;
+        QueueType lastQueue = QueueType::Graphics;
+        uint32_t lastSubmission = UINT32_MAX;
+        uint64_t lastValue = 0;
+    };
+
+    void cullPasses();
+    bool canReuseTransientImages() const;
+    void createTransientImages();
+    void destroyTransientImages();
+    void addBarrier(BarrierBatch &batch, Resource &resource, const AccessInfo &info, bool discard = false);
+    bool needsWait(const ResourceState &state, const Submission &submission) const;
+    void addWait(Submission &submission, Resource &resource, const AccessInfo &info);
+    uint64_t getTimelineValue(uint32_t submission, uint64_t value) const; // of a use after execute
+
+    Graphics *graphics = nullptr;
+
+    eastl::vector<Resource> resources;
+    eastl::vector<Pass> passes;
+    eastl::vector<Submission> submissions;
+
+    // after the last pass of each queue
+    eastl::array<BarrierBatch, QUEUE_TYPE_COUNT> finalBarriers;
+    eastl::vector<QueueWait> finalWaits;
+
+    eastl::hash_map<VkImage, ResourceState> importedStates;
+
+    // transient images are kept while the frames declare the same ones with lifetimes that fit their blocks
+    eastl::vector<TransientImage> declaredImages; // this frame
+    eastl::vector<TransientImage> transientImages;
+    eastl::vector<MemoryBlock> memoryBlocks;
+};
+
+} // namespace vulkan
@@ -23,7 +23,10 @@ namespace vulkan
         VkFilter filter = VK_FILTER_LINEAR;
         VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
         uint32_t arrayLayers = 1;
+        uint32_t mipLevels = 0; // 0 - full chain with generateMipmaps, 1 otherwise
         VkImageCreateFlags flags = 0;
+        bool asyncCompute = false; // used on the async compute queue too, shared by both queue families
+        bool upload = false;       // written by the upload manager on its queue, set by the functions creating images from data
     };
 
     struct Image
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <EASTL/deque.h>
+#include <EASTL/vector.h>
+
+#include <rebirth/graphics/vulkan/resources.h>
+
+namespace vulkan
+{
+
+class Graphics;
+
+// Records buffer/image copies from a persistently mapped staging ring and submits them in batches to the upload queue
+// (dedicated compute family when the device has one). Completion is tracked by a timeline semaphore, graphics submits wait on
+// it on the gpu, so the cpu only stalls when the ring is full. Must be used from the main thread.
+class UploadManager
+{
+public:
+    static constexpr VkDeviceSize STAGING_BUFFER_SIZE = 64 * 1024 * 1024;
+
+    void initialize(Graphics &graphics, uint32_t queueFamilyIndex, VkQueue queue);
+    void destroy();
+
+    // Returned values are timeline values the copy is finished at. Data is copied into the staging memory right away.
+    uint64_t uploadBuffer(Buffer &buffer, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+    // bufferOffset of the regions is relative to data. Image is left in SHADER_READ_ONLY_OPTIMAL.
+    uint64_t uploadImage(Image &image, const void *data, VkDeviceSize size, const VkBufferImageCopy *regions, uint32_t regionCount, uint32_t layerCount = 1);
+
+    // submits recorded copies, returns the value they are finished at
+    uint64_t flush();
+
+    // blocks until the value is reached on the gpu
+    void wait(uint64_t value);
+
+    // flushes and waits for every upload
+    void waitIdle();
+
+    VkSemaphore getSemaphore() { return semaphore; }
+    uint64_t getSubmittedValue() const { return submittedValue; }
+    uint32_t getQueueFamilyIndex() const { return queueFamilyIndex; }
+
+private:
+    struct StagingAllocation
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        unsigned char *data = nullptr;
+    };
+
+    struct Submission
+    {
+        uint64_t value = 0;
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        VkDeviceSize ringEnd = 0;  // ring head when submitted
+        VkDeviceSize ringSize = 0; // bytes used including alignment and wrap padding
+        eastl::vector<Buffer> temporaryBuffers;
+    };
+
+    StagingAllocation allocateStaging(VkDeviceSize size);
+    bool allocateFromRing(VkDeviceSize size, VkDeviceSize &offset);
+    VkCommandBuffer getCommandBuffer();
+    void retireSubmissions();
+
+    Graphics *graphics = nullptr;
+
+    uint32_t queueFamilyIndex = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    eastl::vector<VkCommandBuffer> freeCommandBuffers;
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t submittedValue = 0;
+
+    Buffer stagingBuffer;
+    VkDeviceSize copyAlignment = 16;
+    VkDeviceSize ringHead = 0; // next free byte
+    VkDeviceSize ringTail = 0; // oldest byte in use
+    VkDeviceSize ringUsed = 0;
+
+    // copies recorded since the last flush
+    Submission current;
+    eastl::deque<Submission> submissions;
+};
+
+} // namespace vulkan
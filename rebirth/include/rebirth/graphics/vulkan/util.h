@@ -37,6 +37,7 @@ namespace vulkan
         VkCommandBuffer cmd,
         eastl::vector<VkRenderingAttachmentInfo> colorAttachments,
         const VkRenderingAttachmentInfo *depthAttachment,
-        VkExtent2D extent);
+        VkExtent2D extent,
+        VkRenderingFlags flags = 0); // VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT to execute secondaries
     void endRendering(VkCommandBuffer cmd);
 } // namespace vulkan
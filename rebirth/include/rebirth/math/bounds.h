@@ -18,5 +18,6 @@ namespace math
     Bounds calculateBoundingBox(eastl::vector<Vertex> &vertices);
 
     Bounds calculateBoundingSphere(eastl::vector<Vertex> &vertices);
+    Bounds calculateBoundingSphere(eastl::vector<Vertex> &vertices, size_t vertexOffset, size_t vertexCount);
     Bounds calculateBoundingSphere(Mesh &mesh, eastl::vector<Vertex> &vertices, eastl::vector<uint32_t> &indices);
 } // namespace math
\ No newline at end of file
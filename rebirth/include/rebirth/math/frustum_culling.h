@@ -5,4 +5,7 @@
 namespace math
 {
     bool isSphereVisible(const Bounds &sphere, mat4 viewProj, mat4 transform);
+
+    // normalized planes (left, right, bottom, top, far, near) pointing inside, degenerate planes always pass
+    void getFrustumPlanes(mat4 viewProj, vec4 planes[6]);
 }
\ No newline at end of file
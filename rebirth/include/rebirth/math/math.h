@@ -85,6 +85,19 @@ namespace math
         // clang-format on
     }
 
+    // reverse-z with the y flip of the perspective projections, near maps to 1 and far to 0
+    inline mat4 orthographicReverseZ(float left, float right, float bottom, float top, float near, float far)
+    {
+        // clang-format off
+        return mat4(
+            2.0f / (right - left), 0.0f, 0.0f, 0.0f,
+            0.0f, -2.0f / (top - bottom), 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f / (far - near), 0.0f,
+            -(right + left) / (right - left), (top + bottom) / (top - bottom), far / (far - near), 1.0f
+        );
+        // clang-format on
+    }
+
     inline mat4 orthographic(float left, float right, float bottom, float top, float near, float far)
     {
         // clang-format off
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Jolt/Jolt.h>
+
+#include <Jolt/Core/FixedSizeFreeList.h>
+#include <Jolt/Core/JobSystemWithBarrier.h>
+
+// Runs Jolt jobs on the engine job system, so physics doesn't spawn its own thread pool.
+class PhysicsJobSystem final : public JPH::JobSystemWithBarrier
+{
+public:
+    PhysicsJobSystem(JPH::uint maxJobs, JPH::uint maxBarriers);
+
+    int GetMaxConcurrency() const override;
+    JobHandle CreateJob(const char *name, JPH::ColorArg color, const JobFunction &jobFunction, JPH::uint32 numDependencies = 0) override;
+
+protected:
+    void QueueJob(Job *job) override;
+    void QueueJobs(Job **jobs, JPH::uint jobCount) override;
+    void FreeJob(Job *job) override;
+
+private:
+    using AvailableJobs = JPH::FixedSizeFreeList<Job>;
+    AvailableJobs jobs;
+};
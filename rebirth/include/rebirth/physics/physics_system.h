@@ -4,7 +4,6 @@
 #include <Jolt/Jolt.h>
 
 #include <Jolt/Core/Factory.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
 #include <Jolt/Core/TempAllocator.h>
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
@@ -15,6 +14,7 @@
 
 #include <rebirth/types/id_types.h>
 
+#include <rebirth/physics/physics_job_system.h>
 #include <rebirth/physics/physics_layers.h>
 #include <rebirth/physics/physics_listeners.h>
 #include <rebirth/physics/rigid_body.h>
@@ -52,7 +52,7 @@ public:
     RigidBody &getRigidBody(RigidBodyID id);
 
 private:
-    JPH::JobSystemThreadPool *jobSystem;
+    PhysicsJobSystem *jobSystem; // shares the engine job system threads
     JPH::TempAllocatorImpl *tempAllocator;
 
     // This is the max amount of rigid bodies that you can add to the physics system. If you try to add more you'll get an error.
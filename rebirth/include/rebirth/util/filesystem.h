@@ -10,4 +10,19 @@ std::filesystem::path getExecutablePath();
 void setCurrentPath(std::filesystem::path path);
 eastl::vector<char> readFile(std::filesystem::path path);
 
+// written next to the path and renamed over it, readers never see a partial file
+bool writeFile(std::filesystem::path path, const void *data, size_t size);
+
+// read only view of a whole file, memory mapped where supported and read into memory otherwise
+struct MappedFile
+{
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    eastl::vector<char> buffer; // fallback storage
+};
+
+bool mapFile(MappedFile &file, std::filesystem::path path);
+void unmapFile(MappedFile &file);
+
 } // namespace util
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace memory
+{
+
+// peak resident memory of the process in bytes, 0 if unsupported
+size_t getPeakMemoryUsage();
+
+} // namespace memory
@@ -0,0 +1,413 @@
+#include <rebirth/core/animation.h>
+#include <rebirth/core/job_system.h>
+
+#include <EASTL/algorithm.h>
+
+#include <tracy/Tracy.hpp>
+
+#include <assert.h>
+
+// longest run of keys a kept pair can replace, bounds the cost of checking the keys in between
+static constexpr uint32_t MAX_KEY_SPAN = 64;
+static constexpr float QUANTIZED_MAX = 65535.0f;
+static constexpr float ROTATION_QUANTIZED_MAX = 32767.0f; // 15 bits, the top bits of the first two hold the dropped component
+
+static float quantizedToFloat(uint16_t value, float max)
+{
+    return value / max;
+}
+
+static uint16_t floatToQuantized(float value, float max)
+{
+    return uint16_t(glm::clamp(value, 0.0f, 1.0f) * max + 0.5f);
+}
+
+// smallest three, the largest component is dropped and rebuilt from the others, which are within +-1/sqrt(2)
+static AnimationKey packRotation(quat rotation)
+{
+    const float components[4] = {rotation.x, rotation.y, rotation.z, rotation.w};
+
+    uint32_t largest = 0;
+    for (uint32_t i = 1; i < 4; i++) {
+        if (fabsf(components[i]) > fabsf(components[largest]))
+            largest = i;
+    }
+
+    // q and -q are the same rotation, the dropped one is made positive
+    const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+    AnimationKey key;
+    for (uint32_t i = 0, j = 0; i < 4; i++) {
+        if (i != largest)
+            key.values[j++] = floatToQuantized(components[i] * sign * glm::root_two<float>() * 0.5f + 0.5f, ROTATION_QUANTIZED_MAX);
+    }
+
+    key.values[0] |= (largest & 1) << 15;
+    key.values[1] |= (largest >> 1) << 15;
+
+    return key;
+}
+
+static quat unpackRotation(const AnimationKey &key)
+{
+    const uint32_t largest = (key.values[0] >> 15) | ((key.values[1] >> 15) << 1);
+
+    float components[4];
+    float sum = 0.0f;
+    for (uint32_t i = 0, j = 0; i < 4; i++) {
+        if (i == largest)
+            continue;
+
+        components[i] = (quantizedToFloat(key.values[j++] & 0x7fff, ROTATION_QUANTIZED_MAX) * 2.0f - 1.0f) * glm::one_over_root_two<float>();
+        sum += components[i] * components[i];
+    }
+
+    components[largest] = sqrtf(glm::max(1.0f - sum, 0.0f));
+
+    return quat(components[3], components[0], components[1], components[2]);
+}
+
+static AnimationKey packRange(const vec3 &value, const vec3 &min, const vec3 &extent)
+{
+    AnimationKey key;
+    for (int i = 0; i < 3; i++)
+        key.values[i] = extent[i] > 0.0f ? floatToQuantized((value[i] - min[i]) / extent[i], QUANTIZED_MAX) : 0;
+
+    return key;
+}
+
+static vec3 unpackRange(const AnimationKey &key, const vec3 &min, const vec3 &extent)
+{
+    return min + extent * vec3(key.values[0], key.values[1], key.values[2]) * (1.0f / QUANTIZED_MAX);
+}
+
+static quat toQuat(const vec4 &value)
+{
+    return quat(value.w, value.x, value.y, value.z);
+}
+
+// normalized lerp along the shorter arc, close enough to slerp for keys and blend weights
+static quat nlerp(const quat &from, quat to, float weight)
+{
+    if (glm::dot(from, to) < 0.0f)
+        to = -to;
+
+    return glm::normalize(from * (1.0f - weight) + to * weight);
+}
+
+// whether value is within tolerance of expected
+static bool isClose(AnimationPath path, const vec4 &value, const vec4 &expected, const AnimationTolerance &tolerance)
+{
+    switch (path) {
+        case AnimationPath::rotation:
+            // angle between them is 2 * acos(|dot|)
+            return fabsf(glm::dot(toQuat(value), toQuat(expected))) >= cosf(tolerance.rotation * 0.5f);
+        case AnimationPath::translation:
+            return glm::length(vec3(value) - vec3(expected)) <= tolerance.translation;
+        default:
+            return glm::all(glm::lessThanEqual(glm::abs(vec3(value) - vec3(expected)), vec3(tolerance.scale)));
+    }
+}
+
+static vec4 interpolate(AnimationPath path, const vec4 &from, const vec4 &to, float weight)
+{
+    if (path != AnimationPath::rotation)
+        return glm::mix(from, to, weight);
+
+    const quat rotation = nlerp(toQuat(from), toQuat(to), weight);
+    return vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+}
+
+void AnimationClip::addTrack(uint32_t node, AnimationPath path, AnimationInterpolation interpolation, const float *times, const vec4 *values, uint32_t keyCount, const AnimationTolerance &tolerance)
+{
+    assert(keyCount > 0);
+    sourceKeyCount += keyCount;
+
+    // rotations normalized and in one hemisphere, so neighbours interpolate the short way like when they are sampled
+    eastl::vector<vec4> sourceValues(values, values + keyCount);
+    if (path == AnimationPath::rotation) {
+        for (uint32_t key = 0; key < keyCount; key++) {
+            vec4 &value = sourceValues[key];
+            value = glm::normalize(value);
+
+            if (key > 0 && glm::dot(value, sourceValues[key - 1]) < 0.0f)
+                value = -value;
+        }
+    }
+
+    // a key is dropped when the ones around it reproduce it and every key between them
+    auto canReplace = [&](uint32_t first, uint32_t last) {
+        for (uint32_t key = first + 1; key < last; key++) {
+            const float weight = interpolation == AnimationInterpolation::linear ? (times[key] - times[first]) / (times[last] - times[first]) : 0.0f;
+            if (!isClose(path, sourceValues[key], interpolate(path, sourceValues[first], sourceValues[last], weight), tolerance))
+                return false;
+        }
+        return true;
+    };
+
+    eastl::vector<uint32_t> keptKeys = {0};
+
+    bool constant = true;
+    for (uint32_t key = 1; key < keyCount && constant; key++)
+        constant = isClose(path, sourceValues[key], sourceValues[0], tolerance);
+
+    if (!constant) {
+        for (uint32_t first = 0; first < keyCount - 1;) {
+            uint32_t last = first + 1;
+            while (last + 1 < keyCount && last + 1 - first <= MAX_KEY_SPAN && canReplace(first, last + 1))
+                last++;
+
+            keptKeys.push_back(last);
+            first = last;
+        }
+    }
+
+    const float startTime = times[0];
+    const float timeExtent = times[keptKeys.back()] - startTime;
+
+    vec3 min = vec3(std::numeric_limits<float>::max());
+    vec3 max = vec3(-std::numeric_limits<float>::max());
+    for (uint32_t key : keptKeys) {
+        min = glm::min(min, vec3(sourceValues[key]));
+        max = glm::max(max, vec3(sourceValues[key]));
+    }
+
+    // neighbouring keys that share a quantized time would make the key search fail, such tracks keep exact times
+    eastl::vector<uint16_t> quantizedTimes;
+    bool exactTimes = false;
+    for (uint32_t key : keptKeys) {
+        quantizedTimes.push_back(timeExtent > 0.0f ? floatToQuantized((times[key] - startTime) / timeExtent, QUANTIZED_MAX) : 0);
+        exactTimes |= quantizedTimes.size() > 1 && quantizedTimes.back() <= quantizedTimes[quantizedTimes.size() - 2];
+    }
+
+    trackNodes.push_back(node);
+    trackPaths.push_back(path);
+    trackInterpolations.push_back(interpolation);
+    trackKeyOffsets.push_back(keyValues.size());
+    trackKeyCounts.push_back(keptKeys.size());
+    trackTimeRanges.push_back(vec2(startTime, timeExtent));
+    trackValueMins.push_back(path == AnimationPath::rotation ? vec3(0.0f) : min);
+    trackValueExtents.push_back(path == AnimationPath::rotation ? vec3(0.0f) : max - min);
+    trackTimeOffsets.push_back(exactTimes ? exactKeyTimes.size() : keyTimes.size());
+    trackExactTimes.push_back(exactTimes);
+
+    for (uint32_t key : keptKeys) {
+        if (exactTimes)
+            exactKeyTimes.push_back(times[key]);
+
+        keyValues.push_back(path == AnimationPath::rotation ? packRotation(toQuat(sourceValues[key])) : packRange(vec3(sourceValues[key]), min, max - min));
+    }
+
+    if (!exactTimes)
+        keyTimes.insert(keyTimes.end(), quantizedTimes.begin(), quantizedTimes.end());
+
+    duration = eastl::max(duration, times[keyCount - 1]);
+}
+
+size_t AnimationClip::getMemoryUsage() const
+{
+    const size_t trackSize = sizeof(uint32_t) * 4 + sizeof(AnimationPath) + sizeof(AnimationInterpolation) + sizeof(vec2) + sizeof(vec3) * 2 + sizeof(bool);
+
+    return getTrackCount() * trackSize + keyValues.size() * sizeof(AnimationKey) + keyTimes.size() * sizeof(uint16_t) + exactKeyTimes.size() * sizeof(float);
+}
+
+float AnimationClip::getKeyTime(uint32_t track, uint32_t key) const
+{
+    if (trackExactTimes[track])
+        return exactKeyTimes[trackTimeOffsets[track] + key];
+
+    const vec2 &timeRange = trackTimeRanges[track];
+    return timeRange.x + timeRange.y * quantizedToFloat(keyTimes[trackTimeOffsets[track] + key], QUANTIZED_MAX);
+}
+
+vec4 AnimationClip::getKeyValue(uint32_t track, uint32_t key) const
+{
+    const AnimationKey &value = keyValues[trackKeyOffsets[track] + key];
+    if (trackPaths[track] == AnimationPath::rotation) {
+        const quat rotation = unpackRotation(value);
+        return vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+    }
+
+    return vec4(unpackRange(value, trackValueMins[track], trackValueExtents[track]), 0.0f);
+}
+
+void AnimationPose::resize(uint32_t nodeCount)
+{
+    translations.resize(nodeCount, vec3(0.0f));
+    rotations.resize(nodeCount, quat(1.0f, 0.0f, 0.0f, 0.0f));
+    scales.resize(nodeCount, vec3(1.0f));
+}
+
+// Key before trackTime and the weight of the one after it, in the units of the times. 0 weight before the first
+// and after the last key.
+template <typename T>
+static uint32_t findKey(const T *times, uint32_t keyCount, float trackTime, bool linear, uint32_t &cursor, float &weight)
+{
+    weight = 0.0f;
+
+    if (trackTime >= times[keyCount - 1])
+        return keyCount - 1;
+
+    if (trackTime <= times[0])
+        return 0;
+
+    // playing forward the next key is at most a few steps away, after a loop or a jump it is searched for
+    if (cursor >= keyCount - 1 || times[cursor] > trackTime)
+        cursor = eastl::upper_bound(times, times + keyCount, trackTime, [](float t, T keyTime) { return t < keyTime; }) - times - 1;
+
+    while (times[cursor + 1] <= trackTime)
+        cursor++;
+
+    if (linear)
+        weight = (trackTime - times[cursor]) / (times[cursor + 1] - times[cursor]);
+
+    return cursor;
+}
+
+namespace animation
+{
+    void play(Animator &animator, const AnimationClip *clip, float fadeDuration, bool loop)
+    {
+        AnimationState state = {.clip = clip, .loop = loop};
+        if (clip)
+            state.cursors.resize(clip->getTrackCount(), 0);
+
+        if (fadeDuration <= 0.0f || !animator.current.clip) {
+            animator.current = eastl::move(state);
+            animator.next = {};
+            return;
+        }
+
+        animator.next = eastl::move(state);
+        animator.fadeTime = 0.0f;
+        animator.fadeDuration = fadeDuration;
+    }
+
+    void advance(AnimationState &state, float deltaTime)
+    {
+        if (!state.clip)
+            return;
+
+        const float duration = state.clip->duration;
+        state.time += deltaTime * state.speed;
+
+        if (duration <= 0.0f) {
+            state.time = 0.0f;
+        } else if (state.loop) {
+            state.time = fmodf(state.time, duration);
+            if (state.time < 0.0f)
+                state.time += duration;
+        } else {
+            state.time = glm::clamp(state.time, 0.0f, duration);
+        }
+    }
+
+    void sampleClip(const AnimationClip &clip, float time, eastl::vector<uint32_t> &cursors, AnimationPose &pose)
+    {
+        assert(cursors.size() == clip.getTrackCount());
+
+        for (uint32_t track = 0; track < clip.getTrackCount(); track++) {
+            const uint32_t node = clip.trackNodes[track];
+            if (node >= pose.getNodeCount())
+                continue;
+
+            const uint32_t keyCount = clip.trackKeyCounts[track];
+            const AnimationKey *values = &clip.keyValues[clip.trackKeyOffsets[track]];
+            const bool linear = clip.trackInterpolations[track] == AnimationInterpolation::linear;
+
+            uint32_t key;
+            float weight;
+
+            if (clip.trackExactTimes[track]) {
+                key = findKey(&clip.exactKeyTimes[clip.trackTimeOffsets[track]], keyCount, time, linear, cursors[track], weight);
+            } else {
+                // compared with the quantized key times instead of decoding them
+                const vec2 &timeRange = clip.trackTimeRanges[track];
+                const float trackTime = timeRange.y > 0.0f ? (time - timeRange.x) / timeRange.y * QUANTIZED_MAX : 0.0f;
+                key = findKey(&clip.keyTimes[clip.trackTimeOffsets[track]], keyCount, trackTime, linear, cursors[track], weight);
+            }
+
+            const AnimationKey &from = values[key];
+            const AnimationKey &to = weight > 0.0f ? values[key + 1] : from;
+
+            switch (clip.trackPaths[track]) {
+                case AnimationPath::translation:
+                    pose.translations[node] = glm::mix(unpackRange(from, clip.trackValueMins[track], clip.trackValueExtents[track]),
+                                                       unpackRange(to, clip.trackValueMins[track], clip.trackValueExtents[track]), weight);
+                    break;
+                case AnimationPath::rotation:
+                    pose.rotations[node] = nlerp(unpackRotation(from), unpackRotation(to), weight);
+                    break;
+                case AnimationPath::scale:
+                    pose.scales[node] = glm::mix(unpackRange(from, clip.trackValueMins[track], clip.trackValueExtents[track]),
+                                                 unpackRange(to, clip.trackValueMins[track], clip.trackValueExtents[track]), weight);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    void blendPoses(const AnimationPose &from, const AnimationPose &to, float weight, AnimationPose &result)
+    {
+        assert(from.getNodeCount() == to.getNodeCount());
+
+        const uint32_t nodeCount = from.getNodeCount();
+        result.resize(nodeCount);
+
+        for (uint32_t node = 0; node < nodeCount; node++) {
+            result.translations[node] = glm::mix(from.translations[node], to.translations[node], weight);
+            result.rotations[node] = nlerp(from.rotations[node], to.rotations[node], weight);
+            result.scales[node] = glm::mix(from.scales[node], to.scales[node], weight);
+        }
+    }
+
+    void updateAnimator(Animator &animator, float deltaTime)
+    {
+        if (!animator.restPose)
+            return;
+
+        // sampled from the rest pose every frame, nothing accumulates
+        animator.pose = *animator.restPose;
+
+        AnimationState &current = animator.current;
+        if (current.clip) {
+            advance(current, deltaTime);
+            sampleClip(*current.clip, current.time, current.cursors, animator.pose);
+        }
+
+        AnimationState &next = animator.next;
+        if (!next.clip)
+            return;
+
+        advance(next, deltaTime);
+        animator.fadePose = *animator.restPose;
+        sampleClip(*next.clip, next.time, next.cursors, animator.fadePose);
+
+        animator.fadeTime += deltaTime;
+        const float weight = glm::min(animator.fadeTime / animator.fadeDuration, 1.0f);
+        blendPoses(animator.pose, animator.fadePose, weight, animator.pose);
+
+        if (weight >= 1.0f) {
+            animator.current = eastl::move(next);
+            animator.next = {};
+        }
+    }
+
+    void updateAnimators(Animator *animators, uint32_t count, float deltaTime)
+    {
+        ZoneScoped;
+
+        // a few groups per thread balances the load, characters differ in bone and key counts
+        JobSystem *jobSystem = JobSystem::instance();
+        const uint32_t groupCount = eastl::max(jobSystem->getThreadCount() * 4, 1u);
+        const uint32_t groupSize = eastl::max(count / groupCount, 1u);
+
+        JobCounter counter;
+        jobSystem->parallelFor(&counter, count, groupSize, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                updateAnimator(animators[i], deltaTime);
+        });
+        jobSystem->wait(counter);
+    }
+} // namespace animation
@@ -2,12 +2,14 @@
 #include <rebirth/input/input.h>
 
 #include <rebirth/graphics/gltf.h>
+#include <rebirth/graphics/scene_pack.h>
 
 #include <rebirth/physics/physics_system.h>
 
 #include <rebirth/util/filesystem.h>
 #include <rebirth/util/logger.h>
 #include <rebirth/core/cvar_system.h>
+#include <rebirth/core/job_system.h>
 
 #include "backend/imgui_impl_sdl3.h"
 
@@ -18,12 +20,14 @@ Application::Application(eastl::string name, unsigned int width, unsigned int he
 {
     ZoneScopedN("Application init");
 
+    JobSystem::instance()->initialize();
+
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         logger::logError("Failed to initialize SDL", SDL_GetError());
         exit(EXIT_FAILURE);
     }
 
-    SDL_Window *window = SDL_CreateWindow(name.c_str(), width, height, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+    window = SDL_CreateWindow(name.c_str(), width, height, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
     if (!window) {
         logger::logError("Failed to create SDL window", SDL_GetError());
         exit(EXIT_FAILURE);
@@ -35,12 +39,36 @@ Application::Application(eastl::string name, unsigned int width, unsigned int he
     // load scenes
     {
         ZoneScopedN("Load scenes");
-        // if (!gltf::loadScene(renderer, scene, "assets/models/sponza/Sponza.gltf")) {
-        // if (!gltf::loadScene(renderer, scene, "assets/models/subway_station/scene.gltf")) {
-        if (!gltf::loadScene(renderer, scene, "assets/models/DamagedHelmet/DamagedHelmet.gltf")) {
+
+        // there is no frame to draw into yet, show progress in the title and keep the window responsive
+        auto loadProgress = [&](float progress) {
+            eastl::string title = name + " - Loading " + eastl::to_string(int(progress * 100)) + "%";
+            SDL_SetWindowTitle(window, title.c_str());
+            SDL_PumpEvents();
+        };
+
+        // std::filesystem::path scenePath = "assets/models/sponza/Sponza.gltf";
+        // std::filesystem::path scenePath = "assets/models/subway_station/scene.gltf";
+        std::filesystem::path scenePath = "assets/models/DamagedHelmet/DamagedHelmet.gltf";
+
+        // prefer the baked version (see rebirth-bake) unless the source is newer
+        std::filesystem::path packPath = std::filesystem::path(scenePath).replace_extension(".rpack");
+        std::error_code packError, sceneError;
+        bool usePack = std::filesystem::last_write_time(packPath, packError) >= std::filesystem::last_write_time(scenePath, sceneError) && !packError;
+
+        bool loaded = usePack && scene_pack::loadScene(renderer, scene, packPath, loadProgress);
+        if (!loaded) // no pack or one from an older rebirth-bake
+            loaded = gltf::loadScene(renderer, scene, scenePath, loadProgress);
+
+        if (!loaded) {
             logger::logError("Failed to load scene.");
             exit(EXIT_FAILURE);
         }
+
+        SDL_SetWindowTitle(window, name.c_str());
+
+        // only animated nodes move, the renderer uploads the draw data of the others once on the first sync
+        ecs::spawnScene(world, scene);
     }
 
     // setup camera
@@ -48,11 +76,10 @@ Application::Application(eastl::string name, unsigned int width, unsigned int he
     camera.setPosition(vec3(0, 2, 2));
     camera.type = CameraType::FirstPerson;
 
-    renderer.lights.push_back(
-        Light{
-            .type = LightType::Directional,
-            .direction = vec3(0.0, -1.0, 0.0),
-        });
+    // pointing down
+    world.createEntity(
+        ecs::Transform{.rotation = glm::angleAxis(glm::radians(-90.0f), vec3(1.0f, 0.0f, 0.0f))},
+        ecs::Light{.type = LightType::Directional});
 
     // physicsSystem.initialize();
     // Game::initialize();
@@ -69,6 +96,8 @@ Application::~Application()
 
     SDL_DestroyWindow(window);
     SDL_Quit();
+
+    JobSystem::instance()->shutdown();
 }
 
 void Application::run()
@@ -150,6 +179,11 @@ void Application::update(float deltaTime)
     // Game::update(deltaTime);
     // physicsSystem.update(deltaTime);
 
+    ecs::integrateRigidBodies(world, deltaTime);
+    ecs::updateAnimations(world, deltaTime);
+    ecs::updateTransforms(world);
+    ecs::updateSkins(world);
+
     camera.update(deltaTime);
 }
 
@@ -159,6 +193,6 @@ void Application::render()
 
     // Game::draw(renderer);
 
-    renderer.drawScene(scene);
+    renderer.syncWorld(world);
     renderer.present(camera);
 }
\ No newline at end of file
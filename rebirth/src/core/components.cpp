@@ -0,0 +1,193 @@
+#include <rebirth/core/components.h>
+#include <rebirth/core/scene.h>
+
+#include <tracy/Tracy.hpp>
+
+namespace ecs
+{
+    static const vec3 GRAVITY = vec3(0.0f, -9.81f, 0.0f);
+
+    Transform makeTransform(const mat4 &matrix)
+    {
+        Transform transform;
+        vec3 skew;
+        vec4 perspective;
+        glm::decompose(matrix, transform.scale, transform.rotation, transform.position, skew, perspective);
+
+        transform.matrix = matrix;
+        transform.dirty = false;
+
+        return transform;
+    }
+
+    void updateTransforms(World &world)
+    {
+        ZoneScoped;
+
+        world.parallelEach<Transform>([](Entity, Transform &transform) {
+            if (!transform.dirty)
+                return;
+
+            transform.matrix = glm::translate(transform.position) * glm::mat4_cast(transform.rotation) * glm::scale(transform.scale);
+            transform.dirty = false;
+            transform.version++;
+        });
+    }
+
+    void integrateRigidBodies(World &world, float deltaTime)
+    {
+        ZoneScoped;
+
+        world.parallelEach<Transform, RigidBody>([deltaTime](Entity, Transform &transform, RigidBody &body) {
+            if (body.isStatic)
+                return;
+
+            body.linearVelocity += GRAVITY * body.gravityFactor * deltaTime;
+            transform.position += body.linearVelocity * deltaTime;
+
+            const float angularSpeed = glm::length(body.angularVelocity);
+            if (angularSpeed > 0.0f)
+                transform.rotation = glm::normalize(glm::angleAxis(angularSpeed * deltaTime, body.angularVelocity / angularSpeed) * transform.rotation);
+
+            transform.dirty = true;
+        });
+    }
+
+    void updateAnimations(World &world, float deltaTime)
+    {
+        ZoneScoped;
+
+        // the poses are sampled concurrently, each animation only writes its own component
+        world.parallelEach<Animation>([deltaTime](Entity, Animation &animated) {
+            animation::updateAnimator(animated.animator, deltaTime);
+
+            const AnimationPose &pose = animated.animator.pose;
+            const uint32_t nodeCount = pose.getNodeCount();
+
+            // world placement of the nodes, parents come first
+            // composing scales per axis is exact for uniform scales, which skeletons use
+            AnimationPose &worldPose = animated.worldPose;
+            worldPose.resize(nodeCount);
+
+            for (uint32_t node = 0; node < nodeCount; node++) {
+                const int parent = animated.scene->parents[node];
+                const vec3 &parentPosition = parent >= 0 ? worldPose.translations[parent] : animated.root.position;
+                const quat &parentRotation = parent >= 0 ? worldPose.rotations[parent] : animated.root.rotation;
+                const vec3 &parentScale = parent >= 0 ? worldPose.scales[parent] : animated.root.scale;
+
+                worldPose.translations[node] = parentPosition + parentRotation * (parentScale * pose.translations[node]);
+                worldPose.rotations[node] = parentRotation * pose.rotations[node];
+                worldPose.scales[node] = parentScale * pose.scales[node];
+            }
+        });
+
+        // the node entities are other entities, their transforms are written on this thread
+        world.each<Animation>([&world](Entity, Animation &animated) {
+            const AnimationPose &worldPose = animated.worldPose;
+
+            for (uint32_t node = 0; node < worldPose.getNodeCount(); node++) {
+                if (animated.nodeEntities[node] == INVALID_ENTITY)
+                    continue;
+
+                Transform *transform = world.getComponent<Transform>(animated.nodeEntities[node]);
+                if (!transform)
+                    continue;
+
+                transform->position = worldPose.translations[node];
+                transform->rotation = worldPose.rotations[node];
+                transform->scale = worldPose.scales[node];
+                transform->dirty = true;
+            }
+        });
+    }
+
+    void updateSkins(World &world)
+    {
+        ZoneScoped;
+
+        // joints are only read, no other entity's components are written
+        world.parallelEach<Transform, Skin>([&world](Entity, Transform &transform, Skin &skin) {
+            const mat4 inverseTransform = glm::inverse(transform.matrix);
+            skin.jointMatrices.resize(skin.joints.size());
+
+            for (size_t i = 0; i < skin.joints.size(); i++) {
+                const Transform *joint = world.getComponent<Transform>(skin.joints[i]);
+                skin.jointMatrices[i] = joint ? inverseTransform * joint->matrix * skin.inverseBindMatrices[i] : mat4(1.0f);
+            }
+        });
+    }
+
+    void spawnScene(World &world, const Scene &scene, const mat4 &transform, bool dynamic)
+    {
+        ZoneScoped;
+
+        const uint32_t nodeCount = scene.getNodeCount();
+        eastl::vector<Entity> nodeEntities(nodeCount, INVALID_ENTITY);
+
+        for (uint32_t node = 0; node < nodeCount; node++) {
+            const int meshIndex = scene.meshIndices[node];
+            if (meshIndex < 0 || scene.meshes[meshIndex].primitives.empty())
+                continue;
+
+            nodeEntities[node] = world.createEntity(
+                makeTransform(transform * scene.worldTransforms[node]),
+                MeshRenderer{.mesh = &scene.meshes[meshIndex], .dynamic = dynamic});
+        }
+
+        // joints without a mesh only get a transform
+        auto getNodeEntity = [&](uint32_t node) {
+            if (nodeEntities[node] == INVALID_ENTITY)
+                nodeEntities[node] = world.createEntity(makeTransform(transform * scene.worldTransforms[node]));
+
+            return nodeEntities[node];
+        };
+
+        for (uint32_t node = 0; node < nodeCount; node++) {
+            const int skinIndex = scene.skinIndices[node];
+            if (skinIndex < 0 || skinIndex >= int(scene.skins.size()) || nodeEntities[node] == INVALID_ENTITY)
+                continue; // scene packs don't keep skins yet
+
+            const ::Skin &sceneSkin = scene.skins[skinIndex];
+
+            Skin skin;
+            skin.inverseBindMatrices = sceneSkin.inverseBindMatrices;
+            for (int joint : sceneSkin.joints)
+                skin.joints.push_back(joint >= 0 ? getNodeEntity(joint) : INVALID_ENTITY);
+
+            world.addComponent(nodeEntities[node], eastl::move(skin));
+        }
+
+        if (scene.animations.empty())
+            return;
+
+        // nodes with a track and everything below them move
+        eastl::vector<bool> animatedNodes(nodeCount, false);
+        for (const AnimationClip &clip : scene.animations) {
+            for (uint32_t node : clip.trackNodes) {
+                if (node < nodeCount)
+                    animatedNodes[node] = true;
+            }
+        }
+
+        Animation animated = {.scene = &scene, .root = makeTransform(transform)};
+        animated.nodeEntities.resize(nodeCount, INVALID_ENTITY);
+
+        for (uint32_t node = 0; node < nodeCount; node++) {
+            const int parent = scene.parents[node];
+            if (parent >= 0 && animatedNodes[parent])
+                animatedNodes[node] = true;
+
+            if (!animatedNodes[node] || nodeEntities[node] == INVALID_ENTITY)
+                continue;
+
+            animated.nodeEntities[node] = nodeEntities[node];
+            if (MeshRenderer *meshRenderer = world.getComponent<MeshRenderer>(nodeEntities[node]))
+                meshRenderer->dynamic = true;
+        }
+
+        animated.animator.restPose = &scene.restPose;
+        animation::play(animated.animator, &scene.animations[0]);
+
+        world.createEntity(eastl::move(animated));
+    }
+} // namespace ecs
@@ -0,0 +1,74 @@
+#include <rebirth/core/draw_sort.h>
+
+#include <EASTL/algorithm.h>
+#include <tracy/Tracy.hpp>
+
+#include <string.h>
+
+namespace draw_sort
+{
+    static constexpr uint32_t PIPELINE_SHIFT = 56;
+    static constexpr uint32_t DEPTH_SHIFT = 32;
+    static constexpr uint32_t MATERIAL_SHIFT = 16; // the low 16 bits are unused
+
+    uint64_t makeKey(uint32_t pipeline, float depth, int material)
+    {
+        // bits of positive floats sort like the floats, the top 24 keep the exponent and 15 bits of mantissa
+        uint32_t depthBits;
+        depth = eastl::max(depth, 0.0f);
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+
+        // draws without a material use the default one, they go after the others
+        const uint64_t materialBits = material >= 0 ? eastl::min(uint32_t(material), 0xfffeu) : 0xffffu;
+
+        return uint64_t(pipeline & 0xff) << PIPELINE_SHIFT | uint64_t(depthBits >> 8) << DEPTH_SHIFT | materialBits << MATERIAL_SHIFT;
+    }
+
+    void radixSort(uint64_t *keys, uint32_t *values, uint32_t count, uint64_t *scratchKeys, uint32_t *scratchValues)
+    {
+        ZoneScoped;
+
+        // a histogram of every byte in one pass over the keys
+        uint32_t histograms[8][256] = {};
+        for (uint32_t i = 0; i < count; i++) {
+            const uint64_t key = keys[i];
+            for (uint32_t byte = 0; byte < 8; byte++)
+                histograms[byte][(key >> (byte * 8)) & 0xff]++;
+        }
+
+        uint64_t *srcKeys = keys;
+        uint32_t *srcValues = values;
+        uint64_t *dstKeys = scratchKeys;
+        uint32_t *dstValues = scratchValues;
+
+        for (uint32_t byte = 0; byte < 8; byte++) {
+            uint32_t *histogram = histograms[byte];
+
+            // every key has the same byte, the pass wouldn't move anything
+            if (count == 0 || histogram[(srcKeys[0] >> (byte * 8)) & 0xff] == count)
+                continue;
+
+            uint32_t offset = 0;
+            for (uint32_t i = 0; i < 256; i++) {
+                const uint32_t bucketCount = histogram[i];
+                histogram[i] = offset;
+                offset += bucketCount;
+            }
+
+            for (uint32_t i = 0; i < count; i++) {
+                const uint32_t index = histogram[(srcKeys[i] >> (byte * 8)) & 0xff]++;
+                dstKeys[index] = srcKeys[i];
+                dstValues[index] = srcValues[i];
+            }
+
+            eastl::swap(srcKeys, dstKeys);
+            eastl::swap(srcValues, dstValues);
+        }
+
+        // an odd number of passes left the result in the scratch arrays
+        if (srcKeys != keys) {
+            memcpy(keys, srcKeys, count * sizeof(uint64_t));
+            memcpy(values, srcValues, count * sizeof(uint32_t));
+        }
+    }
+} // namespace draw_sort
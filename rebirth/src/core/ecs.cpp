@@ -0,0 +1,215 @@
+#include <rebirth/core/ecs.h>
+
+#include <atomic>
+
+namespace ecs
+{
+    static eastl::array<ComponentInfo, MAX_COMPONENTS> componentInfos;
+    static std::atomic<uint32_t> componentCount = 0;
+
+    uint32_t registerComponent(const ComponentInfo &info)
+    {
+        const uint32_t id = componentCount.fetch_add(1);
+        assert(id < MAX_COMPONENTS && "too many component types");
+        assert(info.alignment <= alignof(ChunkData));
+
+        componentInfos[id] = info;
+        return id;
+    }
+
+    const ComponentInfo &getComponentInfo(uint32_t id)
+    {
+        return componentInfos[id];
+    }
+
+    Archetype::Archetype(const ComponentMask &mask)
+        : mask(mask)
+    {
+        uint32_t rowSize = sizeof(Entity);
+        uint32_t alignmentPadding = 0;
+
+        for (uint32_t id = 0; id < MAX_COMPONENTS; id++) {
+            if (!mask.test(id))
+                continue;
+
+            const ComponentInfo &info = componentInfos[id];
+            componentIds.push_back(id);
+            componentSizes[id] = info.size;
+
+            rowSize += info.size;
+            alignmentPadding += info.alignment - 1;
+        }
+
+        capacity = (CHUNK_SIZE - alignmentPadding) / rowSize;
+        assert(capacity > 0 && "components don't fit into a chunk");
+
+        // entity handles first, then a column per component
+        uint32_t offset = capacity * sizeof(Entity);
+        for (uint32_t id : componentIds) {
+            const uint32_t alignment = componentInfos[id].alignment;
+            offset = (offset + alignment - 1) / alignment * alignment;
+
+            columnOffsets[id] = offset;
+            offset += capacity * componentSizes[id];
+        }
+
+        assert(offset <= CHUNK_SIZE);
+    }
+
+    uint32_t Archetype::addRow(Entity entity)
+    {
+        if (chunks.empty() || chunks.back().count == capacity)
+            chunks.push_back(Chunk{.data = eastl::unique_ptr<ChunkData>(new ChunkData)});
+
+        Chunk &chunk = chunks.back();
+        getEntities(chunk)[chunk.count++] = entity;
+
+        return entityCount++;
+    }
+
+    void Archetype::removeLastRow()
+    {
+        Chunk &chunk = chunks.back();
+        chunk.count--;
+        entityCount--;
+
+        if (chunk.count == 0)
+            chunks.pop_back();
+    }
+
+    World::~World()
+    {
+        for (auto &archetype : archetypes) {
+            for (uint32_t row = 0; row < archetype->entityCount; row++) {
+                for (uint32_t id : archetype->componentIds)
+                    componentInfos[id].destroy(archetype->getComponent(row, id));
+            }
+        }
+    }
+
+    void World::destroyEntity(Entity entity)
+    {
+        if (!isAlive(entity))
+            return;
+
+        EntityRecord &record = records[entity.index];
+        Archetype *archetype = record.archetype;
+
+        for (uint32_t id : archetype->componentIds)
+            componentInfos[id].destroy(archetype->getComponent(record.row, id));
+
+        removeRow(archetype, record.row);
+
+        record.archetype = nullptr;
+        record.generation++;
+        freeIndices.push_back(entity.index);
+        entityCount--;
+    }
+
+    bool World::isAlive(Entity entity) const
+    {
+        return entity.index < records.size() && records[entity.index].archetype && records[entity.index].generation == entity.generation;
+    }
+
+    Archetype *World::getArchetype(const ComponentMask &mask)
+    {
+        static_assert(MAX_COMPONENTS <= 64, "masks are hashed as 64 bit integers");
+
+        auto it = archetypesByMask.find(mask.to_uint64());
+        if (it != archetypesByMask.end())
+            return it->second;
+
+        archetypes.push_back(eastl::make_unique<Archetype>(mask));
+        Archetype *archetype = archetypes.back().get();
+        archetypesByMask[mask.to_uint64()] = archetype;
+
+        return archetype;
+    }
+
+    Archetype *World::getAddArchetype(Archetype *archetype, uint32_t componentId)
+    {
+        Archetype *&edge = archetype->addEdges[componentId];
+        if (!edge) {
+            ComponentMask mask = archetype->mask;
+            mask.set(componentId);
+
+            edge = getArchetype(mask);
+            edge->removeEdges[componentId] = archetype;
+        }
+
+        return edge;
+    }
+
+    Archetype *World::getRemoveArchetype(Archetype *archetype, uint32_t componentId)
+    {
+        Archetype *&edge = archetype->removeEdges[componentId];
+        if (!edge) {
+            ComponentMask mask = archetype->mask;
+            mask.reset(componentId);
+
+            edge = getArchetype(mask);
+            edge->addEdges[componentId] = archetype;
+        }
+
+        return edge;
+    }
+
+    Entity World::allocateEntity(Archetype *archetype)
+    {
+        uint32_t index;
+        if (!freeIndices.empty()) {
+            index = freeIndices.back();
+            freeIndices.pop_back();
+        } else {
+            index = records.size();
+            records.push_back({});
+        }
+
+        EntityRecord &record = records[index];
+        const Entity entity = {.index = index, .generation = record.generation};
+
+        record.archetype = archetype;
+        record.row = archetype->addRow(entity);
+        entityCount++;
+
+        return entity;
+    }
+
+    void World::moveEntity(Entity entity, Archetype *target)
+    {
+        EntityRecord &record = records[entity.index];
+        Archetype *source = record.archetype;
+        const uint32_t sourceRow = record.row;
+        const uint32_t targetRow = target->addRow(entity);
+
+        for (uint32_t id : source->componentIds) {
+            void *component = source->getComponent(sourceRow, id);
+
+            if (target->mask.test(id))
+                componentInfos[id].move(target->getComponent(targetRow, id), component);
+            else
+                componentInfos[id].destroy(component);
+        }
+
+        removeRow(source, sourceRow);
+
+        record.archetype = target;
+        record.row = targetRow;
+    }
+
+    void World::removeRow(Archetype *archetype, uint32_t row)
+    {
+        const uint32_t last = archetype->entityCount - 1;
+
+        if (row != last) {
+            for (uint32_t id : archetype->componentIds)
+                componentInfos[id].move(archetype->getComponent(row, id), archetype->getComponent(last, id));
+
+            const Entity moved = archetype->getEntity(last);
+            archetype->getEntity(row) = moved;
+            records[moved.index].row = row;
+        }
+
+        archetype->removeLastRow();
+    }
+} // namespace ecs
@@ -2,85 +2,141 @@
 #include <rebirth/graphics/vulkan/graphics.h>
 
 #include <rebirth/util/logger.h>
+#include <rebirth/util/memory.h>
+#include <rebirth/util/timer.h>
 #include <rebirth/graphics/renderer.h>
+#include <rebirth/graphics/image_data.h>
+#include <rebirth/core/job_system.h>
+#include <rebirth/core/mesh_processing.h>
+
+#include <tracy/Tracy.hpp>
 
 namespace gltf
 {
-    bool loadScene(Renderer &renderer, Scene &scene, std::filesystem::path file)
+    // share of the progress taken by geometry and materials, textures take the rest
+    static constexpr float GEOMETRY_PROGRESS = 0.1f;
+
+    bool loadScene(Renderer &renderer, Scene &scene, std::filesystem::path file, LoadProgressCallback progressCallback)
+    {
+        ZoneScoped;
+
+        Timer timer;
+        timer.start();
+
+        if (progressCallback)
+            progressCallback(0.0f);
+
+        cgltf_data *data = parseFile(file);
+        if (!data)
+            return false;
+
+        scene.name = file.stem().c_str();
+        cgltf_scene *root = data->scene;
+        if (!root) {
+            logger::logError("Failed to load scene - root is NULL!");
+            cgltf_free(data);
+            return false;
+        }
+
+        mesh_processing::Stats meshStats;
+        loadGltfMeshes(renderer, scene, data, &meshStats);
+        mesh_processing::logStats(meshStats);
+
+        eastl::vector<int> nodeRemap = loadGltfNodes(scene, data, root);
+
+        loadGltfMaterials(renderer, data);
+
+        if (progressCallback)
+            progressCallback(GEOMETRY_PROGRESS);
+
+        loadGltfTextures(renderer, file.parent_path(), data, progressCallback);
+
+        loadGltfSkins(scene, data, nodeRemap);
+        loadGltfAnimations(scene, data, nodeRemap);
+
+        cgltf_free(data);
+
+        logger::logInfo("Loaded scene ", scene.name.c_str(), " in ", timer.elapsedMilliseconds(), " ms, peak memory usage ", memory::getPeakMemoryUsage() / (1024 * 1024), " MB");
+
+        return true;
+    }
+
+    cgltf_data *parseFile(std::filesystem::path file)
     {
+        ZoneScoped;
+
         cgltf_options options = {};
         cgltf_data *data = NULL;
         cgltf_result result = cgltf_parse_file(&options, file.c_str(), &data);
 
         if (result != cgltf_result_success) {
-            logger::logError("Failed to load gltf scene");
-            return false;
+            logger::logError("Failed to load gltf scene - ", file);
+            return nullptr;
         }
 
         if ((result = cgltf_load_buffers(&options, data, file.c_str())) !=
             cgltf_result_success) {
             logger::logError("Failed to load buffers of gltf scene");
-            return false;
+            cgltf_free(data);
+            return nullptr;
         }
 
         if ((result = cgltf_validate(data)) != cgltf_result_success) {
             logger::logError("Failed to load validate gltf scene");
-            return false;
+            cgltf_free(data);
+            return nullptr;
         }
 
-        if (!data) {
-            logger::logError("Failed to load scene - ", file);
-            return false;
-        }
+        return data;
+    }
 
-        scene.name = file.stem().c_str();
-        cgltf_scene *root = data->scene;
-        if (!root) {
-            logger::logError("Failed to load scene - root is NULL!");
-            return false;
-        }
+    void loadGltfMeshes(Renderer &renderer, Scene &scene, cgltf_data *data, mesh_processing::Stats *meshStats)
+    {
+        ZoneScoped;
 
-        scene.nodes.resize(root->nodes_count);
-        for (size_t i = 0; i < scene.nodes.size(); i++)
-            loadGltfNode(renderer, scene, scene.nodes[i], data, root->nodes[i]);
+        // nodes share meshes by index, so every mesh is loaded once
+        scene.meshes.resize(data->meshes_count);
+        for (size_t i = 0; i < data->meshes_count; i++)
+            loadGltfMesh(renderer, scene, scene.meshes[i], data, &data->meshes[i], meshStats);
+    }
 
-        loadGltfMaterials(renderer, data);
-        loadGltfTextures(renderer, file.parent_path(), data);
+    eastl::vector<int> loadGltfNodes(Scene &scene, cgltf_data *data, cgltf_scene *root)
+    {
+        ZoneScoped;
 
-        // loadGltfSkins(scene, data);
-        // loadGltfAnimations(scene, data);
+        eastl::vector<int> nodeRemap(data->nodes_count, -1);
+        for (size_t i = 0; i < root->nodes_count; i++)
+            loadGltfNode(scene, data, root->nodes[i], -1, nodeRemap);
 
-        cgltf_free(data);
-        return true;
+        return nodeRemap;
     }
 
-    bool loadGltfNode(Renderer &renderer, Scene &scene, SceneNode &node, cgltf_data *data, cgltf_node *gltfNode)
+    bool loadGltfNode(Scene &scene, cgltf_data *data, cgltf_node *gltfNode, int parent, eastl::vector<int> &nodeRemap)
     {
         if (!data || !gltfNode)
             return false;
 
-        node.name = gltfNode->name ? gltfNode->name : "Node";
-        node.index = cgltf_node_index(data, gltfNode);
-        loadGltfTransform(node.transform, gltfNode, false);
+        mat4 transform = mat4(1.0f);
+        loadGltfTransform(transform, gltfNode, false);
+
+        uint32_t node = scene.addNode(parent, transform, gltfNode->name ? gltfNode->name : "Node");
+        nodeRemap[cgltf_node_index(data, gltfNode)] = node;
 
         if (gltfNode->skin) {
-            node.skinIndex = cgltf_skin_index(data, gltfNode->skin);
+            scene.skinIndices[node] = cgltf_skin_index(data, gltfNode->skin);
         }
 
         if (gltfNode->mesh)
-            loadGltfMesh(renderer, scene, node.mesh, data, gltfNode->mesh);
+            scene.meshIndices[node] = cgltf_mesh_index(data, gltfNode->mesh);
 
-        // recursively load child nodes
-        node.children.resize(gltfNode->children_count);
-        for (size_t i = 0; i < gltfNode->children_count; i++) {
-            loadGltfNode(renderer, scene, node.children[i], data, gltfNode->children[i]);
-            node.children[i].parentIndex = node.index;
-        }
+        // children right after their parent, depth first
+        for (size_t i = 0; i < gltfNode->children_count; i++)
+            loadGltfNode(scene, data, gltfNode->children[i], node, nodeRemap);
 
         return true;
     }
 
-    bool loadGltfMesh(Renderer &renderer, Scene &scene, Mesh &mesh, cgltf_data *data, cgltf_mesh *gltfMesh)
+    bool loadGltfMesh(Renderer &renderer, Scene &scene, Mesh &mesh, cgltf_data *data, cgltf_mesh *gltfMesh, mesh_processing::Stats *meshStats)
     {
         if (!data || !gltfMesh)
             return false;
@@ -96,6 +152,20 @@ namespace gltf
 
             uint32_t indexCount = loadIndices(renderer.indices, prim);
 
+            uint32_t meshletOffset = renderer.meshlets.size();
+            uint32_t meshletCount = 0;
+
+            uint32_t lodOffset = renderer.lods.size();
+            uint32_t lodCount = 0;
+
+            if (prim.type == cgltf_primitive_type_triangles && vertexCount > 0 && indexCount > 0) {
+                vertexCount = mesh_processing::optimizeMesh(&renderer.vertices[vertexOffset], vertexCount, &renderer.indices[indexOffset], indexCount, meshStats);
+                renderer.vertices.resize(vertexOffset + vertexCount);
+
+                meshletCount = mesh_processing::buildMeshlets(renderer.meshlets, &renderer.vertices[vertexOffset], vertexCount, &renderer.indices[indexOffset], indexCount, meshStats);
+                lodCount = mesh_processing::buildLods(renderer.lods, renderer.indices, indexOffset, indexCount, &renderer.vertices[vertexOffset], vertexCount, meshStats);
+            }
+
             int materialIndex = prim.material ? materialOffset + cgltf_material_index(data, prim.material) : -1;
 
             Primitive primitive;
@@ -104,6 +174,11 @@ namespace gltf
             primitive.indexCount = indexCount;
             primitive.vertexCount = vertexCount;
             primitive.vertexOffset = vertexOffset;
+            primitive.meshletOffset = meshletOffset;
+            primitive.meshletCount = meshletCount;
+            primitive.lodOffset = lodOffset;
+            primitive.lodCount = lodCount;
+            primitive.bounds = math::calculateBoundingSphere(renderer.vertices, vertexOffset, vertexCount);
 
             mesh.primitives.push_back(primitive);
         }
@@ -213,7 +288,10 @@ namespace gltf
             newIndices.resize(prim.indices->count);
             cgltf_accessor_unpack_indices(prim.indices, newIndices.data(), 4, newIndices.size());
         } else {
-            logger::logWarn("Failed to loadIndices(), no indices!");
+            // generate sequential indices, so non-indexed primitives go through the same indexed indirect path
+            newIndices.resize(prim.attributes[0].data->count);
+            for (size_t i = 0; i < newIndices.size(); i++)
+                newIndices[i] = i;
         }
 
         indices.insert(indices.end(), newIndices.begin(), newIndices.end());
@@ -270,120 +348,204 @@ namespace gltf
         }
     }
 
-    void loadGltfTextures(Renderer &renderer, std::filesystem::path dir, cgltf_data *data)
+    void loadGltfTextures(Renderer &renderer, std::filesystem::path dir, cgltf_data *data, LoadProgressCallback progressCallback)
     {
-        for (size_t i = 0; i < data->textures_count; i++) {
-            cgltf_texture gltfTexture = data->textures[i];
+        ZoneScoped;
 
-            vulkan::ImageCreateInfo createInfo{};
-            vulkan::Image image;
+        JobSystem *jobSystem = JobSystem::instance();
 
-            if (gltfTexture.image->uri) { // load from file
-                std::filesystem::path file = dir / gltfTexture.image->uri;
+        const uint32_t textureCount = data->textures_count;
+        const size_t imageOffset = renderer.images.size();
+        renderer.images.resize(imageOffset + textureCount);
 
-                renderer.getGraphics().createImageFromFile(image, createInfo, file);
-            } else { // load from memory
-                const uint8_t *data = cgltf_buffer_view_data(gltfTexture.image->buffer_view);
-                uint32_t size = gltfTexture.image->buffer_view->size;
+        // decode a few textures per thread at once, the upload is batched per group and decoded pixels are freed after it
+        const uint32_t batchSize = std::max(jobSystem->getThreadCount() * 2, 8u);
+        eastl::vector<ImageData> imageData(batchSize);
 
-                renderer.getGraphics().createImageFromMemory(image, createInfo, const_cast<unsigned char *>(data), size);
-            }
+        eastl::vector<TextureUsage> usages = getTextureUsages(data);
+        size_t textureBytes = 0;
 
-            renderer.images.push_back(image);
+        for (uint32_t batchBegin = 0; batchBegin < textureCount; batchBegin += batchSize) {
+            uint32_t batchCount = std::min(batchSize, textureCount - batchBegin);
+
+            JobCounter counter;
+            jobSystem->parallelFor(&counter, batchCount, 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++)
+                    loadGltfImageData(imageData[i], dir, data->textures[batchBegin + i], usages[batchBegin + i]);
+            });
+            jobSystem->wait(counter);
+
+            for (uint32_t i = 0; i < batchCount; i++)
+                textureBytes += imageData[i].pixels.size();
+
+            renderer.getGraphics().createImagesFromData(&renderer.images[imageOffset + batchBegin], imageData.data(), batchCount, vulkan::ImageCreateInfo{});
+
+            if (progressCallback)
+                progressCallback(GEOMETRY_PROGRESS + (1.0f - GEOMETRY_PROGRESS) * (batchBegin + batchCount) / textureCount);
+        }
+
+        if (progressCallback)
+            progressCallback(1.0f);
+
+        logger::logInfo("Loaded ", textureCount, " textures, ", textureBytes / (1024 * 1024), " MB");
+    }
+
+    eastl::vector<TextureUsage> getTextureUsages(cgltf_data *data)
+    {
+        // textures not referenced by any material are treated as color
+        eastl::vector<TextureUsage> usages(data->textures_count, TextureUsage::Color);
+
+        for (size_t i = 0; i < data->materials_count; i++) {
+            const cgltf_material &gltfMaterial = data->materials[i];
+
+            if (gltfMaterial.has_pbr_metallic_roughness && gltfMaterial.pbr_metallic_roughness.metallic_roughness_texture.texture)
+                usages[cgltf_texture_index(data, gltfMaterial.pbr_metallic_roughness.metallic_roughness_texture.texture)] = TextureUsage::Linear;
+
+            if (gltfMaterial.occlusion_texture.texture)
+                usages[cgltf_texture_index(data, gltfMaterial.occlusion_texture.texture)] = TextureUsage::Linear;
+
+            if (gltfMaterial.normal_texture.texture)
+                usages[cgltf_texture_index(data, gltfMaterial.normal_texture.texture)] = TextureUsage::Normal;
+        }
+
+        return usages;
+    }
+
+    static bool loadGltfImage(ImageData &imageData, std::filesystem::path dir, const cgltf_image &gltfImage)
+    {
+        if (gltfImage.uri) { // load from file
+            std::filesystem::path path = dir / gltfImage.uri;
+            if (path.extension() == ".ktx2")
+                return loadKtx2ImageData(imageData, path);
+
+            return loadImageData(imageData, path);
+        }
+
+        // load from memory
+        const uint8_t *bufferData = cgltf_buffer_view_data(gltfImage.buffer_view);
+        if (isKtx2(bufferData, gltfImage.buffer_view->size))
+            return loadKtx2ImageData(imageData, bufferData, gltfImage.buffer_view->size);
+
+        return loadImageData(imageData, bufferData, gltfImage.buffer_view->size);
+    }
+
+    void loadGltfImageData(ImageData &imageData, std::filesystem::path dir, const cgltf_texture &gltfTexture, TextureUsage usage)
+    {
+        bool loaded = false;
+
+        // KHR_texture_basisu points at a ktx2 image, the regular image is the fallback for when it can't be used
+        if (gltfTexture.has_basisu && gltfTexture.basisu_image)
+            loaded = loadGltfImage(imageData, dir, *gltfTexture.basisu_image);
+
+        if (!loaded && gltfTexture.image)
+            loaded = loadGltfImage(imageData, dir, *gltfTexture.image);
+
+        if (!loaded) {
+            logger::logWarn("Texture ", gltfTexture.name ? gltfTexture.name : "", " has no usable image");
+            createFallbackImageData(imageData);
+            return;
         }
+
+        // compressed and ktx2 images come with their own format and mips
+        if (getBlockSize(imageData.format) > 0 || imageData.mipLevels > 1)
+            return;
+
+        imageData.format = usage == TextureUsage::Color ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        generateMipChain(imageData, usage == TextureUsage::Color);
     }
 
-    void loadGltfAnimations(Scene &scene, cgltf_data *data)
+    void loadGltfAnimations(Scene &scene, cgltf_data *data, const eastl::vector<int> &nodeRemap)
     {
+        ZoneScoped;
+
+        size_t sourceSize = 0;
+        size_t compressedSize = 0;
+
         scene.animations.resize(data->animations_count);
         for (size_t i = 0; i < data->animations_count; i++) {
-            Animation &animation = scene.animations[i];
-            cgltf_animation gltfAnimation = data->animations[i];
+            AnimationClip &clip = scene.animations[i];
+            const cgltf_animation &gltfAnimation = data->animations[i];
 
-            animation.name = gltfAnimation.name
-                                 ? gltfAnimation.name
-                                 : eastl::string("Animation ") + eastl::to_string(i);
+            clip.name = gltfAnimation.name
+                            ? gltfAnimation.name
+                            : eastl::string("Animation ") + eastl::to_string(i);
+
+            // clips don't have to start at zero, keys are shifted so they do
+            float start = std::numeric_limits<float>::max();
+            for (size_t j = 0; j < gltfAnimation.samplers_count; j++) {
+                const cgltf_accessor *input = gltfAnimation.samplers[j].input;
+                if (input && input->count > 0) {
+                    float time = 0.0f;
+                    cgltf_accessor_read_float(input, 0, &time, 1);
+                    start = eastl::min(start, time);
+                }
+            }
+
+            eastl::vector<float> times;
+            eastl::vector<float> temp;
+            eastl::vector<vec4> values;
 
-            // channels
-            animation.channels.resize(gltfAnimation.channels_count);
             for (size_t j = 0; j < gltfAnimation.channels_count; j++) {
-                AnimationChannel &channel = animation.channels[j];
-                cgltf_animation_channel gltfChannel = gltfAnimation.channels[j];
+                const cgltf_animation_channel &gltfChannel = gltfAnimation.channels[j];
+                const cgltf_animation_sampler *gltfSampler = gltfChannel.sampler;
 
+                AnimationPath path = AnimationPath::invalid;
                 switch (gltfChannel.target_path) {
                     case cgltf_animation_path_type_translation:
-                        channel.path = AnimationPath::translation;
+                        path = AnimationPath::translation;
                         break;
                     case cgltf_animation_path_type_rotation:
-                        channel.path = AnimationPath::rotation;
+                        path = AnimationPath::rotation;
                         break;
                     case cgltf_animation_path_type_scale:
-                        channel.path = AnimationPath::scale;
-                        break;
-                    case cgltf_animation_path_type_weights:
-                        channel.path = AnimationPath::weights;
+                        path = AnimationPath::scale;
                         break;
-                    default:
-                        channel.path = AnimationPath::invalid;
+                    default: // morph target weights are not supported
                         break;
                 }
 
-                channel.nodeIndex = cgltf_node_index(data, gltfChannel.target_node);
-
-                channel.samplerIndex = cgltf_animation_sampler_index(&gltfAnimation, gltfChannel.sampler);
-            }
-
-            // samplers
-            animation.samplers.resize(gltfAnimation.samplers_count);
-            for (size_t j = 0; j < gltfAnimation.samplers_count; j++) {
-                AnimationSampler &sampler = animation.samplers[j];
-                cgltf_animation_sampler gltfSampler = gltfAnimation.samplers[j];
-
-                // inputs
-                if (gltfSampler.input) {
-                    sampler.inputs.resize(gltfSampler.input->count);
-                    eastl::vector<float> inputs(sampler.inputs.size());
-                    cgltf_accessor_unpack_floats(gltfSampler.input, inputs.data(), inputs.size());
-
-                    for (size_t k = 0; k < sampler.inputs.size(); k++) {
-                        sampler.inputs[k] = inputs[k];
-
-                        // figure out start and end of animation
-                        if (inputs[k] < animation.start)
-                            animation.start = inputs[k];
-
-                        if (inputs[k] > animation.end)
-                            animation.end = inputs[k];
-                    }
+                const int node = gltfChannel.target_node ? nodeRemap[cgltf_node_index(data, gltfChannel.target_node)] : -1;
+                if (path == AnimationPath::invalid || node < 0 || !gltfSampler->input || !gltfSampler->output || gltfSampler->input->count == 0)
+                    continue;
+
+                const size_t keyCount = gltfSampler->input->count;
+                times.resize(keyCount);
+                cgltf_accessor_unpack_floats(gltfSampler->input, times.data(), keyCount);
+                for (float &time : times)
+                    time -= start;
+
+                // cubic spline keys are in-tangent, value, out-tangent, only the value is kept and interpolated linearly
+                const bool cubicSpline = gltfSampler->interpolation == cgltf_interpolation_type_cubic_spline;
+                const size_t valueStride = cubicSpline ? 3 : 1;
+                const size_t componentCount = cgltf_num_components(gltfSampler->output->type);
+                if (gltfSampler->output->count < keyCount * valueStride || componentCount < 3)
+                    continue;
+
+                temp.resize(gltfSampler->output->count * componentCount);
+                cgltf_accessor_unpack_floats(gltfSampler->output, temp.data(), temp.size());
+
+                values.resize(keyCount);
+                for (size_t k = 0; k < keyCount; k++) {
+                    const float *value = &temp[(k * valueStride + (cubicSpline ? 1 : 0)) * componentCount];
+                    values[k] = vec4(value[0], value[1], value[2], componentCount > 3 ? value[3] : 0.0f);
                 }
 
-                // outputs
-                if (gltfSampler.output) {
-                    sampler.outputs.resize(gltfSampler.output->count);
-
-                    eastl::vector<float> temp(gltfSampler.output->count * 4);
-
-                    for (size_t k = 0; k < sampler.outputs.size(); k++) {
-                        if (gltfSampler.output->type == cgltf_type_vec4) {
-                            cgltf_accessor_unpack_floats(gltfSampler.output, temp.data(), gltfSampler.output->count * 4);
-                            sampler.outputs[k].x = temp[k * 4 + 0];
-                            sampler.outputs[k].y = temp[k * 4 + 1];
-                            sampler.outputs[k].z = temp[k * 4 + 2];
-                            sampler.outputs[k].w = temp[k * 4 + 3];
-                        } else if (gltfSampler.output->type == cgltf_type_vec3) {
-                            cgltf_accessor_unpack_floats(gltfSampler.output, temp.data(), gltfSampler.output->count * 3);
-                            sampler.outputs[k].x = temp[k * 3 + 0];
-                            sampler.outputs[k].y = temp[k * 3 + 1];
-                            sampler.outputs[k].z = temp[k * 3 + 2];
-                            sampler.outputs[k].w = 0.0f;
-                        }
-                    }
-                }
+                const AnimationInterpolation interpolation = gltfSampler->interpolation == cgltf_interpolation_type_step
+                                                                 ? AnimationInterpolation::step
+                                                                 : AnimationInterpolation::linear;
+
+                clip.addTrack(node, path, interpolation, times.data(), values.data(), keyCount);
             }
+
+            sourceSize += clip.getSourceMemoryUsage();
+            compressedSize += clip.getMemoryUsage();
         }
+
+        if (compressedSize > 0)
+            logger::logInfo("Compressed ", data->animations_count, " animations from ", sourceSize / 1024, " KB to ", compressedSize / 1024, " KB");
     }
 
-    void loadGltfSkins(Scene &scene, cgltf_data *data)
+    void loadGltfSkins(Scene &scene, cgltf_data *data, const eastl::vector<int> &nodeRemap)
     {
         scene.skins.resize(data->skins_count);
         for (size_t i = 0; i < data->skins_count; i++) {
@@ -395,11 +557,11 @@ namespace gltf
             // joints
             skin.joints.resize(gltfSkin.joints_count);
             for (size_t j = 0; j < gltfSkin.joints_count; j++) {
-                skin.joints[j] = cgltf_node_index(data, gltfSkin.joints[j]);
+                skin.joints[j] = nodeRemap[cgltf_node_index(data, gltfSkin.joints[j])];
             }
 
             if (gltfSkin.skeleton)
-                skin.skeletonIndex = cgltf_node_index(data, gltfSkin.skeleton);
+                skin.skeletonIndex = nodeRemap[cgltf_node_index(data, gltfSkin.skeleton)];
 
             // inverse bind matrices
             if (gltfSkin.inverse_bind_matrices) {
@@ -428,14 +590,10 @@ namespace gltf
                         temp[j * 16 + 15],
                     };
                 }
-
-                // TODO: this should be changed to global joint materices buffer
-                // vulkan::BufferCreateInfo createInfo = {
-                //     .size = sizeof(mat4) * skin.inverseBindMatrices.size(),
-                //     .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                // };
-                // g_graphics.createBuffer(skin.jointMatricesBuffer, createInfo);
             }
+
+            // identity when the file leaves them out
+            skin.inverseBindMatrices.resize(skin.joints.size(), mat4(1.0f));
         }
     }
 
@@ -453,7 +611,7 @@ namespace gltf
         return true;
     }
 
-    bool loadGltfTransform(mat4 transform, cgltf_node *node, bool world)
+    bool loadGltfTransform(mat4 &transform, cgltf_node *node, bool world)
     {
         if (!node)
             return false;
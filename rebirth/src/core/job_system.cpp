@@ -0,0 +1,311 @@
+#include <rebirth/core/job_system.h>
+
+#include <rebirth/util/logger.h>
+
+#include <EASTL/string.h>
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+#include <assert.h>
+
+static thread_local uint32_t g_threadIndex = UINT32_MAX;
+
+//
+// WorkStealingQueue
+// Correct and Efficient Work-Stealing for Weak Memory Models. Nhat Minh Lê, Antoniu Pop, Albert Cohen, Francesco Zappa Nardelli. 2013
+//
+bool WorkStealingQueue::push(Job *job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+
+    if (b - t >= CAPACITY)
+        return false;
+
+    jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+Job *WorkStealingQueue::pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+    if (t == b) {
+        // last job, race against stealing threads
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+Job *WorkStealingQueue::steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+        return nullptr;
+
+    Job *job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+    // lost the race against the owner or another thief
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+
+    return job;
+}
+
+//
+// JobSystem
+//
+JobSystem *JobSystem::instance()
+{
+    static JobSystem jobSystem;
+    return &jobSystem;
+}
+
+void JobSystem::initialize(uint32_t threadCount)
+{
+    ZoneScopedN("Job system init");
+
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    this->threadCount = threadCount;
+
+    for (uint32_t i = 0; i < threadCount; i++)
+        threadData.push_back(eastl::make_unique<ThreadData>());
+
+    // calling thread is the first one
+    g_threadIndex = 0;
+
+    running = true;
+    for (uint32_t i = 1; i < threadCount; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+
+    logger::logInfo("Job system initialized with ", threadCount, " threads");
+}
+
+void JobSystem::shutdown()
+{
+    ZoneScopedN("Job system shutdown");
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        running = false;
+    }
+    wakeCondition.notify_all();
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    workers.clear();
+    threadData.clear();
+    threadCount = 0;
+}
+
+void JobSystem::execute(JobCounter *counter, std::function<void()> function, JobCounter *dependency)
+{
+    if (counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    Job *job = allocateJob();
+    job->function = std::move(function);
+    job->counter = counter;
+    job->dependency = dependency;
+
+    if (dependency && !dependency->isDone()) {
+        // queued when the dependency is finished
+        std::lock_guard<std::mutex> lock(waitingMutex);
+        waitingJobs.push_back(job);
+        waitingJobCount.fetch_add(1);
+        return;
+    }
+
+    pushJob(job);
+}
+
+void JobSystem::parallelFor(JobCounter *counter, uint32_t count, uint32_t groupSize, std::function<void(uint32_t begin, uint32_t end)> function)
+{
+    assert(groupSize > 0);
+
+    for (uint32_t begin = 0; begin < count; begin += groupSize) {
+        uint32_t end = std::min(begin + groupSize, count);
+        execute(counter, [function, begin, end]() { function(begin, end); });
+    }
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    ZoneScoped;
+
+    while (!counter.isDone()) {
+        if (!runPendingJob())
+            std::this_thread::yield();
+    }
+}
+
+uint32_t JobSystem::getThreadIndex() const
+{
+    return g_threadIndex;
+}
+
+void JobSystem::workerLoop(uint32_t index)
+{
+    g_threadIndex = index;
+
+    eastl::string name = "Job worker " + eastl::to_string(index);
+    tracy::SetThreadName(name.c_str());
+
+    while (running) {
+        if (runPendingJob())
+            continue;
+
+        // queued jobs are being stolen by other threads
+        if (pendingJobs.load() > 0) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCondition.wait(lock, [&]() { return !running || pendingJobs.load() > 0; });
+    }
+}
+
+Job *JobSystem::allocateJob()
+{
+    assert(g_threadIndex < threadCount && "Jobs can only be submitted from the main thread or from workers");
+
+    ThreadData &data = *threadData[g_threadIndex];
+    Job *job = &data.jobPool[data.jobPoolIndex++ & (JOB_POOL_SIZE - 1)];
+
+    // pool wrapped around while the job is still in flight, help until it's finished
+    while (job->active.load(std::memory_order_acquire)) {
+        if (!runPendingJob())
+            std::this_thread::yield();
+    }
+
+    job->active.store(true, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::pushJob(Job *job)
+{
+    pendingJobs.fetch_add(1);
+
+    if (!threadData[g_threadIndex]->queue.push(job)) {
+        pendingJobs.fetch_sub(1);
+
+        // queue is full, run it in place
+        runJob(job);
+        return;
+    }
+
+    // lock to not miss a worker that is about to sleep
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wakeCondition.notify_one();
+}
+
+Job *JobSystem::getJob()
+{
+    Job *job = threadData[g_threadIndex]->queue.pop();
+    if (job)
+        return job;
+
+    // steal from other threads, starting from the next one
+    for (uint32_t i = 1; i < threadCount; i++) {
+        uint32_t victim = (g_threadIndex + i) % threadCount;
+
+        job = threadData[victim]->queue.steal();
+        if (job)
+            return job;
+    }
+
+    return nullptr;
+}
+
+bool JobSystem::runPendingJob()
+{
+    Job *job = getJob();
+    if (!job) {
+        // dependency could have finished before its job was added to the waiting list
+        return releaseWaitingJobs();
+    }
+
+    pendingJobs.fetch_sub(1);
+    runJob(job);
+
+    return true;
+}
+
+void JobSystem::runJob(Job *job)
+{
+    job->function();
+    job->function = nullptr; // release captures
+
+    bool finished = job->counter && job->counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1;
+
+    job->active.store(false, std::memory_order_release);
+
+    if (finished)
+        releaseWaitingJobs();
+}
+
+bool JobSystem::releaseWaitingJobs()
+{
+    if (waitingJobCount.load() == 0)
+        return false;
+
+    eastl::vector<Job *> &readyJobs = threadData[g_threadIndex]->readyJobs;
+
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex);
+
+        for (size_t i = 0; i < waitingJobs.size();) {
+            if (waitingJobs[i]->dependency->isDone()) {
+                readyJobs.push_back(waitingJobs[i]);
+                waitingJobs[i] = waitingJobs.back();
+                waitingJobs.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        waitingJobCount.fetch_sub(readyJobs.size());
+    }
+
+    bool released = !readyJobs.empty();
+
+    // swap out, pushing can run jobs in place that release other jobs
+    eastl::vector<Job *> jobs;
+    jobs.swap(readyJobs);
+
+    for (Job *job : jobs)
+        pushJob(job);
+
+    jobs.clear();
+    if (readyJobs.empty())
+        readyJobs.swap(jobs); // keep the capacity
+
+    return released;
+}
\ No newline at end of file
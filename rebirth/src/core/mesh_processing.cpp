@@ -0,0 +1,179 @@
+#include <rebirth/core/mesh_processing.h>
+
+#include <rebirth/util/logger.h>
+
+#include <EASTL/vector.h>
+#include <meshoptimizer.h>
+#include <tracy/Tracy.hpp>
+
+#include <assert.h>
+
+namespace mesh_processing
+{
+    static constexpr size_t CACHE_SIZE = 16;
+
+    // how much worse the vertex cache is allowed to get for less overdraw
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    // prefer tighter normal cones over tighter spheres a bit, helps backface culling of clusters
+    static constexpr float MESHLET_CONE_WEIGHT = 0.25f;
+
+    // relative to the mesh extents, lods are picked by their projected error so coarse levels only show up far away
+    static constexpr float LOD_MAX_ERROR = 0.1f;
+    // a level that doesn't get rid of enough triangles isn't worth a draw of its own
+    static constexpr float LOD_MIN_REDUCTION = 0.85f;
+
+    uint32_t optimizeMesh(Vertex *vertices, uint32_t vertexCount, uint32_t *indices, uint32_t indexCount, Stats *stats)
+    {
+        ZoneScoped;
+
+        if (vertexCount == 0 || indexCount == 0 || indexCount % 3 != 0)
+            return vertexCount;
+
+        if (stats) {
+            stats->primitiveCount++;
+            stats->triangleCount += indexCount / 3;
+            stats->inputVertexCount += vertexCount;
+            stats->inputTransformedCount += meshopt_analyzeVertexCache(indices, indexCount, vertexCount, CACHE_SIZE, 0, 0).vertices_transformed;
+        }
+
+        // non indexed primitives come with sequential indices, this is where they get shared vertices
+        eastl::vector<uint32_t> remap(vertexCount);
+        size_t uniqueCount = meshopt_generateVertexRemap(remap.data(), indices, indexCount, vertices, vertexCount, sizeof(Vertex));
+        meshopt_remapIndexBuffer(indices, indices, indexCount, remap.data());
+        meshopt_remapVertexBuffer(vertices, vertices, vertexCount, sizeof(Vertex), remap.data());
+
+        meshopt_optimizeVertexCache(indices, indices, indexCount, uniqueCount);
+        meshopt_optimizeOverdraw(indices, indices, indexCount, &vertices[0].position.x, uniqueCount, sizeof(Vertex), OVERDRAW_THRESHOLD);
+
+        // drops vertices no triangle uses
+        uint32_t outputCount = meshopt_optimizeVertexFetch(vertices, indices, indexCount, vertices, uniqueCount, sizeof(Vertex));
+
+        if (stats) {
+            stats->outputVertexCount += outputCount;
+            stats->outputTransformedCount += meshopt_analyzeVertexCache(indices, indexCount, outputCount, CACHE_SIZE, 0, 0).vertices_transformed;
+        }
+
+        return outputCount;
+    }
+
+    uint32_t buildMeshlets(eastl::vector<Meshlet> &meshlets, const Vertex *vertices, uint32_t vertexCount, uint32_t *indices, uint32_t indexCount, Stats *stats)
+    {
+        ZoneScoped;
+
+        if (vertexCount == 0 || indexCount == 0 || indexCount % 3 != 0)
+            return 0;
+
+        size_t maxMeshlets = meshopt_buildMeshletsBound(indexCount, MAX_MESHLET_VERTICES, MAX_MESHLET_TRIANGLES);
+        eastl::vector<meshopt_Meshlet> clusters(maxMeshlets);
+        eastl::vector<uint32_t> meshletVertices(maxMeshlets * MAX_MESHLET_VERTICES);
+        eastl::vector<unsigned char> meshletTriangles(maxMeshlets * MAX_MESHLET_TRIANGLES * 3);
+
+        size_t meshletCount = meshopt_buildMeshlets(
+            clusters.data(), meshletVertices.data(), meshletTriangles.data(), indices, indexCount,
+            &vertices[0].position.x, vertexCount, sizeof(Vertex), MAX_MESHLET_VERTICES, MAX_MESHLET_TRIANGLES, MESHLET_CONE_WEIGHT);
+
+        // every triangle ends up in exactly one meshlet, so the rewritten indices fit in place
+        uint32_t firstIndex = 0;
+        for (size_t i = 0; i < meshletCount; i++) {
+            const meshopt_Meshlet &meshlet = clusters[i];
+            const uint32_t *localVertices = &meshletVertices[meshlet.vertex_offset];
+            const unsigned char *localTriangles = &meshletTriangles[meshlet.triangle_offset];
+
+            meshopt_Bounds bounds = meshopt_computeMeshletBounds(localVertices, localTriangles, meshlet.triangle_count, &vertices[0].position.x, vertexCount, sizeof(Vertex));
+
+            meshlets.push_back(Meshlet{
+                .boundingSphere = vec4(bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius),
+                .cone = vec4(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff),
+                .firstIndex = firstIndex,
+                .indexCount = meshlet.triangle_count * 3,
+            });
+
+            for (uint32_t j = 0; j < meshlet.triangle_count * 3; j++)
+                indices[firstIndex + j] = localVertices[localTriangles[j]];
+
+            firstIndex += meshlet.triangle_count * 3;
+        }
+
+        assert(firstIndex == indexCount);
+
+        if (stats)
+            stats->meshletCount += meshletCount;
+
+        return meshletCount;
+    }
+
+    uint32_t buildLods(eastl::vector<MeshLod> &lods, eastl::vector<uint32_t> &indices, uint32_t indexOffset, uint32_t indexCount, const Vertex *vertices, uint32_t vertexCount, Stats *stats)
+    {
+        ZoneScoped;
+
+        if (vertexCount == 0 || indexCount == 0 || indexCount % 3 != 0)
+            return 0;
+
+        lods.push_back(MeshLod{
+            .firstIndex = 0,
+            .indexCount = indexCount,
+        });
+
+        // indices are appended to, keep the full detail level aside
+        eastl::vector<uint32_t> baseIndices(indices.begin() + indexOffset, indices.begin() + indexOffset + indexCount);
+        eastl::vector<uint32_t> lodIndices(indexCount);
+
+        const float scale = meshopt_simplifyScale(&vertices[0].position.x, vertexCount, sizeof(Vertex));
+
+        uint32_t lodCount = 1;
+        uint32_t previousCount = indexCount;
+        float previousError = 0.0f;
+
+        while (lodCount < MAX_LODS) {
+            // Simplifying the full detail level every time keeps the error from piling up. Primitives are simplified on
+            // their own, their borders are kept so levels of primitives sharing an edge don't open cracks.
+            size_t targetCount = (indexCount >> lodCount) / 3 * 3;
+            if (targetCount < 3)
+                break;
+
+            float error = 0.0f;
+            size_t count = meshopt_simplify(
+                lodIndices.data(), baseIndices.data(), indexCount, &vertices[0].position.x, vertexCount, sizeof(Vertex),
+                targetCount, LOD_MAX_ERROR, meshopt_SimplifyLockBorder, &error);
+
+            if (count == 0 || count > previousCount * LOD_MIN_REDUCTION)
+                break;
+
+            meshopt_optimizeVertexCache(lodIndices.data(), lodIndices.data(), count, vertexCount);
+
+            // a coarser level never claims to be more accurate than the previous one
+            previousError = eastl::max(previousError, error * scale);
+            previousCount = count;
+
+            lods.push_back(MeshLod{
+                .firstIndex = static_cast<uint32_t>(indices.size() - indexOffset),
+                .indexCount = static_cast<uint32_t>(count),
+                .error = previousError,
+            });
+            indices.insert(indices.end(), lodIndices.begin(), lodIndices.begin() + count);
+
+            if (stats) {
+                stats->lodCount++;
+                stats->lodTriangleCount += count / 3;
+            }
+
+            lodCount++;
+        }
+
+        return lodCount;
+    }
+
+    void logStats(const Stats &stats)
+    {
+        if (stats.triangleCount == 0)
+            return;
+
+        float inputAcmr = float(stats.inputTransformedCount) / stats.triangleCount;
+        float outputAcmr = float(stats.outputTransformedCount) / stats.triangleCount;
+
+        logger::logInfo("Optimized ", stats.primitiveCount, " primitives, ", stats.triangleCount, " triangles, ACMR ", inputAcmr, " -> ", outputAcmr, ", ", stats.meshletCount, " meshlets");
+        logger::logInfo("Generated ", stats.lodCount, " lods, ", stats.lodTriangleCount, " triangles");
+        logger::logInfo("Vertices ", stats.inputVertexCount, " -> ", stats.outputVertexCount, ", vertex buffer ", stats.inputVertexCount * sizeof(Vertex) / 1024, " KB -> ", stats.outputVertexCount * sizeof(GpuVertex) / 1024, " KB");
+    }
+} // namespace mesh_processing
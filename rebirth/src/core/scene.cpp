@@ -1,80 +1,112 @@
 #include <rebirth/core/scene.h>
 
-void Scene::updateAnimation(float deltaTime, eastl::string name)
-{
-    if (animations.size() < 1)
-        return;
+#include <tracy/Tracy.hpp>
+
+#include <assert.h>
 
-    Animation *animation = getAnimationByName(name);
-    if (!animation)
-        return;
+uint32_t Scene::addNode(int parent, const mat4 &localTransform, eastl::string name)
+{
+    const uint32_t node = parents.size();
+    assert(parent < int(node));
 
-    animation->currentTime += deltaTime;
-    if (animation->currentTime > animation->end) {
-        animation->currentTime -= animation->end;
+    // every ancestor's subtree grows by one, which only keeps subtrees contiguous when nodes come depth first
+    for (int ancestor = parent; ancestor >= 0; ancestor = parents[ancestor]) {
+        assert(ancestor + subtreeSizes[ancestor] == node);
+        subtreeSizes[ancestor]++;
     }
 
-    for (auto &channel : animation->channels) {
-        AnimationSampler &sampler = animation->samplers[channel.samplerIndex];
-
-        for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
-            if ((animation->currentTime >= sampler.inputs[i]) &&
-                (animation->currentTime <= sampler.inputs[i + 1])) {
-                float step = (animation->currentTime - sampler.inputs[i]) /
-                             (sampler.inputs[i + 1] - sampler.inputs[i]);
-                SceneNode *node = getNodeByIndex(channel.nodeIndex);
-
-                if (!node)
-                    continue;
-
-                if (channel.path == AnimationPath::translation) {
-                    node->transform *= glm::translate(vec3(glm::mix(sampler.outputs[i], sampler.outputs[i + 1], step)));
-                }
-
-                if (channel.path == AnimationPath::rotation) {
-                    glm::quat q1;
-                    q1.x = sampler.outputs[i].x;
-                    q1.y = sampler.outputs[i].y;
-                    q1.z = sampler.outputs[i].z;
-                    q1.w = sampler.outputs[i].w;
-
-                    glm::quat q2;
-                    q2.x = sampler.outputs[i + 1].x;
-                    q2.y = sampler.outputs[i + 1].y;
-                    q2.z = sampler.outputs[i + 1].z;
-                    q2.w = sampler.outputs[i + 1].w;
-
-                    node->transform *= mat4(glm::normalize(glm::slerp(q1, q2, step)));
-                }
-
-                if (channel.path == AnimationPath::scale) {
-                    node->transform = glm::scale(vec3(glm::mix(sampler.outputs[i], sampler.outputs[i + 1], step)));
-                }
+    parents.push_back(parent);
+    subtreeSizes.push_back(1);
+    localTransforms.push_back(localTransform);
+    worldTransforms.push_back(parent >= 0 ? worldTransforms[parent] * localTransform : localTransform);
+    meshIndices.push_back(-1);
+    skinIndices.push_back(-1);
+    names.push_back(eastl::move(name));
+
+    vec3 skew;
+    vec4 perspective;
+    restPose.resize(node + 1);
+    glm::decompose(localTransform, restPose.scales[node], restPose.rotations[node], restPose.translations[node], skew, perspective);
+    dirtyFlags.push_back(0);
+
+    return node;
+}
+
+void Scene::setLocalTransform(uint32_t node, const mat4 &localTransform)
+{
+    localTransforms[node] = localTransform;
+    dirtyFlags[node] |= DIRTY_LOCAL;
+
+    // ancestors that are already flagged have theirs flagged too
+    for (int ancestor = parents[node]; ancestor >= 0 && dirtyFlags[ancestor] == 0; ancestor = parents[ancestor])
+        dirtyFlags[ancestor] = DIRTY_DESCENDANT;
+}
+
+void Scene::updateTransforms(eastl::vector<uint32_t> *changedNodes)
+{
+    ZoneScoped;
+
+    const uint32_t nodeCount = getNodeCount();
+
+    uint32_t node = 0;
+    while (node < nodeCount) {
+        const uint8_t flags = dirtyFlags[node];
+
+        if (flags == 0) {
+            node += subtreeSizes[node];
+            continue;
+        }
+
+        if (flags & DIRTY_LOCAL) {
+            // parents come first, so theirs are already up to date
+            const uint32_t end = node + subtreeSizes[node];
+            for (uint32_t i = node; i < end; i++) {
+                const int parent = parents[i];
+                worldTransforms[i] = parent >= 0 ? worldTransforms[parent] * localTransforms[i] : localTransforms[i];
+                dirtyFlags[i] = 0;
+
+                if (changedNodes)
+                    changedNodes->push_back(i);
             }
+
+            node = end;
+            continue;
         }
-    }
 
-    for (auto &node : nodes) {
-        updateJoints(node);
+        // only something below changed
+        dirtyFlags[node] = 0;
+        node++;
     }
 }
 
-mat4 Scene::getNodeWorldMatrix(SceneNode *node)
+void Scene::updateAnimation(Animator &animator, float deltaTime)
 {
-    if (!node)
-        return mat4(1.0f);
-
-    mat4 worldMatrix = node->transform;
-    SceneNode *parent = getNodeByIndex(node->parentIndex);
-    while (parent) {
-        worldMatrix = parent->transform * worldMatrix;
-        parent = getNodeByIndex(parent->parentIndex);
-    }
+    ZoneScoped;
 
-    return worldMatrix;
+    if (!animator.restPose)
+        animator.restPose = &restPose;
+
+    animation::updateAnimator(animator, deltaTime);
+
+    // local transforms are rebuilt from the pose, not composed with last frame's
+    const AnimationPose &pose = animator.pose;
+    auto placeNodes = [&](const AnimationClip *clip) {
+        if (!clip)
+            return;
+
+        for (uint32_t node : clip->trackNodes) {
+            if (node < pose.getNodeCount())
+                setLocalTransform(node, glm::translate(pose.translations[node]) * glm::mat4_cast(pose.rotations[node]) * glm::scale(pose.scales[node]));
+        }
+    };
+    placeNodes(animator.current.clip);
+    placeNodes(animator.next.clip);
+
+    updateTransforms();
+    updateJoints();
 }
 
-Animation *Scene::getAnimationByName(eastl::string name)
+const AnimationClip *Scene::getAnimationByName(const eastl::string &name) const
 {
     for (auto &animation : animations) {
         if (animation.name == name)
@@ -84,59 +116,23 @@ Animation *Scene::getAnimationByName(eastl::string name)
     return nullptr;
 }
 
-void Scene::updateJoints(SceneNode &node)
+void Scene::updateJoints()
 {
-    if (node.skinIndex > -1) {
-        mat4 inverseTransform = glm::inverse(getNodeWorldMatrix(&node));
-        Skin &skin = skins[node.skinIndex];
+    for (uint32_t node = 0; node < getNodeCount(); node++) {
+        if (skinIndices[node] < 0 || skinIndices[node] >= int(skins.size()))
+            continue;
+
+        mat4 inverseTransform = glm::inverse(worldTransforms[node]);
+        Skin &skin = skins[skinIndices[node]];
 
         size_t jointsCount = skin.joints.size();
-        eastl::vector<mat4> jointMatrices(jointsCount);
+        skin.jointMatrices.resize(jointsCount, mat4(1.0f));
 
         for (size_t i = 0; i < jointsCount; i++) {
-            SceneNode *joint = getNodeByIndex(skin.joints[i]);
-            if (!joint)
+            if (skin.joints[i] < 0)
                 continue;
 
-            jointMatrices[i] = getNodeWorldMatrix(joint) * skin.inverseBindMatrices[i];
-            jointMatrices[i] = inverseTransform * jointMatrices[i];
+            skin.jointMatrices[i] = inverseTransform * worldTransforms[skin.joints[i]] * skin.inverseBindMatrices[i];
         }
     }
-
-    for (auto &child : node.children) {
-        updateJoints(child);
-    }
 }
-
-SceneNode *Scene::getNodeByIndex(int index)
-{
-    if (index <= -1)
-        return nullptr;
-
-    SceneNode *found = nullptr;
-    for (auto &node : nodes) {
-        found = searchNode(&node, index);
-        if (found)
-            break;
-    }
-
-    return found;
-}
-
-SceneNode *Scene::searchNode(SceneNode *node, int index)
-{
-    if (index <= -1)
-        return nullptr;
-
-    SceneNode *found = nullptr;
-    if (node->index == index)
-        return node;
-
-    for (auto &child : node->children) {
-        found = searchNode(&child, index);
-        if (found)
-            break;
-    }
-
-    return found;
-}
\ No newline at end of file
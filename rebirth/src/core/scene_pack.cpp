@@ -0,0 +1,354 @@
+#include <rebirth/graphics/scene_pack.h>
+
+#include <rebirth/graphics/image_data.h>
+#include <rebirth/graphics/renderer.h>
+#include <rebirth/util/filesystem.h>
+#include <rebirth/util/logger.h>
+#include <rebirth/util/memory.h>
+#include <rebirth/util/timer.h>
+
+#include <EASTL/algorithm.h>
+#include <tracy/Tracy.hpp>
+
+#include <math.h>
+#include <string.h>
+
+namespace scene_pack
+{
+    static constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+    //
+    // Writer
+    //
+    bool Writer::open(std::filesystem::path file)
+    {
+        stream.open(file, std::ios::binary | std::ios::trunc);
+        if (!stream.is_open()) {
+            logger::logError("Failed to open file for writing - ", file);
+            return false;
+        }
+
+        header = {};
+        images.clear();
+
+        // reserve space, the header is written last
+        writeSection(&header, sizeof(Header));
+        return true;
+    }
+
+    void Writer::writeScene(const Scene &scene, const Renderer &renderer)
+    {
+        ZoneScoped;
+
+        eastl::vector<Node> nodes(scene.getNodeCount());
+        for (uint32_t i = 0; i < scene.getNodeCount(); i++) {
+            Node &node = nodes[i];
+            node.transform = scene.localTransforms[i];
+            node.parentIndex = scene.parents[i];
+            node.skinIndex = scene.skinIndices[i] < int(scene.skins.size()) ? scene.skinIndices[i] : -1; // skins aren't baked
+            node.meshIndex = scene.meshIndices[i];
+
+            strncpy(node.name, scene.names[i].c_str(), sizeof(node.name) - 1);
+            node.name[sizeof(node.name) - 1] = '\0';
+        }
+
+        eastl::vector<MeshRange> meshes;
+        eastl::vector<Primitive> primitives;
+        for (const Mesh &mesh : scene.meshes) {
+            meshes.push_back(MeshRange{
+                .firstPrimitive = static_cast<uint32_t>(primitives.size()),
+                .primitiveCount = static_cast<uint32_t>(mesh.primitives.size()),
+            });
+            primitives.insert(primitives.end(), mesh.primitives.begin(), mesh.primitives.end());
+        }
+
+        header.vertexCount = renderer.vertices.size();
+        header.indexCount = renderer.indices.size();
+        header.materialCount = renderer.materials.size();
+        header.primitiveCount = primitives.size();
+        header.nodeCount = nodes.size();
+        header.meshCount = meshes.size();
+        header.meshletCount = renderer.meshlets.size();
+        header.lodCount = renderer.lods.size();
+
+        header.verticesOffset = writeSection(renderer.vertices.data(), renderer.vertices.size() * sizeof(Vertex));
+        header.indicesOffset = writeSection(renderer.indices.data(), renderer.indices.size() * sizeof(uint32_t));
+        header.materialsOffset = writeSection(renderer.materials.data(), renderer.materials.size() * sizeof(Material));
+        header.primitivesOffset = writeSection(primitives.data(), primitives.size() * sizeof(Primitive));
+        header.nodesOffset = writeSection(nodes.data(), nodes.size() * sizeof(Node));
+        header.meshesOffset = writeSection(meshes.data(), meshes.size() * sizeof(MeshRange));
+        header.meshletsOffset = writeSection(renderer.meshlets.data(), renderer.meshlets.size() * sizeof(Meshlet));
+        header.lodsOffset = writeSection(renderer.lods.data(), renderer.lods.size() * sizeof(MeshLod));
+    }
+
+    void Writer::writeImage(const ImageData &imageData)
+    {
+        Image image = {
+            .width = imageData.width,
+            .height = imageData.height,
+            .mipLevels = imageData.mipLevels,
+            .format = static_cast<uint32_t>(imageData.format),
+            .dataSize = imageData.pixels.size(),
+        };
+
+        image.dataOffset = writeSection(imageData.pixels.data(), imageData.pixels.size());
+        images.push_back(image);
+    }
+
+    bool Writer::close()
+    {
+        header.imageCount = images.size();
+        header.imagesOffset = writeSection(images.data(), images.size() * sizeof(Image));
+
+        stream.seekp(0);
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+
+        bool success = stream.good();
+        stream.close();
+
+        if (!success)
+            logger::logError("Failed to write scene pack");
+
+        return success;
+    }
+
+    uint64_t Writer::writeSection(const void *data, size_t size)
+    {
+        // pad so the section can be read in place from the mapping
+        uint64_t offset = stream.tellp();
+        uint64_t alignedOffset = (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+
+        static const char padding[SECTION_ALIGNMENT] = {};
+        stream.write(padding, alignedOffset - offset);
+
+        if (size > 0)
+            stream.write(static_cast<const char *>(data), size);
+
+        return alignedOffset;
+    }
+
+    //
+    // Loading
+    //
+    static bool validSection(const filesystem::MappedFile &file, uint64_t offset, uint64_t count, uint64_t stride)
+    {
+        return offset % SECTION_ALIGNMENT == 0 && offset <= file.size && count * stride <= file.size - offset;
+    }
+
+    // Nodes are added depth first, so a parent has to be on the chain of open ancestors of the node (Scene::addNode).
+    static bool validNodes(const Node *nodes, uint32_t count, uint32_t skinCount)
+    {
+        eastl::vector<int32_t> ancestors;
+        for (uint32_t i = 0; i < count; i++) {
+            const Node &node = nodes[i];
+            if (node.parentIndex < -1 || node.parentIndex >= int32_t(i))
+                return false;
+
+            if (node.skinIndex < -1 || node.skinIndex >= int32_t(skinCount))
+                return false;
+
+            while (!ancestors.empty() && ancestors.back() != node.parentIndex)
+                ancestors.pop_back();
+
+            if (node.parentIndex >= 0 && ancestors.empty())
+                return false;
+
+            ancestors.push_back(i);
+        }
+
+        return true;
+    }
+
+    // ranges of the primitives are drawn and culled on the gpu as they are
+    static bool validPrimitives(const Primitive *primitives, const Header &header)
+    {
+        for (uint32_t i = 0; i < header.primitiveCount; i++) {
+            const Primitive &primitive = primitives[i];
+            if (uint64_t(primitive.vertexOffset) + primitive.vertexCount > header.vertexCount ||
+                uint64_t(primitive.indexOffset) + primitive.indexCount > header.indexCount ||
+                uint64_t(primitive.meshletOffset) + primitive.meshletCount > header.meshletCount ||
+                uint64_t(primitive.lodOffset) + primitive.lodCount > header.lodCount)
+                return false;
+
+            if (primitive.materialIndex < -1 || primitive.materialIndex >= int32_t(header.materialCount))
+                return false;
+        }
+
+        return true;
+    }
+
+    // A mip chain the baker could have written: rgba8 or bc, levels tightly packed.
+    static bool validImage(const filesystem::MappedFile &file, const Image &image, uint32_t maxDimension)
+    {
+        if (!validSection(file, image.dataOffset, image.dataSize, 1))
+            return false;
+
+        if (image.width == 0 || image.height == 0 || image.width > maxDimension || image.height > maxDimension)
+            return false;
+
+        const VkFormat format = static_cast<VkFormat>(image.format);
+        if (format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB && getBlockSize(format) == 0)
+            return false;
+
+        // ktx2 sources can have partial chains
+        const uint32_t fullMipLevels = static_cast<uint32_t>(floor(log2(eastl::max(image.width, image.height)))) + 1;
+        if (image.mipLevels == 0 || image.mipLevels > fullMipLevels)
+            return false;
+
+        uint64_t size = 0;
+        for (uint32_t level = 0; level < image.mipLevels; level++)
+            size += getMipSize(format, eastl::max(image.width >> level, 1u), eastl::max(image.height >> level, 1u));
+
+        return size == image.dataSize;
+    }
+
+    bool loadScene(Renderer &renderer, Scene &scene, std::filesystem::path file, gltf::LoadProgressCallback progressCallback)
+    {
+        ZoneScoped;
+
+        Timer timer;
+        timer.start();
+
+        if (progressCallback)
+            progressCallback(0.0f);
+
+        filesystem::MappedFile mappedFile;
+        if (!filesystem::mapFile(mappedFile, file))
+            return false;
+
+        const Header &header = *reinterpret_cast<const Header *>(mappedFile.data);
+
+        bool valid = mappedFile.size >= sizeof(Header) && header.magic == MAGIC && header.version == VERSION &&
+                     validSection(mappedFile, header.verticesOffset, header.vertexCount, sizeof(Vertex)) &&
+                     validSection(mappedFile, header.indicesOffset, header.indexCount, sizeof(uint32_t)) &&
+                     validSection(mappedFile, header.materialsOffset, header.materialCount, sizeof(Material)) &&
+                     validSection(mappedFile, header.primitivesOffset, header.primitiveCount, sizeof(Primitive)) &&
+                     validSection(mappedFile, header.nodesOffset, header.nodeCount, sizeof(Node)) &&
+                     validSection(mappedFile, header.meshesOffset, header.meshCount, sizeof(MeshRange)) &&
+                     validSection(mappedFile, header.imagesOffset, header.imageCount, sizeof(Image)) &&
+                     validSection(mappedFile, header.meshletsOffset, header.meshletCount, sizeof(Meshlet)) &&
+                     validSection(mappedFile, header.lodsOffset, header.lodCount, sizeof(MeshLod)) &&
+                     validNodes(reinterpret_cast<const Node *>(mappedFile.data + header.nodesOffset), header.nodeCount, scene.skins.size()) &&
+                     validPrimitives(reinterpret_cast<const Primitive *>(mappedFile.data + header.primitivesOffset), header);
+
+        if (!valid) {
+            logger::logError("Invalid or outdated scene pack - ", file);
+            filesystem::unmapFile(mappedFile);
+            return false;
+        }
+
+        const Vertex *vertices = reinterpret_cast<const Vertex *>(mappedFile.data + header.verticesOffset);
+        const uint32_t *indices = reinterpret_cast<const uint32_t *>(mappedFile.data + header.indicesOffset);
+        const Material *materials = reinterpret_cast<const Material *>(mappedFile.data + header.materialsOffset);
+        const Node *nodes = reinterpret_cast<const Node *>(mappedFile.data + header.nodesOffset);
+        const MeshRange *meshes = reinterpret_cast<const MeshRange *>(mappedFile.data + header.meshesOffset);
+        const Image *images = reinterpret_cast<const Image *>(mappedFile.data + header.imagesOffset);
+        const Meshlet *meshlets = reinterpret_cast<const Meshlet *>(mappedFile.data + header.meshletsOffset);
+        const MeshLod *lods = reinterpret_cast<const MeshLod *>(mappedFile.data + header.lodsOffset);
+
+        // pack is relative to itself, rebase on top of what is already loaded
+        const uint32_t vertexOffset = renderer.vertices.size();
+        const uint32_t indexOffset = renderer.indices.size();
+        const uint32_t meshletOffset = renderer.meshlets.size();
+        const uint32_t lodOffset = renderer.lods.size();
+        const int materialOffset = renderer.materials.size();
+        const int textureOffset = renderer.images.size();
+
+        renderer.vertices.insert(renderer.vertices.end(), vertices, vertices + header.vertexCount);
+        renderer.indices.insert(renderer.indices.end(), indices, indices + header.indexCount);
+        renderer.meshlets.insert(renderer.meshlets.end(), meshlets, meshlets + header.meshletCount);
+        renderer.lods.insert(renderer.lods.end(), lods, lods + header.lodCount);
+
+        for (uint32_t i = 0; i < header.materialCount; i++) {
+            Material material = materials[i];
+            for (int *id : {&material.baseColorId, &material.metallicRoughnessId, &material.normalId, &material.emissiveId}) {
+                if (*id >= 0)
+                    *id += textureOffset;
+            }
+
+            renderer.materials.push_back(material);
+        }
+
+        eastl::vector<Primitive> primitives(header.primitiveCount);
+        memcpy(primitives.data(), mappedFile.data + header.primitivesOffset, header.primitiveCount * sizeof(Primitive));
+        for (Primitive &primitive : primitives) {
+            primitive.vertexOffset += vertexOffset;
+            primitive.indexOffset += indexOffset;
+            primitive.meshletOffset += meshletOffset;
+            primitive.lodOffset += lodOffset;
+            if (primitive.materialIndex >= 0)
+                primitive.materialIndex += materialOffset;
+        }
+
+        scene.name = file.stem().c_str();
+
+        scene.meshes.resize(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            const MeshRange &range = meshes[i];
+            if (uint64_t(range.firstPrimitive) + range.primitiveCount > header.primitiveCount)
+                continue;
+
+            scene.meshes[i].primitives.assign(primitives.begin() + range.firstPrimitive, primitives.begin() + range.firstPrimitive + range.primitiveCount);
+        }
+
+        for (uint32_t i = 0; i < header.nodeCount; i++) {
+            const Node &packNode = nodes[i];
+
+            // parents and skins were validated with the header
+            uint32_t node = scene.addNode(packNode.parentIndex, packNode.transform, packNode.name);
+
+            scene.skinIndices[node] = packNode.skinIndex;
+            scene.meshIndices[node] = packNode.meshIndex < int32_t(header.meshCount) ? packNode.meshIndex : -1;
+        }
+
+        // mip chains are copied from the mapping straight into staging memory
+        Graphics &graphics = renderer.getGraphics();
+        renderer.images.resize(textureOffset + header.imageCount);
+        size_t textureBytes = 0;
+
+        const uint32_t maxDimension = graphics.getDevicePropertices().limits.maxImageDimension2D;
+
+        for (uint32_t i = 0; i < header.imageCount; i++) {
+            const Image &image = images[i];
+
+            if (validImage(mappedFile, image, maxDimension)) {
+                vulkan::ImageCreateInfo createInfo = {
+                    .width = image.width,
+                    .height = image.height,
+                    .format = static_cast<VkFormat>(image.format),
+                };
+
+                graphics.createImageFromMipChain(renderer.images[textureOffset + i], createInfo, image.mipLevels, mappedFile.data + image.dataOffset, image.dataSize);
+                textureBytes += image.dataSize;
+            } else {
+                // materials using it still get a texture to sample
+                logger::logError("Invalid image ", i, " in scene pack - ", file);
+
+                ImageData fallback;
+                createFallbackImageData(fallback);
+
+                vulkan::ImageCreateInfo createInfo = {
+                    .width = fallback.width,
+                    .height = fallback.height,
+                    .format = fallback.format,
+                };
+
+                graphics.createImageFromMipChain(renderer.images[textureOffset + i], createInfo, fallback.mipLevels, fallback.pixels.data(), fallback.pixels.size());
+            }
+
+            if (progressCallback)
+                progressCallback(float(i + 1) / header.imageCount);
+        }
+
+        graphics.getUploadManager().flush();
+        filesystem::unmapFile(mappedFile);
+
+        if (progressCallback)
+            progressCallback(1.0f);
+
+        logger::logInfo("Loaded ", header.imageCount, " textures, ", textureBytes / (1024 * 1024), " MB");
+        logger::logInfo("Loaded scene pack ", scene.name.c_str(), " in ", timer.elapsedMilliseconds(), " ms, peak memory usage ", memory::getPeakMemoryUsage() / (1024 * 1024), " MB");
+
+        return true;
+    }
+} // namespace scene_pack
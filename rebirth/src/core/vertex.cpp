@@ -0,0 +1,51 @@
+#include <rebirth/core/vertex.h>
+
+#include <meshoptimizer.h>
+
+static uint32_t packSnorm16x2(vec2 value)
+{
+    return uint32_t(uint16_t(meshopt_quantizeSnorm(value.x, 16))) | uint32_t(uint16_t(meshopt_quantizeSnorm(value.y, 16))) << 16;
+}
+
+static vec2 encodeOctahedral(vec3 normal)
+{
+    normal /= glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+
+    // lower hemisphere is folded over the diagonals
+    vec2 encoded = vec2(normal);
+    if (normal.z < 0.0f)
+        encoded = (1.0f - glm::abs(vec2(encoded.y, encoded.x))) * vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+
+    return encoded;
+}
+
+PackedVertex packVertex(const Vertex &vertex)
+{
+    PackedVertex packed = {
+        .position = vertex.position,
+        .uv = uint32_t(meshopt_quantizeHalf(vertex.uv_x)) | uint32_t(meshopt_quantizeHalf(vertex.uv_y)) << 16,
+    };
+
+    if (vertex.normal != vec3(0.0f))
+        packed.normal = packSnorm16x2(encodeOctahedral(vertex.normal));
+
+    if (vertex.tangent != vec4(0.0f)) {
+        uint32_t handedness = vertex.tangent.w < 0.0f ? 0x3 : 0x1; // -1 or 1 as 2 bit snorm
+
+        packed.tangent = (uint32_t(meshopt_quantizeSnorm(vertex.tangent.x, 10)) & 0x3ff) |
+                         (uint32_t(meshopt_quantizeSnorm(vertex.tangent.y, 10)) & 0x3ff) << 10 |
+                         (uint32_t(meshopt_quantizeSnorm(vertex.tangent.z, 10)) & 0x3ff) << 20 |
+                         handedness << 30;
+    }
+
+    // joint 255 is taken by the unused marker
+    for (int i = 0; i < 4; i++) {
+        uint32_t joint = vertex.jointIndices[i] < 0.0f ? 0xff : std::min(uint32_t(vertex.jointIndices[i]), 0xfeu);
+        packed.joints |= joint << (i * 8);
+
+        uint32_t weight = meshopt_quantizeUnorm(vertex.jointWeights[i], 16);
+        packed.weights[i / 2] |= weight << ((i % 2) * 16);
+    }
+
+    return packed;
+}
@@ -0,0 +1,284 @@
+#include <rebirth/graphics/image_data.h>
+
+#include <rebirth/util/filesystem.h>
+#include <rebirth/util/logger.h>
+
+#include <stb_image.h>
+#include <tracy/Tracy.hpp>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+static void setBaseLevel(ImageData &imageData, unsigned char *pixels, int width, int height)
+{
+    imageData.width = width;
+    imageData.height = height;
+    imageData.mipLevels = 1;
+    imageData.format = VK_FORMAT_R8G8B8A8_SRGB;
+    imageData.pixels.assign(pixels, pixels + size_t(width) * height * STBI_rgb_alpha);
+
+    stbi_image_free(pixels);
+}
+
+static float srgbToLinear(unsigned char value)
+{
+    static const eastl::vector<float> table = []() {
+        eastl::vector<float> table(256);
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+
+    return table[value];
+}
+
+static unsigned char linearToSrgb(float value)
+{
+    float c = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+size_t ImageData::getMipOffset(uint32_t level) const
+{
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; i++)
+        offset += getMipSize(format, getMipWidth(i), getMipHeight(i));
+
+    return offset;
+}
+
+uint32_t getBlockSize(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            return 8;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+size_t getMipSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    uint32_t blockSize = getBlockSize(format);
+    if (blockSize == 0)
+        return size_t(width) * height * STBI_rgb_alpha;
+
+    // partial blocks at the edges are stored as whole blocks
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+bool loadImageData(ImageData &imageData, std::filesystem::path path)
+{
+    ZoneScoped;
+
+    int width, height, channels;
+    unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        logger::logError("Failed to load texture: ", path);
+        return false;
+    }
+
+    setBaseLevel(imageData, pixels, width, height);
+    return true;
+}
+
+bool loadImageData(ImageData &imageData, const unsigned char *data, size_t size)
+{
+    ZoneScoped;
+
+    int width, height, channels;
+    unsigned char *pixels = stbi_load_from_memory(data, size, &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        logger::logError("Failed to load texture from memory");
+        return false;
+    }
+
+    setBaseLevel(imageData, pixels, width, height);
+    return true;
+}
+
+void createFallbackImageData(ImageData &imageData)
+{
+    // 1x1 magenta, stands out and keeps texture indices valid
+    imageData.width = 1;
+    imageData.height = 1;
+    imageData.mipLevels = 1;
+    imageData.format = VK_FORMAT_R8G8B8A8_SRGB;
+    imageData.pixels = {255, 0, 255, 255};
+}
+
+//
+// KTX2
+//
+static const unsigned char KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct Ktx2Header
+{
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+
+    // index
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct Ktx2Level
+{
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+static bool isSupportedKtx2Format(VkFormat format)
+{
+    return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB || getBlockSize(format) > 0;
+}
+
+bool isKtx2(const unsigned char *data, size_t size)
+{
+    return size >= sizeof(KTX2_IDENTIFIER) && memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+}
+
+bool loadKtx2ImageData(ImageData &imageData, std::filesystem::path path)
+{
+    filesystem::MappedFile file;
+    if (!filesystem::mapFile(file, path))
+        return false;
+
+    bool loaded = loadKtx2ImageData(imageData, file.data, file.size);
+    filesystem::unmapFile(file);
+
+    if (!loaded)
+        logger::logError("Failed to load texture: ", path);
+
+    return loaded;
+}
+
+bool loadKtx2ImageData(ImageData &imageData, const unsigned char *data, size_t size)
+{
+    ZoneScoped;
+
+    if (!isKtx2(data, size) || size < sizeof(Ktx2Header)) {
+        logger::logError("Not a ktx2 file");
+        return false;
+    }
+
+    Ktx2Header header;
+    memcpy(&header, data, sizeof(Ktx2Header));
+
+    // basisu files have an undefined format and have to be transcoded first
+    if (header.supercompressionScheme != 0 || header.vkFormat == VK_FORMAT_UNDEFINED) {
+        logger::logWarn("Supercompressed (Basis Universal) ktx2 textures are not supported");
+        return false;
+    }
+
+    VkFormat format = static_cast<VkFormat>(header.vkFormat);
+    if (!isSupportedKtx2Format(format) || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.pixelWidth == 0 || header.pixelHeight == 0) {
+        logger::logError("Unsupported ktx2 texture, only 2d rgba8 and bc formats are supported");
+        return false;
+    }
+
+    // zero means the loader should generate the mips
+    uint32_t levelCount = std::max(header.levelCount, 1u);
+    if (size < sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level)) {
+        logger::logError("Truncated ktx2 file");
+        return false;
+    }
+
+    imageData.width = header.pixelWidth;
+    imageData.height = header.pixelHeight;
+    imageData.mipLevels = levelCount;
+    imageData.format = format;
+    imageData.pixels.resize(imageData.getMipOffset(levelCount));
+
+    // levels in the file are stored smallest first, the index is in level order
+    for (uint32_t level = 0; level < levelCount; level++) {
+        Ktx2Level levelIndex;
+        memcpy(&levelIndex, data + sizeof(Ktx2Header) + level * sizeof(Ktx2Level), sizeof(Ktx2Level));
+
+        size_t mipSize = getMipSize(format, imageData.getMipWidth(level), imageData.getMipHeight(level));
+        if (levelIndex.byteLength != mipSize || levelIndex.byteOffset > size || mipSize > size - levelIndex.byteOffset) {
+            logger::logError("Invalid ktx2 level ", level);
+            return false;
+        }
+
+        memcpy(imageData.pixels.data() + imageData.getMipOffset(level), data + levelIndex.byteOffset, mipSize);
+    }
+
+    return true;
+}
+
+void generateMipChain(ImageData &imageData, bool srgb)
+{
+    ZoneScoped;
+
+    assert(getBlockSize(imageData.format) == 0);
+
+    // same count as createImage() with generateMipmaps
+    imageData.mipLevels = static_cast<uint32_t>(floor(log2(std::max(imageData.width, imageData.height)))) + 1;
+    imageData.pixels.resize(imageData.getMipOffset(imageData.mipLevels));
+
+    for (uint32_t level = 1; level < imageData.mipLevels; level++) {
+        const unsigned char *src = imageData.pixels.data() + imageData.getMipOffset(level - 1);
+        unsigned char *dst = imageData.pixels.data() + imageData.getMipOffset(level);
+
+        uint32_t srcWidth = imageData.getMipWidth(level - 1);
+        uint32_t srcHeight = imageData.getMipHeight(level - 1);
+        uint32_t dstWidth = imageData.getMipWidth(level);
+        uint32_t dstHeight = imageData.getMipHeight(level);
+
+        for (uint32_t y = 0; y < dstHeight; y++) {
+            // odd sizes clamp the last row/column
+            uint32_t y0 = std::min(y * 2, srcHeight - 1);
+            uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+
+            for (uint32_t x = 0; x < dstWidth; x++) {
+                uint32_t x0 = std::min(x * 2, srcWidth - 1);
+                uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+
+                const unsigned char *texels[4] = {
+                    src + (size_t(y0) * srcWidth + x0) * STBI_rgb_alpha,
+                    src + (size_t(y0) * srcWidth + x1) * STBI_rgb_alpha,
+                    src + (size_t(y1) * srcWidth + x0) * STBI_rgb_alpha,
+                    src + (size_t(y1) * srcWidth + x1) * STBI_rgb_alpha,
+                };
+
+                unsigned char *out = dst + (size_t(y) * dstWidth + x) * STBI_rgb_alpha;
+
+                for (int c = 0; c < STBI_rgb_alpha; c++) {
+                    if (srgb && c < 3) {
+                        float sum = srgbToLinear(texels[0][c]) + srgbToLinear(texels[1][c]) + srgbToLinear(texels[2][c]) + srgbToLinear(texels[3][c]);
+                        out[c] = linearToSrgb(sum * 0.25f);
+                    } else {
+                        out[c] = (texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -8,13 +8,20 @@
 
 #include <rebirth/math/frustum_culling.h>
 #include <rebirth/util/logger.h>
+#include <rebirth/util/timer.h>
 
 #include <rebirth/core/scene.h>
 #include <rebirth/core/scene_draw_data.h>
 #include <rebirth/core/cvar_system.h>
+#include <rebirth/core/draw_sort.h>
+#include <rebirth/core/job_system.h>
 
 #include <rebirth/graphics/primitives.h>
 
+#include <EASTL/algorithm.h>
+
+#include <atomic>
+
 #include <tracy/Tracy.hpp>
 #include <tracy/TracyVulkan.hpp>
 
@@ -28,10 +35,24 @@ void Renderer::initialize(SDL_Window *window)
     // set cvars
     CVarSystem::instance()->setCVarInt("render_wireframe", 0);
     CVarSystem::instance()->setCVarInt("render_shadows", 0);
+    CVarSystem::instance()->setCVarFloat("render_shadow_distance", 100.0f);    // the last cascade ends here
+    CVarSystem::instance()->setCVarFloat("render_shadow_split_lambda", 0.75f); // 0 - uniform cascade splits, 1 - logarithmic
+    CVarSystem::instance()->setCVarFloat("render_light_distance", 200.0f); // point and spot lights are shaded up to here
+    CVarSystem::instance()->setCVarInt("render_depth_prepass", 1); // depth only pass first, the mesh pass shades each pixel once
+    CVarSystem::instance()->setCVarInt("render_visibility_buffer", 0); // triangle ids first, materials resolved per pixel afterwards
     CVarSystem::instance()->setCVarInt("render_skybox", 1);
     CVarSystem::instance()->setCVarInt("render_imgui", 1);
+    CVarSystem::instance()->setCVarInt("render_frustum_culling", 1);
+    CVarSystem::instance()->setCVarInt("render_occlusion_culling", 1);
+    CVarSystem::instance()->setCVarInt("render_cone_culling", 1);
+    CVarSystem::instance()->setCVarInt("render_lod", 1);
+    CVarSystem::instance()->setCVarFloat("render_lod_threshold", 1.0f); // pixels of screen space error
+    CVarSystem::instance()->setCVarInt("render_freeze_culling", 0);
+    CVarSystem::instance()->setCVarInt("render_parallel_recording", 1); // large passes recorded on the job system workers
+    CVarSystem::instance()->setCVarInt("render_async_compute", 1);      // culling, skinning and the depth pyramid overlap graphics
 
     graphics.initialize(window);
+    renderGraph.initialize(graphics);
 
     // query
     queryPool = graphics.createQueryPool(VK_QUERY_TYPE_TIMESTAMP, timestamps.size());
@@ -52,6 +73,12 @@ void Renderer::shutdown()
     vkDestroyQueryPool(device, queryPool, nullptr);
 
     destroyPipelines();
+    destroyDepthPyramid();
+    destroyVisibilityImage();
+    renderGraph.destroy();
+
+    for (VkImageView view : shadowCascadeViews)
+        vkDestroyImageView(device, view, nullptr);
 
     for (Image &image : images)
         graphics.destroyImage(image);
@@ -63,63 +90,266 @@ void Renderer::shutdown()
     graphics.destroyBuffer(vertexBuffer);
     graphics.destroyBuffer(indexBuffer);
     graphics.destroyBuffer(jointMatricesBuffer);
+    graphics.destroyBuffer(skinJobsBuffer);
+
+    graphics.destroyBuffer(drawDataBuffer);
+    graphics.destroyBuffer(drawOrderBuffer);
+    graphics.destroyBuffer(shadowCommandsBuffer);
+    graphics.destroyBuffer(visibleDrawCommandsBuffer);
+    graphics.destroyBuffer(drawCountsBuffer);
+    graphics.destroyBuffer(cullDataBuffer);
+
+    graphics.destroyBuffer(meshletBuffer);
+    graphics.destroyBuffer(clusterTasksBuffer);
+    graphics.destroyBuffer(clusterDispatchBuffer);
+    graphics.destroyBuffer(lodsBuffer);
+    graphics.destroyBuffer(lightGridBuffer);
 
     graphics.destroy();
 }
 
-void Renderer::drawScene(Scene &scene, mat4 transform)
+uint32_t Renderer::allocateRange(eastl::vector<Range> &freeRanges, uint32_t &usedCount, uint32_t count, uint32_t capacity)
 {
-    ZoneScoped;
+    // reuse the range of a removed instance if one fits
+    for (size_t i = 0; i < freeRanges.size(); i++) {
+        Range &range = freeRanges[i];
+        if (range.count < count)
+            continue;
+
+        const uint32_t first = range.first;
+        range.first += count;
+        range.count -= count;
+        if (range.count == 0)
+            freeRanges.erase_unsorted(freeRanges.begin() + i);
+
+        return first;
+    }
+
+    if (usedCount + count > capacity)
+        return UINT32_MAX;
+
+    const uint32_t first = usedCount;
+    usedCount += count;
+    return first;
+}
+
+uint32_t Renderer::addInstance(const Mesh &mesh, const mat4 &transform, bool dynamic, uint32_t jointCount)
+{
+    const uint32_t drawCount = mesh.primitives.size();
+
+    uint32_t vertexCount = 0;
+    if (jointCount > 0) {
+        for (const Primitive &primitive : mesh.primitives)
+            vertexCount += primitive.vertexCount;
+
+        if (skinJobCount + drawCount > MAX_SKIN_JOBS) {
+            logger::logWarn("Exceeded max skin jobs count - ", MAX_SKIN_JOBS);
+            return INVALID_INSTANCE;
+        }
+    }
 
-    std::function<void(SceneNode &)> nodeDraw = [&](SceneNode &node) {
-        drawMesh(node.mesh, transform * scene.getNodeWorldMatrix(&node));
+    const uint32_t firstDraw = allocateRange(freeDrawRanges, drawCommandCount, drawCount, MAX_INDIRECT_COMMANDS);
+    if (firstDraw == UINT32_MAX) {
+        logger::logWarn("Exceeded max indirect commands count - ", MAX_INDIRECT_COMMANDS);
+        return INVALID_INSTANCE;
+    }
+
+    uint32_t jointOffset = 0;
+    uint32_t skinnedVertexOffset = 0;
+    if (jointCount > 0) {
+        jointOffset = allocateRange(freeJointRanges, jointMatrixCount, jointCount, MAX_JOINT_MATRICES);
+        skinnedVertexOffset = allocateRange(freeSkinnedVertexRanges, skinnedVertexCount, vertexCount, MAX_SKINNED_VERTICES);
+
+        if (jointOffset == UINT32_MAX || skinnedVertexOffset == UINT32_MAX) {
+            logger::logWarn("Exceeded max joint matrices (", MAX_JOINT_MATRICES, ") or skinned vertices (", MAX_SKINNED_VERTICES, ") count");
+
+            freeDrawRanges.push_back(Range{firstDraw, drawCount});
+            if (jointOffset != UINT32_MAX)
+                freeJointRanges.push_back(Range{jointOffset, jointCount});
+            if (skinnedVertexOffset != UINT32_MAX)
+                freeSkinnedVertexRanges.push_back(Range{skinnedVertexOffset, vertexCount});
 
-        for (auto &child : node.children) {
-            nodeDraw(child);
+            return INVALID_INSTANCE;
         }
+
+        // bind pose until the first updateInstanceJoints
+        jointMatrices.resize(jointMatrixCount);
+        eastl::fill(jointMatrices.begin() + jointOffset, jointMatrices.begin() + jointOffset + jointCount, mat4(1.0f));
+        skinJobCount += drawCount;
+    }
+
+    uint32_t id;
+    if (!freeInstances.empty()) {
+        id = freeInstances.back();
+        freeInstances.pop_back();
+    } else {
+        id = instances.size();
+        instances.push_back();
+    }
+
+    instances[id] = MeshInstance{
+        .mesh = &mesh,
+        .transform = transform,
+        .firstDraw = firstDraw,
+        .drawCount = drawCount,
+        .dynamic = dynamic,
+        .jointOffset = jointOffset,
+        .jointCount = jointCount,
+        .skinnedVertexOffset = skinnedVertexOffset,
+        .skinnedVertexCount = vertexCount,
     };
+    markInstanceDirty(id);
+    addShadowCasterChanges(instances[id]);
+
+    if (jointCount > 0)
+        skinnedInstances.push_back(id);
+
+    instanceCount++;
+    return id;
+}
+
+void Renderer::updateInstance(uint32_t id, const mat4 &transform)
+{
+    if (id >= instances.size() || !instances[id].mesh)
+        return;
+
+    MeshInstance &instance = instances[id];
+    if (!instance.dynamic) {
+        // a moving entity would warn every frame
+        if (!instance.movedWarned)
+            logger::logWarn("Static instance ", id, " can't be moved");
 
-    for (auto &node : scene.nodes) {
-        nodeDraw(node);
+        instance.movedWarned = true;
+        return;
+    }
+
+    // the shadows leave the old place too
+    addShadowCasterChanges(instance);
+    instance.transform = transform;
+    addShadowCasterChanges(instance);
+
+    markInstanceDirty(id);
+}
+
+void Renderer::updateInstanceJoints(uint32_t id, const eastl::vector<mat4> &jointMatrices)
+{
+    if (id >= instances.size() || !instances[id].mesh)
+        return;
+
+    const MeshInstance &instance = instances[id];
+    const size_t count = eastl::min<size_t>(instance.jointCount, jointMatrices.size());
+    eastl::copy(jointMatrices.begin(), jointMatrices.begin() + count, this->jointMatrices.begin() + instance.jointOffset);
+}
+
+void Renderer::removeInstance(uint32_t id)
+{
+    if (id >= instances.size() || !instances[id].mesh)
+        return;
+
+    // its draws are cleared in every frame in flight before the range and the id are reused
+    addShadowCasterChanges(instances[id]);
+    instances[id].mesh = nullptr;
+    markInstanceDirty(id);
+
+    if (instances[id].jointCount > 0) {
+        skinnedInstances.erase(eastl::find(skinnedInstances.begin(), skinnedInstances.end(), id));
+        skinJobCount -= instances[id].drawCount;
     }
+
+    instanceCount--;
 }
 
-void Renderer::drawMesh(Mesh &mesh, mat4 transform)
+void Renderer::addScene(const Scene &scene, mat4 transform, bool dynamic, eastl::vector<uint32_t> *instanceIds)
 {
     ZoneScoped;
 
-    meshDraws.push_back(
-        MeshDraw{
-            .mesh = mesh,
-            .transform = transform,
-            // .boundingSphere = math::calculateBoundingSphere(mesh, vertices, indices),
-        });
+    for (uint32_t node = 0; node < scene.getNodeCount(); node++) {
+        const int meshIndex = scene.meshIndices[node];
+        if (meshIndex < 0 || scene.meshes[meshIndex].primitives.empty())
+            continue;
+
+        uint32_t id = addInstance(scene.meshes[meshIndex], transform * scene.worldTransforms[node], dynamic);
+        if (instanceIds)
+            instanceIds->push_back(id);
+    }
 }
 
-void Renderer::updateDynamicData(Camera &camera)
+void Renderer::syncWorld(ecs::World &world)
 {
     ZoneScoped;
 
-    for (auto &light : lights) {
-        if (light.type == LightType::Point) {
-            mat4 projection = math::perspective(glm::radians(45.0f), 1.0f, 1.0f, 100.0f);
-            mat4 view = glm::lookAt(light.position, vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
-            mat4 mvp = projection * view;
-            light.mvp = mvp;
-        } else if (light.type == LightType::Directional) {
-            // mat4 projection = glm::ortho(0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 100.0f);
-            mat4 projection = math::perspectiveInf(glm::radians(45.0f), 1.0f, 1.0f);
-            mat4 view = glm::lookAt(vec3(-4, 100, -4), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
-            mat4 mvp = projection * view;
-            light.mvp = mvp;
+    world.each<ecs::Transform, ecs::MeshRenderer>([&](ecs::Entity entity, ecs::Transform &transform, ecs::MeshRenderer &meshRenderer) {
+        if (!meshRenderer.mesh)
+            return;
+
+        if (meshRenderer.instance == INVALID_INSTANCE) {
+            const ecs::Skin *skin = world.getComponent<ecs::Skin>(entity);
+            const uint32_t jointCount = skin ? skin->joints.size() : 0;
+
+            meshRenderer.instance = addInstance(*meshRenderer.mesh, transform.matrix, meshRenderer.dynamic, jointCount);
+            meshRenderer.transformVersion = transform.version;
+        } else if (meshRenderer.transformVersion != transform.version) {
+            updateInstance(meshRenderer.instance, transform.matrix);
+            meshRenderer.transformVersion = transform.version;
         }
-    }
-    memcpy(lightsBuffer.info.pMappedData, lights.data(), lightsBuffer.size);
+    });
+
+    world.each<ecs::MeshRenderer, ecs::Skin>([&](ecs::Entity, ecs::MeshRenderer &meshRenderer, ecs::Skin &skin) {
+        if (meshRenderer.instance != INVALID_INSTANCE)
+            updateInstanceJoints(meshRenderer.instance, skin.jointMatrices);
+    });
+
+    // directional lights first, they aren't binned into the light clusters
+    lights.clear();
+    directionalLightCount = 0;
+    world.each<ecs::Transform, ecs::Light>([&](ecs::Entity, ecs::Transform &transform, ecs::Light &light) {
+        if (lights.size() >= size_t(MAX_LIGHTS))
+            return;
+
+        const Light gpuLight = {
+            .position = transform.position,
+            .type = light.type,
+            .color = light.color,
+            .cutOff = light.cutOff,
+            .direction = transform.rotation * vec3(0.0f, 0.0f, -1.0f),
+            .range = light.range,
+        };
+
+        if (light.type == LightType::Directional)
+            lights.insert(lights.begin() + directionalLightCount++, gpuLight);
+        else
+            lights.push_back(gpuLight);
+    });
+}
+
+void Renderer::markInstanceDirty(uint32_t id)
+{
+    MeshInstance &instance = instances[id];
+    if (instance.dirtyFrames == 0)
+        dirtyInstances.push_back(id);
+
+    instance.dirtyFrames = FRAMES_IN_FLIGHT;
+}
+
+void Renderer::updateDynamicData(Camera &camera)
+{
+    ZoneScoped;
+
+    updateShadowCascades(camera);
+
+    lightGridNear = camera.near;
+    lightGridFar = eastl::max(*CVarSystem::instance()->getCVarFloat("render_light_distance"), camera.near * 2.0f);
 
     sceneData.projection = camera.projection;
     sceneData.view = camera.view;
     sceneData.cameraPosAndLightNum = vec4(camera.position, lights.size());
-    sceneData.shadowMapIndex = shadowMapIndex;
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        sceneData.cascadeViewProjections[i] = shadowCascades[i].viewProjection;
+        sceneData.cascadeSplits[i] = shadowCascades[i].splitDepth;
+    }
+    sceneData.shadowMapIndex = shadowLightIndex >= 0 ? shadowMapIndex : -1; // not written otherwise
+    sceneData.shadowLightIndex = shadowLightIndex;
+    sceneData.directionalLightCount = directionalLightCount;
     memcpy(sceneDataBuffer.info.pMappedData, &sceneData, sizeof(sceneData));
 }
 
@@ -132,15 +362,48 @@ void Renderer::present(Camera &camera)
         prepared = true;
     }
 
-    timestampDeltaMs = getTimestampDeltaMs();
+    // skinned instances were added past the skinned regions, the vertex buffer is recreated with larger ones
+    if (skinnedVertexCount > skinnedVertexCapacity) {
+        vkDeviceWaitIdle(graphics.getDevice());
 
-    // TODO: create and update global joints buffer
-    updateDynamicData(camera);
+        graphics.destroyBuffer(vertexBuffer);
+        createVertexBuffer();
+        updateDescriptorSet();
+
+        // draw data of the other frames in flight points into the old regions
+        for (uint32_t id : skinnedInstances)
+            markInstanceDirty(id);
+    }
+
+    // Swapchain was recreated (also without a size change), the depth pyramid and the visibility buffer have to match
+    // the new depth image. The visibility buffer is also created and destroyed when its mode is toggled.
+    const bool resized = graphics.getSwapchainGeneration() != swapchainGeneration;
+    const bool visibilityBuffer = *CVarSystem::instance()->getCVarInt("render_visibility_buffer");
+    if (resized || visibilityBuffer != (visibilityImage.image != VK_NULL_HANDLE)) {
+        vkDeviceWaitIdle(graphics.getDevice());
+
+        if (resized) {
+            destroyDepthPyramid();
+            createDepthPyramid();
+        }
 
-    opaqueDraws.reserve(meshDraws.size());
+        destroyVisibilityImage();
+        if (visibilityBuffer)
+            createVisibilityImage();
 
-    cullMeshDraws(camera.projection * camera.view);
-    sortMeshDraws(camera.position);
+        updateDescriptorSet();
+
+        // the depth image and the pyramid are new images, their handles can be the ones of the old images
+        renderGraph.forgetImportedStates();
+
+        // the shadow map loses its state too, its layers are rendered again
+        for (ShadowCascade &cascade : shadowCascades)
+            cascade.valid = false;
+    }
+
+    timestampDeltaMs = getTimestampDeltaMs();
+
+    updateDynamicData(camera);
 
     //
     // Create and begin command buffer
@@ -151,6 +414,16 @@ void Renderer::present(Camera &camera)
         return;
     }
 
+    updateReloadedPipelines();
+
+    // frame resources are free to be written after the frame is waited on
+    updateLightData();
+    updateDrawData();
+    updateSkinningData();
+    updateDrawOrder(camera);
+    updateCullData(camera);
+    cullShadowCasters();
+
     bool supportTimestamps = graphics.supportTimestamps();
 
     if (supportTimestamps) {
@@ -160,68 +433,202 @@ void Renderer::present(Camera &camera)
         graphics.writeTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
     }
 
-    vulkan::Swapchain &swapchain = graphics.getSwapchain();
-    const VkImage &swapchainImage = swapchain.getImage();
-
     //
     // Render passes start
     //
+    buildRenderGraph();
+    renderGraph.compile();
+
+    // the passes can be split over several command buffers, the last one is submitted here
+    const VkCommandBuffer lastCmd = renderGraph.execute(cmd);
+
+    if (!*CVarSystem::instance()->getCVarInt("render_freeze_culling")) {
+        // the next frame tests occlusion from this viewpoint
+        cullData.occlusionView = camera.view;
+        cullData.P00 = camera.projection[0][0];
+        cullData.P11 = camera.projection[1][1];
+        cullData.znear = camera.near;
+        depthPyramidValid = true;
+    }
+
+    //
+    // Render passes end
+    //
+
+    if (supportTimestamps) {
+        // write end timestamp
+        graphics.writeTimestamp(lastCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 1);
+    }
+
+    TracyVkCollect(graphics.getTracyContext(), lastCmd);
+
+    // Submit
+    graphics.submitCommandBuffer(lastCmd, renderGraph.getFinalWaits());
+
+    if (supportTimestamps) {
+        // get timestamp result
+        vkGetQueryPoolResults(graphics.getDevice(), queryPool, 0, timestamps.size(), timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    }
+
+    debugDrawVertices.clear();
+    drawCount = 0;
+}
+
+void Renderer::buildRenderGraph()
+{
+    ZoneScoped;
 
-    // transfer swapchain image to color attachment
-    VkImageMemoryBarrier swapchainBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = swapchainImage,
-        .subresourceRange = vulkan::colorSubresource};
-
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &swapchainBarrier);
-
-    if (indexBuffer.buffer)
-        vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    Swapchain &swapchain = graphics.getSwapchain();
+    const VkExtent2D extent = swapchain.getExtent();
+    const bool renderShadows = shadowLightIndex >= 0;
+    const QueueType computeQueue = *CVarSystem::instance()->getCVarInt("render_async_compute") ? QueueType::AsyncCompute : QueueType::Graphics;
+
+    renderGraph.reset();
 
     //
-    // Clear Pass
+    // Resources
     //
-    {
-        ZoneScopedN("Clear Pass");
-        TracyVkZone(graphics.getTracyContext(), cmd, "Clear Pass");
+    const uint32_t swapchainImage = renderGraph.importSwapchainImage(swapchain.getImage(), swapchain.getImageView());
+    const uint32_t depthImage = renderGraph.importImage("Depth image", graphics.getDepthImage().image, VK_IMAGE_ASPECT_DEPTH_BIT);
+    const uint32_t shadowMap = renderGraph.importImage("Shadow map", images[shadowMapIndex].image, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+    // tested by the culling of the next frame
+    const uint32_t depthPyramid = renderGraph.importImage("Depth pyramid", images[depthPyramidIndex].image, VK_IMAGE_ASPECT_COLOR_BIT);
+    renderGraph.markOutput(depthPyramid);
+
+    const uint32_t colorImage = renderGraph.createImage("Color image multisample", {
+        .width = extent.width,
+        .height = extent.height,
+        .format = swapchain.getSurfaceFormat().format,
+        .samples = graphics.getSampleCount(),
+    });
+
+    // visible counts are read back for the stats
+    const uint32_t vertices = renderGraph.importBuffer("Vertices", vertexBuffer.buffer);
+    const uint32_t visibleDrawCommands = renderGraph.importBuffer("Visible draw commands", visibleDrawCommandsBuffer.buffer);
+    const uint32_t drawCounts = renderGraph.importBuffer("Draw counts", drawCountsBuffer.buffer, RenderGraphAccess::HostRead);
+    const uint32_t clusterTasks = renderGraph.importBuffer("Cluster tasks", clusterTasksBuffer.buffer);
+    const uint32_t clusterDispatch = renderGraph.importBuffer("Cluster dispatch", clusterDispatchBuffer.buffer);
+    const uint32_t lightGrid = renderGraph.importBuffer("Light grid", lightGridBuffer.buffer);
 
-        clearPass(cmd);
+    //
+    // Skinning Pass
+    //
+    if (skinJobCount > 0) {
+        const uint32_t pass = renderGraph.addPass("Skinning Pass", [this](VkCommandBuffer cmd) { skinningPass(cmd); }, computeQueue);
+        renderGraph.use(pass, vertices, RenderGraphAccess::ComputeShaderWrite);
     }
 
     //
     // Shadow Pass
     //
-    if (*CVarSystem::instance()->getCVarInt("render_shadows") && !opaqueDraws.empty()) {
-        ZoneScopedN("Shadow Pass");
-        TracyVkZone(graphics.getTracyContext(), cmd, "Shadow Pass");
+    // declared before culling, which it doesn't need, so it runs on the graphics queue while the culling is on async compute.
+    // Only the cascades that aren't cached are rendered, the others keep their layers.
+    uint32_t renderedCascadeCount = 0;
+    for (const ShadowCascade &cascade : shadowCascades)
+        renderedCascadeCount += cascade.render;
+
+    if (renderShadows && renderedCascadeCount > 0) {
+        const uint32_t pass = renderGraph.addPass("Shadow Pass", [this](VkCommandBuffer cmd) { shadowPass(cmd); });
+        renderGraph.use(pass, shadowMap, RenderGraphAccess::DepthAttachment, renderedCascadeCount == SHADOW_CASCADE_COUNT);
+        renderGraph.use(pass, vertices, RenderGraphAccess::VertexShaderRead);
+    }
+
+    //
+    // Cull Passes
+    //
+    if (drawCommandCount > 0) {
+        uint32_t pass = renderGraph.addPass("Cull Reset Pass", [this](VkCommandBuffer cmd) { cullResetPass(cmd); }, computeQueue);
+        renderGraph.use(pass, drawCounts, RenderGraphAccess::TransferWrite);
+        renderGraph.use(pass, clusterDispatch, RenderGraphAccess::TransferWrite);
+
+        pass = renderGraph.addPass("Cull Pass", [this](VkCommandBuffer cmd) { cullPass(cmd); }, computeQueue);
+        renderGraph.use(pass, depthPyramid, RenderGraphAccess::ComputeShaderReadGeneral);
+        renderGraph.use(pass, drawCounts, RenderGraphAccess::ComputeShaderWrite);
+        renderGraph.use(pass, visibleDrawCommands, RenderGraphAccess::ComputeShaderWrite);
+        renderGraph.use(pass, clusterTasks, RenderGraphAccess::ComputeShaderWrite);
+        renderGraph.use(pass, clusterDispatch, RenderGraphAccess::ComputeShaderWrite);
+
+        pass = renderGraph.addPass("Cluster Cull Pass", [this](VkCommandBuffer cmd) { clusterCullPass(cmd); }, computeQueue);
+        renderGraph.use(pass, depthPyramid, RenderGraphAccess::ComputeShaderReadGeneral);
+        renderGraph.use(pass, clusterDispatch, RenderGraphAccess::IndirectRead);
+        renderGraph.use(pass, clusterTasks, RenderGraphAccess::ComputeShaderRead);
+        renderGraph.use(pass, drawCounts, RenderGraphAccess::ComputeShaderWrite);
+        renderGraph.use(pass, visibleDrawCommands, RenderGraphAccess::ComputeShaderWrite);
+    }
+
+    //
+    // Light Cull Pass
+    //
+    if (drawCommandCount > 0) {
+        const uint32_t pass = renderGraph.addPass("Light Cull Pass", [this](VkCommandBuffer cmd) { lightCullPass(cmd); }, computeQueue);
+        renderGraph.use(pass, lightGrid, RenderGraphAccess::ComputeShaderWrite);
+    }
+
+    //
+    // Depth Prepass
+    //
+    // wireframe lines don't have the depth of the triangles, they are drawn without it
+    const bool wireframe = *CVarSystem::instance()->getCVarInt("render_wireframe");
+    visibilityBufferEnabled = drawCommandCount > 0 && *CVarSystem::instance()->getCVarInt("render_visibility_buffer") && !wireframe && visibilityImage.image != VK_NULL_HANDLE;
+    depthPrepassEnabled = drawCommandCount > 0 && *CVarSystem::instance()->getCVarInt("render_depth_prepass") && !wireframe && !visibilityBufferEnabled;
+
+    if (drawCommandCount > 0 && !wireframe && !visibilityBufferEnabled)
+        createMaterialPipelines(renderShadows);
+    if (depthPrepassEnabled) {
+        const uint32_t pass = renderGraph.addPass("Depth Prepass", [this](VkCommandBuffer cmd) { depthPrepass(cmd); });
+        renderGraph.use(pass, depthImage, RenderGraphAccess::DepthAttachment, true);
+        renderGraph.use(pass, vertices, RenderGraphAccess::VertexShaderRead);
+        renderGraph.use(pass, visibleDrawCommands, RenderGraphAccess::IndirectRead);
+        renderGraph.use(pass, drawCounts, RenderGraphAccess::IndirectRead);
+    }
 
-        shadowPass(cmd);
+    //
+    // Visibility Pass, Visibility Resolve Pass
+    //
+    // Triangles are rasterized without shading into a single sampled visibility buffer, the resolve shades every pixel
+    // once and writes the depth of its triangle, the passes after it see the same color and depth images as after the mesh pass.
+    if (visibilityBufferEnabled) {
+        const uint32_t visibility = renderGraph.importImage("Visibility image", visibilityImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+        const VkExtent2D extent = graphics.getSwapchain().getExtent();
+        const uint32_t visibilityDepth = renderGraph.createImage("Visibility depth", {extent.width, extent.height, VK_FORMAT_D32_SFLOAT});
+
+        uint32_t pass = renderGraph.addPass("Visibility Pass", [this, visibilityDepth](VkCommandBuffer cmd) { visibilityPass(cmd, renderGraph.getImageView(visibilityDepth)); });
+        renderGraph.use(pass, visibility, RenderGraphAccess::ColorAttachment, true);
+        renderGraph.use(pass, visibilityDepth, RenderGraphAccess::DepthAttachment, true);
+        renderGraph.use(pass, vertices, RenderGraphAccess::VertexShaderRead);
+        renderGraph.use(pass, visibleDrawCommands, RenderGraphAccess::IndirectRead);
+        renderGraph.use(pass, drawCounts, RenderGraphAccess::IndirectRead);
+
+        pass = renderGraph.addPass("Visibility Resolve Pass", [this, colorImage](VkCommandBuffer cmd) { visibilityResolvePass(cmd, renderGraph.getImageView(colorImage)); });
+        renderGraph.use(pass, colorImage, RenderGraphAccess::ColorAttachment, true);
+        renderGraph.use(pass, depthImage, RenderGraphAccess::DepthAttachment, true);
+        renderGraph.use(pass, visibility, RenderGraphAccess::FragmentShaderRead);
+        renderGraph.use(pass, vertices, RenderGraphAccess::FragmentShaderRead);
+        renderGraph.use(pass, visibleDrawCommands, RenderGraphAccess::FragmentShaderRead);
+        renderGraph.use(pass, lightGrid, RenderGraphAccess::FragmentShaderRead);
+
+        if (renderShadows)
+            renderGraph.use(pass, shadowMap, RenderGraphAccess::FragmentShaderRead);
     }
 
     //
     // Mesh Pass
     //
-    if (!opaqueDraws.empty()) {
-        ZoneScopedN("Mesh Pass");
-        TracyVkZone(graphics.getTracyContext(), cmd, "Mesh Pass");
+    if (!visibilityBufferEnabled) {
+        const uint32_t pass = renderGraph.addPass("Mesh Pass", [this, colorImage](VkCommandBuffer cmd) { meshPass(cmd, renderGraph.getImageView(colorImage)); });
+        renderGraph.use(pass, colorImage, RenderGraphAccess::ColorAttachment, true);
+        renderGraph.use(pass, depthImage, RenderGraphAccess::DepthAttachment, !depthPrepassEnabled);
+
+        if (drawCommandCount > 0) {
+            renderGraph.use(pass, vertices, RenderGraphAccess::VertexShaderRead);
+            renderGraph.use(pass, visibleDrawCommands, RenderGraphAccess::IndirectRead);
+            renderGraph.use(pass, drawCounts, RenderGraphAccess::IndirectRead);
+            renderGraph.use(pass, lightGrid, RenderGraphAccess::FragmentShaderRead);
+        }
 
-        meshPass(cmd);
+        if (renderShadows)
+            renderGraph.use(pass, shadowMap, RenderGraphAccess::FragmentShaderRead);
     }
 
     //
@@ -229,242 +636,988 @@ void Renderer::present(Camera &camera)
     //
     // TODO: draw cube
     if (*CVarSystem::instance()->getCVarInt("render_skybox")) {
-        ZoneScopedN("Skybox Pass");
-        TracyVkZone(graphics.getTracyContext(), cmd, "Skybox Pass");
-
-        skyboxPass(cmd);
+        const uint32_t pass = renderGraph.addPass("Skybox Pass", [this, colorImage](VkCommandBuffer cmd) { skyboxPass(cmd, renderGraph.getImageView(colorImage)); });
+        renderGraph.use(pass, colorImage, RenderGraphAccess::ColorAttachment);
+        renderGraph.use(pass, depthImage, RenderGraphAccess::DepthAttachment);
+        renderGraph.use(pass, vertices, RenderGraphAccess::VertexShaderRead);
     }
 
     //
-    // Imgui Pass
+    // Depth Pyramid Pass
     //
-    {
-        ZoneScopedN("ImGui Pass");
-        TracyVkZone(graphics.getTracyContext(), cmd, "ImGui Pass");
-
-        imGuiPass(cmd);
-    }
-
-    // transfer swapchain image to present
-    VkImageMemoryBarrier presentBarier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .dstAccessMask = 0,
-        .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = swapchainImage,
-        .subresourceRange = colorSubresource};
-
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &presentBarier);
+    // overlaps the ImGui pass, which doesn't use the depth
+    if (!*CVarSystem::instance()->getCVarInt("render_freeze_culling")) {
+        const uint32_t pass = renderGraph.addPass("Depth Pyramid Pass", [this](VkCommandBuffer cmd) { depthPyramidPass(cmd); }, computeQueue);
+        renderGraph.use(pass, depthImage, RenderGraphAccess::ComputeShaderRead);
+        renderGraph.use(pass, depthPyramid, RenderGraphAccess::ComputeShaderWrite);
+    }
 
     //
-    // Render passes end
+    // ImGui Pass
     //
-
-    if (supportTimestamps) {
-        // write end timestamp
-        graphics.writeTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 1);
+    {
+        const uint32_t pass = renderGraph.addPass("ImGui Pass", [this, colorImage](VkCommandBuffer cmd) { imGuiPass(cmd, renderGraph.getImageView(colorImage)); });
+        renderGraph.use(pass, colorImage, RenderGraphAccess::ColorAttachment);
+        renderGraph.use(pass, swapchainImage, RenderGraphAccess::ColorAttachment);
     }
+}
 
-    TracyVkCollect(graphics.getTracyContext(), cmd);
-
-    // Submit
-    graphics.submitCommandBuffer(cmd);
+// material the shaders read for a draw, -1 (the default one) for indices past the materials
+static int getDrawMaterialIndex(const eastl::vector<Material> &materials, const Primitive &primitive)
+{
+    return primitive.materialIndex > -1 && primitive.materialIndex < int(materials.size()) ? primitive.materialIndex : -1;
+}
 
-    if (supportTimestamps) {
-        // get timestamp result
-        vkGetQueryPoolResults(graphics.getDevice(), queryPool, 0, timestamps.size(), timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
-    }
+// material features of a draw, draws without a material use the base color of the default one (shading.glsl)
+static uint32_t getDrawPermutation(const eastl::vector<Material> &materials, int materialIndex)
+{
+    if (materialIndex > -1)
+        return getMaterialFeatures(materials[materialIndex]);
 
-    debugDrawVertices.clear();
-    meshDraws.clear();
-    opaqueDraws.clear();
-    drawCount = 0;
+    return materials.empty() ? 0 : getMaterialFeatures(materials[0]) & MATERIAL_FEATURE_BASE_COLOR;
 }
 
-void Renderer::cullMeshDraws(mat4 viewProj)
+void Renderer::updateLightData()
 {
     ZoneScoped;
 
-    for (size_t i = 0; i < meshDraws.size(); i++) {
-        // if (isSphereVisible(meshDraws[i].boundingSphere, viewProj, meshDraws[i].transform)) {
-        opaqueDraws.push_back(i);
-        // }
-    }
+    if (lights.empty())
+        return;
+
+    // the light grid of a frame in flight indexes the lights of the same frame, they are in a region per frame
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+    Light *frameLights = static_cast<Light *>(lightsBuffer.info.pMappedData) + currentFrame * MAX_LIGHTS;
+    memcpy(frameLights, lights.data(), lights.size() * sizeof(Light));
+    VK_CHECK(vmaFlushAllocation(graphics.getAllocator(), lightsBuffer.allocation, currentFrame * MAX_LIGHTS * sizeof(Light), lights.size() * sizeof(Light)));
 }
 
-void Renderer::sortMeshDraws(vec3 cameraPos)
+void Renderer::updateDrawData()
 {
     ZoneScoped;
 
-    if (opaqueDraws.empty())
+    if (dirtyInstances.empty())
         return;
 
-    std::sort(opaqueDraws.begin(), opaqueDraws.end(), [&](const auto &i1, const auto &i2) {
-        float dist1 = glm::length(cameraPos - math::getPosition(meshDraws[i1].transform));
-        float dist2 = glm::length(cameraPos - math::getPosition(meshDraws[i2].transform));
-
-        return dist1 < dist2;
+    const uint32_t frameOffset = graphics.getCurrentFrame() * MAX_INDIRECT_COMMANDS;
+
+    DrawData *drawData = static_cast<DrawData *>(drawDataBuffer.info.pMappedData) + frameOffset;
+
+    // skinned draws read the skinned copy of their vertices in the region of this frame
+    const uint32_t skinnedFrameBase = skinnedVertexBase + graphics.getCurrentFrame() * skinnedVertexCapacity;
+
+    // only instances that changed in the last FRAMES_IN_FLIGHT frames are written, into the region of this frame
+    JobCounter counter;
+    JobSystem::instance()->parallelFor(&counter, dirtyInstances.size(), 256, [&](uint32_t begin, uint32_t end) {
+        ZoneScopedN("Write draw data");
+
+        for (uint32_t i = begin; i < end; i++) {
+            const MeshInstance &instance = instances[dirtyInstances[i]];
+            uint32_t skinnedVertexOffset = skinnedFrameBase + instance.skinnedVertexOffset;
+
+            for (uint32_t j = 0; j < instance.drawCount; j++) {
+                const uint32_t drawIndex = instance.firstDraw + j;
+
+                // removed instances leave empty draws behind, the culling shader skips them
+                if (!instance.mesh) {
+                    drawData[drawIndex] = DrawData{};
+                    continue;
+                }
+
+                const Primitive &primitive = instance.mesh->primitives[j];
+                const bool skinned = instance.jointCount > 0;
+
+                uint32_t vertexOffset = primitive.vertexOffset;
+                if (skinned) {
+                    vertexOffset = skinnedVertexOffset;
+                    skinnedVertexOffset += primitive.vertexCount;
+                }
+
+                // the permutation and the material the shaders read have to agree
+                const int materialIndex = getDrawMaterialIndex(materials, primitive);
+
+                // meshlet cones are computed in the bind pose, skinned draws are culled as a whole
+                drawData[drawIndex] = DrawData{
+                    .transform = instance.transform,
+                    .boundingSphere = vec4(primitive.bounds.origin, primitive.bounds.sphereRadius),
+                    .indexCount = primitive.indexCount,
+                    .firstIndex = primitive.indexOffset,
+                    .vertexOffset = static_cast<int32_t>(vertexOffset),
+                    .materialIndex = materialIndex,
+                    .meshletOffset = primitive.meshletOffset,
+                    .meshletCount = skinned ? 0 : primitive.meshletCount,
+                    .lodOffset = primitive.lodOffset,
+                    .lodCount = primitive.lodCount,
+                    .permutation = getDrawPermutation(materials, materialIndex),
+                };
+            }
+        }
     });
-}
+    JobSystem::instance()->wait(counter);
 
-eastl::unordered_map<eastl::string, VkShaderModule> Renderer::loadShaderModules(std::filesystem::path directory)
-{
-    ZoneScoped;
+    uint32_t firstDraw = UINT32_MAX;
+    uint32_t lastDraw = 0;
 
-    eastl::unordered_map<eastl::string, VkShaderModule> shaders;
+    for (size_t i = 0; i < dirtyInstances.size();) {
+        const uint32_t id = dirtyInstances[i];
+        MeshInstance &instance = instances[id];
 
-    const VkDevice device = graphics.getDevice();
-    for (auto &entry : std::filesystem::recursive_directory_iterator(directory)) {
-        if (entry.is_regular_file()) {
-            shaders[entry.path().filename().c_str()] = vulkan::loadShaderModule(device, entry.path());
+        firstDraw = eastl::min(firstDraw, instance.firstDraw);
+        lastDraw = eastl::max(lastDraw, instance.firstDraw + instance.drawCount);
+
+        if (--instance.dirtyFrames > 0) {
+            i++;
+            continue;
+        }
+
+        // up to date in every frame in flight
+        if (!instance.mesh) {
+            freeDrawRanges.push_back(Range{instance.firstDraw, instance.drawCount});
+            freeInstances.push_back(id);
+
+            if (instance.jointCount > 0) {
+                freeJointRanges.push_back(Range{instance.jointOffset, instance.jointCount});
+                freeSkinnedVertexRanges.push_back(Range{instance.skinnedVertexOffset, instance.skinnedVertexCount});
+                instance.jointCount = 0;
+            }
         }
+
+        dirtyInstances.erase_unsorted(dirtyInstances.begin() + i);
     }
 
-    return shaders;
+    if (lastDraw > firstDraw) {
+        VmaAllocator allocator = graphics.getAllocator();
+        VK_CHECK(vmaFlushAllocation(allocator, drawDataBuffer.allocation, (frameOffset + firstDraw) * sizeof(DrawData), (lastDraw - firstDraw) * sizeof(DrawData)));
+    }
 }
 
-void Renderer::createPipelines()
+void Renderer::updateSkinningData()
 {
     ZoneScoped;
 
-    const VkDevice device = graphics.getDevice();
-    DescriptorManager &descriptorManager = graphics.getDescriptorManager();
-    const VkFormat colorFormat = graphics.getSwapchain().getSurfaceFormat().format;
+    maxSkinJobVertexCount = 0;
+    if (skinnedInstances.empty())
+        return;
 
-    eastl::unordered_map<eastl::string, VkShaderModule> shaders = loadShaderModules("build/shaders");
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+    VmaAllocator allocator = graphics.getAllocator();
 
-    //
-    // Create pipeline layouts
-    //
-    {
-        // shadow pipeline layout
-        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ShadowPassPC)};
-        pipelineLayouts["shadow"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
-    }
+    // the whole palette every frame, animated instances change all of their joints anyway
+    mat4 *palette = static_cast<mat4 *>(jointMatricesBuffer.info.pMappedData) + currentFrame * MAX_JOINT_MATRICES;
+    memcpy(palette, jointMatrices.data(), jointMatrices.size() * sizeof(mat4));
+    VK_CHECK(vmaFlushAllocation(allocator, jointMatricesBuffer.allocation, currentFrame * MAX_JOINT_MATRICES * sizeof(mat4), jointMatrices.size() * sizeof(mat4)));
 
-    {
-        // mesh pipeline layout
-        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshPassPC)};
-        pipelineLayouts["mesh"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
-    }
+    // a job per primitive, the skinned vertices of an instance's primitives follow each other
+    SkinJob *jobs = static_cast<SkinJob *>(skinJobsBuffer.info.pMappedData) + currentFrame * MAX_SKIN_JOBS;
+    uint32_t jobCount = 0;
 
-    {
-        // skybox pipeline layout
-        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SkyboxPassPC)};
-        pipelineLayouts["skybox"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
-    }
+    for (uint32_t id : skinnedInstances) {
+        const MeshInstance &instance = instances[id];
+        uint32_t dstVertexOffset = skinnedVertexBase + currentFrame * skinnedVertexCapacity + instance.skinnedVertexOffset;
 
-    //
-    // Create pipelines
-    //
-    {
-        // shadow pipeline
-        PipelineBuilder builder;
-        builder.setPipelineLayout(pipelineLayouts["shadow"]);
-        builder.setShader(shaders["shadow.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT); // default fragment shader
-        builder.setDepthTest(VK_TRUE, VK_TRUE);
-        builder.setCulling(VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-        builder.setPolygonMode(VK_POLYGON_MODE_FILL);
-        pipelines["shadow"] = builder.build(device, {});
+        for (const Primitive &primitive : instance.mesh->primitives) {
+            jobs[jobCount++] = SkinJob{
+                .srcVertexOffset = primitive.vertexOffset,
+                .dstVertexOffset = dstVertexOffset,
+                .vertexCount = primitive.vertexCount,
+                .jointOffset = currentFrame * MAX_JOINT_MATRICES + instance.jointOffset,
+            };
 
-        vulkan::setDebugName(device, (uint64_t)pipelines["shadow"], VK_OBJECT_TYPE_PIPELINE, "Shadow pipeline");
+            dstVertexOffset += primitive.vertexCount;
+            maxSkinJobVertexCount = eastl::max(maxSkinJobVertexCount, primitive.vertexCount);
+        }
     }
 
-    {
-        // mesh pipeline
-        PipelineBuilder builder;
-        builder.setPipelineLayout(pipelineLayouts["mesh"]);
-        builder.setShader(shaders["mesh.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
-        builder.setShader(shaders["mesh.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
-        builder.setDepthTest(VK_TRUE, VK_TRUE);
-        builder.setCulling(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-        builder.setPolygonMode(VK_POLYGON_MODE_FILL);
-        builder.setMultisampleCount(graphics.getSampleCount());
-        pipelines["mesh"] = builder.build(device, {colorFormat});
+    assert(jobCount == skinJobCount);
+    VK_CHECK(vmaFlushAllocation(allocator, skinJobsBuffer.allocation, currentFrame * MAX_SKIN_JOBS * sizeof(SkinJob), jobCount * sizeof(SkinJob)));
+}
 
-        vulkan::setDebugName(device, (uint64_t)pipelines["mesh"], VK_OBJECT_TYPE_PIPELINE, "Mesh pipeline");
-    }
+void Renderer::updateCullData(Camera &camera)
+{
+    ZoneScoped;
 
-    {
-        // wireframe pipeline
-        PipelineBuilder builder;
-        builder.setPipelineLayout(pipelineLayouts["mesh"]);
-        builder.setShader(shaders["color.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
-        builder.setShader(shaders["color.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
-        builder.setDepthTest(VK_TRUE, VK_TRUE);
-        builder.setCulling(VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-        builder.setPolygonMode(VK_POLYGON_MODE_LINE);
-        builder.setMultisampleCount(graphics.getSampleCount());
-        pipelines["wireframe"] = builder.build(device, {colorFormat, colorFormat});
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+    VmaAllocator allocator = graphics.getAllocator();
 
-        vulkan::setDebugName(device, (uint64_t)pipelines["wireframe"], VK_OBJECT_TYPE_PIPELINE, "Wireframe pipeline");
-    }
+    // visible counts written the last time this frame was rendered
+    VK_CHECK(vmaInvalidateAllocation(allocator, drawCountsBuffer.allocation, currentFrame * sizeof(DrawCounts), sizeof(DrawCounts)));
+    const DrawCounts &drawCounts = static_cast<DrawCounts *>(drawCountsBuffer.info.pMappedData)[currentFrame];
+    visibleDrawCount = drawCounts.commandCount;
+    visibleTriangleCount = drawCounts.triangleCount;
 
-    {
-        // skybox pipeline
-        PipelineBuilder builder;
-        builder.setPipelineLayout(pipelineLayouts["skybox"]);
-        builder.setShader(shaders["skybox.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
-        builder.setShader(shaders["skybox.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
-        builder.setCulling(VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-        builder.setDepthTest(VK_TRUE, VK_FALSE, VK_COMPARE_OP_EQUAL);
-        builder.setMultisampleCount(graphics.getSampleCount());
-        pipelines["skybox"] = builder.build(device, {colorFormat});
+    VK_CHECK(vmaInvalidateAllocation(allocator, clusterDispatchBuffer.allocation, currentFrame * sizeof(VkDispatchIndirectCommand), sizeof(VkDispatchIndirectCommand)));
+    clusterTaskCount = static_cast<VkDispatchIndirectCommand *>(clusterDispatchBuffer.info.pMappedData)[currentFrame].x;
 
-        vulkan::setDebugName(device, (uint64_t)pipelines["skybox"], VK_OBJECT_TYPE_PIPELINE, "Skybox pipeline");
+    // frozen culling keeps the frustum and the depth pyramid of the frame it was frozen on
+    if (!*CVarSystem::instance()->getCVarInt("render_freeze_culling")) {
+        math::getFrustumPlanes(camera.projection * camera.view, cullData.frustumPlanes);
+        cullData.cameraPosition = vec4(camera.position, 1.0f);
     }
 
-    for (auto &[_, shader] : shaders) {
-        vkDestroyShaderModule(device, shader, nullptr);
+    const Image &depthPyramid = images[depthPyramidIndex];
+    cullData.depthPyramidIndex = depthPyramidIndex;
+    cullData.depthPyramidSize = vec2(depthPyramid.width, depthPyramid.height);
+    cullData.depthPyramidLevels = depthPyramid.mipLevels;
+
+    cullData.drawOffset = currentFrame * MAX_INDIRECT_COMMANDS;
+    cullData.drawCount = sortedDrawCount;
+    cullData.frustumCulling = *CVarSystem::instance()->getCVarInt("render_frustum_culling");
+    cullData.occlusionCulling = *CVarSystem::instance()->getCVarInt("render_occlusion_culling") && depthPyramidValid;
+    cullData.coneCulling = *CVarSystem::instance()->getCVarInt("render_cone_culling");
+
+    cullData.commandOffset = currentFrame * MAX_VISIBLE_COMMANDS;
+    cullData.maxCommandCount = MAX_VISIBLE_COMMANDS;
+    cullData.taskOffset = currentFrame * MAX_CLUSTER_TASKS;
+    cullData.maxTaskCount = MAX_CLUSTER_TASKS;
+
+    // pixels per unit of error at a distance of 1
+    const float lodThreshold = eastl::max(*CVarSystem::instance()->getCVarFloat("render_lod_threshold"), 0.01f);
+    cullData.lodErrorScale = glm::abs(camera.projection[1][1]) * graphics.getSwapchain().getExtent().height * 0.5f / lodThreshold;
+    cullData.lodSelection = *CVarSystem::instance()->getCVarInt("render_lod");
+
+    for (uint32_t i = 0; i < MATERIAL_PERMUTATION_COUNT; i++) {
+        cullData.permutationOffsets[i] = permutationOffsets[i];
+        cullData.permutationCapacities[i] = permutationCapacities[i];
     }
+
+    memcpy(static_cast<CullData *>(cullDataBuffer.info.pMappedData) + currentFrame, &cullData, sizeof(CullData));
+    VK_CHECK(vmaFlushAllocation(allocator, cullDataBuffer.allocation, currentFrame * sizeof(CullData), sizeof(CullData)));
 }
 
-void Renderer::destroyPipelines()
+// world space bounding sphere of a primitive of an instance, xyz - center, w - radius
+static vec4 getWorldBoundingSphere(const mat4 &transform, const Primitive &primitive)
 {
-    ZoneScoped;
-
-    const VkDevice device = graphics.getDevice();
+    const float scale = eastl::max(eastl::max(glm::length(vec3(transform[0])), glm::length(vec3(transform[1]))), glm::length(vec3(transform[2])));
+    return vec4(vec3(transform * vec4(primitive.bounds.origin, 1.0f)), primitive.bounds.sphereRadius * scale);
+}
 
-    for (auto &[_, pipeline] : pipelines) {
-        vkDestroyPipeline(device, pipeline, nullptr);
+static bool isSphereInside(const vec4 planes[6], const vec4 &sphere)
+{
+    for (int i = 0; i < 6; i++) {
+        if (glm::dot(vec3(planes[i]), vec3(sphere)) + planes[i].w < -sphere.w)
+            return false;
     }
 
-    for (auto &[_, pipelineLayout] : pipelineLayouts) {
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    }
+    return true;
 }
 
-void Renderer::createResources()
+void Renderer::updateDrawOrder(Camera &camera)
 {
     ZoneScoped;
 
-    // shadow map
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+
+    drawSortKeys.resize(drawCommandCount);
+    drawSortIndices.resize(drawCommandCount);
+    drawSortScratchKeys.resize(drawCommandCount);
+    drawSortScratchIndices.resize(drawCommandCount);
+
+    // looking down -z of the view
+    const vec3 cameraForward = -vec3(camera.view[0][2], camera.view[1][2], camera.view[2][2]);
+
+    // draws of removed instances are left out, their entries are empty anyway
+    std::atomic<uint32_t> sortedCount = 0;
+
+    // commands each permutation can emit, a draw emits one or one per meshlet
+    eastl::array<std::atomic<uint32_t>, MATERIAL_PERMUTATION_COUNT> permutationCommands = {};
+
+    JobCounter counter;
+    JobSystem::instance()->parallelFor(&counter, instances.size(), 64, [&](uint32_t begin, uint32_t end) {
+        ZoneScopedN("Build sort keys");
+
+        // gathered per job, then appended with an atomic
+        eastl::vector<uint64_t> keys;
+        eastl::vector<uint32_t> indices;
+        eastl::array<uint32_t, MATERIAL_PERMUTATION_COUNT> commands = {};
+
+        for (uint32_t id = begin; id < end; id++) {
+            const MeshInstance &instance = instances[id];
+            if (!instance.mesh)
+                continue;
+
+            for (uint32_t j = 0; j < instance.drawCount; j++) {
+                const Primitive &primitive = instance.mesh->primitives[j];
+                const vec4 sphere = getWorldBoundingSphere(instance.transform, primitive);
+
+                // nearest point of the bounds, grouped by the material permutation the mesh pass draws them with
+                const int materialIndex = getDrawMaterialIndex(materials, primitive);
+                const uint32_t permutation = getDrawPermutation(materials, materialIndex);
+                const float depth = glm::dot(vec3(sphere) - camera.position, cameraForward) - sphere.w;
+                keys.push_back(draw_sort::makeKey(permutation, depth, materialIndex));
+                indices.push_back(instance.firstDraw + j);
+
+                // skinned draws don't use their meshlets
+                commands[permutation] += instance.jointCount > 0 ? 1 : eastl::max(primitive.meshletCount, 1u);
+            }
+        }
+
+        if (keys.empty())
+            return;
+
+        for (uint32_t i = 0; i < MATERIAL_PERMUTATION_COUNT; i++) {
+            if (commands[i] > 0)
+                permutationCommands[i].fetch_add(commands[i], std::memory_order_relaxed);
+        }
+
+        const uint32_t first = sortedCount.fetch_add(keys.size());
+        memcpy(drawSortKeys.data() + first, keys.data(), keys.size() * sizeof(uint64_t));
+        memcpy(drawSortIndices.data() + first, indices.data(), indices.size() * sizeof(uint32_t));
+    });
+    JobSystem::instance()->wait(counter);
+
+    sortedDrawCount = sortedCount;
+
+    // When the draws of every permutation can't all emit their commands, the ranges are scaled down to fit.
+    // Commands past the capacity of a range are dropped like the ones past the whole buffer.
+    uint64_t totalCommands = 0;
+    for (const std::atomic<uint32_t> &commands : permutationCommands)
+        totalCommands += commands;
+
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < MATERIAL_PERMUTATION_COUNT; i++) {
+        uint32_t capacity = permutationCommands[i];
+        if (totalCommands > MAX_VISIBLE_COMMANDS)
+            capacity = uint32_t(uint64_t(capacity) * MAX_VISIBLE_COMMANDS / totalCommands);
+
+        permutationOffsets[i] = offset;
+        permutationCapacities[i] = capacity;
+        offset += capacity;
+    }
+
+    draw_sort::radixSort(drawSortKeys.data(), drawSortIndices.data(), sortedDrawCount, drawSortScratchKeys.data(), drawSortScratchIndices.data());
+
+    if (sortedDrawCount > 0) {
+        memcpy(static_cast<uint32_t *>(drawOrderBuffer.info.pMappedData) + currentFrame * MAX_INDIRECT_COMMANDS, drawSortIndices.data(), sortedDrawCount * sizeof(uint32_t));
+        VK_CHECK(vmaFlushAllocation(graphics.getAllocator(), drawOrderBuffer.allocation, currentFrame * MAX_INDIRECT_COMMANDS * sizeof(uint32_t), sortedDrawCount * sizeof(uint32_t)));
+    }
+}
+
+void Renderer::addShadowCasterChanges(const MeshInstance &instance)
+{
+    if (!instance.mesh)
+        return;
+
+    for (const Primitive &primitive : instance.mesh->primitives)
+        shadowCasterChanges.push_back(getWorldBoundingSphere(instance.transform, primitive));
+}
+
+void Renderer::updateShadowCascades(Camera &camera)
+{
+    ZoneScoped;
+
+    // the first directional light casts the shadows
+    shadowLightIndex = -1;
+    if (*CVarSystem::instance()->getCVarInt("render_shadows") && drawCommandCount > 0) {
+        for (size_t i = 0; i < lights.size(); i++) {
+            if (lights[i].type == LightType::Directional) {
+                shadowLightIndex = i;
+                break;
+            }
+        }
+    }
+
+    if (shadowLightIndex < 0) {
+        // layers aren't kept up to date without shadows
+        for (ShadowCascade &cascade : shadowCascades)
+            cascade.valid = false;
+
+        shadowCasterChanges.clear();
+        return;
+    }
+
+    const vec3 lightDirection = glm::normalize(lights[shadowLightIndex].direction);
+    if (lightDirection != shadowLightDirection) {
+        for (ShadowCascade &cascade : shadowCascades)
+            cascade.valid = false;
+
+        shadowLightDirection = lightDirection;
+    }
+
+    // the cascades are boxes in light space, looking down -z
+    const vec3 up = glm::abs(lightDirection.y) > 0.99f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+    const mat4 lightView = glm::lookAt(vec3(0.0f), lightDirection, up);
+
+    const float near = camera.near;
+    const float shadowDistance = eastl::max(eastl::min(*CVarSystem::instance()->getCVarFloat("render_shadow_distance"), camera.far), near * 2.0f);
+    const float splitLambda = glm::clamp(*CVarSystem::instance()->getCVarFloat("render_shadow_split_lambda"), 0.0f, 1.0f);
+
+    const vec3 cameraUp = glm::cross(camera.right, camera.front);
+    const float tanHalfFov = tanf(camera.fov * 0.5f);
+
+    float splitNear = near;
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        ShadowCascade &cascade = shadowCascades[i];
+
+        // blend of uniform and logarithmic splits
+        const float t = float(i + 1) / SHADOW_CASCADE_COUNT;
+        const float splitFar = glm::mix(near + (shadowDistance - near) * t, near * powf(shadowDistance / near, t), splitLambda);
+
+        // bounding sphere of the slice, its size doesn't change as the camera turns so neither does the texel size
+        vec3 corners[8];
+        vec3 center = vec3(0.0f);
+        for (uint32_t j = 0; j < 8; j++) {
+            const float depth = j < 4 ? splitNear : splitFar;
+            const float halfHeight = depth * tanHalfFov;
+            const float halfWidth = halfHeight * camera.aspectRatio;
+
+            corners[j] = camera.position + camera.front * depth + camera.right * ((j & 1) ? halfWidth : -halfWidth) + cameraUp * ((j & 2) ? halfHeight : -halfHeight);
+            center += corners[j] / 8.0f;
+        }
+
+        float radius = 0.0f;
+        for (const vec3 &corner : corners)
+            radius = eastl::max(radius, glm::length(corner - center));
+        radius = ceilf(radius * 16.0f) / 16.0f;
+
+        // moved in whole texels, so shadow edges don't shimmer as the camera moves
+        const float texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+        const vec3 lightCenter = glm::floor(vec3(lightView * vec4(center, 1.0f)) / texelSize) * texelSize;
+
+        // extended towards the light, casters in front of the slice shadow it too
+        const mat4 projection = math::orthographicReverseZ(
+            lightCenter.x - radius, lightCenter.x + radius,
+            lightCenter.y - radius, lightCenter.y + radius,
+            -lightCenter.z - radius - SHADOW_CASTER_DISTANCE, -lightCenter.z + radius);
+        const mat4 viewProjection = projection * lightView;
+
+        // the layer is kept while the volume stays the same
+        if (viewProjection != cascade.viewProjection)
+            cascade.valid = false;
+
+        cascade.viewProjection = viewProjection;
+        cascade.splitDepth = splitFar;
+        math::getFrustumPlanes(viewProjection, cascade.planes);
+
+        splitNear = splitFar;
+    }
+
+    // skinned casters move every frame
+    for (uint32_t id : skinnedInstances)
+        addShadowCasterChanges(instances[id]);
+
+    for (const vec4 &sphere : shadowCasterChanges) {
+        for (ShadowCascade &cascade : shadowCascades) {
+            if (cascade.valid && isSphereInside(cascade.planes, sphere))
+                cascade.valid = false;
+        }
+    }
+    shadowCasterChanges.clear();
+}
+
+void Renderer::cullShadowCasters()
+{
+    ZoneScoped;
+
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+
+    // cascades that aren't valid are rendered this frame, with every caster inside them
+    uint32_t renderMask = 0;
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        ShadowCascade &cascade = shadowCascades[i];
+        cascade.render = shadowLightIndex >= 0 && !cascade.valid;
+        cascade.commandOffset = (currentFrame * SHADOW_CASCADE_COUNT + i) * MAX_INDIRECT_COMMANDS;
+        cascade.commandCount = 0;
+
+        if (cascade.render)
+            renderMask |= 1u << i;
+    }
+
+    if (renderMask == 0)
+        return;
+
+    const uint32_t frameOffset = currentFrame * MAX_INDIRECT_COMMANDS;
+    const uint32_t skinnedFrameBase = skinnedVertexBase + currentFrame * skinnedVertexCapacity;
+    VkDrawIndexedIndirectCommand *commands = static_cast<VkDrawIndexedIndirectCommand *>(shadowCommandsBuffer.info.pMappedData);
+
+    // a cascade holds at most every draw once, its region can't overflow
+    std::atomic<uint32_t> commandCounts[SHADOW_CASCADE_COUNT] = {};
+
+    JobCounter counter;
+    JobSystem::instance()->parallelFor(&counter, instances.size(), 64, [&](uint32_t begin, uint32_t end) {
+        ZoneScopedN("Cull shadow casters");
+
+        // gathered per job, then appended to the cascades with an atomic each
+        eastl::vector<VkDrawIndexedIndirectCommand> cascadeCommands[SHADOW_CASCADE_COUNT];
+
+        for (uint32_t id = begin; id < end; id++) {
+            const MeshInstance &instance = instances[id];
+            if (!instance.mesh)
+                continue;
+
+            uint32_t skinnedVertexOffset = skinnedFrameBase + instance.skinnedVertexOffset;
+
+            for (uint32_t j = 0; j < instance.drawCount; j++) {
+                const Primitive &primitive = instance.mesh->primitives[j];
+
+                // same vertices as the draw data of this frame
+                uint32_t vertexOffset = primitive.vertexOffset;
+                if (instance.jointCount > 0) {
+                    vertexOffset = skinnedVertexOffset;
+                    skinnedVertexOffset += primitive.vertexCount;
+                }
+
+                const vec4 sphere = getWorldBoundingSphere(instance.transform, primitive);
+                for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+                    if (!(renderMask & (1u << i)) || !isSphereInside(shadowCascades[i].planes, sphere))
+                        continue;
+
+                    cascadeCommands[i].push_back(VkDrawIndexedIndirectCommand{
+                        .indexCount = primitive.indexCount,
+                        .instanceCount = 1,
+                        .firstIndex = primitive.indexOffset,
+                        .vertexOffset = static_cast<int32_t>(vertexOffset),
+                        .firstInstance = frameOffset + instance.firstDraw + j,
+                    });
+                }
+            }
+        }
+
+        for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+            if (cascadeCommands[i].empty())
+                continue;
+
+            const uint32_t first = commandCounts[i].fetch_add(cascadeCommands[i].size());
+            memcpy(commands + shadowCascades[i].commandOffset + first, cascadeCommands[i].data(), cascadeCommands[i].size() * sizeof(VkDrawIndexedIndirectCommand));
+        }
+    });
+    JobSystem::instance()->wait(counter);
+
+    VmaAllocator allocator = graphics.getAllocator();
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        ShadowCascade &cascade = shadowCascades[i];
+        if (!cascade.render)
+            continue;
+
+        cascade.commandCount = commandCounts[i];
+        cascade.valid = true;
+
+        if (cascade.commandCount > 0)
+            VK_CHECK(vmaFlushAllocation(allocator, shadowCommandsBuffer.allocation, cascade.commandOffset * sizeof(VkDrawIndexedIndirectCommand), cascade.commandCount * sizeof(VkDrawIndexedIndirectCommand)));
+    }
+}
+
+eastl::unordered_map<eastl::string, VkShaderModule> Renderer::loadShaderModules(std::filesystem::path directory)
+{
+    ZoneScoped;
+
+    eastl::unordered_map<eastl::string, VkShaderModule> shaders;
+
+    const VkDevice device = graphics.getDevice();
+    for (auto &entry : std::filesystem::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            shaders[entry.path().filename().c_str()] = vulkan::loadShaderModule(device, entry.path());
+        }
+    }
+
+    return shaders;
+}
+
+void Renderer::createPipelines()
+{
+    ZoneScoped;
+
+    Timer timer;
+    timer.start();
+
+    createPipelineLayouts();
+    pipelines = buildPipelines();
+
+    // the first start on a device or driver is cold, later ones load the pipelines from the cache
+    logger::logInfo("Created ", pipelines.size(), " pipelines in ", timer.elapsedMilliseconds(), " ms on ", JobSystem::instance()->getThreadCount(),
+                    " threads, pipeline cache ", graphics.isPipelineCacheWarm() ? "warm" : "cold");
+
+    // saved now too, a run that doesn't shut down cleanly still starts warm the next time
+    if (!graphics.isPipelineCacheWarm())
+        graphics.savePipelineCache();
+}
+
+void Renderer::createPipelineLayouts()
+{
+    ZoneScoped;
+
+    DescriptorManager &descriptorManager = graphics.getDescriptorManager();
+
+    {
+        // shadow pipeline layout
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ShadowPassPC)};
+        pipelineLayouts["shadow"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+
+    {
+        // mesh pipeline layout (per-draw data is read from the draw data buffer, the push constants find the light cluster)
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshPassPC)};
+        pipelineLayouts["mesh"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+
+    {
+        // visibility resolve pipeline layout
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(VisibilityResolvePC)};
+        pipelineLayouts["visibility_resolve"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+
+    {
+        // skybox pipeline layout
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SkyboxPassPC)};
+        pipelineLayouts["skybox"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+
+    {
+        // cull pipeline layout
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPassPC)};
+        pipelineLayouts["cull"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+
+    {
+        // skinning pipeline layout
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPC)};
+        pipelineLayouts["skinning"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+
+    {
+        // light cull pipeline layout
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LightCullPC)};
+        pipelineLayouts["light_cull"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+
+    {
+        // depth reduce pipeline layout
+        VkPushConstantRange pushConstant = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReducePC)};
+        pipelineLayouts["depth_reduce"] = graphics.createPipelineLayout(&descriptorManager.getSetLayout(), &pushConstant);
+    }
+}
+
+// a pipeline to build, builders are independent of each other
+struct PipelineDesc
+{
+    const char *name;
+    const char *debugName;
+    PipelineBuilder builder;
+    eastl::vector<VkFormat> colorFormats;
+    bool compute = false;
+};
+
+eastl::unordered_map<eastl::string, VkPipeline> Renderer::buildPipelines(bool parallel)
+{
+    ZoneScoped;
+
+    const VkDevice device = graphics.getDevice();
+    const VkFormat colorFormat = graphics.getSwapchain().getSurfaceFormat().format;
+
+    eastl::unordered_map<eastl::string, VkShaderModule> shaders = loadShaderModules("build/shaders");
+
+    eastl::vector<PipelineDesc> descs;
+
+    {
+        // shadow pipeline
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["shadow"]);
+        builder.setShader(shaders["shadow.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT); // default fragment shader
+        builder.setDepthTest(VK_TRUE, VK_TRUE);
+        builder.setCulling(VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        builder.setPolygonMode(VK_POLYGON_MODE_FILL);
+        descs.push_back({"shadow", "Shadow pipeline", builder, {}});
+    }
+
+    {
+        // depth prepass pipeline, positions only and the alpha test of mesh.frag
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["mesh"]);
+        builder.setShader(shaders["depth_prepass.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
+        builder.setShader(shaders["depth_prepass.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
+        builder.setDepthTest(VK_TRUE, VK_TRUE);
+        builder.setCulling(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        builder.setPolygonMode(VK_POLYGON_MODE_FILL);
+        builder.setMultisampleCount(graphics.getSampleCount());
+        descs.push_back({"depth_prepass", "Depth prepass pipeline", builder, {}});
+    }
+
+    {
+        // visibility pipeline, single sampled, writes the visible command and triangle of every pixel
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["mesh"]);
+        builder.setShader(shaders["visibility.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
+        builder.setShader(shaders["visibility.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
+        builder.setDepthTest(VK_TRUE, VK_TRUE);
+        builder.setCulling(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        builder.setPolygonMode(VK_POLYGON_MODE_FILL);
+        descs.push_back({"visibility", "Visibility pipeline", builder, {VISIBILITY_FORMAT}});
+    }
+
+    {
+        // visibility resolve pipeline, a fullscreen triangle that shades every pixel and writes the depth of its triangle
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["visibility_resolve"]);
+        builder.setShader(shaders["quad.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
+        builder.setShader(shaders["visibility_resolve.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
+        builder.setDepthTest(VK_TRUE, VK_TRUE, VK_COMPARE_OP_ALWAYS);
+        builder.setCulling(VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        builder.setPolygonMode(VK_POLYGON_MODE_FILL);
+        builder.setMultisampleCount(graphics.getSampleCount());
+        descs.push_back({"visibility_resolve", "Visibility resolve pipeline", builder, {colorFormat}});
+    }
+
+    {
+        // wireframe pipeline
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["mesh"]);
+        builder.setShader(shaders["color.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
+        builder.setShader(shaders["color.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
+        builder.setDepthTest(VK_TRUE, VK_TRUE);
+        builder.setCulling(VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        builder.setPolygonMode(VK_POLYGON_MODE_LINE);
+        builder.setMultisampleCount(graphics.getSampleCount());
+        descs.push_back({"wireframe", "Wireframe pipeline", builder, {colorFormat, colorFormat}});
+    }
+
+    {
+        // skybox pipeline
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["skybox"]);
+        builder.setShader(shaders["skybox.vert.spv"], VK_SHADER_STAGE_VERTEX_BIT);
+        builder.setShader(shaders["skybox.frag.spv"], VK_SHADER_STAGE_FRAGMENT_BIT);
+        builder.setCulling(VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        builder.setDepthTest(VK_TRUE, VK_FALSE, VK_COMPARE_OP_EQUAL);
+        builder.setMultisampleCount(graphics.getSampleCount());
+        descs.push_back({"skybox", "Skybox pipeline", builder, {colorFormat}});
+    }
+
+    {
+        // cull pipeline
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["cull"]);
+        builder.setShader(shaders["cull.comp.spv"], VK_SHADER_STAGE_COMPUTE_BIT);
+        descs.push_back({"cull", "Cull pipeline", builder, {}, true});
+    }
+
+    {
+        // cluster cull pipeline (same push constants as cull)
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["cull"]);
+        builder.setShader(shaders["cluster_cull.comp.spv"], VK_SHADER_STAGE_COMPUTE_BIT);
+        descs.push_back({"cluster_cull", "Cluster cull pipeline", builder, {}, true});
+    }
+
+    {
+        // skinning pipeline
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["skinning"]);
+        builder.setShader(shaders["skinning.comp.spv"], VK_SHADER_STAGE_COMPUTE_BIT);
+        descs.push_back({"skinning", "Skinning pipeline", builder, {}, true});
+    }
+
+    {
+        // light cull pipeline
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["light_cull"]);
+        builder.setShader(shaders["light_cull.comp.spv"], VK_SHADER_STAGE_COMPUTE_BIT);
+        descs.push_back({"light_cull", "Light cull pipeline", builder, {}, true});
+    }
+
+    {
+        // depth reduce pipeline
+        PipelineBuilder builder;
+        builder.setPipelineLayout(pipelineLayouts["depth_reduce"]);
+        builder.setShader(shaders["depth_reduce.comp.spv"], VK_SHADER_STAGE_COMPUTE_BIT);
+        descs.push_back({"depth_reduce", "Depth reduce pipeline", builder, {}, true});
+    }
+
+    // the driver compiles each pipeline on its own, they are spread over the workers
+    eastl::vector<VkPipeline> built(descs.size());
+
+    auto build = [&](uint32_t begin, uint32_t end) {
+        ZoneScopedN("Build pipelines");
+
+        for (uint32_t i = begin; i < end; i++) {
+            PipelineDesc &desc = descs[i];
+            desc.builder.setPipelineCache(graphics.getPipelineCache());
+            built[i] = desc.compute ? desc.builder.buildCompute(device) : desc.builder.build(device, desc.colorFormats);
+
+            vulkan::setDebugName(device, (uint64_t)built[i], VK_OBJECT_TYPE_PIPELINE, desc.debugName);
+        }
+    };
+
+    if (parallel) {
+        JobCounter counter;
+        JobSystem::instance()->parallelFor(&counter, descs.size(), 1, build);
+        JobSystem::instance()->wait(counter);
+    } else {
+        build(0, descs.size());
+    }
+
+    eastl::unordered_map<eastl::string, VkPipeline> result;
+    for (uint32_t i = 0; i < descs.size(); i++)
+        result[descs[i].name] = built[i];
+
+    for (auto &[_, shader] : shaders) {
+        vkDestroyShaderModule(device, shader, nullptr);
+    }
+
+    return result;
+}
+
+eastl::hash_map<uint32_t, VkPipeline> Renderer::buildMaterialPipelines(const eastl::vector<uint32_t> &keys, bool parallel)
+{
+    ZoneScoped;
+
+    const VkDevice device = graphics.getDevice();
+    const VkFormat colorFormat = graphics.getSwapchain().getSurfaceFormat().format;
+
+    const VkShaderModule vertexShader = vulkan::loadShaderModule(device, "build/shaders/mesh.vert.spv");
+    const VkShaderModule fragmentShader = vulkan::loadShaderModule(device, "build/shaders/mesh.frag.spv");
+
+    // constant ids of shading.glsl
+    struct Specialization
+    {
+        uint32_t features;
+        VkBool32 exact;
+        VkBool32 shadows;
+    };
+
+    const VkSpecializationMapEntry entries[] = {
+        {0, offsetof(Specialization, features), sizeof(uint32_t)},
+        {1, offsetof(Specialization, exact), sizeof(VkBool32)},
+        {2, offsetof(Specialization, shadows), sizeof(VkBool32)},
+    };
+
+    eastl::vector<Specialization> specializations(keys.size());
+    eastl::vector<VkSpecializationInfo> specializationInfos(keys.size());
+    eastl::vector<VkPipeline> built(keys.size());
+
+    auto build = [&](uint32_t begin, uint32_t end) {
+        ZoneScopedN("Build material pipelines");
+
+        for (uint32_t i = begin; i < end; i++) {
+            const uint32_t key = keys[i];
+            const uint32_t permutation = key & (MATERIAL_PERMUTATION_COUNT - 1);
+            const bool equalDepth = key & MATERIAL_PIPELINE_EQUAL_DEPTH;
+            const bool shadows = key & MATERIAL_PIPELINE_SHADOWS;
+
+            // every draw of the permutation has its maps, the shader doesn't test the ids
+            specializations[i] = {permutation, VK_TRUE, shadows ? VK_TRUE : VK_FALSE};
+            specializationInfos[i] = {sizeof(entries) / sizeof(entries[0]), entries, sizeof(Specialization), &specializations[i]};
+
+            PipelineBuilder builder;
+            builder.setPipelineLayout(pipelineLayouts["mesh"]);
+            builder.setPipelineCache(graphics.getPipelineCache());
+            builder.setShader(vertexShader, VK_SHADER_STAGE_VERTEX_BIT);
+            builder.setShader(fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, &specializationInfos[i]);
+            if (equalDepth)
+                builder.setDepthTest(VK_TRUE, VK_FALSE, VK_COMPARE_OP_EQUAL); // only the nearest surface passes after the depth prepass
+            else
+                builder.setDepthTest(VK_TRUE, VK_TRUE);
+            builder.setCulling(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+            builder.setPolygonMode(VK_POLYGON_MODE_FILL);
+            builder.setMultisampleCount(graphics.getSampleCount());
+            built[i] = builder.build(device, {colorFormat});
+
+            char name[64];
+            snprintf(name, sizeof(name), "Mesh pipeline (permutation %u%s%s)", permutation, equalDepth ? ", equal depth" : "", shadows ? ", shadows" : "");
+            vulkan::setDebugName(device, (uint64_t)built[i], VK_OBJECT_TYPE_PIPELINE, name);
+        }
+    };
+
+    if (parallel) {
+        JobCounter counter;
+        JobSystem::instance()->parallelFor(&counter, keys.size(), 1, build);
+        JobSystem::instance()->wait(counter);
+    } else {
+        build(0, keys.size());
+    }
+
+    vkDestroyShaderModule(device, vertexShader, nullptr);
+    vkDestroyShaderModule(device, fragmentShader, nullptr);
+
+    eastl::hash_map<uint32_t, VkPipeline> result;
+    for (uint32_t i = 0; i < keys.size(); i++)
+        result[keys[i]] = built[i];
+
+    return result;
+}
+
+void Renderer::createMaterialPipelines(bool shadows)
+{
+    ZoneScoped;
+
+    eastl::vector<uint32_t> keys;
+    for (uint32_t permutation = 0; permutation < MATERIAL_PERMUTATION_COUNT; permutation++) {
+        const uint32_t key = getMaterialPipelineKey(permutation, depthPrepassEnabled, shadows);
+        if (permutationCapacities[permutation] > 0 && materialPipelines.find(key) == materialPipelines.end())
+            keys.push_back(key);
+    }
+
+    if (keys.empty())
+        return;
+
+    Timer timer;
+    timer.start();
+
+    for (auto &[key, pipeline] : buildMaterialPipelines(keys))
+        materialPipelines[key] = pipeline;
+
+    logger::logInfo("Created ", keys.size(), " material pipelines in ", timer.elapsedMilliseconds(), " ms, ", materialPipelines.size(), " in total.");
+}
+
+void Renderer::destroyPipelines()
+{
+    ZoneScoped;
+
+    const VkDevice device = graphics.getDevice();
+
+    // a reload that is still building
+    if (reloadThread.joinable())
+        reloadThread.join();
+
+    for (auto &[_, pipeline] : reloadedPipelines) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+
+    for (auto &[_, pipeline] : reloadedMaterialPipelines) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+
+    for (auto &[_, pipeline] : materialPipelines) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+
+    for (eastl::vector<VkPipeline> &retired : retiredPipelines) {
+        for (VkPipeline pipeline : retired)
+            vkDestroyPipeline(device, pipeline, nullptr);
+    }
+
+    for (auto &[_, pipeline] : pipelines) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+
+    for (auto &[_, pipelineLayout] : pipelineLayouts) {
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    }
+}
+
+void Renderer::createResources()
+{
+    ZoneScoped;
+
+    // shadow map, sampled as an array and rendered a layer at a time
     {
         ImageCreateInfo createInfo = {
             .width = SHADOW_MAP_SIZE,
             .height = SHADOW_MAP_SIZE,
-            .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-            .format = VK_FORMAT_D32_SFLOAT,
+            .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            .format = SHADOW_MAP_FORMAT,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
             .aspect = VK_IMAGE_ASPECT_DEPTH_BIT,
+            .addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .arrayLayers = SHADOW_CASCADE_COUNT,
         };
 
         shadowMapIndex = images.size();
         vulkan::Image &shadowMap = images.emplace_back();
         graphics.createImage(shadowMap, createInfo, false);
         vulkan::setDebugName(graphics.getDevice(), reinterpret_cast<uint64_t>(shadowMap.image), VK_OBJECT_TYPE_IMAGE, "Shadowmap image");
+
+        for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+            VkImageSubresourceRange range = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, i, 1};
+            shadowCascadeViews[i] = graphics.createImageView(shadowMap.image, VK_IMAGE_VIEW_TYPE_2D, SHADOW_MAP_FORMAT, range);
+        }
     }
 
     // skybox
@@ -485,10 +1638,102 @@ void Renderer::createResources()
         vulkan::setDebugName(graphics.getDevice(), reinterpret_cast<uint64_t>(skybox.image), VK_OBJECT_TYPE_IMAGE, "Skybox image");
     }
 
+    // depth pyramid (created for the current depth image)
+    depthPyramidIndex = images.size();
+    images.emplace_back();
+    createDepthPyramid();
+
     createBuffers();
     updateDescriptorSet();
 }
 
+void Renderer::createDepthPyramid()
+{
+    ZoneScoped;
+
+    const VkDevice device = graphics.getDevice();
+    const VkExtent2D extent = graphics.getSwapchain().getExtent();
+
+    // power of two that fits the depth image, so that each level is exactly half of the previous one
+    auto previousPow2 = [](uint32_t value) {
+        uint32_t result = 1;
+        while (result * 2 <= value)
+            result *= 2;
+        return result;
+    };
+
+    ImageCreateInfo createInfo = {
+        .width = previousPow2(extent.width),
+        .height = previousPow2(extent.height),
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+        .format = VK_FORMAT_R32_SFLOAT,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .filter = VK_FILTER_NEAREST,
+        .addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .asyncCompute = true, // built and read by compute passes, on whichever queue runs them
+    };
+
+    vulkan::Image &depthPyramid = images[depthPyramidIndex];
+    graphics.createImage(depthPyramid, createInfo, true);
+    vulkan::setDebugName(device, reinterpret_cast<uint64_t>(depthPyramid.image), VK_OBJECT_TYPE_IMAGE, "Depth pyramid image");
+
+    assert(depthPyramid.mipLevels <= MAX_STORAGE_IMAGES);
+
+    for (uint32_t i = 0; i < depthPyramid.mipLevels; i++) {
+        VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1};
+        depthPyramidMips.push_back(graphics.createImageView(depthPyramid.image, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32_SFLOAT, range));
+    }
+
+    // the pyramid stays in general layout, it's written and sampled by compute shaders only (transitioned by the render graph)
+    depthPyramidExtent = extent;
+    swapchainGeneration = graphics.getSwapchainGeneration();
+    depthPyramidValid = false;
+}
+
+void Renderer::createVisibilityImage()
+{
+    ZoneScoped;
+
+    const VkExtent2D extent = graphics.getSwapchain().getExtent();
+
+    ImageCreateInfo createInfo = {
+        .width = extent.width,
+        .height = extent.height,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .format = VISIBILITY_FORMAT,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .filter = VK_FILTER_NEAREST,
+        .addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    };
+
+    graphics.createImage(visibilityImage, createInfo, false);
+    vulkan::setDebugName(graphics.getDevice(), reinterpret_cast<uint64_t>(visibilityImage.image), VK_OBJECT_TYPE_IMAGE, "Visibility image");
+}
+
+void Renderer::destroyVisibilityImage()
+{
+    ZoneScoped;
+
+    if (visibilityImage.image != VK_NULL_HANDLE) {
+        graphics.destroyImage(visibilityImage);
+        visibilityImage = {};
+    }
+}
+
+void Renderer::destroyDepthPyramid()
+{
+    ZoneScoped;
+
+    for (VkImageView view : depthPyramidMips)
+        vkDestroyImageView(graphics.getDevice(), view, nullptr);
+    depthPyramidMips.clear();
+
+    if (depthPyramidExtent.width > 0) {
+        graphics.destroyImage(images[depthPyramidIndex]);
+        images[depthPyramidIndex] = {};
+    }
+}
+
 void Renderer::createBuffers()
 {
     ZoneScoped;
@@ -518,39 +1763,214 @@ void Renderer::createBuffers()
         memcpy(materialsBuffer.info.pMappedData, materials.data(), materialsBuffer.size);
     }
 
-    // lights
-    if (!lights.empty()) {
+    // lights, sized for MAX_LIGHTS since they can change every frame, a region per frame in flight (written by updateLightData)
+    {
         BufferCreateInfo createInfo = {
-            .size = lights.size() * sizeof(Light),
+            .size = FRAMES_IN_FLIGHT * MAX_LIGHTS * sizeof(Light),
             .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
         };
 
         graphics.createBuffer(lightsBuffer, createInfo);
         vulkan::setDebugName(device, reinterpret_cast<uint64_t>(lightsBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Lights buffer");
-        memcpy(lightsBuffer.info.pMappedData, lights.data(), lightsBuffer.size);
     }
 
     // indices
     if (!indices.empty()) {
         vulkan::BufferCreateInfo createInfo;
-        createInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        createInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT; // triangles are fetched by the visibility resolve
         createInfo.size = indices.size() * sizeof(uint32_t);
 
         graphics.createBuffer(indexBuffer, createInfo);
         graphics.uploadBuffer(indexBuffer, indices.data(), createInfo.size);
     }
 
-    // vertices
-    if (!vertices.empty()) {
-        vulkan::BufferCreateInfo createInfo;
-        createInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-        createInfo.size = vertices.size() * sizeof(Vertex);
+    createVertexBuffer();
 
-        graphics.createBuffer(vertexBuffer, createInfo);
-        graphics.uploadBuffer(vertexBuffer, vertices.data(), createInfo.size);
+    // joint matrices
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * MAX_JOINT_MATRICES * sizeof(mat4),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(jointMatricesBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(jointMatricesBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Joint Matrices buffer");
+    }
+
+    // skin jobs
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * MAX_SKIN_JOBS * sizeof(SkinJob),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(skinJobsBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(skinJobsBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Skin Jobs buffer");
+    }
+
+    // draw data
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * MAX_INDIRECT_COMMANDS * sizeof(DrawData),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(drawDataBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(drawDataBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Draw Data buffer");
+    }
+
+    // draw order (written by updateDrawOrder)
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * MAX_INDIRECT_COMMANDS * sizeof(uint32_t),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(drawOrderBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(drawOrderBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Draw Order buffer");
+    }
+
+    // shadow caster commands (written by cullShadowCasters)
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * SHADOW_CASCADE_COUNT * MAX_INDIRECT_COMMANDS * sizeof(VkDrawIndexedIndirectCommand),
+            .usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(shadowCommandsBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(shadowCommandsBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Shadow Commands buffer");
+    }
+
+    // visible draw commands (written by the cull pass)
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * MAX_VISIBLE_COMMANDS * sizeof(VkDrawIndexedIndirectCommand),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(visibleDrawCommandsBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(visibleDrawCommandsBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Visible Draw Commands buffer");
+    }
+
+    // draw counts
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * sizeof(DrawCounts),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        };
+
+        graphics.createBuffer(drawCountsBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(drawCountsBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Draw Counts buffer");
+        memset(drawCountsBuffer.info.pMappedData, 0, drawCountsBuffer.size);
+    }
+
+    // cull data
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * sizeof(CullData),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(cullDataBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(cullDataBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Cull Data buffer");
+    }
+
+    // meshlets (at least one entry, the cluster cull pipeline always references the buffer)
+    {
+        BufferCreateInfo createInfo = {
+            .size = eastl::max<size_t>(meshlets.size(), 1) * sizeof(Meshlet),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        };
+
+        graphics.createBuffer(meshletBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(meshletBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Meshlets buffer");
+
+        if (!meshlets.empty())
+            graphics.uploadBuffer(meshletBuffer, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+    }
+
+    // lods (at least one entry, like meshlets)
+    {
+        BufferCreateInfo createInfo = {
+            .size = eastl::max<size_t>(lods.size(), 1) * sizeof(MeshLod),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        };
+
+        graphics.createBuffer(lodsBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(lodsBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Lods buffer");
+
+        if (!lods.empty())
+            graphics.uploadBuffer(lodsBuffer, lods.data(), lods.size() * sizeof(MeshLod));
+    }
+
+    // light grid, a light count and MAX_CLUSTER_LIGHTS slots per cluster (written by the light cull pass)
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * LIGHT_CLUSTER_COUNT * (MAX_CLUSTER_LIGHTS + 1) * sizeof(uint32_t),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .memUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        };
+
+        graphics.createBuffer(lightGridBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(lightGridBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Light Grid buffer");
+    }
+
+    // cluster tasks (written by the cull pass)
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * MAX_CLUSTER_TASKS * sizeof(uvec2),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        };
+
+        graphics.createBuffer(clusterTasksBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(clusterTasksBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Cluster Tasks buffer");
+    }
+
+    // cluster dispatch
+    {
+        BufferCreateInfo createInfo = {
+            .size = FRAMES_IN_FLIGHT * sizeof(VkDispatchIndirectCommand),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        };
+
+        graphics.createBuffer(clusterDispatchBuffer, createInfo);
+        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(clusterDispatchBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Cluster Dispatch buffer");
+        memset(clusterDispatchBuffer.info.pMappedData, 0, clusterDispatchBuffer.size);
     }
 }
 
+
+// Vertices, followed by the skinned vertices of every frame in flight (written by the skinning pass). The skinned regions
+// fit the skinned instances that were added, present() recreates the buffer with larger ones when more are added.
+void Renderer::createVertexBuffer()
+{
+    const VkDevice device = graphics.getDevice();
+
+    skinnedVertexBase = vertices.size();
+    skinnedVertexCapacity = eastl::min(eastl::max(skinnedVertexCapacity * 2, skinnedVertexCount), MAX_SKINNED_VERTICES);
+
+    const VkDeviceSize vertexCount = eastl::max(vertices.size() + FRAMES_IN_FLIGHT * skinnedVertexCapacity, size_t(1));
+
+    vulkan::BufferCreateInfo createInfo;
+    createInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    createInfo.size = vertexCount * sizeof(GpuVertex);
+
+    graphics.createBuffer(vertexBuffer, createInfo);
+    vulkan::setDebugName(device, reinterpret_cast<uint64_t>(vertexBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Vertex buffer");
+
+#ifdef REBIRTH_QUANTIZE_VERTICES
+    eastl::vector<PackedVertex> packedVertices(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        packedVertices[i] = packVertex(vertices[i]);
+
+    if (!vertices.empty())
+        graphics.uploadBuffer(vertexBuffer, packedVertices.data(), vertices.size() * sizeof(GpuVertex));
+#else
+    if (!vertices.empty())
+        graphics.uploadBuffer(vertexBuffer, vertices.data(), vertices.size() * sizeof(GpuVertex));
+#endif
+}
+
 void Renderer::updateDescriptorSet()
 {
     ZoneScoped;
@@ -559,13 +1979,40 @@ void Renderer::updateDescriptorSet()
     DescriptorWriter writer;
 
     for (size_t i = 0; i < images.size(); i++) {
-        writer.write(TEXTURES_BINDING, images[i].view, images[i].sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, i);
+        VkImageLayout layout = int(i) == depthPyramidIndex ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        writer.write(TEXTURES_BINDING, images[i].view, images[i].sampler, layout, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, i);
+    }
+
+    // depth image and depth pyramid levels for the depth reduction
+    Image &depthImage = graphics.getDepthImage();
+    writer.write(TEXTURES_BINDING, depthImage.view, depthImage.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthImageIndex);
+
+    if (visibilityImage.image != VK_NULL_HANDLE)
+        writer.write(TEXTURES_BINDING, visibilityImage.view, visibilityImage.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, visibilityImageIndex);
+
+    VkSampler nullSampler = VK_NULL_HANDLE;
+    for (size_t i = 0; i < depthPyramidMips.size(); i++) {
+        writer.write(STORAGE_IMAGES_BINDING, depthPyramidMips[i], nullSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, i);
     }
 
     writer.write(SCENE_DATA_BINDING, sceneDataBuffer.buffer, sceneDataBuffer.size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0);
     writer.write(MATERIALS_BINDING, materialsBuffer.buffer, materialsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
     writer.write(LIGHTS_BINDING, lightsBuffer.buffer, lightsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
     writer.write(VERTEX_BINDING, vertexBuffer.buffer, vertexBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(JOINT_MATRICES_BINDING, jointMatricesBuffer.buffer, jointMatricesBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(SKIN_JOBS_BINDING, skinJobsBuffer.buffer, skinJobsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(DRAW_DATA_BINDING, drawDataBuffer.buffer, drawDataBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(DRAW_ORDER_BINDING, drawOrderBuffer.buffer, drawOrderBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    if (indexBuffer.buffer != VK_NULL_HANDLE)
+        writer.write(INDICES_BINDING, indexBuffer.buffer, indexBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(DRAW_COMMANDS_BINDING, visibleDrawCommandsBuffer.buffer, visibleDrawCommandsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(DRAW_COUNTS_BINDING, drawCountsBuffer.buffer, drawCountsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(CULL_DATA_BINDING, cullDataBuffer.buffer, cullDataBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(MESHLETS_BINDING, meshletBuffer.buffer, meshletBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(CLUSTER_TASKS_BINDING, clusterTasksBuffer.buffer, clusterTasksBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(CLUSTER_DISPATCH_BINDING, clusterDispatchBuffer.buffer, clusterDispatchBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(LODS_BINDING, lodsBuffer.buffer, lodsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+    writer.write(LIGHT_GRID_BINDING, lightGridBuffer.buffer, lightGridBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
 
     writer.update(graphics.getDevice(), graphics.getDescriptorManager().getSet());
 }
@@ -574,9 +2021,72 @@ void Renderer::reloadShaders()
 {
     ZoneScoped;
 
+    if (reloadPending) {
+        logger::logInfo("Shaders are still reloading.");
+        return;
+    }
+
     logger::logInfo("Reloading shaders.");
 
-    vkDeviceWaitIdle(graphics.getDevice());
-    destroyPipelines();
-    createPipelines();
+    // the material permutations that were drawn so far are built again too
+    eastl::vector<uint32_t> materialKeys;
+    for (auto &[key, _] : materialPipelines)
+        materialKeys.push_back(key);
+
+    // the previous reload was swapped in already
+    if (reloadThread.joinable())
+        reloadThread.join();
+
+    // Frames keep rendering with the current pipelines, the new ones replace them when they're all built. A thread of
+    // its own builds them one after another, so the waits of the render thread never pick up a compile.
+    reloadPending = true;
+    reloadDone.store(false, std::memory_order_relaxed);
+    reloadThread = std::thread([this, materialKeys = eastl::move(materialKeys)] {
+        tracy::SetThreadName("Shader reload");
+
+        Timer timer;
+        timer.start();
+
+        reloadedPipelines = buildPipelines(false);
+        reloadedMaterialPipelines = buildMaterialPipelines(materialKeys, false);
+        reloadTimeMs = timer.elapsedMilliseconds();
+
+        reloadDone.store(true, std::memory_order_release);
+    });
+}
+
+void Renderer::updateReloadedPipelines()
+{
+    ZoneScoped;
+
+    const VkDevice device = graphics.getDevice();
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+
+    // the frames that could still use them were waited for when this frame began
+    for (VkPipeline pipeline : retiredPipelines[currentFrame])
+        vkDestroyPipeline(device, pipeline, nullptr);
+    retiredPipelines[currentFrame].clear();
+
+    if (!reloadPending || !reloadDone.load(std::memory_order_acquire))
+        return;
+
+    reloadThread.join();
+
+    // recorded frames in flight use the old ones, they are destroyed when this frame in flight comes around again
+    for (auto &[name, pipeline] : reloadedPipelines) {
+        retiredPipelines[currentFrame].push_back(pipelines[name]);
+        pipelines[name] = pipeline;
+    }
+
+    // permutations created since the reload started were built with the new shaders already
+    for (auto &[key, pipeline] : reloadedMaterialPipelines) {
+        retiredPipelines[currentFrame].push_back(materialPipelines[key]);
+        materialPipelines[key] = pipeline;
+    }
+
+    logger::logInfo("Reloaded ", reloadedPipelines.size() + reloadedMaterialPipelines.size(), " pipelines in ", reloadTimeMs, " ms.");
+
+    reloadedPipelines.clear();
+    reloadedMaterialPipelines.clear();
+    reloadPending = false;
 }
\ No newline at end of file
@@ -9,106 +9,102 @@
 #include <backend/imgui_impl_vulkan.h>
 #include <imgui.h>
 
+#include <EASTL/algorithm.h>
+#include <tracy/TracyVulkan.hpp>
+
 void Renderer::shadowPass(const VkCommandBuffer cmd)
 {
-    const Image &shadowMap = images[shadowMapIndex];
     const VkExtent2D shadowMapExtent = {SHADOW_MAP_SIZE, SHADOW_MAP_SIZE};
 
-    // attachments
-    VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    depthAttachment.clearValue.depthStencil = {0.0, 0};
-    depthAttachment.imageView = shadowMap.view;
-    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
     float color[4] = {0.3, 0.3, 0.3, 0.3};
     vulkan::beginDebugLabel(cmd, "Shadow pass", color);
 
-    vulkan::beginRendering(cmd, {}, &depthAttachment, shadowMapExtent);
+    const bool parallel = *CVarSystem::instance()->getCVarInt("render_parallel_recording");
 
-    vulkan::setViewport(cmd, 0.0f, 0.0f, shadowMapExtent.width, shadowMapExtent.height);
-    vulkan::setScissor(cmd, shadowMapExtent);
+    // looked up here, the ranges are recorded on other threads
+    const VkPipeline pipeline = pipelines["shadow"];
+    const VkPipelineLayout pipelineLayout = pipelineLayouts["shadow"];
+    const VkDescriptorSet set = graphics.getDescriptorManager().getSet();
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines["shadow"]);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts["shadow"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        // cached cascades keep their layers
+        const ShadowCascade &cascade = shadowCascades[i];
+        if (!cascade.render)
+            continue;
 
-    //
-    // Draw
-    //
-    for (auto &light : lights) {
-        for (uint32_t &opaqueDraw : opaqueDraws) {
-            MeshDraw &meshDraw = meshDraws[opaqueDraw];
-            Mesh &mesh = meshDraw.mesh;
+        // attachments
+        VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+        depthAttachment.clearValue.depthStencil = {0.0, 0};
+        depthAttachment.imageView = shadowCascadeViews[i];
+        depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+        const bool secondary = parallel && cascade.commandCount > 0;
+        vulkan::beginRendering(cmd, {}, &depthAttachment, shadowMapExtent, secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0);
+
+        //
+        // Draw
+        //
+        // casters inside the cascade, begin and end are relative to its commands
+        auto recordRange = [&](VkCommandBuffer cmd, uint32_t begin, uint32_t end) {
+            vulkan::setViewport(cmd, 0.0f, 0.0f, shadowMapExtent.width, shadowMapExtent.height);
+            vulkan::setScissor(cmd, shadowMapExtent);
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &set, 0, nullptr);
+            vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
             ShadowPassPC pc = {
-                .transform = light.mvp * meshDraw.transform,
+                .lightMvp = cascade.viewProjection,
             };
-            vkCmdPushConstants(cmd, pipelineLayouts["shadow"], VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
+            vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
 
-            for (Primitive &primitive : mesh.primitives) {
-                if (primitive.indexCount > 0)
-                    vkCmdDrawIndexed(cmd, primitive.indexCount, 1, primitive.indexOffset, primitive.vertexOffset, 0);
-                else
-                    vkCmdDraw(cmd, primitive.vertexCount, 1, primitive.vertexOffset, 0);
-            }
+            const VkDeviceSize offset = (cascade.commandOffset + begin) * sizeof(VkDrawIndexedIndirectCommand);
+            vkCmdDrawIndexedIndirect(cmd, shadowCommandsBuffer.buffer, offset, end - begin, sizeof(VkDrawIndexedIndirectCommand));
+        };
 
-            drawCount++;
+        if (secondary) {
+            VkCommandBufferInheritanceRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+            renderingInfo.depthAttachmentFormat = SHADOW_MAP_FORMAT;
+            renderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+            graphics.recordParallel(cmd, renderingInfo, cascade.commandCount, SHADOW_RECORD_RANGE_SIZE, recordRange);
+        } else if (cascade.commandCount > 0) {
+            recordRange(cmd, 0, cascade.commandCount);
         }
+
+        drawCount += cascade.commandCount;
+
+        vulkan::endRendering(cmd);
     }
 
     // end
-    vulkan::endRendering(cmd);
     vulkan::endDebugLabel(cmd);
-
-    // transfer shadowmap to fragment shader read
-    VkImageMemoryBarrier shadowMapReadBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = shadowMap.image,
-        .subresourceRange = depthSubresource};
-
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &shadowMapReadBarrier);
 }
 
-void Renderer::meshPass(const VkCommandBuffer cmd)
+void Renderer::meshPass(const VkCommandBuffer cmd, VkImageView colorView)
 {
     Swapchain &swapchain = graphics.getSwapchain();
 
     // TODO: make RenderInfo that would contain all information needed for a pipeline
     const VkExtent2D extent = swapchain.getExtent();
-    const Image &colorImage = graphics.getColorImage();
     const Image &depthImage = graphics.getDepthImage();
 
-    // attachments
+    // attachments, cleared here every frame even without draws, the depth by the depth prepass when it runs
     VkRenderingAttachmentInfo colorAttachment;
     colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
     colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
-    colorAttachment.imageView = colorImage.view;
+    colorAttachment.imageView = colorView;
     colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
     VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
     depthAttachment.clearValue.depthStencil = {0.0, 0};
     depthAttachment.imageView = depthImage.view;
     depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.loadOp = depthPrepassEnabled ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
     float color[4] = {0.3, 0.3, 0.0, 0.3};
@@ -120,31 +116,46 @@ void Renderer::meshPass(const VkCommandBuffer cmd)
     vulkan::setViewport(cmd, 0.0f, 0.0f, extent.width, extent.height);
     vulkan::setScissor(cmd, extent);
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *CVarSystem::instance()->getCVarInt("render_wireframe") ? pipelines["wireframe"] : pipelines["mesh"]);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts["mesh"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
-
     //
     // Draw
     //
-    for (uint32_t &opaqueDraw : opaqueDraws) {
-        MeshDraw &meshDraw = meshDraws[opaqueDraw];
-        Mesh &mesh = meshDraw.mesh;
-
-        for (Primitive &primitive : mesh.primitives) {
-            MeshPassPC pc = {
-                .transform = meshDraw.transform,
-                .materialIndex = primitive.materialIndex,
-            };
+    if (drawCommandCount > 0) {
+        const bool wireframe = *CVarSystem::instance()->getCVarInt("render_wireframe");
+        const bool shadows = shadowLightIndex >= 0;
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts["mesh"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+        vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        const uint32_t currentFrame = graphics.getCurrentFrame();
+
+        MeshPassPC pc = {
+            .screenSize = vec2(extent.width, extent.height),
+            .znear = lightGridNear,
+            .zfar = lightGridFar,
+            .frameIndex = currentFrame,
+        };
+        vkCmdPushConstants(cmd, pipelineLayouts["mesh"], VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
+
+        if (wireframe)
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines["wireframe"]);
+
+        // an indirect draw per material permutation, each with the pipeline specialized to it
+        for (uint32_t permutation = 0; permutation < MATERIAL_PERMUTATION_COUNT; permutation++) {
+            if (permutationCapacities[permutation] == 0)
+                continue;
 
-            vkCmdPushConstants(cmd, pipelineLayouts["mesh"], VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
+            // GPU time of every permutation in the profiler
+            char zoneName[32];
+            snprintf(zoneName, sizeof(zoneName), "Permutation %u", permutation);
+            TracyVkZoneTransient(graphics.getTracyContext(), permutationZone, cmd, zoneName, true);
 
-            if (primitive.indexCount > 0)
-                vkCmdDrawIndexed(cmd, primitive.indexCount, 1, primitive.indexOffset, primitive.vertexOffset, 0);
-            else
-                vkCmdDraw(cmd, primitive.vertexCount, 1, primitive.vertexOffset, 0);
+            if (!wireframe)
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, materialPipelines[getMaterialPipelineKey(permutation, depthPrepassEnabled, shadows)]);
+
+            drawPermutation(cmd, permutation);
         }
 
-        drawCount++;
+        drawCount += eastl::min(visibleDrawCount, MAX_VISIBLE_COMMANDS);
     }
 
     // end
@@ -152,18 +163,161 @@ void Renderer::meshPass(const VkCommandBuffer cmd)
     vulkan::endDebugLabel(cmd);
 }
 
-void Renderer::imGuiPass(const VkCommandBuffer cmd)
+void Renderer::drawPermutation(const VkCommandBuffer cmd, uint32_t permutation)
+{
+    if (permutationCapacities[permutation] == 0)
+        return;
+
+    // range of the permutation in the visible commands of this frame, its count in the draw counts of this frame
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+    const VkDeviceSize commandsOffset = (currentFrame * MAX_VISIBLE_COMMANDS + permutationOffsets[permutation]) * sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize countOffset = currentFrame * sizeof(DrawCounts) + offsetof(DrawCounts, permutationCounts) + permutation * sizeof(uint32_t);
+    vkCmdDrawIndexedIndirectCount(cmd, visibleDrawCommandsBuffer.buffer, commandsOffset, drawCountsBuffer.buffer, countOffset, permutationCapacities[permutation], sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void Renderer::depthPrepass(const VkCommandBuffer cmd)
+{
+    const VkExtent2D extent = graphics.getSwapchain().getExtent();
+
+    // the visible draws front to back, in the order of the sort keys
+    VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    depthAttachment.clearValue.depthStencil = {0.0, 0};
+    depthAttachment.imageView = graphics.getDepthImage().view;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    float color[4] = {0.2, 0.2, 0.2, 0.3};
+    vulkan::beginDebugLabel(cmd, "Depth prepass", color);
+
+    vulkan::beginRendering(cmd, {}, &depthAttachment, extent);
+
+    vulkan::setViewport(cmd, 0.0f, 0.0f, extent.width, extent.height);
+    vulkan::setScissor(cmd, extent);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines["depth_prepass"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts["mesh"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+    vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    for (uint32_t permutation = 0; permutation < MATERIAL_PERMUTATION_COUNT; permutation++)
+        drawPermutation(cmd, permutation);
+
+    vulkan::endRendering(cmd);
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::visibilityPass(const VkCommandBuffer cmd, VkImageView depthView)
+{
+    const VkExtent2D extent = graphics.getSwapchain().getExtent();
+
+    // visible command and triangle of every pixel, empty pixels stay at UINT32_MAX
+    VkRenderingAttachmentInfo visibilityAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    visibilityAttachment.clearValue.color.uint32[0] = UINT32_MAX;
+    visibilityAttachment.clearValue.color.uint32[1] = UINT32_MAX;
+    visibilityAttachment.imageView = visibilityImage.view;
+    visibilityAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    visibilityAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    visibilityAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    depthAttachment.clearValue.depthStencil = {0.0, 0};
+    depthAttachment.imageView = depthView;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    float color[4] = {0.0, 0.3, 0.3, 0.3};
+    vulkan::beginDebugLabel(cmd, "Visibility pass", color);
+
+    eastl::vector<VkRenderingAttachmentInfo> colorAttachments = {visibilityAttachment};
+    vulkan::beginRendering(cmd, colorAttachments, &depthAttachment, extent);
+
+    vulkan::setViewport(cmd, 0.0f, 0.0f, extent.width, extent.height);
+    vulkan::setScissor(cmd, extent);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines["visibility"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts["mesh"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+    vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    // the visibility buffer stores the command index of the frame, gl_DrawIDARB starts at zero in every draw
+    MeshPassPC pc = {.frameIndex = graphics.getCurrentFrame()};
+    for (uint32_t permutation = 0; permutation < MATERIAL_PERMUTATION_COUNT; permutation++) {
+        if (permutationCapacities[permutation] == 0)
+            continue;
+
+        pc.commandBase = permutationOffsets[permutation];
+        vkCmdPushConstants(cmd, pipelineLayouts["mesh"], VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
+
+        drawPermutation(cmd, permutation);
+    }
+
+    vulkan::endRendering(cmd);
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::visibilityResolvePass(const VkCommandBuffer cmd, VkImageView colorView)
+{
+    const VkExtent2D extent = graphics.getSwapchain().getExtent();
+
+    // every sample of a pixel gets the same color and depth, triangle edges aren't antialiased in this mode
+    VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
+    colorAttachment.imageView = colorView;
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    depthAttachment.clearValue.depthStencil = {0.0, 0};
+    depthAttachment.imageView = graphics.getDepthImage().view;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    float color[4] = {0.3, 0.3, 0.0, 0.3};
+    vulkan::beginDebugLabel(cmd, "Visibility resolve pass", color);
+
+    eastl::vector<VkRenderingAttachmentInfo> colorAttachments = {colorAttachment};
+    vulkan::beginRendering(cmd, colorAttachments, &depthAttachment, extent);
+
+    vulkan::setViewport(cmd, 0.0f, 0.0f, extent.width, extent.height);
+    vulkan::setScissor(cmd, extent);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines["visibility_resolve"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts["visibility_resolve"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+
+    VisibilityResolvePC pc = {
+        .screenSize = vec2(extent.width, extent.height),
+        .znear = lightGridNear,
+        .zfar = lightGridFar,
+        .frameIndex = currentFrame,
+        .visibilityIndex = visibilityImageIndex,
+        .commandOffset = currentFrame * MAX_VISIBLE_COMMANDS,
+    };
+    vkCmdPushConstants(cmd, pipelineLayouts["visibility_resolve"], VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
+
+    // fullscreen triangle
+    vkCmdDraw(cmd, 3, 1, 0, 0);
+
+    drawCount += eastl::min(visibleDrawCount, MAX_VISIBLE_COMMANDS);
+
+    vulkan::endRendering(cmd);
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::imGuiPass(const VkCommandBuffer cmd, VkImageView colorView)
 {
     Swapchain &swapchain = graphics.getSwapchain();
 
     const VkImageView &swapchainImageView = swapchain.getImageView();
-    const Image &colorImage = graphics.getColorImage();
     const VkExtent2D extent = swapchain.getExtent();
 
-    // attachments
+    // attachments, the multisampled color is resolved into the swapchain image
     VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
     colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
-    colorAttachment.imageView = colorImage.view;
+    colorAttachment.imageView = colorView;
     colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -197,13 +351,40 @@ void Renderer::imGuiPass(const VkCommandBuffer cmd)
         ImGui::Text("Frame time: %f ms", timestampDeltaMs);
         ImGui::Text("FPS: %d", int(1000.0f / timestampDeltaMs));
         ImGui::Text("Draw count: %d", drawCount);
+        ImGui::Text("Instances: %d (%d dirty), draws: %d", instanceCount, int(dirtyInstances.size()), drawCommandCount);
+        ImGui::Text("Visible commands: %d", visibleDrawCount);
+        ImGui::Text("Material permutations: %d drawn, %d pipelines", int(eastl::count_if(permutationCapacities.begin(), permutationCapacities.end(), [](uint32_t capacity) { return capacity > 0; })), int(materialPipelines.size()));
+        ImGui::Text("Cluster tasks: %d, meshlets: %d", clusterTaskCount, int(meshlets.size()));
+        ImGui::Text("Visible triangles: %d", visibleTriangleCount);
+        ImGui::Text("Lights: %d (%d directional)", int(lights.size()), directionalLightCount);
 
         ImGui::Separator();
 
         ImGui::Checkbox("Enable wireframe", (bool*)CVarSystem::instance()->getCVarInt("render_wireframe"));
         ImGui::Checkbox("Enable shadows", (bool*)CVarSystem::instance()->getCVarInt("render_shadows"));
         ImGui::Checkbox("Enable skybox", (bool*)CVarSystem::instance()->getCVarInt("render_skybox"));
+        ImGui::Checkbox("Enable depth prepass", (bool*)CVarSystem::instance()->getCVarInt("render_depth_prepass"));
+        ImGui::Checkbox("Enable visibility buffer", (bool*)CVarSystem::instance()->getCVarInt("render_visibility_buffer"));
         ImGui::Checkbox("Enable imgui", (bool*)CVarSystem::instance()->getCVarInt("render_imgui"));
+
+        ImGui::Separator();
+
+        ImGui::Checkbox("Enable frustum culling", (bool*)CVarSystem::instance()->getCVarInt("render_frustum_culling"));
+        ImGui::Checkbox("Enable occlusion culling", (bool*)CVarSystem::instance()->getCVarInt("render_occlusion_culling"));
+        ImGui::Checkbox("Enable cone culling", (bool*)CVarSystem::instance()->getCVarInt("render_cone_culling"));
+        ImGui::Checkbox("Freeze culling", (bool*)CVarSystem::instance()->getCVarInt("render_freeze_culling"));
+
+        ImGui::Separator();
+
+        ImGui::Checkbox("Enable lods", (bool*)CVarSystem::instance()->getCVarInt("render_lod"));
+        ImGui::SliderFloat("Lod threshold (px)", CVarSystem::instance()->getCVarFloat("render_lod_threshold"), 0.25f, 16.0f);
+
+        ImGui::Separator();
+
+        // 0 casters for cascades cached this frame
+        ImGui::Text("Shadow casters: %d, %d, %d, %d", shadowCascades[0].commandCount, shadowCascades[1].commandCount, shadowCascades[2].commandCount, shadowCascades[3].commandCount);
+        ImGui::SliderFloat("Shadow distance", CVarSystem::instance()->getCVarFloat("render_shadow_distance"), 10.0f, 500.0f);
+        ImGui::SliderFloat("Shadow split lambda", CVarSystem::instance()->getCVarFloat("render_shadow_split_lambda"), 0.0f, 1.0f);
         ImGui::End();
 
         //
@@ -228,17 +409,16 @@ void Renderer::imGuiPass(const VkCommandBuffer cmd)
     vulkan::endDebugLabel(cmd);
 }
 
-void Renderer::skyboxPass(const VkCommandBuffer cmd)
+void Renderer::skyboxPass(const VkCommandBuffer cmd, VkImageView colorView)
 {
     vulkan::Swapchain &swapchain = graphics.getSwapchain();
-    const Image &colorImage = graphics.getColorImage();
     const Image &depthImage = graphics.getDepthImage();
     const VkExtent2D extent = swapchain.getExtent();
 
     // attachments
     VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
     colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}}; // not used when op is load
-    colorAttachment.imageView = colorImage.view;
+    colorAttachment.imageView = colorView;
     colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -271,9 +451,10 @@ void Renderer::skyboxPass(const VkCommandBuffer cmd)
 
     vkCmdPushConstants(cmd, pipelineLayouts["skybox"], VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
 
-    if (cubePrimitive.indexCount > 0)
+    if (cubePrimitive.indexCount > 0) {
+        vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
         vkCmdDrawIndexed(cmd, cubePrimitive.indexCount, 1, cubePrimitive.indexOffset, cubePrimitive.vertexOffset, 0);
-    else
+    } else
         vkCmdDraw(cmd, cubePrimitive.vertexCount, 1, cubePrimitive.vertexOffset, 0);
 
     drawCount++;
@@ -283,159 +464,153 @@ void Renderer::skyboxPass(const VkCommandBuffer cmd)
     vulkan::endDebugLabel(cmd);
 }
 
-void Renderer::clearPass(const VkCommandBuffer cmd)
+void Renderer::cullResetPass(const VkCommandBuffer cmd)
+{
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+
+    float color[4] = {0.0, 0.5, 0.5, 0.3};
+    vulkan::beginDebugLabel(cmd, "Cull reset pass", color);
+
+    // reset the visible count and the cluster dispatch of this frame
+    vkCmdFillBuffer(cmd, drawCountsBuffer.buffer, currentFrame * sizeof(DrawCounts), sizeof(DrawCounts), 0);
+
+    const VkDispatchIndirectCommand clusterDispatch = {0, 1, 1};
+    vkCmdUpdateBuffer(cmd, clusterDispatchBuffer.buffer, currentFrame * sizeof(VkDispatchIndirectCommand), sizeof(clusterDispatch), &clusterDispatch);
+
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::cullPass(const VkCommandBuffer cmd)
+{
+    float color[4] = {0.0, 0.5, 0.5, 0.3};
+    vulkan::beginDebugLabel(cmd, "Cull pass", color);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines["cull"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts["cull"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+
+    CullPassPC pc = {
+        .frameIndex = graphics.getCurrentFrame(),
+    };
+    vkCmdPushConstants(cmd, pipelineLayouts["cull"], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+
+    vkCmdDispatch(cmd, (drawCommandCount + 63) / 64, 1, 1);
+
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::clusterCullPass(const VkCommandBuffer cmd)
+{
+    const uint32_t currentFrame = graphics.getCurrentFrame();
+
+    float color[4] = {0.0, 0.5, 0.5, 0.3};
+    vulkan::beginDebugLabel(cmd, "Cluster cull pass", color);
+
+    // cluster tasks of the visible draws, the task count is the dispatch size
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines["cluster_cull"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts["cull"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+
+    CullPassPC pc = {
+        .frameIndex = currentFrame,
+    };
+    vkCmdPushConstants(cmd, pipelineLayouts["cull"], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+
+    vkCmdDispatchIndirect(cmd, clusterDispatchBuffer.buffer, currentFrame * sizeof(VkDispatchIndirectCommand));
+
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::skinningPass(const VkCommandBuffer cmd)
+{
+    float color[4] = {0.5, 0.0, 0.5, 0.3};
+    vulkan::beginDebugLabel(cmd, "Skinning pass", color);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines["skinning"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts["skinning"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+
+    SkinningPC pc = {
+        .jobOffset = graphics.getCurrentFrame() * MAX_SKIN_JOBS,
+    };
+    vkCmdPushConstants(cmd, pipelineLayouts["skinning"], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+
+    // a row of workgroups per job, as wide as the largest one
+    vkCmdDispatch(cmd, (maxSkinJobVertexCount + 63) / 64, skinJobCount, 1);
+
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::lightCullPass(const VkCommandBuffer cmd)
+{
+    float color[4] = {0.5, 0.5, 0.0, 0.3};
+    vulkan::beginDebugLabel(cmd, "Light cull pass", color);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines["light_cull"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts["light_cull"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+
+    LightCullPC pc = {
+        .view = sceneData.view,
+        .P00 = sceneData.projection[0][0],
+        .P11 = sceneData.projection[1][1],
+        .znear = lightGridNear,
+        .zfar = lightGridFar,
+        .lightOffset = directionalLightCount,
+        .lightCount = uint32_t(lights.size()) - directionalLightCount,
+        .frameIndex = graphics.getCurrentFrame(),
+    };
+    vkCmdPushConstants(cmd, pipelineLayouts["light_cull"], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+
+    // a workgroup per cluster
+    vkCmdDispatch(cmd, LIGHT_GRID_X, LIGHT_GRID_Y, LIGHT_GRID_Z);
+
+    vulkan::endDebugLabel(cmd);
+}
+
+void Renderer::depthPyramidPass(const VkCommandBuffer cmd)
 {
-    const Image &colorImage = graphics.getColorImage();
     const Image &depthImage = graphics.getDepthImage();
-    const Image &shadowMap = images[shadowMapIndex];
-    // vulkan::Swapchain &swapchain = graphics.getSwapchain();
-    // const VkExtent2D extent = swapchain.getExtent();
-
-    // transfer multisampled image to transfer dst
-    VkImageMemoryBarrier transferImageBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = colorImage.image,
-        .subresourceRange = colorSubresource};
-
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &transferImageBarrier);
-
-    // transfer depth image to transfer
-    VkImageMemoryBarrier depthTransferBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = depthImage.image,
-        .subresourceRange = depthSubresource};
-
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &depthTransferBarrier);
-
-    // transfer shadowmap image to transfer
-    depthTransferBarrier.image = shadowMap.image;
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &depthTransferBarrier);
-
-    VkClearDepthStencilValue clearDepthVal = {0.0, 0};
-    VkClearColorValue clearColorVal = {{0.0, 0.0, 0.0, 1.0}};
-
-    VkImageSubresourceRange depthRange{};
-    depthRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    depthRange.baseMipLevel = 0;
-    depthRange.levelCount = 1;
-    depthRange.baseArrayLayer = 0;
-    depthRange.layerCount = 1;
-
-    VkImageSubresourceRange multisampledColorRange = {
-        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        .baseMipLevel = 0,
-        .levelCount = colorImage.mipLevels,
-        .baseArrayLayer = 0,
-        .layerCount = 1};
+    const Image &depthPyramid = images[depthPyramidIndex];
+    const VkExtent2D extent = graphics.getSwapchain().getExtent();
+
+    float color[4] = {0.5, 0.5, 0.5, 0.3};
+    vulkan::beginDebugLabel(cmd, "Depth pyramid pass", color);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines["depth_reduce"]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts["depth_reduce"], 0, 1, &graphics.getDescriptorManager().getSet(), 0, nullptr);
+
+    ivec2 srcSize = ivec2(extent.width, extent.height);
+
+    for (uint32_t i = 0; i < depthPyramid.mipLevels; i++) {
+        ivec2 dstSize = glm::max(ivec2(depthPyramid.width >> i, depthPyramid.height >> i), ivec2(1));
+
+        // first level is reduced from the depth image, the rest from the previous level
+        DepthReducePC pc = {
+            .srcSize = srcSize,
+            .dstSize = dstSize,
+            .srcIndex = i == 0 ? depthImageIndex : int(i - 1),
+            .dstIndex = int(i),
+            .srcType = i > 0 ? 0 : (graphics.getSampleCount() == VK_SAMPLE_COUNT_1_BIT ? 1 : 2),
+        };
+        vkCmdPushConstants(cmd, pipelineLayouts["depth_reduce"], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+
+        vkCmdDispatch(cmd, (dstSize.x + 7) / 8, (dstSize.y + 7) / 8, 1);
+
+        // level is read by the next reduction, the render graph orders the whole pyramid with the culling of the next frame
+        if (i + 1 < depthPyramid.mipLevels) {
+            VkMemoryBarrier2 levelBarrier = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT};
+
+            VkDependencyInfo dependencyInfo = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+            dependencyInfo.memoryBarrierCount = 1;
+            dependencyInfo.pMemoryBarriers = &levelBarrier;
+
+            vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+        }
 
-    //
-    // Clear images
-    //
-    vkCmdClearDepthStencilImage(cmd, depthImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearDepthVal, 1, &depthRange);
-    vkCmdClearDepthStencilImage(cmd, shadowMap.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearDepthVal, 1, &depthRange);
-    vkCmdClearColorImage(cmd, colorImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColorVal, 1, &multisampledColorRange);
-
-    // transfer multisampled image to color output
-    VkImageMemoryBarrier multisampleBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = colorImage.image,
-        .subresourceRange = colorSubresource};
-
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &multisampleBarrier);
-
-    // transfer depth image to depth attachment
-    VkImageMemoryBarrier depthBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = depthImage.image,
-        .subresourceRange = depthSubresource};
-
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &depthBarrier);
-
-    // transfer shadowmap image to depth attachment
-    depthBarrier.image = shadowMap.image;
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
-        1,
-        &depthBarrier);
+        srcSize = dstSize;
+    }
+
+    vulkan::endDebugLabel(cmd);
 }
\ No newline at end of file
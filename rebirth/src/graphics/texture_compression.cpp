@@ -0,0 +1,230 @@
+#include <rebirth/graphics/texture_compression.h>
+
+#include <tracy/Tracy.hpp>
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace texture_compression
+{
+
+static uint16_t packRgb565(const int *color)
+{
+    return static_cast<uint16_t>(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+static void unpackRgb565(uint16_t packed, int *color)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+static void writeLittleEndian(unsigned char *dst, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        dst[i] = static_cast<unsigned char>(value >> (i * 8));
+}
+
+void encodeBC1Block(const unsigned char *pixels, unsigned char *dst)
+{
+    int min[3] = {255, 255, 255};
+    int max[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            min[c] = std::min<int>(min[c], pixels[i * 4 + c]);
+            max[c] = std::max<int>(max[c], pixels[i * 4 + c]);
+        }
+    }
+
+    // inset the box a bit, the extremes are rarely worth an endpoint
+    for (int c = 0; c < 3; c++) {
+        int inset = (max[c] - min[c]) / 16;
+        min[c] += inset;
+        max[c] -= inset;
+    }
+
+    // pick the box diagonal the colors follow, red and blue are flipped when they go against green
+    int covariance[2] = {};
+    for (int i = 0; i < 16; i++) {
+        int g = pixels[i * 4 + 1] * 2 - (min[1] + max[1]);
+        covariance[0] += (pixels[i * 4 + 0] * 2 - (min[0] + max[0])) * g;
+        covariance[1] += (pixels[i * 4 + 2] * 2 - (min[2] + max[2])) * g;
+    }
+
+    if (covariance[0] < 0)
+        std::swap(min[0], max[0]);
+    if (covariance[1] < 0)
+        std::swap(min[2], max[2]);
+
+    uint16_t color0 = packRgb565(max);
+    uint16_t color1 = packRgb565(min);
+
+    // color0 > color1 selects the four color mode
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestDistance = INT32_MAX;
+            for (int p = 0; p < 4; p++) {
+                int distance = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = pixels[i * 4 + c] - palette[p][c];
+                    distance += d * d;
+                }
+
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= uint32_t(best) << (i * 2);
+        }
+    }
+
+    writeLittleEndian(dst, color0, 2);
+    writeLittleEndian(dst + 2, color1, 2);
+    writeLittleEndian(dst + 4, indices, 4);
+}
+
+void encodeBC4Block(const unsigned char *values, uint32_t stride, unsigned char *dst)
+{
+    int min = 255;
+    int max = 0;
+    for (int i = 0; i < 16; i++) {
+        min = std::min<int>(min, values[i * stride]);
+        max = std::max<int>(max, values[i * stride]);
+    }
+
+    // eight value mode, red0 > red1. Index 0 is red0, 1 is red1 and 2-7 are interpolated from red0 towards red1
+    uint64_t indices = 0;
+    if (max != min) {
+        int range = max - min;
+        for (int i = 0; i < 16; i++) {
+            int position = ((values[i * stride] - min) * 7 + range / 2) / range; // 0 is min, 7 is max
+
+            uint64_t index;
+            if (position == 7)
+                index = 0;
+            else if (position == 0)
+                index = 1;
+            else
+                index = 8 - position;
+
+            indices |= index << (i * 3);
+        }
+    }
+
+    dst[0] = static_cast<unsigned char>(max);
+    dst[1] = static_cast<unsigned char>(min);
+    writeLittleEndian(dst + 2, indices, 6);
+}
+
+void encodeBC3Block(const unsigned char *pixels, unsigned char *dst)
+{
+    encodeBC4Block(pixels + 3, 4, dst);
+    encodeBC1Block(pixels, dst + 8);
+}
+
+void encodeBC5Block(const unsigned char *pixels, unsigned char *dst)
+{
+    encodeBC4Block(pixels, 4, dst);
+    encodeBC4Block(pixels + 1, 4, dst + 8);
+}
+
+VkFormat getCompressedFormat(const ImageData &imageData, TextureUsage usage)
+{
+    switch (usage) {
+        case TextureUsage::Color: {
+            // only the base level decides, mips of an opaque image are opaque too
+            size_t baseSize = getMipSize(imageData.format, imageData.width, imageData.height);
+            for (size_t i = 3; i < baseSize; i += 4) {
+                if (imageData.pixels[i] != 255)
+                    return VK_FORMAT_BC3_SRGB_BLOCK;
+            }
+
+            return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+        }
+        case TextureUsage::Linear:
+            return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case TextureUsage::Normal:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+void compressImageData(ImageData &imageData, TextureUsage usage)
+{
+    ZoneScoped;
+
+    assert(getBlockSize(imageData.format) == 0);
+
+    VkFormat format = getCompressedFormat(imageData, usage);
+    uint32_t blockSize = getBlockSize(format);
+
+    ImageData compressed = {
+        .width = imageData.width,
+        .height = imageData.height,
+        .mipLevels = imageData.mipLevels,
+        .format = format,
+    };
+    compressed.pixels.resize(compressed.getMipOffset(compressed.mipLevels));
+
+    for (uint32_t level = 0; level < imageData.mipLevels; level++) {
+        const unsigned char *src = imageData.pixels.data() + imageData.getMipOffset(level);
+        unsigned char *dst = compressed.pixels.data() + compressed.getMipOffset(level);
+
+        uint32_t width = imageData.getMipWidth(level);
+        uint32_t height = imageData.getMipHeight(level);
+
+        for (uint32_t blockY = 0; blockY < height; blockY += 4) {
+            for (uint32_t blockX = 0; blockX < width; blockX += 4) {
+                // blocks over the edge repeat the last row/column
+                unsigned char block[16 * 4];
+                for (uint32_t y = 0; y < 4; y++) {
+                    uint32_t srcY = std::min(blockY + y, height - 1);
+                    for (uint32_t x = 0; x < 4; x++) {
+                        uint32_t srcX = std::min(blockX + x, width - 1);
+                        memcpy(block + (y * 4 + x) * 4, src + (size_t(srcY) * width + srcX) * 4, 4);
+                    }
+                }
+
+                switch (format) {
+                    case VK_FORMAT_BC3_SRGB_BLOCK:
+                        encodeBC3Block(block, dst);
+                        break;
+                    case VK_FORMAT_BC5_UNORM_BLOCK:
+                        encodeBC5Block(block, dst);
+                        break;
+                    default:
+                        encodeBC1Block(block, dst);
+                        break;
+                }
+
+                dst += blockSize;
+            }
+        }
+    }
+
+    imageData = eastl::move(compressed);
+}
+
+} // namespace texture_compression
@@ -9,7 +9,8 @@ void DescriptorManager::initialize(Graphics &graphics)
     eastl::vector<VkDescriptorPoolSize> poolSizes = {
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}, // scene data
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_TEXTURES}, // textures
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4}, // materials, lights, joints, vertices
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 16}, // materials, lights, joints, vertices, draw data, draw commands, draw counts, cull data, meshlets, cluster tasks, cluster dispatch, lods, skin jobs, light grid, draw order, indices
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_STORAGE_IMAGES}, // storage images
     };
 
     pool = graphics.createDescriptorPool(poolSizes, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
@@ -51,6 +52,84 @@ void DescriptorManager::initialize(Graphics &graphics)
             .descriptorCount = 1,
             .stageFlags = VK_SHADER_STAGE_ALL,
         },
+        {
+            .binding = DRAW_DATA_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = DRAW_COMMANDS_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = DRAW_COUNTS_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = CULL_DATA_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = STORAGE_IMAGES_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = MAX_STORAGE_IMAGES,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = MESHLETS_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = CLUSTER_TASKS_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = CLUSTER_DISPATCH_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = LODS_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = SKIN_JOBS_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = LIGHT_GRID_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = DRAW_ORDER_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+        {
+            .binding = INDICES_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
     };
 
     setLayout = graphics.createDescriptorSetLayout(bindings.data(), bindings.size(), nullptr);
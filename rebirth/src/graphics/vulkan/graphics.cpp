@@ -3,12 +3,17 @@
 #include <cmath>
 #include <set>
 #include <stdio.h>
+#include <string.h>
 
+#include <rebirth/core/job_system.h>
 #include <rebirth/util/common.h>
+#include <rebirth/util/filesystem.h>
 #include <rebirth/util/logger.h>
 
 #include <rebirth/graphics/vulkan/swapchain.h>
 #include <rebirth/graphics/vulkan/util.h>
+#include <rebirth/graphics/vulkan/upload_manager.h>
+#include <rebirth/graphics/image_data.h>
 
 #include "backend/imgui_impl_sdl3.h"
 #include "backend/imgui_impl_vulkan.h"
@@ -74,12 +79,16 @@ namespace vulkan
 
         createAllocator(VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT);
 
+        createPipelineCache();
+
         swapchain.initialize(window, *this);
 
-        createCommandPool();
-        createCommandBuffers();
+        createCommandPools();
+
+        uploadManager.initialize(*this, computeQueueIndex, computeQueue);
 
         createSyncPrimitives();
+        createQueueSemaphores();
 
         descriptorManager.initialize(*this);
 
@@ -87,8 +96,33 @@ namespace vulkan
 
         setupImGui();
 
-        for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
-            tracyVkCtx[i] = TracyVkContext(physicalDevice, device, graphicsQueue, commandBuffers[i]);
+        // a gpu timeline per queue, tracy records its calibration into command buffers of a temporary pool
+        const char *queueNames[] = {"Graphics queue", "Async compute queue"};
+        for (uint32_t queue = 0; queue < QUEUE_TYPE_COUNT; queue++) {
+            if (QueueType(queue) == QueueType::AsyncCompute && !supportAsyncCompute())
+                continue;
+
+            VkCommandPoolCreateInfo tracyPoolCI = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+            tracyPoolCI.queueFamilyIndex = getQueueFamilyIndex(QueueType(queue));
+            tracyPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+            VkCommandPool tracyPool;
+            VK_CHECK(vkCreateCommandPool(device, &tracyPoolCI, nullptr, &tracyPool));
+
+            VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+            bufferAllocInfo.commandPool = tracyPool;
+            bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            bufferAllocInfo.commandBufferCount = 1;
+
+            for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+                VkCommandBuffer cmd;
+                VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &cmd));
+
+                tracyVkCtx[i][queue] = TracyVkContext(physicalDevice, device, QueueType(queue) == QueueType::Graphics ? graphicsQueue : computeQueue, cmd);
+                TracyVkContextName(tracyVkCtx[i][queue], queueNames[queue], strlen(queueNames[queue]));
+            }
+
+            vkDestroyCommandPool(device, tracyPool, nullptr);
         }
     }
 
@@ -98,8 +132,10 @@ namespace vulkan
 
         vkDeviceWaitIdle(device);
 
-        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
-            TracyVkDestroy(tracyVkCtx[i]);
+        for (auto &frameContexts : tracyVkCtx) {
+            for (TracyVkCtx &context : frameContexts)
+                if (context)
+                    TracyVkDestroy(context);
         }
 
         ImGui_ImplVulkan_Shutdown();
@@ -112,15 +148,26 @@ namespace vulkan
 
         for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
             vkDestroySemaphore(device, acquireSemaphores[i], nullptr);
-            vkDestroyFence(device, finishRenderFences[i], nullptr);
         }
 
-        destroyImage(colorImage);
+        for (VkSemaphore semaphore : queueSemaphores)
+            vkDestroySemaphore(device, semaphore, nullptr);
+
         destroyImage(depthImage);
 
         descriptorManager.destroy(device);
+        uploadManager.destroy();
+
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
         vkDestroyCommandPool(device, commandPool, nullptr);
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+            for (FrameCommandPool &queuePool : queueCommandPools[i])
+                vkDestroyCommandPool(device, queuePool.pool, nullptr);
+            for (FrameCommandPool &threadPool : threadCommandPools[i])
+                vkDestroyCommandPool(device, threadPool.pool, nullptr);
+        }
         swapchain.destroy(device);
 
         vmaDestroyAllocator(allocator);
@@ -242,25 +289,43 @@ namespace vulkan
         deviceFeatures = {};
         deviceFeatures.fillModeNonSolid = VK_TRUE;
         deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        deviceFeatures.multiDrawIndirect = VK_TRUE;
+        deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+        deviceFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+
+        // baked textures are block compressed, available on every desktop gpu
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+        // VK 1.1 features
+        VkPhysicalDeviceVulkan11Features features11 = {
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+        features11.shaderDrawParameters = VK_TRUE; // gl_DrawID of the visibility pass
 
         // VK 1.2 features
         VkPhysicalDeviceVulkan12Features features12 = {
             VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+        features12.pNext = &features11;
         features12.runtimeDescriptorArray = VK_TRUE;
         features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
         features12.bufferDeviceAddress = VK_TRUE;
+        features12.drawIndirectCount = VK_TRUE;
+        features12.timelineSemaphore = VK_TRUE;
+        features12.separateDepthStencilLayouts = VK_TRUE; // depth attachment layouts
 
-        // Dynamic rendering features
-        VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures = {
-            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES};
-        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
-        dynamicRenderingFeatures.pNext = &features12;
+        // VK 1.3 features
+        VkPhysicalDeviceVulkan13Features features13 = {
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+        features13.dynamicRendering = VK_TRUE;
+        features13.synchronization2 = VK_TRUE; // render graph barriers
+        features13.pNext = &features12;
 
         const char *deviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
         // create device
         VkDeviceCreateInfo deviceCI = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-        deviceCI.pNext = &dynamicRenderingFeatures;
+        deviceCI.pNext = &features13;
         deviceCI.ppEnabledExtensionNames = deviceExtensions;
         deviceCI.enabledExtensionCount = ARRAY_SIZE(deviceExtensions);
         deviceCI.pEnabledFeatures = &deviceFeatures;
@@ -300,9 +365,11 @@ namespace vulkan
                     presentQueueIndex = i;
             }
 
-            if (computeQueueIndex == UINT32_MAX && queueFamily.queueCount > 0 &&
-                queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
-                computeQueueIndex = i;
+            // prefer a family without graphics, it runs transfers and compute asynchronously to rendering
+            if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) {
+                if (computeQueueIndex == UINT32_MAX || (!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && computeQueueIndex == graphicsQueueIndex))
+                    computeQueueIndex = i;
+            }
             i++;
         }
 
@@ -369,13 +436,86 @@ namespace vulkan
         VK_CHECK(vmaCreateAllocator(&createInfo, &allocator));
     }
 
-    void Graphics::createCommandPool()
+    // a file per device and driver, another driver (or version) can't use the data and starts its own
+    std::filesystem::path Graphics::getPipelineCachePath() const
+    {
+        char name[64];
+        int length = snprintf(name, sizeof(name), "%08x_%08x_", deviceProperties.deviceID, deviceProperties.driverVersion);
+        for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+            length += snprintf(name + length, sizeof(name) - length, "%02x", deviceProperties.pipelineCacheUUID[i]);
+
+        return std::filesystem::path("build/pipeline_cache") / (eastl::string(name) + ".bin").c_str();
+    }
+
+    void Graphics::createPipelineCache()
+    {
+        ZoneScoped;
+
+        const std::filesystem::path path = getPipelineCachePath();
+
+        eastl::vector<char> data;
+        if (std::filesystem::exists(path))
+            data = filesystem::readFile(path);
+
+        // drivers are supposed to reject data of another device, not all of them check it
+        VkPipelineCacheHeaderVersionOne header = {};
+        if (data.size() >= sizeof(header))
+            memcpy(&header, data.data(), sizeof(header));
+
+        pipelineCacheWarm = data.size() >= sizeof(header) &&
+                            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                            header.vendorID == deviceProperties.vendorID &&
+                            header.deviceID == deviceProperties.deviceID &&
+                            memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+        VkPipelineCacheCreateInfo createInfo = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+        if (pipelineCacheWarm) {
+            createInfo.initialDataSize = data.size();
+            createInfo.pInitialData = data.data();
+        }
+
+        VK_CHECK(vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache));
+
+        logger::logInfo("Pipeline cache ", pipelineCacheWarm ? "loaded" : "is empty", ", ", createInfo.initialDataSize / 1024, " KB - ", path);
+    }
+
+    void Graphics::savePipelineCache()
+    {
+        ZoneScoped;
+
+        size_t size = 0;
+        VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+
+        eastl::vector<char> data(size);
+        VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()));
+
+        filesystem::writeFile(getPipelineCachePath(), data.data(), size);
+    }
+
+    void Graphics::createCommandPools()
     {
         VkCommandPoolCreateInfo commandPoolCI = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
         commandPoolCI.queueFamilyIndex = graphicsQueueIndex;
         commandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
         VK_CHECK(vkCreateCommandPool(device, &commandPoolCI, nullptr, &commandPool));
+
+        // frame command buffers are reset with their pools
+        VkCommandPoolCreateInfo framePoolCI = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+        framePoolCI.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+            for (uint32_t queue = 0; queue < QUEUE_TYPE_COUNT; queue++) {
+                framePoolCI.queueFamilyIndex = getQueueFamilyIndex(QueueType(queue));
+                VK_CHECK(vkCreateCommandPool(device, &framePoolCI, nullptr, &queueCommandPools[i][queue].pool));
+            }
+
+            // a pool per thread, command pools can't be used from several threads at once
+            framePoolCI.queueFamilyIndex = graphicsQueueIndex;
+            threadCommandPools[i].resize(JobSystem::instance()->getThreadCount());
+            for (FrameCommandPool &threadPool : threadCommandPools[i])
+                VK_CHECK(vkCreateCommandPool(device, &framePoolCI, nullptr, &threadPool.pool));
+        }
     }
 
     VkCommandBuffer Graphics::createCommandBuffer(VkCommandBufferLevel level, bool start)
@@ -424,7 +564,20 @@ namespace vulkan
 
         VK_CHECK(vkEndCommandBuffer(cmd));
 
+        // commands could read uploaded resources
+        uint64_t uploadValue = uploadManager.flush();
+        VkSemaphore uploadSemaphore = uploadManager.getSemaphore();
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &uploadValue;
+
         VkSubmitInfo submit = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+        submit.pNext = &timelineInfo;
+        submit.waitSemaphoreCount = 1;
+        submit.pWaitSemaphores = &uploadSemaphore;
+        submit.pWaitDstStageMask = &waitStage;
         submit.pCommandBuffers = &cmd;
         submit.commandBufferCount = 1;
 
@@ -437,14 +590,65 @@ namespace vulkan
             vkFreeCommandBuffers(device, pool, 1, &cmd);
     }
 
-    void Graphics::createCommandBuffers()
+    VkCommandBuffer Graphics::allocateCommandBuffer(FrameCommandPool &pool, VkCommandBufferLevel level)
     {
-        VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-        bufferAllocInfo.commandPool = commandPool;
-        bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        bufferAllocInfo.commandBufferCount = commandBuffers.size();
+        // command buffers of the pool are kept through resets, a pool only hands out one level
+        if (pool.usedCount == pool.commandBuffers.size()) {
+            VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+            bufferAllocInfo.commandPool = pool.pool;
+            bufferAllocInfo.level = level;
+            bufferAllocInfo.commandBufferCount = 1;
+
+            VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &pool.commandBuffers.push_back()));
+        }
+
+        return pool.commandBuffers[pool.usedCount++];
+    }
+
+    void Graphics::recordParallel(
+        VkCommandBuffer cmd,
+        const VkCommandBufferInheritanceRenderingInfo &renderingInfo,
+        uint32_t count,
+        uint32_t minRangeSize,
+        eastl::function<void(VkCommandBuffer cmd, uint32_t begin, uint32_t end)> function)
+    {
+        ZoneScoped;
+
+        if (count == 0)
+            return;
+
+        // a few ranges per thread so the workers balance them, not smaller than minRangeSize
+        JobSystem *jobSystem = JobSystem::instance();
+        const uint32_t targetRangeCount = jobSystem->getThreadCount() * 4;
+        const uint32_t rangeSize = eastl::max((count + targetRangeCount - 1) / targetRangeCount, eastl::max(minRangeSize, 1u));
+        const uint32_t rangeCount = (count + rangeSize - 1) / rangeSize;
+
+        eastl::vector<VkCommandBuffer> secondaries(rangeCount);
+
+        VkCommandBufferInheritanceInfo inheritanceInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+        inheritanceInfo.pNext = &renderingInfo;
+
+        VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        JobCounter counter;
+        jobSystem->parallelFor(&counter, rangeCount, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t range = begin; range < end; range++) {
+                ZoneScopedN("Record range");
+
+                FrameCommandPool &threadPool = threadCommandPools[currentFrame][jobSystem->getThreadIndex()];
+                VkCommandBuffer secondary = allocateCommandBuffer(threadPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+                VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+                function(secondary, range * rangeSize, eastl::min((range + 1) * rangeSize, count));
+                VK_CHECK(vkEndCommandBuffer(secondary));
 
-        VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, commandBuffers.data()));
+                secondaries[range] = secondary;
+            }
+        });
+        jobSystem->wait(counter);
+
+        vkCmdExecuteCommands(cmd, rangeCount, secondaries.data());
     }
 
     void Graphics::createSyncPrimitives()
@@ -461,18 +665,28 @@ namespace vulkan
 
         for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
             acquireSemaphores[i] = createSemaphore();
-            finishRenderFences[i] = createFence(VK_FENCE_CREATE_SIGNALED_BIT);
 
             vulkan::setDebugName(
                 device,
                 (uint64_t)acquireSemaphores[i],
                 VK_OBJECT_TYPE_SEMAPHORE,
                 "acquire semaphore " + eastl::to_string(i));
-            vulkan::setDebugName(
-                device,
-                (uint64_t)finishRenderFences[i],
-                VK_OBJECT_TYPE_FENCE,
-                "finish render fence " + eastl::to_string(i));
+        }
+    }
+
+    void Graphics::createQueueSemaphores()
+    {
+        VkSemaphoreTypeCreateInfo semaphoreTypeCI = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+        semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        semaphoreTypeCI.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreCI = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+        semaphoreCI.pNext = &semaphoreTypeCI;
+
+        const char *names[] = {"Graphics queue semaphore", "Async compute queue semaphore"};
+        for (uint32_t queue = 0; queue < QUEUE_TYPE_COUNT; queue++) {
+            VK_CHECK(vkCreateSemaphore(device, &semaphoreCI, nullptr, &queueSemaphores[queue]));
+            setDebugName(device, reinterpret_cast<uint64_t>(queueSemaphores[queue]), VK_OBJECT_TYPE_SEMAPHORE, names[queue]);
         }
     }
 
@@ -485,12 +699,10 @@ namespace vulkan
 
         swapchain.destroy(device);
 
-        destroyImage(colorImage);
         destroyImage(depthImage);
 
         for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
             vkDestroySemaphore(device, acquireSemaphores[i], nullptr);
-            vkDestroyFence(device, finishRenderFences[i], nullptr);
         }
 
         for (auto &semaphore : submitSemaphores) {
@@ -501,6 +713,8 @@ namespace vulkan
 
         createImages();
         createSyncPrimitives();
+
+        swapchainGeneration++;
     }
 
     void Graphics::setupImGui()
@@ -550,34 +764,27 @@ namespace vulkan
             return;
         }
 
-        BufferCreateInfo stagingCI = {
-            .size = size,
-            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        };
-
-        Buffer staging;
-        createBuffer(staging, stagingCI);
-        memcpy(staging.info.pMappedData, data, size);
-
-        VK_CHECK(vmaFlushAllocation(allocator, staging.allocation, 0, VK_WHOLE_SIZE));
-
-        // command buffer start
-        VkCommandBuffer copyCmd = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-        // copy
-        VkBufferCopy copyRegion = {0, 0, size};
-        vkCmdCopyBuffer(copyCmd, staging.buffer, buffer.buffer, 1, &copyRegion);
-
-        // submit
-        flushCommandBuffer(copyCmd, graphicsQueue, commandPool, true);
-
-        destroyBuffer(staging);
+        uploadManager.uploadBuffer(buffer, data, size);
     }
 
     VkCommandBuffer Graphics::beginCommandBuffer()
     {
-        VK_CHECK(vkWaitForFences(device, 1, &finishRenderFences[currentFrame], VK_TRUE, ~0ull));
-        VK_CHECK(vkResetFences(device, 1, &finishRenderFences[currentFrame]));
+        // every submission of the frame is finished, its command buffers and resources are free
+        VkSemaphoreWaitInfo waitInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+        waitInfo.semaphoreCount = QUEUE_TYPE_COUNT;
+        waitInfo.pSemaphores = queueSemaphores.data();
+        waitInfo.pValues = frameValues[currentFrame].data();
+        VK_CHECK(vkWaitSemaphores(device, &waitInfo, ~0ull));
+
+        for (FrameCommandPool &queuePool : queueCommandPools[currentFrame]) {
+            VK_CHECK(vkResetCommandPool(device, queuePool.pool, 0));
+            queuePool.usedCount = 0;
+        }
+
+        for (FrameCommandPool &threadPool : threadCommandPools[currentFrame]) {
+            VK_CHECK(vkResetCommandPool(device, threadPool.pool, 0));
+            threadPool.usedCount = 0;
+        }
 
         VkResult result = swapchain.acquireNextImage(device, acquireSemaphores[currentFrame]);
         if (resizeRequested || result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -588,8 +795,14 @@ namespace vulkan
             exit(EXIT_FAILURE);
         }
 
-        VkCommandBuffer cmd = commandBuffers[currentFrame];
-        VK_CHECK(vkResetCommandBuffer(cmd, 0));
+        swapchainWaited = false;
+
+        return beginQueueCommandBuffer(QueueType::Graphics);
+    }
+
+    VkCommandBuffer Graphics::beginQueueCommandBuffer(QueueType queue)
+    {
+        VkCommandBuffer cmd = allocateCommandBuffer(queueCommandPools[currentFrame][uint32_t(queue)], VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
         // Command buffer begin
         VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
@@ -599,25 +812,19 @@ namespace vulkan
         return cmd;
     }
 
-    void Graphics::submitCommandBuffer(VkCommandBuffer cmd)
+    uint64_t Graphics::submitQueueCommandBuffer(VkCommandBuffer cmd, QueueType queue, const eastl::vector<QueueWait> &waits, bool waitSwapchain)
+    {
+        return submit(cmd, queue, waits, waitSwapchain, VK_NULL_HANDLE);
+    }
+
+    void Graphics::submitCommandBuffer(VkCommandBuffer cmd, const eastl::vector<QueueWait> &waits)
     {
         uint32_t imageIndex = swapchain.getImageIndex();
 
-        // Command buffer end
-        VK_CHECK(vkEndCommandBuffer(cmd));
+        submit(cmd, QueueType::Graphics, waits, true, submitSemaphores[imageIndex]);
 
-        // Submit
-        VkSubmitInfo submit = {};
-        VkPipelineStageFlags stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit.waitSemaphoreCount = 1;
-        submit.pWaitSemaphores = &acquireSemaphores[currentFrame];
-        submit.pWaitDstStageMask = stages;
-        submit.commandBufferCount = 1;
-        submit.pCommandBuffers = &cmd;
-        submit.signalSemaphoreCount = 1;
-        submit.pSignalSemaphores = &submitSemaphores[imageIndex];
-        VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, finishRenderFences[currentFrame]));
+        // the frame in flight is done when both queues get here
+        frameValues[currentFrame] = submittedValues;
 
         // Present
         VkResult result = swapchain.present(presentQueue, submitSemaphores[imageIndex]);
@@ -627,6 +834,77 @@ namespace vulkan
         currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
     }
 
+    uint64_t Graphics::submit(VkCommandBuffer cmd, QueueType queue, const eastl::vector<QueueWait> &waits, bool waitSwapchain, VkSemaphore signalSemaphore)
+    {
+        // Command buffer end
+        VK_CHECK(vkEndCommandBuffer(cmd));
+
+        // resources used by the frame could still be uploading
+        eastl::vector<VkSemaphoreSubmitInfo> waitInfos;
+        waitInfos.push_back({
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = uploadManager.getSemaphore(),
+            .value = uploadManager.flush(),
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        });
+
+        if (waitSwapchain && !swapchainWaited) {
+            waitInfos.push_back({
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .semaphore = acquireSemaphores[currentFrame],
+                .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            });
+            swapchainWaited = true;
+        }
+
+        for (const QueueWait &wait : waits) {
+            waitInfos.push_back({
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .semaphore = queueSemaphores[uint32_t(wait.queue)],
+                .value = wait.value,
+                .stageMask = wait.stages,
+            });
+        }
+
+        const uint64_t value = ++submittedValues[uint32_t(queue)];
+
+        VkSemaphoreSubmitInfo signalInfos[] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .semaphore = queueSemaphores[uint32_t(queue)],
+                .value = value,
+                .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .semaphore = signalSemaphore,
+                .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            },
+        };
+
+        VkCommandBufferSubmitInfo cmdInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO};
+        cmdInfo.commandBuffer = cmd;
+
+        VkSubmitInfo2 submitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+        submitInfo.waitSemaphoreInfoCount = waitInfos.size();
+        submitInfo.pWaitSemaphoreInfos = waitInfos.data();
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &cmdInfo;
+        submitInfo.signalSemaphoreInfoCount = signalSemaphore != VK_NULL_HANDLE ? 2 : 1;
+        submitInfo.pSignalSemaphoreInfos = signalInfos;
+
+        VK_CHECK(vkQueueSubmit2(queue == QueueType::Graphics ? graphicsQueue : computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+        return value;
+    }
+
+    TracyVkCtx &Graphics::getTracyContext(QueueType queue)
+    {
+        // without an async compute queue its work is on the graphics timeline
+        TracyVkCtx &context = tracyVkCtx[currentFrame][uint32_t(queue)];
+        return context ? context : tracyVkCtx[currentFrame][uint32_t(QueueType::Graphics)];
+    }
+
     bool Graphics::supportTimestamps()
     {
         return deviceProperties.limits.timestampPeriod > 0 && deviceProperties.limits.timestampComputeAndGraphics;
@@ -638,7 +916,10 @@ namespace vulkan
         image.height = createInfo.height;
         image.channels = createInfo.channels;
 
-        image.mipLevels = generateMipmaps ? static_cast<uint32_t>(floor(log2(std::max(createInfo.width, createInfo.height))) + 1) : 1;
+        if (createInfo.mipLevels > 0)
+            image.mipLevels = createInfo.mipLevels;
+        else
+            image.mipLevels = generateMipmaps ? static_cast<uint32_t>(floor(log2(std::max(createInfo.width, createInfo.height))) + 1) : 1;
 
         VkImageCreateInfo imageInfo = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
         imageInfo.imageType = createInfo.imageType;
@@ -653,6 +934,15 @@ namespace vulkan
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         imageInfo.flags = createInfo.flags;
 
+        // Upload targets are written by the upload queue and read by graphics, others can be used by async compute passes.
+        // Images only cleared or blitted on graphics stay exclusive.
+        uint32_t queueFamilies[] = {graphicsQueueIndex, computeQueueIndex};
+        if (graphicsQueueIndex != computeQueueIndex && (createInfo.upload || createInfo.asyncCompute)) {
+            imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            imageInfo.queueFamilyIndexCount = ARRAY_SIZE(queueFamilies);
+            imageInfo.pQueueFamilyIndices = queueFamilies;
+        }
+
         VmaAllocationCreateInfo allocInfo = {};
         allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
         allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
@@ -703,106 +993,70 @@ namespace vulkan
 
     void Graphics::createLoadImage(Image &image, ImageCreateInfo &createInfo, unsigned char *data, uint32_t size)
     {
-        createImage(image, createInfo, true);
+        ImageData imageData;
+        imageData.width = createInfo.width;
+        imageData.height = createInfo.height;
+        imageData.format = createInfo.format;
+        imageData.pixels.assign(data, data + size);
 
-        BufferCreateInfo stagingCI = {
-            .size = size,
-            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        };
+        stbi_image_free(data);
 
-        Buffer staging;
-        createBuffer(staging, stagingCI);
-        memcpy(staging.info.pMappedData, data, size);
+        generateMipChain(imageData, createInfo.format == VK_FORMAT_R8G8B8A8_SRGB);
+        createImagesFromData(&image, &imageData, 1, createInfo);
+    }
 
-        stbi_image_free(data);
+    void Graphics::createImagesFromData(Image *images, const ImageData *imageData, uint32_t count, ImageCreateInfo createInfo)
+    {
+        ZoneScoped;
 
-        // command buffer start
-        VkCommandBuffer copyCmd = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        for (uint32_t i = 0; i < count; i++) {
+            createInfo.width = imageData[i].width;
+            createInfo.height = imageData[i].height;
+            createInfo.format = imageData[i].format;
+            createImageFromMipChain(images[i], createInfo, imageData[i].mipLevels, imageData[i].pixels.data(), imageData[i].pixels.size());
+        }
 
-        // transition image to transfer
-        VkImageMemoryBarrier barrier0 = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = image.image,
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1}};
+        // start copying while the caller prepares the next images
+        uploadManager.flush();
+    }
 
-        vkCmdPipelineBarrier(
-            copyCmd,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0,
-            0,
-            nullptr,
-            0,
-            nullptr,
-            1,
-            &barrier0);
+    void Graphics::createImageFromMipChain(Image &image, ImageCreateInfo &createInfo, uint32_t mipLevels, const unsigned char *pixels, size_t size)
+    {
+        if (getBlockSize(createInfo.format) > 0 && !deviceFeatures.textureCompressionBC) {
+            logger::logError("Block compressed textures are not supported by the device");
 
-        // copy
-        VkBufferImageCopy copyRegion = {};
-        copyRegion.imageSubresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1};
-        copyRegion.imageExtent = {
-            static_cast<uint32_t>(image.width),
-            static_cast<uint32_t>(image.height),
-            1};
-
-        vkCmdCopyBufferToImage(
-            copyCmd,
-            staging.buffer,
-            image.image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &copyRegion);
+            ImageData fallback;
+            createFallbackImageData(fallback);
 
-        // transition image to transfer src for read during blit
-        VkImageMemoryBarrier barrier1 = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = image.image,
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1}};
+            ImageCreateInfo fallbackInfo = createInfo;
+            fallbackInfo.width = fallback.width;
+            fallbackInfo.height = fallback.height;
+            fallbackInfo.format = fallback.format;
+            createImageFromMipChain(image, fallbackInfo, fallback.mipLevels, fallback.pixels.data(), fallback.pixels.size());
+            return;
+        }
 
-        vkCmdPipelineBarrier(
-            copyCmd,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0,
-            0,
-            nullptr,
-            0,
-            nullptr,
-            1,
-            &barrier1);
+        // ktx2 files can have partial chains
+        createInfo.mipLevels = mipLevels;
+        createInfo.upload = true;
+        createImage(image, createInfo, mipLevels > 1);
 
-        // submit
-        flushCommandBuffer(copyCmd, graphicsQueue, commandPool, true);
+        // levels are tightly packed one after another
+        eastl::vector<VkBufferImageCopy> copyRegions(mipLevels);
+        VkDeviceSize offset = 0;
+        for (uint32_t level = 0; level < mipLevels; level++) {
+            uint32_t width = std::max(createInfo.width >> level, 1u);
+            uint32_t height = std::max(createInfo.height >> level, 1u);
 
-        destroyBuffer(staging);
+            copyRegions[level].bufferOffset = offset;
+            copyRegions[level].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+            copyRegions[level].imageExtent = {width, height, 1};
+
+            offset += getMipSize(createInfo.format, width, height);
+        }
+        assert(offset == size);
 
-        generateMipmaps(image);
+        uploadManager.uploadImage(image, pixels, size, copyRegions.data(), copyRegions.size());
     }
 
     void Graphics::createCubemapImage(Image &image, ImageCreateInfo &createInfo, std::filesystem::path dir)
@@ -822,58 +1076,18 @@ namespace vulkan
             }
         }
 
+        createInfo.upload = true;
         createImage(image, createInfo, false);
 
-        uint32_t size = createInfo.width * createInfo.height * CUBE_FACES_COUNT * STBI_rgb_alpha;
-        uint32_t layerSize = size / CUBE_FACES_COUNT;
+        uint32_t layerSize = createInfo.width * createInfo.height * STBI_rgb_alpha;
 
-        BufferCreateInfo bufferCreateInfo = {
-            .size = size,
-            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        };
-
-        Buffer staging;
-        createBuffer(staging, bufferCreateInfo);
-
-        // copy image pixels into staging buffer
+        // faces are laid out one after another
+        eastl::vector<unsigned char> pixels(layerSize * CUBE_FACES_COUNT);
         for (uint32_t i = 0; i < CUBE_FACES_COUNT; i++) {
-            unsigned char *dst = static_cast<unsigned char *>(staging.info.pMappedData) + (layerSize * i);
-            memcpy(dst, imagePixels[i], layerSize);
+            memcpy(pixels.data() + layerSize * i, imagePixels[i], layerSize);
+            stbi_image_free(imagePixels[i]);
         }
 
-        // create temporary command buffer
-        VkCommandBuffer copyCmd = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-        // transition image to transfer
-        VkImageMemoryBarrier barrier0 = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = image.image,
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = CUBE_FACES_COUNT}};
-
-        vkCmdPipelineBarrier(
-            copyCmd,
-            VK_PIPELINE_STAGE_HOST_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0,
-            0,
-            nullptr,
-            0,
-            nullptr,
-            1,
-            &barrier0);
-
-        // copy
         eastl::vector<VkBufferImageCopy> copyRegions(CUBE_FACES_COUNT);
         for (uint32_t i = 0; i < CUBE_FACES_COUNT; i++) {
             copyRegions[i].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, i, 1};
@@ -884,47 +1098,7 @@ namespace vulkan
             copyRegions[i].bufferOffset = i * layerSize;
         }
 
-        vkCmdCopyBufferToImage(
-            copyCmd,
-            staging.buffer,
-            image.image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            copyRegions.size(),
-            copyRegions.data());
-
-        // transition image to fragment shader
-        VkImageMemoryBarrier barrier1 = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = image.image,
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = CUBE_FACES_COUNT}};
-
-        vkCmdPipelineBarrier(
-            copyCmd,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            0,
-            0,
-            nullptr,
-            0,
-            nullptr,
-            1,
-            &barrier1);
-
-        // submit
-        flushCommandBuffer(copyCmd, graphicsQueue, commandPool, true);
-
-        destroyBuffer(staging);
+        uploadManager.uploadImage(image, pixels.data(), pixels.size(), copyRegions.data(), copyRegions.size(), CUBE_FACES_COUNT);
     }
 
     void Graphics::generateMipmaps(Image &image)
@@ -1091,6 +1265,14 @@ namespace vulkan
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         bufferInfo.usage = createInfo.usage;
 
+        // buffers are shared by the upload and async compute queue with graphics, concurrent sharing doesn't cost buffers anything
+        uint32_t queueFamilies[] = {graphicsQueueIndex, computeQueueIndex};
+        if (graphicsQueueIndex != computeQueueIndex) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = ARRAY_SIZE(queueFamilies);
+            bufferInfo.pQueueFamilyIndices = queueFamilies;
+        }
+
         VmaAllocationCreateInfo allocInfo = {};
         allocInfo.usage = createInfo.memUsage;
         allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
@@ -1265,24 +1447,17 @@ namespace vulkan
     {
         const VkExtent2D extent = swapchain.getExtent();
 
-        // color image multisample
+        // depth image (sampled when building the depth pyramid on async compute), the multisampled color image is a render graph transient
         ImageCreateInfo createInfo = {
             .width = extent.width,
             .height = extent.height,
-            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-            .format = swapchain.getSurfaceFormat().format,
+            .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            .format = VK_FORMAT_D32_SFLOAT,
+            .aspect = VK_IMAGE_ASPECT_DEPTH_BIT,
             .samples = getSampleCount(),
+            .asyncCompute = true,
         };
 
-        createImage(colorImage, createInfo, false);
-        vulkan::setDebugName(device, reinterpret_cast<uint64_t>(colorImage.image), VK_OBJECT_TYPE_IMAGE, "Color image multisample");
-
-        // depth image
-        createInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-        createInfo.format = VK_FORMAT_D32_SFLOAT;
-        createInfo.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
-        createInfo.samples = getSampleCount();
-
         createImage(depthImage, createInfo, false);
         vulkan::setDebugName(getDevice(), reinterpret_cast<uint64_t>(depthImage.image), VK_OBJECT_TYPE_IMAGE, "Depth image");
     }
@@ -48,6 +48,7 @@ namespace vulkan
         dynamicState = {VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
 
         pipelineLayout = {VK_NULL_HANDLE};
+        pipelineCache = {VK_NULL_HANDLE};
     }
 
     void PipelineBuilder::setBindingDescription(
@@ -71,6 +72,8 @@ namespace vulkan
 
     void PipelineBuilder::clearShaders() { shaderStages.clear(); }
 
+    void PipelineBuilder::setPipelineCache(VkPipelineCache cache) { pipelineCache = cache; }
+
     void PipelineBuilder::setShader(
         VkShaderModule module,
         VkShaderStageFlagBits stage,
@@ -192,7 +195,21 @@ namespace vulkan
         pipelineInfo.renderPass = nullptr;
 
         VkPipeline pipeline;
-        VK_CHECK(vkCreateGraphicsPipelines(device, 0, 1, &pipelineInfo, nullptr, &pipeline));
+        VK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+
+        return pipeline;
+    }
+
+    VkPipeline PipelineBuilder::buildCompute(VkDevice device)
+    {
+        assert(shaderStages.size() == 1 && shaderStages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT);
+
+        VkComputePipelineCreateInfo pipelineInfo = {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+        pipelineInfo.stage = shaderStages[0];
+        pipelineInfo.layout = pipelineLayout;
+
+        VkPipeline pipeline;
+        VK_CHECK(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
 
         return pipeline;
     }
@@ -0,0 +1,719 @@
+#include <rebirth/graphics/vulkan/render_graph.h>
+#include <rebirth/graphics/vulkan/graphics.h>
+#include <rebirth/graphics/vulkan/util.h>
+
+#include <rebirth/util/common.h>
+#include <rebirth/util/logger.h>
+
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+
+namespace vulkan
+{
+
+static constexpr VkAccessFlags2 WRITE_ACCESS = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                                               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+                                               VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+static VkImageAspectFlags getAspect(VkFormat format)
+{
+    switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    case VK_FORMAT_S8_UINT:
+        return VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+static bool overlaps(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB)
+{
+    return firstA <= lastB && firstB <= lastA;
+}
+
+RenderGraph::AccessInfo RenderGraph::getAccessInfo(RenderGraphAccess access)
+{
+    switch (access) {
+    case RenderGraphAccess::ColorAttachment:
+        return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true};
+    case RenderGraphAccess::DepthAttachment:
+        return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true};
+    case RenderGraphAccess::VertexShaderRead:
+        return {VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false};
+    case RenderGraphAccess::FragmentShaderRead:
+        return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false};
+    case RenderGraphAccess::ComputeShaderRead:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false};
+    case RenderGraphAccess::ComputeShaderReadGeneral:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false};
+    case RenderGraphAccess::ComputeShaderWrite:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true};
+    case RenderGraphAccess::TransferWrite:
+        return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true};
+    case RenderGraphAccess::IndirectRead:
+        return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false};
+    case RenderGraphAccess::HostRead:
+        return {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false};
+    case RenderGraphAccess::Present:
+        return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, false};
+    case RenderGraphAccess::None:
+        break;
+    }
+
+    return {};
+}
+
+void RenderGraph::BarrierBatch::record(VkCommandBuffer cmd) const
+{
+    const bool hasMemoryBarrier = memoryBarrier.srcStageMask != VK_PIPELINE_STAGE_2_NONE || memoryBarrier.dstStageMask != VK_PIPELINE_STAGE_2_NONE;
+    if (!hasMemoryBarrier && imageBarriers.empty())
+        return;
+
+    VkDependencyInfo dependencyInfo = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependencyInfo.memoryBarrierCount = hasMemoryBarrier ? 1 : 0;
+    dependencyInfo.pMemoryBarriers = &memoryBarrier;
+    dependencyInfo.imageMemoryBarrierCount = imageBarriers.size();
+    dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+}
+
+void RenderGraph::initialize(Graphics &graphics)
+{
+    this->graphics = &graphics;
+}
+
+void RenderGraph::destroy()
+{
+    destroyTransientImages();
+
+    resources.clear();
+    passes.clear();
+    importedStates.clear();
+}
+
+void RenderGraph::reset()
+{
+    resources.clear();
+    passes.clear();
+    submissions.clear();
+    declaredImages.clear();
+    finalWaits.clear();
+
+    for (BarrierBatch &batch : finalBarriers)
+        batch = {};
+}
+
+uint32_t RenderGraph::importImage(const char *name, VkImage image, VkImageAspectFlags aspect, RenderGraphAccess finalAccess)
+{
+    Resource &resource = resources.push_back();
+    resource.name = name;
+    resource.type = ResourceType::Image;
+    resource.image = image;
+    resource.aspect = aspect;
+    resource.finalAccess = finalAccess;
+    resource.persistent = true;
+
+    auto it = importedStates.find(image);
+    if (it != importedStates.end())
+        resource.state = it->second;
+
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::importBuffer(const char *name, VkBuffer buffer, RenderGraphAccess finalAccess)
+{
+    Resource &resource = resources.push_back();
+    resource.name = name;
+    resource.type = ResourceType::Buffer;
+    resource.buffer = buffer;
+    resource.finalAccess = finalAccess;
+
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::importSwapchainImage(VkImage image, VkImageView view)
+{
+    Resource &resource = resources.push_back();
+    resource.name = "Swapchain image";
+    resource.type = ResourceType::Image;
+    resource.image = image;
+    resource.view = view;
+    resource.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    resource.finalAccess = RenderGraphAccess::Present;
+    resource.swapchain = true;
+
+    // the submission waits for the acquire semaphore at the color attachment output stage, the first barrier chains to it
+    resource.state.writeStages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::createImage(const char *name, const ImageDesc &desc)
+{
+    Resource &resource = resources.push_back();
+    resource.name = name;
+    resource.type = ResourceType::TransientImage;
+    resource.aspect = getAspect(desc.format);
+    resource.transient = declaredImages.size();
+
+    TransientImage &image = declaredImages.push_back();
+    image.name = name;
+    image.desc = desc;
+    image.aspect = resource.aspect;
+
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::addPass(const char *name, PassFunction function, QueueType queue)
+{
+    Pass &pass = passes.push_back();
+    pass.name = name;
+    pass.function = eastl::move(function);
+    pass.queue = queue;
+
+    return passes.size() - 1;
+}
+
+void RenderGraph::use(uint32_t pass, uint32_t resource, RenderGraphAccess access, bool discard)
+{
+    const AccessInfo info = getAccessInfo(access);
+
+    for (PassUse &passUse : passes[pass].uses) {
+        if (passUse.resource != resource)
+            continue;
+
+        if (resources[resource].type != ResourceType::Buffer && passUse.info.layout != info.layout)
+            logger::logError("Render graph pass \"", passes[pass].name.c_str(), "\" uses \"", resources[resource].name.c_str(), "\" in two layouts");
+
+        passUse.info.stages |= info.stages;
+        passUse.info.access |= info.access;
+        passUse.info.usage |= info.usage;
+        passUse.info.write |= info.write;
+        passUse.discard &= discard;
+        return;
+    }
+
+    passes[pass].uses.push_back({resource, info, discard});
+}
+
+void RenderGraph::compile()
+{
+    ZoneScoped;
+
+    cullPasses();
+
+    if (!graphics->supportAsyncCompute())
+        for (Pass &pass : passes)
+            pass.queue = QueueType::Graphics;
+
+    // usage and lifetime of the transient images over the passes that run
+    for (uint32_t i = 0; i < passes.size(); i++) {
+        if (passes[i].culled)
+            continue;
+
+        for (const PassUse &use : passes[i].uses) {
+            const Resource &resource = resources[use.resource];
+            if (resource.type != ResourceType::TransientImage)
+                continue;
+
+            TransientImage &image = declaredImages[resource.transient];
+            image.usage |= use.info.usage;
+            image.queues |= 1 << uint32_t(passes[i].queue);
+            image.firstPass = eastl::min(image.firstPass, i);
+            image.lastPass = eastl::max(image.lastPass, i);
+        }
+    }
+
+    if (canReuseTransientImages()) {
+        for (uint32_t i = 0; i < transientImages.size(); i++) {
+            transientImages[i].firstPass = declaredImages[i].firstPass;
+            transientImages[i].lastPass = declaredImages[i].lastPass;
+        }
+    } else {
+        createTransientImages();
+    }
+
+    for (Resource &resource : resources) {
+        if (resource.type == ResourceType::TransientImage) {
+            resource.image = transientImages[resource.transient].image;
+            resource.view = transientImages[resource.transient].view;
+        }
+    }
+
+    //
+    // Submissions and barriers
+    //
+    bool swapchainWaited = false;
+
+    for (uint32_t i = 0; i < passes.size(); i++) {
+        Pass &pass = passes[i];
+        if (pass.culled)
+            continue;
+
+        // contents are undefined, the first use of a transient image only waits for the image that was in the memory before
+        for (const PassUse &use : pass.uses) {
+            Resource &resource = resources[use.resource];
+            if (resource.type != ResourceType::TransientImage || i != transientImages[resource.transient].firstPass)
+                continue;
+
+            const MemoryBlock &block = memoryBlocks[transientImages[resource.transient].block];
+            resource.state = {
+                .writeStages = block.lastStages,
+                .writeAccess = block.lastWriteAccess,
+                .queue = block.lastQueue,
+                .submission = block.lastSubmission,
+                .value = block.lastValue,
+            };
+        }
+
+        // the passes before don't have to wait for the other queue as long as this one
+        bool split = submissions.empty() || submissions.back().queue != pass.queue;
+        for (const PassUse &use : pass.uses)
+            split = split || needsWait(resources[use.resource].state, submissions.back());
+
+        if (split)
+            submissions.push_back().queue = pass.queue;
+
+        pass.submission = submissions.size() - 1;
+        Submission &submission = submissions.back();
+
+        for (const PassUse &use : pass.uses) {
+            Resource &resource = resources[use.resource];
+
+            if (resource.swapchain && !swapchainWaited) {
+                submission.waitSwapchain = true;
+                swapchainWaited = true;
+            }
+
+            addWait(submission, resource, use.info);
+            addBarrier(pass.barriers, resource, use.info, use.discard);
+
+            resource.state.queue = pass.queue;
+            resource.state.submission = pass.submission;
+
+            if (resource.type != ResourceType::TransientImage || i != transientImages[resource.transient].lastPass)
+                continue;
+
+            MemoryBlock &block = memoryBlocks[transientImages[resource.transient].block];
+            block.lastStages = resource.state.writeStages | resource.state.readStages;
+            block.lastWriteAccess = resource.state.writeAccess;
+            block.lastQueue = resource.state.queue;
+            block.lastSubmission = resource.state.submission;
+            block.lastValue = resource.state.value;
+        }
+    }
+
+    // the caller submits the last graphics submission, there always is one
+    if (submissions.empty() || submissions.back().queue != QueueType::Graphics)
+        submissions.push_back().queue = QueueType::Graphics;
+
+    eastl::array<uint32_t, QUEUE_TYPE_COUNT> lastSubmissions;
+    lastSubmissions.fill(UINT32_MAX);
+    for (uint32_t i = 0; i < submissions.size(); i++)
+        lastSubmissions[uint32_t(submissions[i].queue)] = i;
+
+    // final accesses are on the queue of the last use, or on the graphics queue when that one has no submissions
+    for (Resource &resource : resources) {
+        if (resource.finalAccess == RenderGraphAccess::None)
+            continue;
+
+        const AccessInfo info = getAccessInfo(resource.finalAccess);
+        uint32_t submission = lastSubmissions[uint32_t(resource.state.queue)];
+        if (submission == UINT32_MAX) {
+            submission = lastSubmissions[uint32_t(QueueType::Graphics)];
+            addWait(submissions[submission], resource, info);
+        }
+
+        addBarrier(finalBarriers[uint32_t(submissions[submission].queue)], resource, info);
+    }
+}
+
+VkCommandBuffer RenderGraph::execute(VkCommandBuffer cmd)
+{
+    ZoneScoped;
+
+    // submissions of a queue signal the next values of its timeline in order, including the one the caller submits
+    eastl::array<uint64_t, QUEUE_TYPE_COUNT> values;
+    for (uint32_t queue = 0; queue < QUEUE_TYPE_COUNT; queue++)
+        values[queue] = graphics->getSubmittedValue(QueueType(queue));
+
+    uint32_t lastGraphicsSubmission = 0;
+    eastl::array<uint32_t, QUEUE_TYPE_COUNT> lastSubmissions;
+    lastSubmissions.fill(UINT32_MAX);
+    for (uint32_t i = 0; i < submissions.size(); i++) {
+        submissions[i].value = ++values[uint32_t(submissions[i].queue)];
+        lastSubmissions[uint32_t(submissions[i].queue)] = i;
+
+        if (submissions[i].queue == QueueType::Graphics)
+            lastGraphicsSubmission = i;
+    }
+
+    VkCommandBuffer frameCmd = cmd;
+    bool collectedCompute = false;
+    uint32_t passIndex = 0;
+
+    for (uint32_t i = 0; i < submissions.size(); i++) {
+        const Submission &submission = submissions[i];
+
+        // the first graphics submission records into the command buffer of the frame
+        VkCommandBuffer submissionCmd = frameCmd;
+        if (submission.queue != QueueType::Graphics || submissionCmd == VK_NULL_HANDLE)
+            submissionCmd = graphics->beginQueueCommandBuffer(submission.queue);
+        if (submission.queue == QueueType::Graphics)
+            frameCmd = VK_NULL_HANDLE;
+
+        // the caller collects the graphics timeline
+        if (submission.queue == QueueType::AsyncCompute && !collectedCompute) {
+            TracyVkCollect(graphics->getTracyContext(QueueType::AsyncCompute), submissionCmd);
+            collectedCompute = true;
+        }
+
+        for (; passIndex < passes.size() && (passes[passIndex].culled || passes[passIndex].submission == i); passIndex++) {
+            const Pass &pass = passes[passIndex];
+            if (pass.culled)
+                continue;
+
+            pass.barriers.record(submissionCmd);
+
+            ZoneTransientN(passZone, pass.name.c_str(), true);
+            TracyVkZoneTransient(graphics->getTracyContext(submission.queue), passGpuZone, submissionCmd, pass.name.c_str(), true);
+
+            pass.function(submissionCmd);
+        }
+
+        if (lastSubmissions[uint32_t(submission.queue)] == i)
+            finalBarriers[uint32_t(submission.queue)].record(submissionCmd);
+
+        eastl::vector<QueueWait> waits;
+        for (uint32_t queue = 0; queue < QUEUE_TYPE_COUNT; queue++) {
+            uint64_t value = submission.waitValues[queue];
+            if (submission.waitSubmissions[queue] != UINT32_MAX)
+                value = eastl::max(value, submissions[submission.waitSubmissions[queue]].value);
+
+            if (value > 0)
+                waits.push_back({QueueType(queue), value, submission.waitStages[queue]});
+        }
+
+        if (i == lastGraphicsSubmission) {
+            cmd = submissionCmd;
+            finalWaits = eastl::move(waits);
+            continue;
+        }
+
+        graphics->submitQueueCommandBuffer(submissionCmd, submission.queue, waits, submission.waitSwapchain);
+    }
+
+    // later frames wait for timeline values
+    for (const Resource &resource : resources) {
+        if (!resource.persistent)
+            continue;
+
+        ResourceState state = resource.state;
+        state.value = getTimelineValue(state.submission, state.value);
+        state.submission = UINT32_MAX;
+        importedStates[resource.image] = state;
+    }
+
+    for (MemoryBlock &block : memoryBlocks) {
+        block.lastValue = getTimelineValue(block.lastSubmission, block.lastValue);
+        block.lastSubmission = UINT32_MAX;
+    }
+
+    return cmd;
+}
+
+uint64_t RenderGraph::getTimelineValue(uint32_t submission, uint64_t value) const
+{
+    return submission != UINT32_MAX ? submissions[submission].value : value;
+}
+
+bool RenderGraph::needsWait(const ResourceState &state, const Submission &submission) const
+{
+    if (state.queue == submission.queue)
+        return false;
+
+    const uint32_t queue = uint32_t(state.queue);
+    if (state.submission != UINT32_MAX)
+        return submission.waitSubmissions[queue] == UINT32_MAX || state.submission > submission.waitSubmissions[queue];
+
+    return state.value > submission.waitValues[queue];
+}
+
+void RenderGraph::addWait(Submission &submission, Resource &resource, const AccessInfo &info)
+{
+    ResourceState &state = resource.state;
+    if (state.queue == submission.queue || (state.submission == UINT32_MAX && state.value == 0))
+        return;
+
+    const uint32_t queue = uint32_t(state.queue);
+    if (needsWait(state, submission)) {
+        if (state.submission != UINT32_MAX)
+            submission.waitSubmissions[queue] = state.submission;
+        else
+            submission.waitValues[queue] = state.value;
+    }
+
+    submission.waitStages[queue] |= info.stages;
+
+    // The semaphore wait makes everything the other queue did available and visible to the stages of this use.
+    // Layout transitions have to wait for it too, for images the wait counts as a write at those stages.
+    state = {
+        .layout = state.layout,
+        .writeStages = resource.type != ResourceType::Buffer ? info.stages : VK_PIPELINE_STAGE_2_NONE,
+        .visibleStages = info.stages,
+        .visibleAccess = info.access,
+        .queue = submission.queue,
+    };
+}
+
+void RenderGraph::cullPasses()
+{
+    // resources read after the graph, then everything the passes producing them read, from the last pass to the first
+    eastl::vector<bool> needed(resources.size());
+    for (uint32_t i = 0; i < resources.size(); i++)
+        needed[i] = resources[i].output || resources[i].finalAccess != RenderGraphAccess::None;
+
+    for (uint32_t i = passes.size(); i-- > 0;) {
+        Pass &pass = passes[i];
+
+        pass.culled = true;
+        for (const PassUse &use : pass.uses)
+            if (use.info.write && needed[use.resource])
+                pass.culled = false;
+
+        if (pass.culled)
+            continue;
+
+        // attachments are loaded, so the earlier writers of everything a pass uses are needed
+        for (const PassUse &use : pass.uses)
+            needed[use.resource] = true;
+    }
+}
+
+void RenderGraph::addBarrier(BarrierBatch &batch, Resource &resource, const AccessInfo &info, bool discard)
+{
+    ResourceState &state = resource.state;
+
+    const bool isImage = resource.type != ResourceType::Buffer;
+    const VkImageLayout oldLayout = isImage && discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+    const bool transition = isImage && oldLayout != info.layout;
+
+    VkPipelineStageFlags2 srcStages;
+    VkAccessFlags2 srcAccess;
+    bool needed;
+
+    if (info.write || transition) {
+        // writes and layout transitions wait for every use since the last write
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+        needed = transition || srcStages != VK_PIPELINE_STAGE_2_NONE;
+
+        state.layout = isImage ? info.layout : state.layout;
+        state.writeStages = info.stages;
+        state.writeAccess = info.write ? info.access & WRITE_ACCESS : VK_ACCESS_2_NONE;
+        state.readStages = info.write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+        state.visibleStages = info.write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+        state.visibleAccess = info.write ? VK_ACCESS_2_NONE : info.access;
+    } else {
+        // reads wait for the last write once per stage and access. Stages and accesses are tracked separately,
+        // every access has a fixed set of both so a pair that wasn't made visible shows up as a new stage or access
+        srcStages = state.writeStages;
+        srcAccess = state.writeAccess;
+        needed = srcStages != VK_PIPELINE_STAGE_2_NONE && ((info.stages & ~state.visibleStages) || (info.access & ~state.visibleAccess));
+
+        state.readStages |= info.stages;
+        state.visibleStages |= info.stages;
+        state.visibleAccess |= info.access;
+    }
+
+    if (!needed)
+        return;
+
+    if (isImage) {
+        batch.imageBarriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = srcStages,
+            .srcAccessMask = srcAccess,
+            .dstStageMask = info.stages,
+            .dstAccessMask = info.access,
+            .oldLayout = oldLayout,
+            .newLayout = state.layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = resource.image,
+            .subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS},
+        });
+    } else {
+        // buffers are used in whole regions, one memory barrier covers all of them
+        batch.memoryBarrier.srcStageMask |= srcStages;
+        batch.memoryBarrier.srcAccessMask |= srcAccess;
+        batch.memoryBarrier.dstStageMask |= info.stages;
+        batch.memoryBarrier.dstAccessMask |= info.access;
+    }
+}
+
+bool RenderGraph::canReuseTransientImages() const
+{
+    if (declaredImages.size() != transientImages.size())
+        return false;
+
+    for (uint32_t i = 0; i < declaredImages.size(); i++) {
+        const TransientImage &declared = declaredImages[i];
+        const TransientImage &created = transientImages[i];
+
+        if (declared.desc.width != created.desc.width || declared.desc.height != created.desc.height || declared.desc.format != created.desc.format ||
+            declared.desc.samples != created.desc.samples || declared.usage != created.usage || declared.queues != created.queues)
+            return false;
+    }
+
+    // images sharing a block mustn't be alive at the same time with the new lifetimes
+    for (uint32_t i = 0; i < transientImages.size(); i++) {
+        for (uint32_t j = i + 1; j < transientImages.size(); j++) {
+            if (transientImages[i].block == UINT32_MAX || transientImages[i].block != transientImages[j].block)
+                continue;
+
+            if (overlaps(declaredImages[i].firstPass, declaredImages[i].lastPass, declaredImages[j].firstPass, declaredImages[j].lastPass))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void RenderGraph::createTransientImages()
+{
+    ZoneScoped;
+
+    VkDevice device = graphics->getDevice();
+
+    // used by the frames in flight, only happens when the frames declare different images (after a resize)
+    if (!transientImages.empty()) {
+        vkDeviceWaitIdle(device);
+        destroyTransientImages();
+    }
+
+    transientImages = declaredImages;
+
+    eastl::vector<VkMemoryRequirements> requirements(transientImages.size());
+    eastl::vector<uint32_t> order;
+
+    for (uint32_t i = 0; i < transientImages.size(); i++) {
+        TransientImage &image = transientImages[i];
+
+        // every pass using it was culled
+        if (image.usage == 0)
+            continue;
+
+        VkImageCreateInfo imageCI = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        imageCI.imageType = VK_IMAGE_TYPE_2D;
+        imageCI.format = image.desc.format;
+        imageCI.extent = {image.desc.width, image.desc.height, 1};
+        imageCI.mipLevels = 1;
+        imageCI.arrayLayers = 1;
+        imageCI.samples = image.desc.samples;
+        imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage = image.usage;
+        imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        // used by passes on both queues
+        uint32_t queueFamilies[] = {graphics->getQueueFamilyIndex(QueueType::Graphics), graphics->getQueueFamilyIndex(QueueType::AsyncCompute)};
+        if (image.queues == (1 << QUEUE_TYPE_COUNT) - 1) {
+            imageCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            imageCI.queueFamilyIndexCount = ARRAY_SIZE(queueFamilies);
+            imageCI.pQueueFamilyIndices = queueFamilies;
+        }
+
+        VK_CHECK(vkCreateImage(device, &imageCI, nullptr, &image.image));
+        setDebugName(device, reinterpret_cast<uint64_t>(image.image), VK_OBJECT_TYPE_IMAGE, image.name);
+
+        vkGetImageMemoryRequirements(device, image.image, &requirements[i]);
+        order.push_back(i);
+    }
+
+    // largest first, every image goes into the first block with compatible memory whose images are never alive with it
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return requirements[a].size > requirements[b].size; });
+
+    VkDeviceSize imagesSize = 0;
+    for (uint32_t i : order) {
+        TransientImage &image = transientImages[i];
+        imagesSize += requirements[i].size;
+
+        for (uint32_t block = 0; block < memoryBlocks.size() && image.block == UINT32_MAX; block++) {
+            if ((memoryBlocks[block].requirements.memoryTypeBits & requirements[i].memoryTypeBits) == 0)
+                continue;
+
+            bool fits = true;
+            for (const TransientImage &other : transientImages)
+                if (other.block == block && overlaps(image.firstPass, image.lastPass, other.firstPass, other.lastPass))
+                    fits = false;
+
+            if (fits)
+                image.block = block;
+        }
+
+        if (image.block == UINT32_MAX) {
+            image.block = memoryBlocks.size();
+            memoryBlocks.push_back().requirements = requirements[i];
+            continue;
+        }
+
+        VkMemoryRequirements &blockRequirements = memoryBlocks[image.block].requirements;
+        blockRequirements.size = eastl::max(blockRequirements.size, requirements[i].size);
+        blockRequirements.alignment = eastl::max(blockRequirements.alignment, requirements[i].alignment);
+        blockRequirements.memoryTypeBits &= requirements[i].memoryTypeBits;
+    }
+
+    VmaAllocator allocator = graphics->getAllocator();
+
+    VmaAllocationCreateInfo allocationCI = {};
+    allocationCI.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    VkDeviceSize blocksSize = 0;
+    for (MemoryBlock &block : memoryBlocks) {
+        VK_CHECK(vmaAllocateMemory(allocator, &block.requirements, &allocationCI, &block.allocation, nullptr));
+        blocksSize += block.requirements.size;
+    }
+
+    for (uint32_t i : order) {
+        TransientImage &image = transientImages[i];
+
+        VK_CHECK(vmaBindImageMemory(allocator, memoryBlocks[image.block].allocation, image.image));
+        image.view = graphics->createImageView(image.image, VK_IMAGE_VIEW_TYPE_2D, image.desc.format, {image.aspect, 0, 1, 0, 1});
+    }
+
+    logger::logInfo("Render graph: ", order.size(), " transient images in ", memoryBlocks.size(), " memory blocks, ", blocksSize / 1024, " KB (", imagesSize / 1024, " KB without aliasing)");
+}
+
+void RenderGraph::destroyTransientImages()
+{
+    VkDevice device = graphics->getDevice();
+
+    for (TransientImage &image : transientImages) {
+        if (image.image == VK_NULL_HANDLE)
+            continue;
+
+        vkDestroyImageView(device, image.view, nullptr);
+        vkDestroyImage(device, image.image, nullptr);
+    }
+
+    for (MemoryBlock &block : memoryBlocks)
+        vmaFreeMemory(graphics->getAllocator(), block.allocation);
+
+    transientImages.clear();
+    memoryBlocks.clear();
+}
+
+} // namespace vulkan
@@ -0,0 +1,317 @@
+#include <rebirth/graphics/vulkan/upload_manager.h>
+#include <rebirth/graphics/vulkan/graphics.h>
+#include <rebirth/graphics/vulkan/util.h>
+
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+#include <string.h>
+
+namespace vulkan
+{
+
+void UploadManager::initialize(Graphics &graphics, uint32_t queueFamilyIndex, VkQueue queue)
+{
+    this->graphics = &graphics;
+    this->queueFamilyIndex = queueFamilyIndex;
+    this->queue = queue;
+
+    VkDevice device = graphics.getDevice();
+
+    copyAlignment = std::max<VkDeviceSize>(copyAlignment, graphics.getDevicePropertices().limits.optimalBufferCopyOffsetAlignment);
+
+    VkCommandPoolCreateInfo commandPoolCI = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    commandPoolCI.queueFamilyIndex = queueFamilyIndex;
+    commandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    VK_CHECK(vkCreateCommandPool(device, &commandPoolCI, nullptr, &commandPool));
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeCI = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeCI.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCI = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphoreCI.pNext = &semaphoreTypeCI;
+    VK_CHECK(vkCreateSemaphore(device, &semaphoreCI, nullptr, &semaphore));
+    setDebugName(device, reinterpret_cast<uint64_t>(semaphore), VK_OBJECT_TYPE_SEMAPHORE, "Upload semaphore");
+
+    BufferCreateInfo stagingCI = {
+        .size = STAGING_BUFFER_SIZE,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .memUsage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+    };
+
+    graphics.createBuffer(stagingBuffer, stagingCI);
+    setDebugName(device, reinterpret_cast<uint64_t>(stagingBuffer.buffer), VK_OBJECT_TYPE_BUFFER, "Upload staging buffer");
+}
+
+void UploadManager::destroy()
+{
+    waitIdle();
+
+    VkDevice device = graphics->getDevice();
+
+    graphics->destroyBuffer(stagingBuffer);
+    vkDestroySemaphore(device, semaphore, nullptr);
+    vkDestroyCommandPool(device, commandPool, nullptr);
+
+    freeCommandBuffers.clear();
+}
+
+uint64_t UploadManager::uploadBuffer(Buffer &buffer, const void *data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+    ZoneScoped;
+
+    assert(size > 0 && dstOffset + size <= buffer.size);
+
+    StagingAllocation staging = allocateStaging(size);
+    memcpy(staging.data, data, size);
+
+    VkBufferCopy copyRegion = {staging.offset, dstOffset, size};
+    vkCmdCopyBuffer(getCommandBuffer(), staging.buffer, buffer.buffer, 1, &copyRegion);
+
+    return submittedValue + 1;
+}
+
+uint64_t UploadManager::uploadImage(Image &image, const void *data, VkDeviceSize size, const VkBufferImageCopy *regions, uint32_t regionCount, uint32_t layerCount)
+{
+    ZoneScoped;
+
+    assert(size > 0 && regionCount > 0);
+
+    StagingAllocation staging = allocateStaging(size);
+    memcpy(staging.data, data, size);
+
+    VkCommandBuffer cmd = getCommandBuffer();
+
+    VkImageSubresourceRange subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = image.mipLevels,
+        .baseArrayLayer = 0,
+        .layerCount = layerCount};
+
+    // transition image to transfer
+    VkImageMemoryBarrier barrier0 = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image.image,
+        .subresourceRange = subresourceRange};
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier0);
+
+    // copy
+    eastl::vector<VkBufferImageCopy> copyRegions(regions, regions + regionCount);
+    for (VkBufferImageCopy &region : copyRegions)
+        region.bufferOffset += staging.offset;
+
+    vkCmdCopyBufferToImage(
+        cmd,
+        staging.buffer,
+        image.image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        copyRegions.size(),
+        copyRegions.data());
+
+    // transition image to shader read, upload queue might not support shader stages.
+    // Visibility for the graphics queue comes from waiting on the timeline semaphore
+    VkImageMemoryBarrier barrier1 = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = 0,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image.image,
+        .subresourceRange = subresourceRange};
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier1);
+
+    return submittedValue + 1;
+}
+
+uint64_t UploadManager::flush()
+{
+    if (current.cmd == VK_NULL_HANDLE)
+        return submittedValue;
+
+    ZoneScoped;
+
+    VK_CHECK(vkEndCommandBuffer(current.cmd));
+
+    VmaAllocator allocator = graphics->getAllocator();
+    VK_CHECK(vmaFlushAllocation(allocator, stagingBuffer.allocation, 0, VK_WHOLE_SIZE));
+    for (Buffer &buffer : current.temporaryBuffers)
+        VK_CHECK(vmaFlushAllocation(allocator, buffer.allocation, 0, VK_WHOLE_SIZE));
+
+    uint64_t value = submittedValue + 1;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &value;
+
+    VkSubmitInfo submit = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit.pNext = &timelineInfo;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &current.cmd;
+    submit.signalSemaphoreCount = 1;
+    submit.pSignalSemaphores = &semaphore;
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE));
+
+    submittedValue = value;
+
+    current.value = value;
+    current.ringEnd = ringHead;
+    submissions.push_back(eastl::move(current));
+    current = {};
+
+    retireSubmissions();
+
+    return value;
+}
+
+void UploadManager::wait(uint64_t value)
+{
+    ZoneScoped;
+
+    if (value > submittedValue)
+        flush();
+
+    VkSemaphoreWaitInfo waitInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+    VK_CHECK(vkWaitSemaphores(graphics->getDevice(), &waitInfo, UINT64_MAX));
+
+    retireSubmissions();
+}
+
+void UploadManager::waitIdle()
+{
+    wait(flush());
+}
+
+UploadManager::StagingAllocation UploadManager::allocateStaging(VkDeviceSize size)
+{
+    if (size > stagingBuffer.size) {
+        // doesn't fit into the ring at all, use a separate buffer that lives until the copy is finished
+        BufferCreateInfo createInfo = {
+            .size = size,
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .memUsage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+        };
+
+        Buffer buffer;
+        graphics->createBuffer(buffer, createInfo);
+        current.temporaryBuffers.push_back(buffer);
+
+        return {buffer.buffer, 0, static_cast<unsigned char *>(buffer.info.pMappedData)};
+    }
+
+    VkDeviceSize offset = 0;
+    while (!allocateFromRing(size, offset)) {
+        // ring is full, stall until the oldest submission is finished
+        ZoneScopedN("Wait for staging memory");
+
+        retireSubmissions();
+        if (allocateFromRing(size, offset))
+            break;
+
+        if (!submissions.empty())
+            wait(submissions.front().value);
+        else
+            flush(); // everything is used by the copies recorded so far
+    }
+
+    return {stagingBuffer.buffer, offset, static_cast<unsigned char *>(stagingBuffer.info.pMappedData) + offset};
+}
+
+bool UploadManager::allocateFromRing(VkDeviceSize size, VkDeviceSize &offset)
+{
+    const VkDeviceSize capacity = stagingBuffer.size;
+
+    if (ringUsed == 0)
+        ringHead = ringTail = 0;
+
+    VkDeviceSize alignedHead = (ringHead + copyAlignment - 1) & ~(copyAlignment - 1);
+    bool full = ringHead == ringTail && ringUsed > 0;
+
+    VkDeviceSize padding = 0;
+
+    if (ringHead >= ringTail && !full) {
+        // free space is [head, capacity) and [0, tail)
+        if (alignedHead + size <= capacity) {
+            offset = alignedHead;
+            padding = alignedHead - ringHead;
+        } else if (size <= ringTail) {
+            // wrap around, the end of the ring is left unused
+            offset = 0;
+            padding = capacity - ringHead;
+        } else {
+            return false;
+        }
+    } else if (ringHead < ringTail && alignedHead + size <= ringTail) {
+        // free space is [head, tail)
+        offset = alignedHead;
+        padding = alignedHead - ringHead;
+    } else {
+        return false;
+    }
+
+    ringUsed += padding + size;
+    current.ringSize += padding + size;
+    ringHead = offset + size;
+
+    return true;
+}
+
+VkCommandBuffer UploadManager::getCommandBuffer()
+{
+    if (current.cmd != VK_NULL_HANDLE)
+        return current.cmd;
+
+    if (!freeCommandBuffers.empty()) {
+        current.cmd = freeCommandBuffers.back();
+        freeCommandBuffers.pop_back();
+    } else {
+        VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(graphics->getDevice(), &allocInfo, &current.cmd));
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(current.cmd, &beginInfo));
+
+    return current.cmd;
+}
+
+void UploadManager::retireSubmissions()
+{
+    uint64_t completedValue = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(graphics->getDevice(), semaphore, &completedValue));
+
+    while (!submissions.empty() && submissions.front().value <= completedValue) {
+        Submission &submission = submissions.front();
+
+        VK_CHECK(vkResetCommandBuffer(submission.cmd, 0));
+        freeCommandBuffers.push_back(submission.cmd);
+
+        for (Buffer &buffer : submission.temporaryBuffers)
+            graphics->destroyBuffer(buffer);
+
+        ringTail = submission.ringEnd;
+        ringUsed -= submission.ringSize;
+
+        submissions.pop_front();
+    }
+}
+
+} // namespace vulkan
@@ -80,9 +80,11 @@ namespace vulkan
         VkCommandBuffer cmd,
         eastl::vector<VkRenderingAttachmentInfo> colorAttachments,
         const VkRenderingAttachmentInfo *depthAttachment,
-        VkExtent2D extent)
+        VkExtent2D extent,
+        VkRenderingFlags flags)
     {
         VkRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_RENDERING_INFO};
+        renderingInfo.flags = flags;
         renderingInfo.colorAttachmentCount = colorAttachments.size();
         renderingInfo.pColorAttachments = colorAttachments.data();
         renderingInfo.pDepthAttachment = depthAttachment;
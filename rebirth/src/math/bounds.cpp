@@ -42,6 +42,28 @@ namespace math
         };
     }
 
+    Bounds calculateBoundingSphere(eastl::vector<Vertex> &vertices, size_t vertexOffset, size_t vertexCount)
+    {
+        if (vertexCount == 0)
+            return Bounds{};
+
+        vec3 min = vertices[vertexOffset].position;
+        vec3 max = vertices[vertexOffset].position;
+
+        for (size_t i = vertexOffset; i < vertexOffset + vertexCount; i++) {
+            min = glm::min(min, vertices[i].position);
+            max = glm::max(max, vertices[i].position);
+        }
+
+        vec3 extents = (max - min) / 2.f;
+
+        return Bounds{
+            .origin = (max + min) / 2.f,
+            .sphereRadius = glm::length(extents),
+            .extents = extents,
+        };
+    }
+
     Bounds calculateBoundingSphere(Mesh &mesh, eastl::vector<Vertex> &vertices, eastl::vector<uint32_t> &indices)
     {
         vec3 min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
@@ -45,4 +45,24 @@ namespace math
             return true;
         }
     }
+
+    void getFrustumPlanes(mat4 viewProj, vec4 planes[6])
+    {
+        // rows of the view projection matrix
+        mat4 m = glm::transpose(viewProj);
+
+        planes[0] = m[3] + m[0]; // left
+        planes[1] = m[3] - m[0]; // right
+        planes[2] = m[3] + m[1]; // bottom
+        planes[3] = m[3] - m[1]; // top
+        planes[4] = m[2];        // z >= 0 (far with reverse-z)
+        planes[5] = m[3] - m[2]; // z <= w (near with reverse-z)
+
+        for (int i = 0; i < 6; i++) {
+            float length = glm::length(vec3(planes[i]));
+
+            // far plane of an infinite projection
+            planes[i] = length > 1e-6f ? planes[i] / length : vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
 } // namespace math
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <rebirth/physics/physics_job_system.h>
+
+#include <rebirth/core/job_system.h>
+
+PhysicsJobSystem::PhysicsJobSystem(JPH::uint maxJobs, JPH::uint maxBarriers)
+    : JobSystemWithBarrier(maxBarriers)
+{
+    jobs.Init(maxJobs, maxJobs);
+}
+
+int PhysicsJobSystem::GetMaxConcurrency() const
+{
+    return JobSystem::instance()->getThreadCount();
+}
+
+PhysicsJobSystem::JobHandle PhysicsJobSystem::CreateJob(const char *name, JPH::ColorArg color, const JobFunction &jobFunction, JPH::uint32 numDependencies)
+{
+    // wait for a free job, all of them are in flight
+    JPH::uint32 index;
+    while ((index = jobs.ConstructObject(name, color, this, jobFunction, numDependencies)) == AvailableJobs::cInvalidObjectIndex)
+        std::this_thread::yield();
+
+    Job *job = &jobs.Get(index);
+
+    // handle keeps the job alive until it's freed
+    JobHandle handle(job);
+
+    if (numDependencies == 0)
+        QueueJob(job);
+
+    return handle;
+}
+
+void PhysicsJobSystem::QueueJob(Job *job)
+{
+    job->AddRef();
+
+    JobSystem::instance()->execute(nullptr, [job]() {
+        job->Execute();
+        job->Release();
+    });
+}
+
+void PhysicsJobSystem::QueueJobs(Job **jobs, JPH::uint jobCount)
+{
+    for (JPH::uint i = 0; i < jobCount; i++)
+        QueueJob(jobs[i]);
+}
+
+void PhysicsJobSystem::FreeJob(Job *job)
+{
+    jobs.DestructObject(job);
+}
@@ -25,11 +25,8 @@ void PhysicsSystem::initialize()
     // pre-allocating 10 MB to avoid having to do allocations during the physics update.
     tempAllocator = new JPH::TempAllocatorImpl(10 * 1024 * 1024);
 
-    // We need a job system that will execute physics jobs on multiple threads.
-    jobSystem = new JPH::JobSystemThreadPool(
-        JPH::cMaxPhysicsJobs,
-        JPH::cMaxPhysicsBarriers,
-        JPH::thread::hardware_concurrency() - 1);
+    // Physics jobs are executed by the engine job system workers.
+    jobSystem = new PhysicsJobSystem(JPH::cMaxPhysicsJobs, JPH::cMaxPhysicsBarriers);
 
     physicsSystem.Init(
         maxBodies,
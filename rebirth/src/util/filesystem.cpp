@@ -3,6 +3,9 @@
 #include <rebirth/util/logger.h>
 
 #ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #endif
 
@@ -42,4 +45,86 @@ namespace filesystem
 
         return buffer;
     }
+
+    bool writeFile(std::filesystem::path path, const void *data, size_t size)
+    {
+        std::error_code error;
+        if (path.has_parent_path())
+            std::filesystem::create_directories(path.parent_path(), error);
+
+        std::filesystem::path temporaryPath = path;
+        temporaryPath += ".tmp";
+
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            logger::logError("Failed to open file - ", temporaryPath);
+            return false;
+        }
+
+        file.write(static_cast<const char *>(data), size);
+        file.close();
+
+        if (file.fail()) {
+            logger::logError("Failed to write file - ", temporaryPath);
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+
+        std::filesystem::rename(temporaryPath, path, error);
+        if (error) {
+            logger::logError("Failed to rename file - ", temporaryPath);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool mapFile(MappedFile &file, std::filesystem::path path)
+    {
+        // TODO: add windows support
+#ifdef __linux__
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            logger::logError("Failed to open file - ", path);
+            return false;
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            logger::logError("Failed to map file - ", path);
+            close(fd);
+            return false;
+        }
+
+        void *data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // mapping keeps the file alive
+
+        if (data == MAP_FAILED) {
+            logger::logError("Failed to map file - ", path);
+            return false;
+        }
+
+        madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+
+        file.data = static_cast<const unsigned char *>(data);
+        file.size = fileStat.st_size;
+        return true;
+#else
+        file.buffer = readFile(path);
+        file.data = reinterpret_cast<const unsigned char *>(file.buffer.data());
+        file.size = file.buffer.size();
+        return !file.buffer.empty();
+#endif
+    }
+
+    void unmapFile(MappedFile &file)
+    {
+#ifdef __linux__
+        if (file.data)
+            munmap(const_cast<unsigned char *>(file.data), file.size);
+#endif
+        file.buffer.clear();
+        file.data = nullptr;
+        file.size = 0;
+    }
 } // namespace filesystem
\ No newline at end of file
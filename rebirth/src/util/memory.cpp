@@ -0,0 +1,19 @@
+#include <rebirth/util/memory.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+namespace memory
+{
+    size_t getPeakMemoryUsage()
+    {
+        // TODO: add windows support
+#ifdef __linux__
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return size_t(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+        return 0;
+    }
+} // namespace memory
@@ -0,0 +1,13 @@
+#ifndef ALPHA_TEST_GLSL
+#define ALPHA_TEST_GLSL
+
+// Same alpha test as mesh.frag for the passes that only write depth or visibility.
+// Include types, scene_data and textures before this file.
+bool isAlphaDiscarded(int materialId, vec2 uv)
+{
+    Material material = materials[materialId > -1 ? materialId : 0]; // default material
+
+    return material.baseColorId > -1 && TEX_2D(material.baseColorId, uv).a * material.baseColorFactor.a < 0.5;
+}
+
+#endif
@@ -6,15 +6,16 @@
 #include "types.glsl"
 
 #include "scene_data.glsl"
-#include "mesh_pc.glsl"
+#include "draw_data.glsl"
 #include "vertices.glsl"
 
 layout (location = 0) out vec4 outColor;
 
 void main()
 {
-    Vertex vertex = vertices[gl_VertexIndex];
+    Vertex vertex = loadVertex(gl_VertexIndex);
+    DrawData draw = draws[gl_InstanceIndex];
 
-    gl_Position = scene_data.projection * scene_data.view * pc.transform * vec4(vertex.position, 1.0);
+    gl_Position = scene_data.projection * scene_data.view * draw.transform * vec4(vertex.position, 1.0);
     outColor = vec4(0.0, 1.0, 0.0, 1.0);
 }
\ No newline at end of file
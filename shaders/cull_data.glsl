@@ -0,0 +1,9 @@
+#ifndef CULL_DATA_GLSL
+#define CULL_DATA_GLSL
+
+// one entry per frame in flight
+layout (binding = 9) readonly buffer CullDataBuffer {
+    CullData cullData[];
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef CULLING_GLSL
+#define CULLING_GLSL
+
+// needs textures.glsl and meshlets.glsl
+
+// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere. Michael Mara, Morgan McGuire. 2013
+// c is the view space center with z pointing forward, aabb is returned in uv space
+bool projectSphere(vec3 c, float r, float znear, float P00, float P11, out vec4 aabb)
+{
+    if (c.z < r + znear)
+        return false;
+
+    vec3 cr = c * r;
+    float czr2 = c.z * c.z - r * r;
+
+    float vx = sqrt(c.x * c.x + czr2);
+    float minx = (vx * c.x - cr.z) / (vx * c.z + cr.x);
+    float maxx = (vx * c.x + cr.z) / (vx * c.z - cr.x);
+
+    float vy = sqrt(c.y * c.y + czr2);
+    float miny = (vy * c.y - cr.z) / (vy * c.z + cr.y);
+    float maxy = (vy * c.y + cr.z) / (vy * c.z - cr.y);
+
+    // P11 is negative (y flip), so maxy maps to the top of the screen
+    aabb = vec4(minx * P00, maxy * P11, maxx * P00, miny * P11);
+    aabb = aabb * 0.5 + 0.5;
+
+    return true;
+}
+
+float getMaxScale(mat4 transform)
+{
+    return max(max(length(transform[0].xyz), length(transform[1].xyz)), length(transform[2].xyz));
+}
+
+// center and radius are in world space
+bool isInsideFrustum(CullData cull, vec3 center, float radius)
+{
+    bool visible = true;
+    for (int i = 0; i < 6; i++)
+        visible = visible && dot(cull.frustumPlanes[i].xyz, center) + cull.frustumPlanes[i].w > -radius;
+
+    return visible;
+}
+
+// tested against the depth pyramid of the previous frame
+bool isOccluded(CullData cull, vec3 center, float radius)
+{
+    vec3 c = vec3(cull.occlusionView * vec4(center, 1.0));
+    c.z = -c.z; // view space looks down -z
+
+    vec4 aabb;
+    if (!projectSphere(c, radius, cull.znear, cull.P00, cull.P11, aabb))
+        return false;
+
+    vec2 size = (aabb.zw - aabb.xy) * cull.depthPyramidSize;
+
+    // the box covers at most 2x2 texels on this level
+    float level = max(ceil(log2(max(max(size.x, size.y), 1.0))), 0.0);
+    int lod = min(int(level), cull.depthPyramidLevels - 1);
+
+    ivec2 levelSize = max(ivec2(cull.depthPyramidSize) >> lod, ivec2(1));
+    ivec2 minCoord = clamp(ivec2(aabb.xy * levelSize), ivec2(0), levelSize - 1);
+    ivec2 maxCoord = clamp(ivec2(aabb.zw * levelSize), ivec2(0), levelSize - 1);
+
+    float depth = min(
+        min(texelFetch(texture2Ds[cull.depthPyramidId], minCoord, lod).r,
+            texelFetch(texture2Ds[cull.depthPyramidId], ivec2(maxCoord.x, minCoord.y), lod).r),
+        min(texelFetch(texture2Ds[cull.depthPyramidId], ivec2(minCoord.x, maxCoord.y), lod).r,
+            texelFetch(texture2Ds[cull.depthPyramidId], maxCoord, lod).r));
+
+    // reverse-z infinite projection, depth of the closest point of the sphere
+    float sphereDepth = cull.znear / (c.z - radius);
+
+    return sphereDepth < depth;
+}
+
+// the coarsest level whose error stays under a pixel, distance is to the closest point of the bounding sphere
+uint selectLod(CullData cull, DrawData draw, vec3 center, float radius, float scale)
+{
+    if (cull.lodSelection == 0 || draw.lodCount <= 1)
+        return 0;
+
+    float distance = max(length(center - cull.cameraPosition.xyz) - radius, cull.znear);
+    float threshold = distance / (scale * cull.lodErrorScale);
+
+    uint lod = 0;
+    for (uint i = 1; i < draw.lodCount; i++) {
+        if (lods[draw.lodOffset + i].error > threshold)
+            break;
+
+        lod = i;
+    }
+
+    return lod;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "types.glsl"
+
+#include "scene_data.glsl"
+#include "textures.glsl"
+#include "alpha_test.glsl"
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) flat in int inMaterialId;
+
+// the shading pass only shades what the prepass kept
+void main()
+{
+    if (isAlphaDiscarded(inMaterialId, inUV))
+        discard;
+}
@@ -0,0 +1,27 @@
+#version 450
+
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "types.glsl" // should be included before everything
+
+#include "scene_data.glsl"
+#include "draw_data.glsl"
+#include "vertices.glsl"
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) flat out int outMaterialId;
+
+// same depth as mesh.vert
+invariant gl_Position;
+
+void main()
+{
+    DrawData draw = draws[gl_InstanceIndex];
+
+    vec4 worldPos = draw.transform * vec4(loadVertexPosition(gl_VertexIndex), 1.0);
+    gl_Position = scene_data.projection * scene_data.view * worldPos;
+
+    outUV = loadVertexUV(gl_VertexIndex);
+    outMaterialId = draw.materialId;
+}
@@ -0,0 +1,31 @@
+#ifndef DRAW_COMMANDS_GLSL
+#define DRAW_COMMANDS_GLSL
+
+// shaders reading the commands back (visibility resolve) define DRAW_COMMANDS_READ before including this file
+#ifdef DRAW_COMMANDS_READ
+#define DRAW_COMMANDS_ACCESS readonly
+#else
+#define DRAW_COMMANDS_ACCESS writeonly
+#endif
+
+// commands of the draws that passed culling
+layout (binding = 7) DRAW_COMMANDS_ACCESS buffer DrawCommandsBuffer {
+    DrawCommand drawCommands[];
+};
+
+// one counter per frame in flight
+layout (binding = 8) buffer DrawCountsBuffer {
+    DrawCounts drawCounts[];
+};
+
+// xy - draw id and its first meshlet of the group
+layout (binding = 12) buffer ClusterTasksBuffer {
+    uvec2 clusterTasks[];
+};
+
+// VkDispatchIndirectCommand per frame in flight, x is the number of cluster tasks
+layout (binding = 13) buffer ClusterDispatchBuffer {
+    uint clusterDispatch[];
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef DRAW_DATA_GLSL
+#define DRAW_DATA_GLSL
+
+// indexed with gl_InstanceIndex (firstInstance of the indirect command)
+layout (binding = 6) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
+
+// draw indices front to back, sorted on the cpu every frame, the culling shader walks the draws in this order
+layout (binding = 17) readonly buffer DrawOrderBuffer {
+    uint drawOrder[];
+};
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef INDICES_GLSL
+#define INDICES_GLSL
+
+// the index buffer, for passes fetching triangles themselves
+layout (binding = 18) readonly buffer IndexBuffer {
+    uint indices[];
+};
+
+#endif
@@ -1,8 +1,14 @@
 #ifndef JOINTS_GLSL
 #define JOINTS_GLSL
 
+// joint palettes of all skinned instances, MAX_JOINT_MATRICES per frame in flight
 layout (binding = 4) readonly buffer JointMatricesBuffer {
     mat4 jointMatrices[];
 };
 
+// one per primitive of every skinned instance, MAX_SKIN_JOBS per frame in flight
+layout (binding = 15) readonly buffer SkinJobsBuffer {
+    SkinJob skinJobs[];
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef LIGHT_GRID_GLSL
+#define LIGHT_GRID_GLSL
+
+// light clusters, screen tiles split into exponential view depth slices, matches renderer.h
+const uint LIGHT_GRID_X = 16;
+const uint LIGHT_GRID_Y = 9;
+const uint LIGHT_GRID_Z = 24;
+const uint LIGHT_CLUSTER_COUNT = LIGHT_GRID_X * LIGHT_GRID_Y * LIGHT_GRID_Z;
+const uint MAX_CLUSTER_LIGHTS = 256;
+
+// per frame in flight, the light count of every cluster followed by MAX_CLUSTER_LIGHTS light indices of every cluster
+layout (binding = 16) buffer LightGridBuffer {
+    uint lightGrid[];
+};
+
+uint getLightGridOffset(uint frameIndex)
+{
+    return frameIndex * LIGHT_CLUSTER_COUNT * (MAX_CLUSTER_LIGHTS + 1);
+}
+
+uint getLightClusterIndex(uvec3 cluster)
+{
+    return (cluster.z * LIGHT_GRID_Y + cluster.y) * LIGHT_GRID_X + cluster.x;
+}
+
+// offset of the first light index of a cluster
+uint getLightClusterOffset(uint frameIndex, uint clusterIndex)
+{
+    return getLightGridOffset(frameIndex) + LIGHT_CLUSTER_COUNT + clusterIndex * MAX_CLUSTER_LIGHTS;
+}
+
+// view depth where a slice starts
+float getLightSliceDepth(uint slice, float znear, float zfar)
+{
+    return znear * pow(zfar / znear, float(slice) / float(LIGHT_GRID_Z));
+}
+
+uint getLightSlice(float viewDepth, float znear, float zfar)
+{
+    float slice = floor(log(max(viewDepth, znear) / znear) / log(zfar / znear) * float(LIGHT_GRID_Z));
+    return uint(clamp(slice, 0.0, float(LIGHT_GRID_Z - 1)));
+}
+
+#endif
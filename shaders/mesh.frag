@@ -8,117 +8,32 @@
 
 #include "pbr.glsl"
 #include "scene_data.glsl"
-#include "mesh_pc.glsl"
 #include "textures.glsl"
+#include "light_grid.glsl"
+#include "shading.glsl"
 
 layout (location = 0) in vec3 inWorldPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
 layout (location = 3) in vec4 inTangent;
 layout (location = 4) in mat3 inTBN;
+layout (location = 7) flat in int inMaterialId;
 
 layout (location = 0) out vec4 fragColor;
 
-#define DEFAULT_MATERIAL_ID 0
+layout (push_constant) uniform PushConstant
+{
+    vec2 screenSize;
+    float znear, zfar; // of the light grid
+    uint frameIndex;
+} pc;
 
 void main()
 {
-    vec3 cameraPos = scene_data.cameraPosAndLightNum.xyz;
-    uint lightCount = uint(scene_data.cameraPosAndLightNum.w);
-
-    vec4 baseColor = vec4(0.0, 0.0, 0.0, 1.0);
-    vec4 metallicRoughtness = vec4(0);
-    vec3 normal = inNormal;
-    vec3 emissive = vec3(0);
-
-    if (pc.materialId > -1) {
-        Material material = materials[pc.materialId];
-
-        if (material.baseColorId > -1) {
-            baseColor = TEX_2D(material.baseColorId, inUV) * material.baseColorFactor;
-        }
-
-        if (material.metallicRoughnessId > -1) {
-            metallicRoughtness = TEX_2D(material.metallicRoughnessId, inUV);
-            metallicRoughtness.g *= material.roughnessFactor; // roughness
-            metallicRoughtness.b *= material.metallicFactor; // metallic
-        }
-
-        if (material.normalId > -1) {
-            normal = TEX_2D(material.normalId, inUV).rgb;
-        }
+    Surface surface = loadSurface(inMaterialId, inWorldPos, inNormal, inTangent, inTBN, inUV, dFdx(inUV), dFdy(inUV));
 
-        if (material.emissiveId > -1) {
-            emissive = TEX_2D(material.emissiveId, inUV).rgb;
-        }
-    } else {
-        // set default material
-        Material material = materials[DEFAULT_MATERIAL_ID];
-
-        if (material.baseColorId > -1) {
-            baseColor = TEX_2D(material.baseColorId, inUV) * material.baseColorFactor;
-        }
-    }
-
-    if (baseColor.a < 0.5)
+    if (surface.baseColor.a < 0.5)
         discard;
 
-    if (inTangent != vec4(0.0)) {
-        normal = inTBN * normalize(normal * 2.0 - 1.0);
-    }
-
-    normal = normalize(normal);
-    vec3 viewDir = normalize(cameraPos - inWorldPos);
-
-    float roughness = max(0.05, metallicRoughtness.g);
-    float metallic = metallicRoughtness.b;
-    float reflectance = 0.4; // constant
-    vec3 diffuseColor = (1.0 - metallic) * vec3(baseColor);
-
-    vec3 f0 = 0.16 * reflectance * reflectance * (1.0 - metallic) + diffuseColor * metallic;
-
-    vec3 finalColor = vec3(0.0);
-    for (int i = 0; i < lightCount; i++) {
-        Light light = lights[i];
-
-        // Lighting
-        vec3 lightDir = vec3(0.0);
-        float NoL = 0.0;
-        vec3 lightColor = vec3(0.0);
-
-        if (light.type == LIGHT_TYPE_DIRECTIONAL) {
-            lightDir = normalize(-light.direction);
-            NoL = clamp(dot(normal, lightDir), 0.0, 1.0);
-
-            lightColor = pbrBRDF(lightDir, viewDir, normal, roughness, f0, diffuseColor) * NoL * light.color;
-        }
-
-        // Shadow mapping
-        float visibility = 1.0;
-        if (scene_data.shadowMapId > -1) {
-            vec4 lightSpace = light.mvp * vec4(inWorldPos, 1.0);
-            vec3 projCoords = lightSpace.xyz / lightSpace.w;
-
-            vec2 coords = (projCoords.xy * 0.5 + 0.5);
-            float closestDepth = TEX_2D(scene_data.shadowMapId, coords).r;
-            float currentDepth = projCoords.z;
-
-            float bias = max(0.0005 * (1.0 - NoL), 0.0001);
-
-            // poisson sampling
-            for (int i = 0; i < 4; i++) {
-                if (TEX_2D(scene_data.shadowMapId, coords + poissonDisk[i] / 5000.0).r > currentDepth - bias) {
-                    visibility -= 0.2;
-                }
-            }
-        }
-
-        finalColor += lightColor * (NoL * visibility);
-    }
-
-    float ambient = 0.05;
-    finalColor += vec3(baseColor) * ambient;
-    finalColor += emissive;
-
-    fragColor = vec4(finalColor, 1.0);
+    fragColor = vec4(shadeSurface(surface, gl_FragCoord.xy, pc.screenSize, pc.znear, pc.zfar, pc.frameIndex), 1.0);
 }
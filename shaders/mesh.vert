@@ -6,49 +6,38 @@
 #include "types.glsl" // should be included before everything
 
 #include "scene_data.glsl"
-#include "mesh_pc.glsl"
+#include "draw_data.glsl"
 #include "vertices.glsl"
-#include "joints.glsl"
 
 layout (location = 0) out vec3 outWorldPos;
 layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec2 outUV;
 layout (location = 3) out vec4 outTangent;
 layout (location = 4) out mat3 outTBN;
+layout (location = 7) flat out int outMaterialId;
+
+// same depth as the depth prepass, shaded with an equal depth test after it
+invariant gl_Position;
 
 void main()
 {
-    Vertex vertex = vertices[gl_VertexIndex];
-
-    mat4 skinMat = mat4(0.0);
-    if (vertex.jointIndices.x > -1) {
-        skinMat += vertex.jointWeights.x * jointMatrices[vertex.jointIndices.x];
-    }
-    if (vertex.jointIndices.y > -1) {
-        skinMat += vertex.jointWeights.y * jointMatrices[vertex.jointIndices.y];
-    }
-    if (vertex.jointIndices.z > -1) {
-        skinMat += vertex.jointWeights.z * jointMatrices[vertex.jointIndices.z];
-    }
-    if (vertex.jointIndices.w > -1) {
-        skinMat += vertex.jointWeights.w * jointMatrices[vertex.jointIndices.w];
-    }
-
-    if (skinMat == mat4(0.0)) {
-        skinMat = mat4(1.0);
-    }
-
-    vec4 worldPos = pc.transform * skinMat * vec4(vertex.position, 1.0);
+    Vertex vertex = loadVertex(gl_VertexIndex);
+    DrawData draw = draws[gl_InstanceIndex];
+
+    // skinned draws read vertices the skinning pass already skinned
+    vec4 worldPos = draw.transform * vec4(vertex.position, 1.0);
     gl_Position = scene_data.projection * scene_data.view * worldPos;
 
     outWorldPos = vec3(worldPos);
     outUV = vec2(vertex.uv_x, vertex.uv_y);
-    outNormal = transpose(inverse(mat3(pc.transform * skinMat))) * vertex.normal;
+    outNormal = transpose(inverse(mat3(draw.transform))) * vertex.normal;
 
     outTangent = vertex.tangent;
 
-    vec3 T = normalize(vec3(pc.transform * skinMat * vertex.tangent));
+    vec3 T = normalize(mat3(draw.transform) * vertex.tangent.xyz);
     vec3 N = outNormal;
     vec3 B = cross(N, T) * vertex.tangent.w;
     outTBN = mat3(T, B, N);
+
+    outMaterialId = draw.materialId;
 }
@@ -0,0 +1,12 @@
+#ifndef MESHLETS_GLSL
+#define MESHLETS_GLSL
+
+layout (binding = 11) readonly buffer MeshletsBuffer {
+    Meshlet meshlets[];
+};
+
+layout (binding = 14) readonly buffer LodsBuffer {
+    MeshLod lods[];
+};
+
+#endif
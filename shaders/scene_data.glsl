@@ -1,20 +1,34 @@
 #ifndef SCENE_DATA_GLSL
 #define SCENE_DATA_GLSL
 
+const uint SHADOW_CASCADE_COUNT = 4;
+
 layout (binding = 0) uniform SceneData
 {
     mat4 projection;
     mat4 view;
     vec4 cameraPosAndLightNum; // vec4 -> vec3 (camera position) / int (number of lights)
-    int shadowMapId;
+    mat4 cascadeViewProjections[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits; // view depth where each cascade ends
+    int shadowMapId;    // layer per cascade
+    int shadowLightId;  // light casting the shadows
+    int directionalLightCount; // come first in the lights buffer, the others are in the light grid
 } scene_data;
 
 layout (binding = 2) readonly buffer MaterialsBuffer {
     Material materials[];
 };
 
+const uint MAX_LIGHTS = 8192; // per frame in flight
+
 layout (binding = 3) readonly buffer LightsBuffer {
     Light lights[];
 };
 
+// the light grid of a frame in flight indexes the lights of the same frame
+Light getLight(uint frameIndex, uint lightIndex)
+{
+    return lights[frameIndex * MAX_LIGHTS + lightIndex];
+}
+
 #endif
\ No newline at end of file
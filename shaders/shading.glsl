@@ -0,0 +1,188 @@
+#ifndef SHADING_GLSL
+#define SHADING_GLSL
+
+// Materials and lighting of opaque surfaces, shared by the mesh pass and the visibility buffer resolve.
+// Include types, pbr, scene_data, textures and light_grid before this file.
+
+#define DEFAULT_MATERIAL_ID 0
+
+// MaterialFeature in material.h
+#define MATERIAL_FEATURE_BASE_COLOR 1u
+#define MATERIAL_FEATURE_METALLIC_ROUGHNESS 2u
+#define MATERIAL_FEATURE_NORMAL 4u
+#define MATERIAL_FEATURE_EMISSIVE 8u
+
+// Set per pipeline by the mesh pass, a pipeline per material permutation. The defaults keep every branch, for the
+// shaders that shade any material (the visibility buffer resolve).
+layout (constant_id = 0) const uint MATERIAL_FEATURES = 15;          // maps the draws can have
+layout (constant_id = 1) const bool MATERIAL_FEATURES_EXACT = false; // every draw has all of them, the ids aren't tested
+layout (constant_id = 2) const bool SHADOWS_ENABLED = true;
+
+bool hasMaterialFeature(uint feature, int textureId)
+{
+    return (MATERIAL_FEATURES & feature) != 0u && (MATERIAL_FEATURES_EXACT || textureId > -1);
+}
+
+struct Surface
+{
+    vec3 worldPos;
+    vec3 normal;
+    vec4 baseColor;
+    vec4 metallicRoughness; // g - roughness, b - metallic
+    vec3 emissive;
+};
+
+// Textures are sampled with explicit uv gradients, the resolve pass computes them from the triangle.
+Surface loadSurface(int materialId, vec3 worldPos, vec3 normal, vec4 tangent, mat3 TBN, vec2 uv, vec2 uvDx, vec2 uvDy)
+{
+    Surface surface;
+    surface.worldPos = worldPos;
+    surface.normal = normal;
+    surface.baseColor = vec4(0.0, 0.0, 0.0, 1.0);
+    surface.metallicRoughness = vec4(0.0);
+    surface.emissive = vec3(0.0);
+
+    if (materialId > -1) {
+        Material material = materials[materialId];
+
+        if (hasMaterialFeature(MATERIAL_FEATURE_BASE_COLOR, material.baseColorId)) {
+            surface.baseColor = TEX_2D_GRAD(material.baseColorId, uv, uvDx, uvDy) * material.baseColorFactor;
+        }
+
+        if (hasMaterialFeature(MATERIAL_FEATURE_METALLIC_ROUGHNESS, material.metallicRoughnessId)) {
+            surface.metallicRoughness = TEX_2D_GRAD(material.metallicRoughnessId, uv, uvDx, uvDy);
+            surface.metallicRoughness.g *= material.roughnessFactor; // roughness
+            surface.metallicRoughness.b *= material.metallicFactor; // metallic
+        }
+
+        if (hasMaterialFeature(MATERIAL_FEATURE_NORMAL, material.normalId) && tangent != vec4(0.0)) {
+            // z is reconstructed, two channel (bc5) normal maps only store xy
+            vec2 xy = TEX_2D_GRAD(material.normalId, uv, uvDx, uvDy).rg * 2.0 - 1.0;
+            surface.normal = TBN * vec3(xy, sqrt(clamp(1.0 - dot(xy, xy), 0.0, 1.0)));
+        }
+
+        if (hasMaterialFeature(MATERIAL_FEATURE_EMISSIVE, material.emissiveId)) {
+            surface.emissive = TEX_2D_GRAD(material.emissiveId, uv, uvDx, uvDy).rgb;
+        }
+    } else {
+        // set default material
+        Material material = materials[DEFAULT_MATERIAL_ID];
+
+        if (hasMaterialFeature(MATERIAL_FEATURE_BASE_COLOR, material.baseColorId)) {
+            surface.baseColor = TEX_2D_GRAD(material.baseColorId, uv, uvDx, uvDy) * material.baseColorFactor;
+        }
+    }
+
+    surface.normal = normalize(surface.normal);
+    return surface;
+}
+
+// cascaded shadow map of the shadow light, the first cascade whose slice contains the point is sampled
+float getShadowVisibility(vec3 worldPos, float NoL)
+{
+    float viewDepth = -(scene_data.view * vec4(worldPos, 1.0)).z;
+    if (viewDepth > scene_data.cascadeSplits[SHADOW_CASCADE_COUNT - 1])
+        return 1.0;
+
+    uint cascade = 0;
+    while (cascade < SHADOW_CASCADE_COUNT - 1 && viewDepth > scene_data.cascadeSplits[cascade])
+        cascade++;
+
+    // orthographic, reverse-z
+    vec3 projCoords = (scene_data.cascadeViewProjections[cascade] * vec4(worldPos, 1.0)).xyz;
+    vec2 coords = projCoords.xy * 0.5 + 0.5;
+    float currentDepth = projCoords.z;
+
+    float bias = max(0.0005 * (1.0 - NoL), 0.0001);
+
+    // poisson sampling
+    float visibility = 1.0;
+    for (int i = 0; i < 4; i++) {
+        if (TEX_2D_ARRAY(scene_data.shadowMapId, vec3(coords + poissonDisk[i] / 5000.0, cascade)).r > currentDepth - bias) {
+            visibility -= 0.2;
+        }
+    }
+
+    return visibility;
+}
+
+// inverse square falloff windowed to reach zero at the range
+float getDistanceAttenuation(float distanceSq, float range)
+{
+    float factor = distanceSq / (range * range);
+    float window = clamp(1.0 - factor * factor, 0.0, 1.0);
+    return window * window / max(distanceSq, 0.0001);
+}
+
+// cutOff is the cosine of the cone angle, the edge is faded over the outer tenth
+float getSpotAttenuation(vec3 lightDir, vec3 spotDirection, float cutOff)
+{
+    float cosAngle = dot(-lightDir, normalize(spotDirection));
+    return smoothstep(cutOff, mix(cutOff, 1.0, 0.1), cosAngle);
+}
+
+// Directional lights and the point and spot lights of the light cluster of the pixel.
+// znear, zfar and frameIndex are the ones of the light grid.
+vec3 shadeSurface(Surface surface, vec2 fragCoord, vec2 screenSize, float znear, float zfar, uint frameIndex)
+{
+    vec3 cameraPos = scene_data.cameraPosAndLightNum.xyz;
+    vec3 normal = surface.normal;
+    vec3 viewDir = normalize(cameraPos - surface.worldPos);
+
+    float roughness = max(0.05, surface.metallicRoughness.g);
+    float metallic = surface.metallicRoughness.b;
+    float reflectance = 0.4; // constant
+    vec3 diffuseColor = (1.0 - metallic) * vec3(surface.baseColor);
+
+    vec3 f0 = 0.16 * reflectance * reflectance * (1.0 - metallic) + diffuseColor * metallic;
+
+    vec3 finalColor = vec3(0.0);
+
+    // directional lights, every pixel
+    for (int i = 0; i < scene_data.directionalLightCount; i++) {
+        Light light = getLight(frameIndex, uint(i));
+
+        vec3 lightDir = normalize(-light.direction);
+        float NoL = clamp(dot(normal, lightDir), 0.0, 1.0);
+
+        vec3 lightColor = pbrBRDF(lightDir, viewDir, normal, roughness, f0, diffuseColor) * NoL * light.color;
+
+        // Shadow mapping
+        float visibility = 1.0;
+        if (SHADOWS_ENABLED && scene_data.shadowMapId > -1 && i == scene_data.shadowLightId)
+            visibility = getShadowVisibility(surface.worldPos, NoL);
+
+        finalColor += lightColor * (NoL * visibility);
+    }
+
+    // point and spot lights of the light cluster of the pixel
+    float viewDepth = -(scene_data.view * vec4(surface.worldPos, 1.0)).z;
+    uvec2 tile = min(uvec2(fragCoord / screenSize * vec2(LIGHT_GRID_X, LIGHT_GRID_Y)), uvec2(LIGHT_GRID_X - 1, LIGHT_GRID_Y - 1));
+    uint clusterIndex = getLightClusterIndex(uvec3(tile, getLightSlice(viewDepth, znear, zfar)));
+
+    uint clusterLightCount = lightGrid[getLightGridOffset(frameIndex) + clusterIndex];
+    uint clusterOffset = getLightClusterOffset(frameIndex, clusterIndex);
+
+    for (uint i = 0; i < clusterLightCount; i++) {
+        Light light = getLight(frameIndex, lightGrid[clusterOffset + i]);
+
+        vec3 toLight = light.position - surface.worldPos;
+        float distanceSq = dot(toLight, toLight);
+        vec3 lightDir = toLight * inversesqrt(max(distanceSq, 0.0001));
+        float NoL = clamp(dot(normal, lightDir), 0.0, 1.0);
+
+        float attenuation = getDistanceAttenuation(distanceSq, light.range);
+        if (light.type == LIGHT_TYPE_SPOT)
+            attenuation *= getSpotAttenuation(lightDir, light.direction, light.cutOff);
+
+        finalColor += pbrBRDF(lightDir, viewDir, normal, roughness, f0, diffuseColor) * light.color * (NoL * attenuation);
+    }
+
+    float ambient = 0.05;
+    finalColor += vec3(surface.baseColor) * ambient;
+    finalColor += surface.emissive;
+
+    return finalColor;
+}
+
+#endif
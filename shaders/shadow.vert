@@ -6,34 +6,16 @@
 
 #include "scene_data.glsl"
 #include "vertices.glsl"
-#include "joints.glsl"
+#include "draw_data.glsl"
 
 layout (push_constant) uniform PushConstant
 {
-    mat4 transform;
+    mat4 lightMvp;
 } pc;
 
 void main()
 {
-    Vertex vertex = vertices[gl_VertexIndex];
+    DrawData draw = draws[gl_InstanceIndex];
 
-    mat4 skinMat = mat4(0.0);
-    if (vertex.jointIndices.x > -1) {
-        skinMat += vertex.jointWeights.x * jointMatrices[vertex.jointIndices.x];
-    }
-    if (vertex.jointIndices.y > -1) {
-        skinMat += vertex.jointWeights.y * jointMatrices[vertex.jointIndices.y];
-    }
-    if (vertex.jointIndices.z > -1) {
-        skinMat += vertex.jointWeights.z * jointMatrices[vertex.jointIndices.z];
-    }
-    if (vertex.jointIndices.w > -1) {
-        skinMat += vertex.jointWeights.w * jointMatrices[vertex.jointIndices.w];
-    }
-
-    if (skinMat == mat4(0.0)) {
-        skinMat = mat4(1.0);
-    }
-
-    gl_Position = pc.transform * skinMat * vec4(vertex.position, 1.0);
+    gl_Position = pc.lightMvp * draw.transform * vec4(loadVertexPosition(gl_VertexIndex), 1.0);
 }
\ No newline at end of file
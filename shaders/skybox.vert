@@ -11,7 +11,7 @@ layout (location = 0) out vec3 outUVW;
 
 void main()
 {
-    Vertex vertex = vertices[gl_VertexIndex];
+    Vertex vertex = loadVertex(gl_VertexIndex);
 
     outUVW = vertex.position;
 
@@ -0,0 +1,6 @@
+#ifndef STORAGE_IMAGES_GLSL
+#define STORAGE_IMAGES_GLSL
+
+layout (binding = 10, r32f) uniform image2D storageImages[];
+
+#endif
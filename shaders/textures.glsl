@@ -3,11 +3,16 @@
 
 layout (binding = 1) uniform sampler1D texture1Ds[];
 layout (binding = 1) uniform sampler2D texture2Ds[];
+layout (binding = 1) uniform sampler2DArray texture2DArrays[];
 layout (binding = 1) uniform sampler3D texture3Ds[];
 layout (binding = 1) uniform samplerCube textureCubes[];
+layout (binding = 1) uniform sampler2DMS texture2DMSs[];
+layout (binding = 1) uniform usampler2D utexture2Ds[];
 
 #define TEX_1D(id, uv) texture(texture1Ds[nonuniformEXT(id)], uv)
 #define TEX_2D(id, uv) texture(texture2Ds[nonuniformEXT(id)], uv)
+#define TEX_2D_GRAD(id, uv, dx, dy) textureGrad(texture2Ds[nonuniformEXT(id)], uv, dx, dy)
+#define TEX_2D_ARRAY(id, uv) texture(texture2DArrays[nonuniformEXT(id)], uv) // uv.z - layer
 #define TEX_3D(id, uv) texture(texture3Ds[nonuniformEXT(id)], uv)
 #define TEX_CUBE(id, uv) texture(textureCubes[nonuniformEXT(id)], uv)
 
@@ -1,6 +1,9 @@
 #ifndef TYPES_GLSL
 #define TYPES_GLSL
 
+// every combination of the MATERIAL_FEATURE_* bits, see material.h
+const uint MATERIAL_PERMUTATION_COUNT = 16;
+
 struct Vertex
 {
     vec3 position;
@@ -8,10 +11,21 @@ struct Vertex
     vec3 normal;
     float uv_y;
     vec4 tangent;
-    ivec4 jointIndices;
+    vec4 jointIndices; // -1 - unused
     vec4 jointWeights;
 };
 
+// quantized vertex, see PackedVertex in vertex.h
+struct PackedVertex
+{
+    float px, py, pz;
+    uint uv;         // half2
+    uint normal;     // octahedral snorm16x2
+    uint tangent;    // snorm 10:10:10:2
+    uint joints;     // uint8x4, 0xff - unused
+    uint weights[2]; // unorm16x4
+};
+
 struct Material
 {
     int baseColorId;
@@ -27,16 +41,119 @@ struct Material
     float _pad1;
 };
 
+struct DrawData
+{
+    mat4 transform;
+    vec4 boundingSphere; // xyz - local space center, w - radius
+
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+
+    int materialId;
+
+    uint meshletOffset;
+    uint meshletCount;
+
+    uint lodOffset;
+    uint lodCount;
+
+    uint permutation; // material features, its visible commands go into the range of this permutation
+    uint _pad0[3];
+};
+
+struct MeshLod
+{
+    uint firstIndex; // relative to the first index of the draw
+    uint indexCount;
+    float error;
+
+    uint _pad0;
+};
+
+struct Meshlet
+{
+    vec4 boundingSphere; // primitive local space
+    vec4 cone;           // xyz - axis, w - cutoff
+
+    uint firstIndex; // relative to the first index of the draw
+    uint indexCount;
+
+    uint _pad0;
+    uint _pad1;
+};
+
+// matches VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+struct CullData
+{
+    mat4 occlusionView;
+    vec4 frustumPlanes[6];
+    vec4 cameraPosition;
+
+    float P00;
+    float P11;
+    float znear;
+    int depthPyramidId;
+    vec2 depthPyramidSize;
+    int depthPyramidLevels;
+
+    uint drawOffset;
+    uint drawCount;
+    uint frustumCulling;
+    uint occlusionCulling;
+    uint coneCulling;
+
+    uint commandOffset;
+    uint maxCommandCount;
+    uint taskOffset;
+    uint maxTaskCount;
+
+    float lodErrorScale;
+    uint lodSelection;
+
+    uint _pad0;
+    uint _pad1;
+
+    // the visible commands are split into a range per material permutation, relative to commandOffset
+    uint permutationOffsets[MATERIAL_PERMUTATION_COUNT];
+    uint permutationCapacities[MATERIAL_PERMUTATION_COUNT];
+};
+
+struct DrawCounts
+{
+    uint commandCount; // of all permutations
+    uint triangleCount;
+    uint permutationCounts[MATERIAL_PERMUTATION_COUNT]; // counts of the indirect draws, can go past the capacities
+};
+
+struct SkinJob
+{
+    uint srcVertexOffset;
+    uint dstVertexOffset;
+    uint vertexCount;
+    uint jointOffset;
+};
+
+// meshlets of a visible draw are culled in groups of this size, one workgroup per group
+const uint CLUSTER_TASK_SIZE = 64;
+
 struct Light
 {
-    mat4 mvp;
     vec3 position;
     int type;       // enum LightType
     vec3 color;
     float cutOff;   // only for spot light
-    vec3 direction; // only for directional light
-
-    float _pad0;
+    vec3 direction; // only for directional and spot light
+    float range;    // only for point and spot light
 };
 
 const uint LIGHT_TYPE_DIRECTIONAL = 0;
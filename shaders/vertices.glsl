@@ -1,8 +1,141 @@
 #ifndef VERTICES_GLSL
 #define VERTICES_GLSL
 
-layout (binding = 5) readonly buffer VertexBuffer {
+// shaders writing vertices (skinning) define VERTICES_WRITE before including this file
+#ifdef VERTICES_WRITE
+#define VERTICES_ACCESS
+#else
+#define VERTICES_ACCESS readonly
+#endif
+
+#ifdef REBIRTH_QUANTIZE_VERTICES
+
+layout (binding = 5) VERTICES_ACCESS buffer VertexBuffer {
+    PackedVertex vertices[];
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+Vertex loadVertex(uint index)
+{
+    PackedVertex data = vertices[index];
+
+    Vertex vertex;
+    vertex.position = vec3(data.px, data.py, data.pz);
+
+    vec2 uv = unpackHalf2x16(data.uv);
+    vertex.uv_x = uv.x;
+    vertex.uv_y = uv.y;
+
+    vertex.normal = decodeOctahedral(unpackSnorm2x16(data.normal));
+
+    // sign extend the 10 bit fields
+    ivec4 tangent = ivec4(int(data.tangent << 22) >> 22, int(data.tangent << 12) >> 22, int(data.tangent << 2) >> 22, int(data.tangent) >> 30);
+    vertex.tangent = vec4(max(vec3(tangent.xyz) / 511.0, -1.0), float(tangent.w));
+
+    uvec4 joints = (uvec4(data.joints) >> uvec4(0, 8, 16, 24)) & 0xffu;
+    vertex.jointIndices = mix(vec4(joints), vec4(-1.0), equal(joints, uvec4(0xffu)));
+    vertex.jointWeights = vec4(unpackUnorm2x16(data.weights[0]), unpackUnorm2x16(data.weights[1]));
+
+    return vertex;
+}
+
+// depth only passes fetch what they need of the vertex
+vec3 loadVertexPosition(uint index)
+{
+    return vec3(vertices[index].px, vertices[index].py, vertices[index].pz);
+}
+
+vec2 loadVertexUV(uint index)
+{
+    return unpackHalf2x16(vertices[index].uv);
+}
+
+#ifdef VERTICES_WRITE
+
+// same encoding as packVertex in vertex.cpp
+vec2 encodeOctahedral(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+
+    // lower hemisphere is folded over the diagonals
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(e.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(e, vec2(0.0)));
+
+    return e;
+}
+
+uint packSnorm10(float value)
+{
+    return uint(int(round(clamp(value, -1.0, 1.0) * 511.0))) & 0x3ffu;
+}
+
+void storeVertex(uint index, Vertex vertex)
+{
+    PackedVertex data;
+    data.px = vertex.position.x;
+    data.py = vertex.position.y;
+    data.pz = vertex.position.z;
+    data.uv = packHalf2x16(vec2(vertex.uv_x, vertex.uv_y));
+    data.normal = vertex.normal != vec3(0.0) ? packSnorm2x16(encodeOctahedral(vertex.normal)) : 0u;
+
+    data.tangent = 0u;
+    if (vertex.tangent != vec4(0.0)) {
+        uint handedness = vertex.tangent.w < 0.0 ? 3u : 1u;
+        data.tangent = packSnorm10(vertex.tangent.x) | packSnorm10(vertex.tangent.y) << 10 | packSnorm10(vertex.tangent.z) << 20 | handedness << 30;
+    }
+
+    // joints are only stored unused, written vertices are already skinned
+    data.joints = 0xffffffffu;
+    data.weights[0] = 0u;
+    data.weights[1] = 0u;
+
+    vertices[index] = data;
+}
+
+#endif
+
+#else
+
+layout (binding = 5) VERTICES_ACCESS buffer VertexBuffer {
     Vertex vertices[];
 };
 
+Vertex loadVertex(uint index)
+{
+    return vertices[index];
+}
+
+vec3 loadVertexPosition(uint index)
+{
+    return vertices[index].position;
+}
+
+vec2 loadVertexUV(uint index)
+{
+    return vec2(vertices[index].uv_x, vertices[index].uv_y);
+}
+
+#ifdef VERTICES_WRITE
+
+void storeVertex(uint index, Vertex vertex)
+{
+    vertex.jointIndices = vec4(-1.0);
+    vertex.jointWeights = vec4(0.0);
+
+    vertices[index] = vertex;
+}
+
+#endif
+
+#endif
+
 #endif
\ No newline at end of file
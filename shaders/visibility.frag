@@ -0,0 +1,25 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "types.glsl"
+
+#include "scene_data.glsl"
+#include "textures.glsl"
+#include "alpha_test.glsl"
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) flat in int inMaterialId;
+layout (location = 2) flat in uint inCommandIndex;
+
+// x - visible command, y - triangle of the command
+layout (location = 0) out uvec2 outVisibility;
+
+void main()
+{
+    if (isAlphaDiscarded(inMaterialId, inUV))
+        discard;
+
+    outVisibility = uvec2(inCommandIndex, gl_PrimitiveID);
+}
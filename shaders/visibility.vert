@@ -0,0 +1,39 @@
+#version 450
+
+#extension GL_ARB_shader_draw_parameters : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "types.glsl" // should be included before everything
+
+#include "scene_data.glsl"
+#include "draw_data.glsl"
+#include "vertices.glsl"
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) flat out int outMaterialId;
+layout (location = 2) flat out uint outCommandIndex;
+
+// MeshPassPC, the draws of each material permutation are a range of the visible commands
+layout (push_constant) uniform PushConstant
+{
+    vec2 screenSize;
+    float znear, zfar;
+    uint frameIndex;
+    uint commandBase;
+} pc;
+
+// same depth as mesh.vert
+invariant gl_Position;
+
+void main()
+{
+    DrawData draw = draws[gl_InstanceIndex];
+
+    vec4 worldPos = draw.transform * vec4(loadVertexPosition(gl_VertexIndex), 1.0);
+    gl_Position = scene_data.projection * scene_data.view * worldPos;
+
+    outUV = loadVertexUV(gl_VertexIndex);
+    outMaterialId = draw.materialId;
+    outCommandIndex = pc.commandBase + gl_DrawIDARB; // of the visible commands, the resolve pass reads the command back
+}
@@ -0,0 +1,138 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "types.glsl"
+
+#define DRAW_COMMANDS_READ
+
+#include "pbr.glsl"
+#include "scene_data.glsl"
+#include "textures.glsl"
+#include "light_grid.glsl"
+#include "draw_data.glsl"
+#include "draw_commands.glsl"
+#include "vertices.glsl"
+#include "indices.glsl"
+#include "shading.glsl"
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 fragColor;
+
+layout (push_constant) uniform PushConstant
+{
+    vec2 screenSize;
+    float znear, zfar; // of the light grid
+    uint frameIndex;
+    int visibilityId;
+    uint commandOffset; // visible commands of this frame
+} pc;
+
+struct Barycentrics
+{
+    vec3 lambda; // perspective correct
+    vec3 ddx;    // per pixel
+    vec3 ddy;
+};
+
+// Barycentrics of a pixel in a triangle and their screen space derivatives, from the clip space positions.
+// "The Visibility Buffer: A Cache-Friendly Approach to Deferred Shading" (Burns and Hunt) and Wolfgang Engel's follow up.
+Barycentrics getBarycentrics(vec4 p0, vec4 p1, vec4 p2, vec2 pixelNdc)
+{
+    Barycentrics result;
+
+    vec3 invW = 1.0 / vec3(p0.w, p1.w, p2.w);
+    vec2 ndc0 = p0.xy * invW.x;
+    vec2 ndc1 = p1.xy * invW.y;
+    vec2 ndc2 = p2.xy * invW.z;
+
+    float invDet = 1.0 / determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+    result.ddx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+    result.ddy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+    float ddxSum = dot(result.ddx, vec3(1.0));
+    float ddySum = dot(result.ddy, vec3(1.0));
+
+    vec2 delta = pixelNdc - ndc0;
+    float interpInvW = invW.x + delta.x * ddxSum + delta.y * ddySum;
+    float interpW = 1.0 / interpInvW;
+
+    result.lambda.x = interpW * (invW.x + delta.x * result.ddx.x + delta.y * result.ddy.x);
+    result.lambda.y = interpW * (delta.x * result.ddx.y + delta.y * result.ddy.y);
+    result.lambda.z = interpW * (delta.x * result.ddx.z + delta.y * result.ddy.z);
+
+    // from ndc units to a pixel step
+    vec2 pixelSize = 2.0 / pc.screenSize;
+    result.ddx *= pixelSize.x;
+    result.ddy *= pixelSize.y;
+    ddxSum *= pixelSize.x;
+    ddySum *= pixelSize.y;
+
+    float interpWdx = 1.0 / (interpInvW + ddxSum);
+    float interpWdy = 1.0 / (interpInvW + ddySum);
+    result.ddx = interpWdx * (result.lambda * interpInvW + result.ddx) - result.lambda;
+    result.ddy = interpWdy * (result.lambda * interpInvW + result.ddy) - result.lambda;
+
+    return result;
+}
+
+vec3 interpolate(Barycentrics b, vec3 a0, vec3 a1, vec3 a2)
+{
+    return a0 * b.lambda.x + a1 * b.lambda.y + a2 * b.lambda.z;
+}
+
+// Shades the triangle stored in the visibility buffer, every pixel once. The material is only known here, so the
+// geometry pass stays cheap however dense the meshes are.
+void main()
+{
+    uvec2 visibility = texelFetch(utexture2Ds[pc.visibilityId], ivec2(gl_FragCoord.xy), 0).xy;
+    if (visibility.x == 0xffffffffu)
+        discard; // nothing drawn, the clear color and depth stay
+
+    DrawCommand command = drawCommands[pc.commandOffset + visibility.x];
+    DrawData draw = draws[command.firstInstance];
+
+    uint firstIndex = command.firstIndex + visibility.y * 3;
+    Vertex v0 = loadVertex(indices[firstIndex + 0] + command.vertexOffset);
+    Vertex v1 = loadVertex(indices[firstIndex + 1] + command.vertexOffset);
+    Vertex v2 = loadVertex(indices[firstIndex + 2] + command.vertexOffset);
+
+    // same transform as visibility.vert
+    vec4 world0 = draw.transform * vec4(v0.position, 1.0);
+    vec4 world1 = draw.transform * vec4(v1.position, 1.0);
+    vec4 world2 = draw.transform * vec4(v2.position, 1.0);
+
+    mat4 viewProjection = scene_data.projection * scene_data.view;
+    vec4 clip0 = viewProjection * world0;
+    vec4 clip1 = viewProjection * world1;
+    vec4 clip2 = viewProjection * world2;
+
+    vec2 pixelNdc = gl_FragCoord.xy / pc.screenSize * 2.0 - 1.0;
+    Barycentrics b = getBarycentrics(clip0, clip1, clip2, pixelNdc);
+
+    // the depth the geometry pass had, later passes test against it
+    gl_FragDepth = dot(b.lambda, vec3(clip0.z, clip1.z, clip2.z)) / dot(b.lambda, vec3(clip0.w, clip1.w, clip2.w));
+
+    vec3 worldPos = interpolate(b, world0.xyz, world1.xyz, world2.xyz);
+
+    mat3 normalMatrix = transpose(inverse(mat3(draw.transform)));
+    vec3 normal = normalMatrix * interpolate(b, v0.normal, v1.normal, v2.normal);
+    vec4 tangent = vec4(interpolate(b, v0.tangent.xyz, v1.tangent.xyz, v2.tangent.xyz), v0.tangent.w);
+
+    vec3 T = normalize(mat3(draw.transform) * tangent.xyz);
+    vec3 N = normalize(normal);
+    vec3 B = cross(N, T) * tangent.w;
+
+    vec3 uv0 = vec3(v0.uv_x, v0.uv_y, 0.0);
+    vec3 uv1 = vec3(v1.uv_x, v1.uv_y, 0.0);
+    vec3 uv2 = vec3(v2.uv_x, v2.uv_y, 0.0);
+    vec2 uv = interpolate(b, uv0, uv1, uv2).xy;
+    vec2 uvDx = (uv0 * b.ddx.x + uv1 * b.ddx.y + uv2 * b.ddx.z).xy;
+    vec2 uvDy = (uv0 * b.ddy.x + uv1 * b.ddy.y + uv2 * b.ddy.z).xy;
+
+    Surface surface = loadSurface(draw.materialId, worldPos, normal, tangent, mat3(T, B, N), uv, uvDx, uvDy);
+
+    fragColor = vec4(shadeSurface(surface, gl_FragCoord.xy, pc.screenSize, pc.znear, pc.zfar, pc.frameIndex), 1.0);
+}
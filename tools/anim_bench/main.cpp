@@ -0,0 +1,191 @@
+#include <rebirth/core/animation.h>
+#include <rebirth/core/job_system.h>
+#include <rebirth/core/scene.h>
+#include <rebirth/util/logger.h>
+
+#include <bench/bench.h>
+
+#include <random>
+#include <stdlib.h>
+
+// Compression ratio and error of the clips, then animated characters evaluated per millisecond, with a key search
+// per track over uncompressed keys like the old runtime, with cached cursors on one thread and on every worker.
+// Usage: rebirth-anim-bench [character count...], defaults to 100, 1k and 10k characters
+static constexpr uint32_t JOINT_COUNT = 64;
+static constexpr float CLIP_DURATION = 10.0f;
+static constexpr float KEY_RATE = 120.0f; // keys per second, a common mocap rate
+static constexpr float FRAME_TIME = 1.0f / 60.0f;
+
+// uncompressed keys, what glTF stores and what the clips used to keep
+struct SourceTrack
+{
+    uint32_t node = 0;
+    AnimationPath path = AnimationPath::invalid;
+    eastl::vector<float> times;
+    eastl::vector<vec4> values;
+};
+
+// a rotation track on every joint and a translation track on the root, smooth motion with a little noise like mocap
+static AnimationClip createClip(const char *name, std::mt19937 &random, eastl::vector<SourceTrack> &sourceTracks)
+{
+    std::uniform_real_distribution<float> phase(0.0f, 6.28f);
+    std::uniform_real_distribution<float> noise(-0.00005f, 0.00005f);
+
+    AnimationClip clip;
+    clip.name = name;
+
+    const uint32_t keyCount = uint32_t(CLIP_DURATION * KEY_RATE) + 1;
+    eastl::vector<float> times(keyCount);
+    for (uint32_t key = 0; key < keyCount; key++)
+        times[key] = key / KEY_RATE;
+
+    for (uint32_t joint = 0; joint <= JOINT_COUNT; joint++) {
+        SourceTrack &track = sourceTracks.push_back();
+        track.node = joint < JOINT_COUNT ? joint : 0;
+        track.path = joint < JOINT_COUNT ? AnimationPath::rotation : AnimationPath::translation;
+        track.times = times;
+        track.values.resize(keyCount);
+
+        const float offset = phase(random);
+        for (uint32_t key = 0; key < keyCount; key++) {
+            const float time = times[key];
+            if (track.path == AnimationPath::rotation) {
+                const quat rotation = glm::angleAxis(0.5f * sinf(time * 2.0f + offset) + noise(random), glm::normalize(vec3(sinf(offset), 1.0f, cosf(offset))));
+                track.values[key] = vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+            } else {
+                track.values[key] = vec4(time, 0.05f * sinf(time * 4.0f), 0.0f, 0.0f);
+            }
+        }
+
+        clip.addTrack(track.node, track.path, AnimationInterpolation::linear, track.times.data(), track.values.data(), keyCount);
+    }
+
+    return clip;
+}
+
+// what Scene::updateAnimation did before, a linear search for the key of every track
+static void sampleWithSearch(const eastl::vector<SourceTrack> &tracks, float time, AnimationPose &pose)
+{
+    for (const SourceTrack &track : tracks) {
+        for (uint32_t key = 0; key + 1 < track.times.size(); key++) {
+            if (time < track.times[key] || time > track.times[key + 1])
+                continue;
+
+            const float weight = (time - track.times[key]) / (track.times[key + 1] - track.times[key]);
+            const vec4 value = glm::mix(track.values[key], track.values[key + 1], weight);
+
+            if (track.path == AnimationPath::rotation)
+                pose.rotations[track.node] = glm::normalize(quat(value.w, value.x, value.y, value.z));
+            else if (track.path == AnimationPath::translation)
+                pose.translations[track.node] = vec3(value);
+            break;
+        }
+    }
+}
+
+// largest difference between the compressed clip and its source keys over the whole clip
+static void measureError(const Scene &scene, const AnimationClip &clip, const eastl::vector<SourceTrack> &sourceTracks, float &rotationError, float &translationError)
+{
+    rotationError = 0.0f;
+    translationError = 0.0f;
+
+    AnimationPose pose = scene.restPose;
+    AnimationPose sourcePose = scene.restPose;
+    eastl::vector<uint32_t> cursors(clip.getTrackCount(), 0);
+
+    for (float time = 0.0f; time <= clip.duration; time += FRAME_TIME * 0.25f) {
+        animation::sampleClip(clip, time, cursors, pose);
+        sampleWithSearch(sourceTracks, time, sourcePose);
+
+        for (uint32_t node = 0; node < pose.getNodeCount(); node++) {
+            const float dot = glm::min(fabsf(glm::dot(pose.rotations[node], sourcePose.rotations[node])), 1.0f);
+            rotationError = glm::max(rotationError, 2.0f * acosf(dot));
+            translationError = glm::max(translationError, glm::length(pose.translations[node] - sourcePose.translations[node]));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const eastl::vector<uint32_t> characterCounts = bench::getCounts(argc, argv, {100, 1000, 10000});
+
+    JobSystem::instance()->initialize();
+
+    std::mt19937 random(42);
+
+    // a spine with four limbs hanging off it
+    Scene scene;
+    for (uint32_t joint = 0; joint < JOINT_COUNT; joint++) {
+        const int parent = joint == 0 ? -1 : (joint % 16 == 0 ? 0 : int(joint) - 1);
+        scene.addNode(parent, glm::translate(vec3(0.0f, 0.1f, 0.0f)), "Joint");
+    }
+
+    eastl::vector<SourceTrack> walkTracks, runTracks;
+    scene.animations.push_back(createClip("Walk", random, walkTracks));
+    scene.animations.push_back(createClip("Run", random, runTracks));
+
+    for (uint32_t i = 0; i < scene.animations.size(); i++) {
+        const AnimationClip &clip = scene.animations[i];
+
+        float rotationError, translationError;
+        measureError(scene, clip, i == 0 ? walkTracks : runTracks, rotationError, translationError);
+
+        logger::logInfo(clip.name.c_str(), ": ", clip.sourceKeyCount, " keys, ", clip.getSourceMemoryUsage() / 1024, " KB -> ", clip.keyValues.size(), " keys, ", clip.getMemoryUsage() / 1024,
+                        " KB (", float(clip.getSourceMemoryUsage()) / clip.getMemoryUsage(), "x), max error ", glm::degrees(rotationError), " degrees, ", translationError, " units");
+    }
+
+    std::uniform_real_distribution<float> startTime(0.0f, CLIP_DURATION);
+
+    for (uint32_t characterCount : characterCounts) {
+        // every other character is cross-fading into the second clip
+        eastl::vector<Animator> animators(characterCount);
+        for (uint32_t i = 0; i < characterCount; i++) {
+            Animator &animator = animators[i];
+            animator.restPose = &scene.restPose;
+
+            animation::play(animator, &scene.animations[0]);
+            animator.current.time = startTime(random);
+
+            if (i % 2 == 1)
+                animation::play(animator, &scene.animations[1], 1000.0f);
+        }
+
+        eastl::vector<float> times(characterCount);
+        for (uint32_t i = 0; i < characterCount; i++)
+            times[i] = animators[i].current.time;
+
+        AnimationPose pose, fadePose;
+        double searchMs = bench::measure([&] {
+            for (uint32_t i = 0; i < characterCount; i++) {
+                times[i] = fmodf(times[i] + FRAME_TIME, CLIP_DURATION);
+
+                pose = scene.restPose;
+                sampleWithSearch(walkTracks, times[i], pose);
+
+                if (i % 2 == 1) {
+                    fadePose = scene.restPose;
+                    sampleWithSearch(runTracks, times[i], fadePose);
+                    animation::blendPoses(pose, fadePose, 0.5f, pose);
+                }
+            }
+        });
+
+        double serialMs = bench::measure([&] {
+            for (Animator &animator : animators)
+                animation::updateAnimator(animator, FRAME_TIME);
+        });
+
+        double parallelMs = bench::measure([&] {
+            animation::updateAnimators(animators.data(), animators.size(), FRAME_TIME);
+        });
+
+        logger::logInfo(characterCount, " characters, ", JOINT_COUNT, " joints, ", JobSystem::instance()->getThreadCount(), " threads");
+        logger::logInfo("  key search:             ", searchMs, " ms (", bench::getThroughput(characterCount, searchMs), " characters/ms)");
+        logger::logInfo("  cached cursors serial:  ", serialMs, " ms (", bench::getThroughput(characterCount, serialMs), " characters/ms)");
+        logger::logInfo("  cached cursors workers: ", parallelMs, " ms (", bench::getThroughput(characterCount, parallelMs), " characters/ms)");
+    }
+
+    JobSystem::instance()->shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include <rebirth/core/job_system.h>
+#include <rebirth/core/mesh_processing.h>
+#include <rebirth/graphics/gltf.h>
+#include <rebirth/graphics/image_data.h>
+#include <rebirth/graphics/renderer.h>
+#include <rebirth/graphics/scene_pack.h>
+#include <rebirth/graphics/texture_compression.h>
+#include <rebirth/util/logger.h>
+#include <rebirth/util/timer.h>
+
+#include <string.h>
+
+// Everything the tool does between the job system initialize and shutdown, so every failure ends on the same path.
+static bool bake(const std::filesystem::path &input, const std::filesystem::path &output, bool compress)
+{
+    JobSystem *jobSystem = JobSystem::instance();
+
+    cgltf_data *data = gltf::parseFile(input);
+    if (!data || !data->scene) {
+        cgltf_free(data); // null safe
+        return false;
+    }
+
+    // only the cpu side scene arrays are filled, the renderer is never initialized
+    Renderer renderer;
+    Scene scene;
+
+    mesh_processing::Stats meshStats;
+    gltf::loadGltfMeshes(renderer, scene, data, &meshStats);
+    mesh_processing::logStats(meshStats);
+
+    gltf::loadGltfNodes(scene, data, data->scene);
+
+    gltf::loadGltfMaterials(renderer, data);
+
+    scene_pack::Writer writer;
+    if (!writer.open(output)) {
+        cgltf_free(data);
+        return false;
+    }
+
+    writer.writeScene(scene, renderer);
+
+    eastl::vector<TextureUsage> usages = gltf::getTextureUsages(data);
+
+    // decode a group in parallel, write it in order and reuse the memory for the next one
+    const uint32_t textureCount = data->textures_count;
+    const uint32_t batchSize = std::max(jobSystem->getThreadCount() * 2, 8u);
+    eastl::vector<ImageData> imageData(batchSize);
+    eastl::vector<size_t> uncompressedSizes(batchSize);
+
+    // what the textures take in gpu memory, rgba8 against what is written
+    size_t uncompressedBytes = 0;
+    size_t bakedBytes = 0;
+
+    for (uint32_t batchBegin = 0; batchBegin < textureCount; batchBegin += batchSize) {
+        uint32_t batchCount = std::min(batchSize, textureCount - batchBegin);
+
+        JobCounter counter;
+        jobSystem->parallelFor(&counter, batchCount, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                gltf::loadGltfImageData(imageData[i], input.parent_path(), data->textures[batchBegin + i], usages[batchBegin + i]);
+                uncompressedSizes[i] = imageData[i].pixels.size();
+
+                // ktx2 sources may already be compressed
+                if (compress && getBlockSize(imageData[i].format) == 0)
+                    texture_compression::compressImageData(imageData[i], usages[batchBegin + i]);
+            }
+        });
+        jobSystem->wait(counter);
+
+        for (uint32_t i = 0; i < batchCount; i++) {
+            writer.writeImage(imageData[i]);
+            uncompressedBytes += uncompressedSizes[i];
+            bakedBytes += imageData[i].pixels.size();
+        }
+
+        logger::logInfo("Baked ", batchBegin + batchCount, "/", textureCount, " textures");
+    }
+
+    cgltf_free(data);
+
+    if (!writer.close())
+        return false;
+
+    logger::logInfo("Textures ", uncompressedBytes / (1024 * 1024), " MB decoded, ", bakedBytes / (1024 * 1024), " MB baked");
+    return true;
+}
+
+// Bakes a glTF scene into a scene pack, so the engine maps it instead of parsing json and decoding textures.
+// Textures are block compressed (bc1/bc3/bc5 depending on how materials use them) unless --uncompressed is passed.
+// Usage: rebirth-bake [--uncompressed] <scene.gltf> [output.rpack]
+int main(int argc, char **argv)
+{
+    bool compress = true;
+    eastl::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--uncompressed") == 0)
+            compress = false;
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if (paths.empty()) {
+        logger::logError("Usage: rebirth-bake [--uncompressed] <scene.gltf> [output.rpack]");
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path input = paths[0];
+    std::filesystem::path output = paths.size() > 1 ? std::filesystem::path(paths[1]) : std::filesystem::path(input).replace_extension(".rpack");
+
+    // the workers have to be joined on every path
+    JobSystem::instance()->initialize();
+
+    Timer timer;
+    timer.start();
+
+    const bool success = bake(input, output, compress);
+
+    JobSystem::instance()->shutdown();
+
+    if (!success) {
+        logger::logError("Failed to bake ", input);
+        return EXIT_FAILURE;
+    }
+
+    logger::logInfo("Baked ", input, " into ", output, " in ", timer.elapsedMilliseconds(), " ms");
+    return EXIT_SUCCESS;
+}
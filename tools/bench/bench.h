@@ -0,0 +1,53 @@
+#pragma once
+
+#include <rebirth/util/timer.h>
+
+#include <EASTL/vector.h>
+
+#include <initializer_list>
+#include <stdlib.h>
+
+// Timing shared by the benchmark tools, each one only has its scenarios.
+namespace bench
+{
+    static constexpr int ITERATIONS = 10;
+
+    // average of ITERATIONS runs in milliseconds
+    template <typename F>
+    double measure(F &&function)
+    {
+        double total = 0.0;
+        for (int i = 0; i < ITERATIONS; i++) {
+            Timer timer;
+            timer.start();
+            function();
+            total += timer.elapsedMilliseconds();
+        }
+
+        return total / ITERATIONS;
+    }
+
+    // items per millisecond
+    inline double getThroughput(uint32_t count, double ms)
+    {
+        return ms > 0.0 ? count / ms : 0.0;
+    }
+
+    inline double getMillionsPerSecond(uint32_t count, double ms)
+    {
+        return getThroughput(count, ms) / 1000.0;
+    }
+
+    // counts passed on the command line, the defaults without any
+    inline eastl::vector<uint32_t> getCounts(int argc, char **argv, std::initializer_list<uint32_t> defaults = {10000, 100000, 1000000})
+    {
+        eastl::vector<uint32_t> counts;
+        for (int i = 1; i < argc; i++)
+            counts.push_back(strtoul(argv[i], nullptr, 10));
+
+        if (counts.empty())
+            counts.assign(defaults.begin(), defaults.end());
+
+        return counts;
+    }
+} // namespace bench
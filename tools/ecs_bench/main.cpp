@@ -0,0 +1,94 @@
+#include <rebirth/core/components.h>
+#include <rebirth/core/job_system.h>
+#include <rebirth/core/scene.h>
+#include <rebirth/util/logger.h>
+
+#include <bench/bench.h>
+
+#include <random>
+#include <stdlib.h>
+
+// Compares entity iteration with walking the scene hierarchy, for the same objects stored both ways.
+// Usage: rebirth-ecs-bench [object count...], defaults to 10k, 100k and 1M objects
+int main(int argc, char **argv)
+{
+    const eastl::vector<uint32_t> objectCounts = bench::getCounts(argc, argv);
+
+    JobSystem::instance()->initialize();
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> offset(-100.0f, 100.0f);
+
+    Mesh mesh;
+    mesh.primitives.push_back({});
+
+    for (uint32_t objectCount : objectCounts) {
+        // objects under a few parents, a tenth of them also have a rigid body so there is more than one archetype
+        Scene scene;
+        scene.meshes.push_back(mesh);
+
+        ecs::World world;
+
+        int parent = -1;
+        for (uint32_t i = 0; i < objectCount; i++) {
+            const vec3 position = vec3(offset(random), offset(random), offset(random));
+
+            if (i % 64 == 0)
+                parent = scene.addNode(-1, mat4(1.0f));
+
+            uint32_t node = scene.addNode(parent, glm::translate(position));
+            scene.meshIndices[node] = 0;
+
+            ecs::Entity entity = world.createEntity(ecs::Transform{.position = position}, ecs::MeshRenderer{.mesh = &scene.meshes[0]});
+            if (i % 10 == 0)
+                world.addComponent(entity, ecs::RigidBody{});
+        }
+
+        // what the renderer reads, the world position of every drawn object
+        vec3 sum = vec3(0.0f);
+
+        double sceneWalkMs = bench::measure([&] {
+            for (uint32_t node = 0; node < scene.getNodeCount(); node++) {
+                if (scene.meshIndices[node] >= 0)
+                    sum += vec3(scene.worldTransforms[node][3]);
+            }
+        });
+
+        double entityEachMs = bench::measure([&] {
+            world.each<ecs::Transform, ecs::MeshRenderer>([&](ecs::Entity, ecs::Transform &transform, ecs::MeshRenderer &) {
+                sum += vec3(transform.matrix[3]);
+            });
+        });
+
+        // moving every object
+        double sceneUpdateMs = bench::measure([&] {
+            for (uint32_t node = 0; node < scene.getNodeCount(); node++) {
+                if (scene.parents[node] < 0)
+                    scene.setLocalTransform(node, scene.localTransforms[node]);
+            }
+
+            scene.updateTransforms();
+        });
+
+        double entityUpdateMs = bench::measure([&] {
+            world.each<ecs::Transform>([](ecs::Entity, ecs::Transform &transform) { transform.dirty = true; });
+            ecs::updateTransforms(world);
+        });
+
+        double entityUpdateSerialMs = bench::measure([&] {
+            world.each<ecs::Transform>([](ecs::Entity, ecs::Transform &transform) {
+                transform.matrix = glm::translate(transform.position) * glm::mat4_cast(transform.rotation) * glm::scale(transform.scale);
+                transform.version++;
+            });
+        });
+
+        logger::logInfo(objectCount, " objects, ", world.getArchetypeCount(), " archetypes, ", JobSystem::instance()->getThreadCount(), " threads");
+        logger::logInfo("  read:   scene walk ", sceneWalkMs, " ms (", bench::getMillionsPerSecond(objectCount, sceneWalkMs), " M/s), entities ", entityEachMs, " ms (", bench::getMillionsPerSecond(objectCount, entityEachMs), " M/s)");
+        logger::logInfo("  update: scene ", sceneUpdateMs, " ms, entities serial ", entityUpdateSerialMs, " ms, parallel ", entityUpdateMs, " ms");
+        logger::logInfo("  (", sum.x + sum.y + sum.z, ")");
+    }
+
+    JobSystem::instance()->shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#include <rebirth/core/scene.h>
+#include <rebirth/util/logger.h>
+#include <rebirth/util/timer.h>
+
+#include <bench/bench.h>
+
+#include <random>
+#include <stdlib.h>
+
+// Times world transform updates of the flat scene hierarchy on random trees.
+// Usage: rebirth-scene-bench [node count...], defaults to 10k, 100k and 1M nodes
+static constexpr uint32_t MAX_DEPTH = 16;
+
+static void buildScene(Scene &scene, uint32_t nodeCount, std::mt19937 &random)
+{
+    // the path from a root to the last added node, a new node hangs off a random node of it
+    eastl::vector<int> path;
+    path.reserve(MAX_DEPTH);
+
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+    for (uint32_t i = 0; i < nodeCount; i++) {
+        size_t depth = random() % (path.size() + 1);
+        if (depth >= MAX_DEPTH)
+            depth = MAX_DEPTH - 1;
+
+        path.resize(depth);
+        int parent = path.empty() ? -1 : path.back();
+
+        mat4 transform = glm::translate(vec3(offset(random), offset(random), offset(random)));
+        path.push_back(scene.addNode(parent, transform));
+    }
+}
+
+// what getNodeWorldMatrix used to do per node, with an O(1) parent lookup instead of a search
+static void climbParents(const Scene &scene, eastl::vector<mat4> &worldTransforms)
+{
+    for (uint32_t node = 0; node < scene.getNodeCount(); node++) {
+        mat4 worldMatrix = scene.localTransforms[node];
+        for (int parent = scene.parents[node]; parent >= 0; parent = scene.parents[parent])
+            worldMatrix = scene.localTransforms[parent] * worldMatrix;
+
+        worldTransforms[node] = worldMatrix;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const eastl::vector<uint32_t> nodeCounts = bench::getCounts(argc, argv);
+
+    std::mt19937 random(42);
+
+    for (uint32_t nodeCount : nodeCounts) {
+        Scene scene;
+
+        Timer timer;
+        timer.start();
+        buildScene(scene, nodeCount, random);
+        double buildMs = timer.elapsedMilliseconds();
+
+        eastl::vector<uint32_t> roots;
+        for (uint32_t node = 0; node < nodeCount; node++) {
+            if (scene.parents[node] < 0)
+                roots.push_back(node);
+        }
+
+        eastl::vector<uint32_t> changedNodes;
+        changedNodes.reserve(nodeCount);
+
+        double cleanMs = bench::measure([&] { scene.updateTransforms(); });
+
+        double fullMs = bench::measure([&] {
+            for (uint32_t root : roots)
+                scene.setLocalTransform(root, scene.localTransforms[root]);
+
+            scene.updateTransforms();
+        });
+
+        // 1% of the nodes move, like a scene with a few animated objects
+        double sparseMs = bench::measure([&] {
+            for (uint32_t i = 0; i < nodeCount / 100; i++) {
+                uint32_t node = random() % nodeCount;
+                scene.setLocalTransform(node, scene.localTransforms[node]);
+            }
+
+            changedNodes.clear();
+            scene.updateTransforms(&changedNodes);
+        });
+
+        eastl::vector<mat4> worldTransforms(nodeCount);
+        double climbMs = bench::measure([&] { climbParents(scene, worldTransforms); });
+
+        logger::logInfo(nodeCount, " nodes, ", roots.size(), " roots: build ", buildMs, " ms");
+        logger::logInfo("  clean ", cleanMs, " ms, 1% dirty ", sparseMs, " ms (", changedNodes.size(), " nodes updated), all dirty ", fullMs, " ms");
+        logger::logInfo("  parent climbing per node ", climbMs, " ms");
+    }
+
+    return EXIT_SUCCESS;
+}